@@ -0,0 +1,168 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/* Microbenchmark of translating MAFW filters to UPnP search criteria, to
+   be run by hand ("make bench").  Prints the time a translation takes for
+   filters as clients write them and for generated ones as wide and as
+   deep as smart playlists make them, both afresh and from the cache. */
+
+#include "config.h"
+
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include <libmafw/mafw.h>
+
+#include "../upnp-source/mafw-upnp-source-criteria.h"
+
+/* Seconds to repeat each measurement for at least */
+#define BENCH_SECONDS 0.5
+
+/* The filters of a smart playlist: a few rules, some of them repeated
+   and negated, every one of them a handful of terms. */
+static gchar *bench_playlist(guint rules)
+{
+	GString *sexp;
+	guint i;
+
+	sexp = g_string_new("(&(title?)");
+	for (i = 0; i < rules; i++)
+	{
+		switch (i % 4)
+		{
+		case 0:
+			g_string_append_printf(
+				sexp, "(|(genre=Genre %u)(genre=Genre %u))",
+				i, i + 1);
+			break;
+		case 1:
+			g_string_append_printf(
+				sexp, "(!(artist=Artist \\28%u\\29))", i % 8);
+			break;
+		case 2:
+			g_string_append_printf(
+				sexp, "(&(duration>%u)(duration<%u))",
+				i * 10, i * 10 + 600);
+			break;
+		default:
+			g_string_append_printf(
+				sexp, "(|(album~*Live*)(!(title~Remix %u)))",
+				i % 8);
+			break;
+		}
+	}
+	g_string_append_c(sexp, ')');
+
+	return g_string_free(sexp, FALSE);
+}
+
+/* An or of @n exact matches */
+static gchar *bench_wide(guint n)
+{
+	GString *sexp;
+	guint i;
+
+	sexp = g_string_new("(|");
+	for (i = 0; i < n; i++)
+		g_string_append_printf(sexp, "(title=Track %u)", i);
+	g_string_append_c(sexp, ')');
+
+	return g_string_free(sexp, FALSE);
+}
+
+/* Ands and ors nested @depth deep, every second one negated */
+static gchar *bench_deep(guint depth)
+{
+	GString *sexp;
+	guint i;
+
+	sexp = g_string_new(NULL);
+	for (i = 0; i < depth; i++)
+		g_string_append_printf(sexp, "%s(%c(artist=%u)",
+				       i % 2 ? "(!" : "",
+				       i % 3 ? '|' : '&', i);
+	g_string_append(sexp, "(album=x)");
+	for (i = 0; i < depth; i++)
+		g_string_append(sexp, i % 2 ? "))" : ")");
+
+	return g_string_free(sexp, FALSE);
+}
+
+/* Microseconds one translation of @filter takes, from @cache if given */
+static gdouble bench_run(const MafwFilter *filter, CriteriaCache *cache)
+{
+	GTimer *timer;
+	gdouble elapsed;
+	gchar *criteria;
+	guint n;
+
+	n = 0;
+	timer = g_timer_new();
+	do
+	{
+		criteria = cache != NULL
+			? criteria_cache_translate(cache, filter, NULL, NULL)
+			: criteria_translate(filter, NULL, NULL);
+		g_assert(criteria != NULL);
+		g_free(criteria);
+		n++;
+	} while ((elapsed = g_timer_elapsed(timer, NULL)) < BENCH_SECONDS);
+	g_timer_destroy(timer);
+
+	return elapsed * 1e6 / n;
+}
+
+static void bench(const gchar *name, gchar *sexp)
+{
+	CriteriaCache *cache;
+	MafwFilter *filter;
+
+	filter = mafw_filter_parse(sexp);
+	if (filter == NULL)
+		g_error("Cannot parse the %s filter", name);
+
+	cache = criteria_cache_new();
+	printf("%-16s %8u %12.2f %12.2f\n", name, (guint)strlen(sexp),
+	       bench_run(filter, NULL), bench_run(filter, cache));
+	criteria_cache_free(cache);
+
+	mafw_filter_free(filter);
+	g_free(sexp);
+}
+
+int main(void)
+{
+	printf("%-16s %8s %12s %12s\n", "filter", "length", "us/afresh",
+	       "us/cached");
+	bench("artist", g_strdup("(artist=Madonna)"));
+	bench("artist+title", g_strdup("(&(artist=Madonna)(title~like*))"));
+	bench("playlist-10", bench_playlist(10));
+	bench("playlist-100", bench_playlist(100));
+	bench("or-1000", bench_wide(1000));
+	bench("or-10000", bench_wide(10000));
+	bench("nested-100", bench_deep(100));
+	bench("nested-5000", bench_deep(5000));
+
+	return 0;
+}
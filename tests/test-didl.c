@@ -34,6 +34,7 @@
 #include <libgupnp-av/gupnp-av.h>
 
 #include "../upnp-source/mafw-upnp-source-didl.h"
+#include "../upnp-source/mafw-upnp-source-scratch.h"
 #include "../upnp-source/mafw-upnp-source.h"
 #include "../upnp-source/mafw-upnp-source-util.h"
 
@@ -72,6 +73,7 @@ void test_didl_item_cb(GUPnPDIDLLiteParser* parser,
 	GValue *val;
 	gboolean is_audio, is_supported = FALSE;
 	MafwUPnPSource* source;
+	PageScratch *scratch;
 
 	fail_if(didlobject == NULL, "GUPnP is %s", "broken");
 	
@@ -83,6 +85,14 @@ void test_didl_item_cb(GUPnPDIDLLiteParser* parser,
 	g_free(value);
 	g_object_unref(source);
 
+	scratch = page_scratch_new("uuid");
+	fail_unless(strcmp(page_scratch_objectid(scratch, didlobject),
+			   "uuid::18132") == 0, "Wrong scratch object ID");
+	page_scratch_reset(scratch);
+	fail_unless(strcmp(page_scratch_objectid(scratch, didlobject),
+			   "uuid::18132") == 0, "Wrong scratch object ID");
+	page_scratch_free(scratch);
+
 	/* Protocol info stuff */
 	resources = didl_get_supported_resources(didlobject);
 	fail_if(resources == NULL || resources->data == NULL,
@@ -98,7 +108,7 @@ void test_didl_item_cb(GUPnPDIDLLiteParser* parser,
 	fail_if(is_audio == FALSE, "Item should be audio");
 	fail_if(is_supported == FALSE, "Item should be supported");
 	
-	didl_get_mimetype(mdata, FALSE, TRUE, resources);
+	didl_get_mimetype(mdata, NULL, FALSE, TRUE, resources);
 	val = mafw_metadata_first(mdata, MAFW_METADATA_KEY_MIME);
 	fail_if(val == NULL);
 	fail_if(strcmp(g_value_get_string(val), "audio/mpeg") != 0, "Wrong MIME: %s", value);
@@ -179,7 +189,7 @@ void test_didl_container_cb(GUPnPDIDLLiteParser* parser, GUPnPDIDLLiteObject* di
 
 	fail_if(didlobject == NULL, "GUPnP is %s", "broken");
 
-	didl_get_mimetype(mdata, TRUE, TRUE, resources);
+	didl_get_mimetype(mdata, NULL, TRUE, TRUE, resources);
 	val = mafw_metadata_first(mdata, MAFW_METADATA_KEY_MIME);
 	fail_if(val == NULL);
 	fail_if(strcmp(g_value_get_string(val), MAFW_METADATA_VALUE_MIME_CONTAINER) != 0,
@@ -229,6 +239,187 @@ START_TEST(test_didl_container)
 }
 END_TEST
 
+START_TEST(test_didl_parse_cache)
+{
+	const DidlProtocolInfo *info;
+
+	info = didl_protocol_info_lookup("http-get:*:audio/mpeg:DLNA.ORG_PN=MP3;"
+					 "DLNA.ORG_OP=11;DLNA.ORG_FLAGS="
+					 "01500000000000000000000000000000");
+	fail_if(info == NULL);
+	fail_if(strcmp(info->protocol, "http-get") != 0, "Wrong protocol");
+	fail_if(strcmp(info->mime_type, "audio/mpeg") != 0, "Wrong MIME");
+	fail_if(strcmp(info->dlna_profile, "MP3") != 0, "Wrong DLNA profile");
+	fail_if(info->dlna_operation != (GUPNP_DLNA_OPERATION_RANGE |
+					 GUPNP_DLNA_OPERATION_TIMESEEK),
+		"Wrong DLNA operation: %x", info->dlna_operation);
+	fail_if(info->dlna_flags != 0x01500000, "Wrong DLNA flags");
+	fail_if(!info->is_http || !info->has_dlna);
+	fail_if(info->media_class != DIDL_MEDIA_AUDIO);
+
+	/* The same string must be served from the cache */
+	fail_if(info != didl_protocol_info_lookup(info->raw),
+		"protocolInfo was parsed twice");
+
+	info = didl_protocol_info_lookup("rtsp-rtp-udp:*:video/mp4:*");
+	fail_if(info->is_http || info->has_dlna);
+	fail_if(info->media_class != DIDL_MEDIA_VIDEO);
+
+	info = didl_protocol_info_lookup("garbage");
+	fail_if(info->protocol != NULL || info->mime_type != NULL);
+
+	fail_if(didl_class_lookup("object.item.audioItem.musicTrack") !=
+		DIDL_MEDIA_AUDIO);
+	fail_if(didl_class_lookup("object.item.audioItem.musicTrack") !=
+		DIDL_MEDIA_AUDIO);
+	fail_if(didl_class_lookup("object.item.videoItem") != DIDL_MEDIA_VIDEO);
+	fail_if(didl_class_lookup("object.container.album") != DIDL_MEDIA_OTHER);
+	fail_if(didl_class_lookup(NULL) != DIDL_MEDIA_OTHER);
+}
+END_TEST
+
+START_TEST(test_didl_decoders)
+{
+	glong epoch;
+	guint64 size;
+	gint number, x, y;
+	gfloat rate;
+	GHashTable *mdata;
+	GValue *val;
+
+	fail_unless(didl_parse_date("2009-02-13T23:31:30Z", &epoch));
+	fail_if(epoch != 1234567890, "Wrong epoch: %ld", epoch);
+	fail_unless(didl_parse_date("2009-02-14T01:31:30+02:00", &epoch));
+	fail_if(epoch != 1234567890, "Wrong epoch with offset: %ld", epoch);
+	fail_unless(didl_parse_date("2000", &epoch));
+	fail_if(epoch != 946684800, "Wrong epoch for a year: %ld", epoch);
+	fail_if(didl_parse_date("20x0", &epoch));
+	fail_if(didl_parse_date("2009-02-30", &epoch));
+	fail_unless(didl_parse_date("2008-02-29", &epoch));
+
+	fail_unless(didl_parse_duration("0:04:32.770", &number));
+	fail_if(number != 272, "Wrong duration: %d", number);
+	fail_if(didl_parse_duration("4:32", &number));
+
+	fail_unless(didl_parse_resolution("640x480", &x, &y));
+	fail_if(x != 640 || y != 480, "Wrong resolution");
+	fail_if(didl_parse_resolution("640", &x, &y));
+
+	fail_unless(didl_parse_float("30000/1001", &rate));
+	fail_if(rate < 29.97 || rate > 29.98, "Wrong framerate: %f", rate);
+
+	fail_unless(didl_parse_int("2008-05-01", &number));
+	fail_if(number != 2008, "Wrong year: %d", number);
+	fail_if(didl_parse_int("abc", &number));
+
+	fail_unless(didl_parse_size("4294967296", &size));
+	fail_if(size != G_GUINT64_CONSTANT(4294967296), "Wrong size");
+	fail_if(didl_parse_size("-1", &size));
+	fail_if(didl_parse_size("99999999999999999999", &size));
+
+	mdata = mafw_metadata_new();
+	didl_decode_date(mdata, NULL, MAFW_METADATA_KEY_MODIFIED, "1970-01-02");
+	val = mafw_metadata_first(mdata, MAFW_METADATA_KEY_MODIFIED);
+	fail_if(val == NULL || !G_VALUE_HOLDS(val, G_TYPE_LONG));
+	fail_if(g_value_get_long(val) != 86400);
+	didl_decode_float(mdata, NULL, MAFW_METADATA_KEY_VIDEO_FRAMERATE, "25");
+	val = mafw_metadata_first(mdata, MAFW_METADATA_KEY_VIDEO_FRAMERATE);
+	fail_if(val == NULL || !G_VALUE_HOLDS(val, G_TYPE_FLOAT));
+	didl_decode_int(mdata, NULL, MAFW_METADATA_KEY_BPP, "junk");
+	fail_if(mafw_metadata_first(mdata, MAFW_METADATA_KEY_BPP) != NULL);
+	didl_decode_size(mdata, NULL, MAFW_METADATA_KEY_FILESIZE,
+			 "3000000000");
+	fail_if(mafw_metadata_first(mdata, MAFW_METADATA_KEY_FILESIZE) != NULL,
+		"Size over G_MAXINT was not left out");
+	didl_decode_size(mdata, NULL, MAFW_METADATA_KEY_FILESIZE, "1048576");
+	val = mafw_metadata_first(mdata, MAFW_METADATA_KEY_FILESIZE);
+	fail_if(val == NULL || g_value_get_int(val) != 1048576);
+	g_hash_table_unref(mdata);
+}
+END_TEST
+
+START_TEST(test_didl_intern_pool)
+{
+	InternPool *pool, *other;
+	InternPoolStats stats;
+	GHashTable *md1, *md2, *md3, *md4;
+	const gchar *v2, *v3;
+
+	pool = intern_pool_new(64);
+	md1 = mafw_metadata_new();
+	md2 = mafw_metadata_new();
+	md3 = mafw_metadata_new();
+
+	/* Admitted on the second sighting, shared from then on */
+	didl_decode_shared(md1, pool, MAFW_METADATA_KEY_ARTIST, "Artist");
+	didl_decode_shared(md2, pool, MAFW_METADATA_KEY_ARTIST, "Artist");
+	didl_decode_shared(md3, pool, MAFW_METADATA_KEY_ARTIST, "Artist");
+	v2 = g_value_get_string(mafw_metadata_first(md2,
+						    MAFW_METADATA_KEY_ARTIST));
+	v3 = g_value_get_string(mafw_metadata_first(md3,
+						    MAFW_METADATA_KEY_ARTIST));
+	fail_if(strcmp(v3, "Artist") != 0);
+#if GLIB_CHECK_VERSION(2,66,0)
+	fail_if(v2 != v3, "Interned value was copied");
+#endif
+
+	intern_pool_get_stats(pool, &stats);
+	fail_if(stats.strings != 1 || stats.pinned_bytes != 7);
+	fail_if(stats.hits != 1 || stats.copies != 1);
+
+	/* Over the budget values are copied */
+	didl_decode_shared(md1, pool, MAFW_METADATA_KEY_GENRE,
+			   "A genre name long enough to break the budget "
+			   "of this pool");
+	didl_decode_shared(md2, pool, MAFW_METADATA_KEY_GENRE,
+			   "A genre name long enough to break the budget "
+			   "of this pool");
+	intern_pool_get_stats(pool, &stats);
+	fail_if(stats.strings != 1 || stats.copies != 3);
+
+	/* Another pool shares the string */
+	other = intern_pool_new(64);
+	md4 = mafw_metadata_new();
+	didl_decode_shared(md4, other, MAFW_METADATA_KEY_ALBUM, "Artist");
+	didl_decode_shared(md4, other, MAFW_METADATA_KEY_ARTIST, "Artist");
+#if GLIB_CHECK_VERSION(2,66,0)
+	fail_if(g_value_get_string(mafw_metadata_first(
+			md4, MAFW_METADATA_KEY_ARTIST)) != v3,
+		"Pools do not share the string");
+#endif
+
+	/* Values outlive their pool */
+	intern_pool_free(pool);
+	fail_if(strcmp(g_value_get_string(mafw_metadata_first(
+				md3, MAFW_METADATA_KEY_ARTIST)), "Artist") != 0);
+
+	/* A full pool evicts what it has to admit more */
+	didl_decode_shared(md4, other, MAFW_METADATA_KEY_GENRE,
+			   "A genre that fills most of the pool");
+	didl_decode_shared(md4, other, MAFW_METADATA_KEY_GENRE,
+			   "A genre that fills most of the pool");
+	didl_decode_shared(md4, other, MAFW_METADATA_KEY_COMPOSER,
+			   "A composer to break the budget");
+	didl_decode_shared(md4, other, MAFW_METADATA_KEY_COMPOSER,
+			   "A composer to break the budget");
+	intern_pool_get_stats(other, &stats);
+	fail_if(stats.evictions != 1 || stats.strings != 1,
+		"Full pool was not swept");
+	fail_if(strcmp(g_value_get_string(mafw_metadata_first(
+				md4, MAFW_METADATA_KEY_ARTIST)), "Artist") != 0);
+
+	/* A NULL pool copies */
+	didl_decode_shared(md3, NULL, MAFW_METADATA_KEY_ALBUM, "Album");
+	fail_if(mafw_metadata_first(md3, MAFW_METADATA_KEY_ALBUM) == NULL);
+
+	g_hash_table_unref(md1);
+	g_hash_table_unref(md2);
+	g_hash_table_unref(md3);
+	g_hash_table_unref(md4);
+	intern_pool_free(other);
+}
+END_TEST
+
 int main(void)
 {
 	SRunner* sr;
@@ -242,6 +433,9 @@ int main(void)
 	suite_add_tcase(suite, tc);
 	tcase_add_test(tc, test_didl_item);
 	tcase_add_test(tc, test_didl_container);
+	tcase_add_test(tc, test_didl_parse_cache);
+	tcase_add_test(tc, test_didl_decoders);
+	tcase_add_test(tc, test_didl_intern_pool);
 
 	sr = srunner_create(suite);
 	srunner_run_all(sr, CK_NORMAL);
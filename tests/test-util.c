@@ -35,6 +35,22 @@
 
 #include "../upnp-source/mafw-upnp-source.h"
 #include "../upnp-source/mafw-upnp-source-util.h"
+#include "../upnp-source/mafw-upnp-source-scratch.h"
+#include "../upnp-source/mafw-upnp-source-page.h"
+#include "../upnp-source/mafw-upnp-source-catalog.h"
+#include "../upnp-source/mafw-upnp-source-updates.h"
+#include "../upnp-source/mafw-upnp-source-crawler.h"
+#include "../upnp-source/mafw-upnp-source-diff.h"
+#include "../upnp-source/mafw-upnp-source-negcache.h"
+#include "../upnp-source/mafw-upnp-source-ancestry.h"
+#include "../upnp-source/mafw-upnp-source-profile.h"
+#include "../upnp-source/mafw-upnp-source-predicate.h"
+#include "../upnp-source/mafw-upnp-source-sorter.h"
+#include "../upnp-source/mafw-upnp-source-criteria.h"
+#include "../upnp-source/mafw-upnp-source-federated.h"
+#include "../upnp-source/mafw-upnp-source-textindex.h"
+#include "../upnp-source/mafw-upnp-source-jump.h"
+#include "../upnp-source/mafw-upnp-source-typeahead.h"
 
 START_TEST(test_util_udn_to_uuid)
 {
@@ -69,6 +85,1391 @@ START_TEST(test_util_compare_uint)
 }
 END_TEST
 
+START_TEST(test_util_mdata_keys)
+{
+	gchar *filter;
+
+	util_init();
+
+	fail_unless(util_compile_mdata_keys(
+			    MAFW_SOURCE_LIST(MAFW_METADATA_KEY_URI)) ==
+		    MUPnPSrc_MKey_URI);
+	fail_unless(util_compile_mdata_keys(
+			    MAFW_SOURCE_LIST(MAFW_METADATA_KEY_TITLE,
+					     MAFW_METADATA_KEY_ICON,
+					     "no-such-key",
+					     MAFW_METADATA_KEY_RES_Y)) ==
+		    (MUPnPSrc_MKey_Title | MUPnPSrc_MKey_Icon |
+		     MUPnPSrc_MKey_Res_Y));
+	fail_unless(util_compile_mdata_keys(MAFW_SOURCE_NO_KEYS) == 0);
+	fail_unless(util_compile_mdata_keys(MAFW_SOURCE_ALL_KEYS) ==
+		    G_MAXUINT64);
+
+	/* Filters come out once each, in table order. */
+	filter = util_mafwkey_array_to_upnp_filter(
+		MUPnPSrc_MKey_Title | MUPnPSrc_MKey_URI |
+		MUPnPSrc_MKey_Res_X | MUPnPSrc_MKey_Res_Y);
+	fail_if(strcmp(filter, "res,res@resolution,dc:title") != 0,
+		"Unexpected filter: %s", filter);
+	g_free(filter);
+
+	filter = util_mafwkey_array_to_upnp_filter(0);
+	fail_if(strcmp(filter, "") != 0);
+	g_free(filter);
+
+	filter = util_mafwkey_array_to_upnp_filter(G_MAXUINT64);
+	fail_if(strncmp(filter, "res,res@protocolInfo,", 21) != 0);
+	fail_if(strstr(filter, ",icon,") == NULL);
+	fail_if(strstr(filter, ",,") != NULL);
+	g_free(filter);
+}
+END_TEST
+
+START_TEST(test_util_page_scratch)
+{
+	PageScratch *scratch;
+	GHashTable *md, *again;
+
+	scratch = page_scratch_new("uuid");
+
+	/* Tables come back empty */
+	md = page_scratch_take_metadata(scratch);
+	mafw_metadata_add_str(md, MAFW_METADATA_KEY_TITLE, "title");
+	page_scratch_recycle_metadata(scratch, md);
+	page_scratch_reset(scratch);
+	again = page_scratch_take_metadata(scratch);
+	fail_if(again != md, "Metadata table was not recycled");
+	fail_if(g_hash_table_size(again) != 0);
+	page_scratch_recycle_metadata(scratch, again);
+
+	page_scratch_free(scratch);
+}
+END_TEST
+
+START_TEST(test_util_column_page)
+{
+	ColumnPage *page;
+	GHashTable *md;
+	const guint32 *mimes, *artists;
+
+	page = column_page_new(10);
+
+	md = mafw_metadata_new();
+	mafw_metadata_add_str(md, MAFW_METADATA_KEY_TITLE, "One");
+	mafw_metadata_add_str(md, MAFW_METADATA_KEY_ARTIST, "Band");
+	mafw_metadata_add_str(md, MAFW_METADATA_KEY_ALBUM, "Record");
+	mafw_metadata_add_str(md, MAFW_METADATA_KEY_URI, "http://host/1");
+	mafw_metadata_add_str(md, MAFW_METADATA_KEY_MIME, "audio/mpeg");
+	mafw_metadata_add_int(md, MAFW_METADATA_KEY_DURATION, 180);
+	column_page_append(page, "uuid::1", md);
+	mafw_metadata_release(md);
+
+	md = mafw_metadata_new();
+	mafw_metadata_add_str(md, MAFW_METADATA_KEY_ARTIST, "Band");
+	mafw_metadata_add_str(md, MAFW_METADATA_KEY_MIME, "audio/mpeg");
+	column_page_append(page, "uuid::2", md);
+	mafw_metadata_release(md);
+
+	column_page_seal(page);
+
+	fail_if(column_page_get_n_rows(page) != 2);
+	fail_if(column_page_get_first_index(page) != 10);
+	fail_if(strcmp(column_page_get_string(page, 0, COLUMN_PAGE_OBJECT_ID),
+		       "uuid::1") != 0);
+	fail_if(strcmp(column_page_get_string(page, 0, COLUMN_PAGE_TITLE),
+		       "One") != 0);
+	fail_if(strcmp(column_page_get_string(page, 0, COLUMN_PAGE_URI),
+		       "http://host/1") != 0);
+	fail_if(column_page_get_duration(page, 0) != 180);
+
+	/* Missing fields */
+	fail_if(column_page_get_string(page, 1, COLUMN_PAGE_TITLE) != NULL);
+	fail_if(column_page_get_string(page, 1, COLUMN_PAGE_URI) != NULL);
+	fail_if(column_page_get_duration(page, 1) != COLUMN_PAGE_NO_DURATION);
+
+	/* The MIME type and the artist are stored once */
+	mimes = column_page_get_offsets(page, COLUMN_PAGE_MIME);
+	fail_if(mimes[0] != mimes[1], "MIME type was not shared");
+	fail_if(strcmp(column_page_get_string(page, 1, COLUMN_PAGE_MIME),
+		       "audio/mpeg") != 0);
+	artists = column_page_get_offsets(page, COLUMN_PAGE_ARTIST);
+	fail_if(artists[0] != artists[1], "Artist was not shared");
+	fail_if(strcmp(column_page_get_string(page, 0, COLUMN_PAGE_ALBUM),
+		       "Record") != 0);
+	fail_if(column_page_get_string(page, 1, COLUMN_PAGE_ALBUM) != NULL);
+
+	column_page_free(page);
+}
+END_TEST
+
+static ColumnPage *catalog_test_page(const gchar *second_title)
+{
+	ColumnPage *page;
+
+	page = column_page_new(0);
+	column_page_append_row(page, "uuid::1", "One", NULL, NULL,
+			       "http://host/1", "audio/mpeg", 180);
+	column_page_append_row(page, "uuid::2", second_title, NULL, NULL,
+			       NULL, "x-mafw/container",
+			       COLUMN_PAGE_NO_DURATION);
+
+	return page;
+}
+
+START_TEST(test_util_catalog)
+{
+	Catalog *catalog;
+	CatalogEntry entry;
+	ColumnPage *page;
+	gchar *dir, *path;
+	guint32 update_id;
+
+	dir = g_dir_make_tmp("catalog-XXXXXX", NULL);
+	fail_if(dir == NULL);
+	g_setenv(CATALOG_DIR_ENV, dir, TRUE);
+	path = catalog_get_path("uuid");
+	fail_if(!g_str_has_prefix(path, dir));
+
+	/* Fresh catalog */
+	catalog = catalog_open(path);
+	fail_if(catalog_get_update_id(catalog, NULL));
+	fail_if(catalog_lookup(catalog, "0", &entry));
+	fail_unless(catalog_set_update_id(catalog, 5));
+	fail_if(catalog_store(catalog, "0", catalog_test_page("Two")));
+	fail_unless(catalog_lookup(catalog, "0", &entry));
+	fail_if(entry.n_rows != 2);
+	fail_unless(catalog_flush(catalog, NULL));
+	catalog_free(catalog);
+
+	/* From the file */
+	catalog = catalog_open(path);
+	fail_unless(catalog_get_update_id(catalog, &update_id));
+	fail_if(update_id != 5);
+	fail_unless(catalog_lookup(catalog, "0", &entry));
+	fail_if(entry.n_rows != 2);
+	fail_if(strcmp(catalog_entry_get_string(&entry, 0,
+						COLUMN_PAGE_URI),
+		       "http://host/1") != 0);
+	fail_if(catalog_entry_get_string(&entry, 1, COLUMN_PAGE_URI) != NULL);
+	fail_if(entry.durations[0] != 180);
+
+	page = catalog_entry_to_page(&entry, 1, 0);
+	fail_if(column_page_get_n_rows(page) != 1);
+	fail_if(strcmp(column_page_get_string(page, 0, COLUMN_PAGE_TITLE),
+		       "Two") != 0);
+	column_page_free(page);
+
+	/* Only real changes count */
+	fail_if(catalog_store(catalog, "0", catalog_test_page("Two")));
+	fail_unless(catalog_store(catalog, "0", catalog_test_page("Three")));
+
+	/* The server has changed */
+	fail_if(catalog_set_update_id(catalog, 5));
+	fail_unless(catalog_set_update_id(catalog, 6));
+	fail_if(catalog_lookup(catalog, "0", &entry));
+	catalog_free(catalog);
+
+	unlink(path);
+	rmdir(dir);
+	g_unsetenv(CATALOG_DIR_ENV);
+	g_free(path);
+	g_free(dir);
+}
+END_TEST
+
+START_TEST(test_util_update_tracker)
+{
+	UpdateTracker *tracker;
+	UpdateStamp stamp;
+
+	tracker = update_tracker_new();
+
+	/* Nothing told yet */
+	update_tracker_get_stamp(tracker, "7", &stamp);
+	fail_if(stamp.flags != 0);
+	fail_if(update_tracker_changed_since(tracker, "7", &stamp) !=
+		UPDATE_UNKNOWN);
+
+	/* SystemUpdateID only */
+	fail_unless(update_tracker_set_system(tracker, 10));
+	fail_if(update_tracker_set_system(tracker, 10));
+	update_tracker_get_stamp(tracker, "7", &stamp);
+	fail_if(stamp.flags != UPDATE_STAMP_SYSTEM);
+	fail_if(update_tracker_changed_since(tracker, "7", &stamp) !=
+		UPDATE_UNCHANGED);
+	update_tracker_set_system(tracker, 11);
+	fail_if(update_tracker_changed_since(tracker, "7", &stamp) !=
+		UPDATE_CHANGED);
+
+	/* The container's own ID wins over the SystemUpdateID */
+	fail_unless(update_tracker_set_container(tracker, "7", 3));
+	fail_if(update_tracker_set_container(tracker, "7", 3));
+	update_tracker_get_stamp(tracker, "7", &stamp);
+	fail_if(stamp.flags != (UPDATE_STAMP_SYSTEM | UPDATE_STAMP_CONTAINER));
+	update_tracker_set_system(tracker, 12);
+	fail_if(update_tracker_changed_since(tracker, "7", &stamp) !=
+		UPDATE_UNCHANGED);
+	update_tracker_set_container(tracker, "7", 4);
+	fail_if(update_tracker_changed_since(tracker, "7", &stamp) !=
+		UPDATE_CHANGED);
+
+	update_tracker_free(tracker);
+}
+END_TEST
+
+START_TEST(test_util_crawler)
+{
+	Crawler *crawler;
+	gchar *id;
+
+	crawler = crawler_new();
+	fail_if(crawler_next(crawler) != NULL);
+
+	/* Breadth first, each container once */
+	fail_unless(crawler_enqueue(crawler, "0", FALSE));
+	fail_if(crawler_enqueue(crawler, "0", FALSE));
+	id = crawler_next(crawler);
+	fail_if(strcmp(id, "0") != 0);
+	g_free(id);
+	fail_if(crawler_enqueue(crawler, "0", FALSE), "Visited twice");
+	fail_unless(crawler_enqueue(crawler, "a", FALSE));
+	fail_unless(crawler_enqueue(crawler, "b", FALSE));
+
+	/* Changed containers come first, even if visited */
+	fail_unless(crawler_enqueue(crawler, "0", TRUE));
+	fail_if(crawler_get_pending(crawler) != 3);
+	id = crawler_next(crawler);
+	fail_if(strcmp(id, "0") != 0);
+	g_free(id);
+	id = crawler_next(crawler);
+	fail_if(strcmp(id, "a") != 0);
+	g_free(id);
+	fail_if(crawler_get_visited(crawler) != 2);
+
+	/* Complete only once everything was browsed without errors */
+	fail_if(crawler_is_complete(crawler));
+	g_free(crawler_next(crawler));
+	fail_unless(crawler_is_complete(crawler));
+	crawler_fail(crawler);
+	fail_if(crawler_is_complete(crawler));
+
+	/* Starting over, visited containers are walked again */
+	crawler_restart(crawler);
+	fail_unless(crawler_is_complete(crawler));
+	fail_if(crawler_get_pending(crawler) != 0);
+	fail_if(crawler_get_visited(crawler) != 0);
+	fail_unless(crawler_enqueue(crawler, "0", FALSE));
+
+	crawler_free(crawler);
+}
+END_TEST
+
+START_TEST(test_util_container_diff)
+{
+	ColumnPage *old, *cur;
+	ContainerDiff *diff;
+
+	old = column_page_new(0);
+	column_page_append_row(old, "uuid::1", "One", NULL, NULL,
+			       "http://host/1", "audio/mpeg", 180);
+	column_page_append_row(old, "uuid::2", "Two", NULL, NULL,
+			       "http://host/2", "audio/mpeg", 200);
+	column_page_append_row(old, "uuid::3", "Three", NULL, NULL,
+			       "http://host/3", "audio/mpeg", 220);
+	column_page_seal(old);
+
+	/* Same items in another order */
+	cur = column_page_new(0);
+	column_page_append_row(cur, "uuid::3", "Three", NULL, NULL,
+			       "http://host/3", "audio/mpeg", 220);
+	column_page_append_row(cur, "uuid::2", "Two", NULL, NULL,
+			       "http://host/2", "audio/mpeg", 200);
+	column_page_append_row(cur, "uuid::1", "One", NULL, NULL,
+			       "http://host/1", "audio/mpeg", 180);
+	column_page_seal(cur);
+	diff = container_diff_new(old, cur);
+	fail_unless(container_diff_is_empty(diff), "Reordering is no change");
+	container_diff_free(diff);
+	column_page_free(cur);
+
+	/* 1 removed, 2 retitled, 4 added */
+	cur = column_page_new(0);
+	column_page_append_row(cur, "uuid::2", "Deux", NULL, NULL,
+			       "http://host/2", "audio/mpeg", 200);
+	column_page_append_row(cur, "uuid::3", "Three", NULL, NULL,
+			       "http://host/3", "audio/mpeg", 220);
+	column_page_append_row(cur, "uuid::4", "Four", NULL, NULL,
+			       NULL, NULL, COLUMN_PAGE_NO_DURATION);
+	column_page_seal(cur);
+	diff = container_diff_new(old, cur);
+	fail_if(container_diff_is_empty(diff));
+	fail_if(column_page_get_n_rows(diff->added) != 1);
+	fail_if(strcmp(column_page_get_string(diff->added, 0,
+					      COLUMN_PAGE_OBJECT_ID),
+		       "uuid::4") != 0);
+	fail_if(column_page_get_string(diff->added, 0, COLUMN_PAGE_URI) != NULL);
+	fail_if(column_page_get_n_rows(diff->modified) != 1);
+	fail_if(strcmp(column_page_get_string(diff->modified, 0,
+					      COLUMN_PAGE_TITLE),
+		       "Deux") != 0);
+	fail_if(diff->removed->len != 1);
+	fail_if(strcmp(g_ptr_array_index(diff->removed, 0), "uuid::1") != 0);
+	container_diff_free(diff);
+
+	column_page_free(cur);
+	column_page_free(old);
+}
+END_TEST
+
+START_TEST(test_util_neg_cache)
+{
+	NegCache *cache;
+	GError *error = NULL;
+	GError *cached = NULL;
+
+	g_set_error(&error, MAFW_SOURCE_ERROR,
+		    MAFW_SOURCE_ERROR_GET_METADATA_RESULT_FAILED,
+		    "No such object");
+
+	cache = neg_cache_new(NEG_CACHE_TTL);
+	fail_if(neg_cache_lookup(cache, "BrowseMetadata", "42", &cached));
+	neg_cache_add(cache, "BrowseMetadata", "42", error);
+
+	/* Per action and object */
+	fail_unless(neg_cache_lookup(cache, "BrowseMetadata", "42", &cached));
+	fail_if(cached == NULL);
+	fail_if(cached->domain != MAFW_SOURCE_ERROR ||
+		cached->code != MAFW_SOURCE_ERROR_GET_METADATA_RESULT_FAILED);
+	g_clear_error(&cached);
+	fail_if(neg_cache_lookup(cache, "BrowseMetadata", "43", &cached));
+	fail_if(neg_cache_lookup(cache, "BrowseDirectChildren", "42",
+				 &cached));
+	fail_if(cached != NULL);
+
+	neg_cache_clear(cache);
+	fail_if(neg_cache_get_size(cache) != 0);
+	fail_if(neg_cache_lookup(cache, "BrowseMetadata", "42", &cached));
+	neg_cache_free(cache);
+
+	/* Expired entries are forgotten */
+	cache = neg_cache_new(0);
+	neg_cache_add(cache, "BrowseMetadata", "42", error);
+	fail_if(neg_cache_lookup(cache, "BrowseMetadata", "42", &cached));
+	fail_if(neg_cache_get_size(cache) != 0);
+	neg_cache_free(cache);
+
+	g_error_free(error);
+}
+END_TEST
+
+START_TEST(test_util_ancestry)
+{
+	Ancestry *ancestry;
+	GPtrArray *chain;
+	const gchar *missing;
+	const gchar *parent, *title;
+	GError *error = NULL;
+
+	ancestry = ancestry_new();
+	ancestry_add(ancestry, "album", "artist", "Album");
+	ancestry_add(ancestry, "artist", "music", "Artist");
+
+	/* Stops at the first unknown level */
+	chain = ancestry_walk(ancestry, "album", &missing, NULL);
+	fail_if(chain->len != 2);
+	fail_if(strcmp(g_ptr_array_index(chain, 0), "album") != 0);
+	fail_if(strcmp(g_ptr_array_index(chain, 1), "artist") != 0);
+	fail_if(missing == NULL || strcmp(missing, "music") != 0);
+	g_ptr_array_free(chain, TRUE);
+
+	ancestry_add(ancestry, "music", "0", "Music");
+	ancestry_add(ancestry, "0", "-1", "Root");
+	chain = ancestry_walk(ancestry, "album", &missing, NULL);
+	fail_if(chain->len != 4);
+	fail_if(strcmp(g_ptr_array_index(chain, 3), "0") != 0);
+	fail_if(missing != NULL);
+	g_ptr_array_free(chain, TRUE);
+
+	fail_unless(ancestry_lookup(ancestry, "0", &parent, &title));
+	fail_if(parent != NULL, "The root has no parent");
+	fail_if(strcmp(title, "Root") != 0);
+
+	/* Moved and renamed */
+	ancestry_add(ancestry, "album", "music", "Renamed");
+	fail_unless(ancestry_lookup(ancestry, "album", &parent, &title));
+	fail_if(strcmp(parent, "music") != 0);
+	fail_if(strcmp(title, "Renamed") != 0);
+
+	/* Loops do not hang */
+	ancestry_add(ancestry, "a", "b", NULL);
+	ancestry_add(ancestry, "b", "a", NULL);
+	chain = ancestry_walk(ancestry, "a", &missing, &error);
+	fail_if(chain != NULL, "A loop was taken as the path to the root");
+	fail_if(error == NULL);
+	g_error_free(error);
+
+	ancestry_free(ancestry);
+}
+END_TEST
+
+START_TEST(test_util_server_profile)
+{
+	ServerProfile *profile;
+	gchar *dir, *path;
+
+	dir = g_dir_make_tmp("profile-XXXXXX", NULL);
+	fail_if(dir == NULL);
+	g_setenv(CATALOG_DIR_ENV, dir, TRUE);
+	path = server_profile_get_path("uuid");
+	fail_if(!g_str_has_prefix(path, dir));
+
+	/* Nothing known, nothing assumed */
+	profile = server_profile_load(path);
+	fail_unless(server_profile_can_sort(profile, "+dc:title"));
+	fail_unless(server_profile_can_search(profile));
+	fail_if(server_profile_get_page_size(profile, 500) != 500);
+	fail_if(server_profile_short_page_ends(profile) != PROFILE_UNKNOWN);
+
+	server_profile_set_sort_caps(profile, "dc:title,upnp:album");
+	server_profile_set_search_caps(profile, "");
+	fail_unless(server_profile_can_sort(profile, "+dc:title,-upnp:album"));
+	fail_if(server_profile_can_sort(profile, "+dc:date"));
+	fail_if(server_profile_can_sort(profile, "+dc:tit"));
+	fail_if(server_profile_can_search(profile));
+	fail_if(server_profile_can_search_by(profile, "dc:title"));
+	server_profile_set_search_caps(profile, "dc:title,upnp:artist");
+	fail_unless(server_profile_can_search_by(profile, "upnp:artist"));
+	fail_if(server_profile_can_search_by(profile, "upnp:album"));
+	server_profile_set_search_caps(profile, "");
+
+	/* A server that caps pages at 100 */
+	server_profile_short_page(profile, 500, 100, FALSE);
+	fail_if(server_profile_get_page_size(profile, 500) != 100);
+	fail_if(server_profile_get_page_size(profile, 50) != 50);
+	server_profile_short_page(profile, 100, 42, TRUE);
+	fail_if(server_profile_short_page_ends(profile) != PROFILE_YES);
+	fail_unless(server_profile_short_page_is_end(profile, 42));
+	fail_if(server_profile_short_page_is_end(profile, 100));
+
+	server_profile_total_matches(profile, TRUE);
+	server_profile_total_matches(profile, FALSE);
+	server_profile_total_matches(profile, TRUE);
+	fail_if(server_profile_total_matches_reliable(profile) != PROFILE_NO);
+
+	server_profile_add_latency(profile, 80);
+	fail_if(server_profile_get_latency(profile) != 80);
+	fail_unless(server_profile_save(profile, NULL));
+	server_profile_free(profile);
+
+	/* Remembered across sessions */
+	profile = server_profile_load(path);
+	fail_if(server_profile_can_sort(profile, "+dc:date"));
+	fail_if(server_profile_can_search(profile));
+	fail_if(server_profile_get_page_size(profile, 500) != 100);
+	fail_if(server_profile_short_page_ends(profile) != PROFILE_YES);
+	fail_if(server_profile_total_matches_reliable(profile) != PROFILE_NO);
+	fail_if(server_profile_get_latency(profile) != 80);
+
+	/* More after a short page within the cap: short pages say nothing */
+	server_profile_short_page(profile, 100, 60, FALSE);
+	fail_if(server_profile_short_page_ends(profile) != PROFILE_NO);
+	server_profile_free(profile);
+
+	/* Ending with a short page before any cap is known */
+	profile = server_profile_load(NULL);
+	server_profile_short_page(profile, 500, 42, TRUE);
+	fail_if(server_profile_short_page_ends(profile) != PROFILE_YES);
+	fail_if(server_profile_short_page_is_end(profile, 200),
+		"A possibly capped page ended the browse");
+	server_profile_page(profile, 200);
+	server_profile_short_page(profile, 500, 200, FALSE);
+	fail_if(server_profile_get_page_size(profile, 500) != 200,
+		"Cap not learned after short pages were taken as the end");
+	fail_unless(server_profile_short_page_is_end(profile, 150));
+	fail_if(server_profile_short_page_is_end(profile, 200));
+	server_profile_free(profile);
+
+	unlink(path);
+	rmdir(dir);
+	g_unsetenv(CATALOG_DIR_ENV);
+	g_free(path);
+	g_free(dir);
+}
+END_TEST
+
+static gboolean test_predicate(const gchar *sexp, GHashTable *metadata)
+{
+	MafwFilter *filter;
+	Predicate *pred;
+	gboolean match;
+
+	filter = mafw_filter_parse(sexp);
+	fail_if(filter == NULL, "Could not parse filter: %s", sexp);
+	pred = predicate_compile(filter, NULL);
+	fail_if(pred == NULL, "Could not compile filter: %s", sexp);
+	match = predicate_match(pred, metadata);
+	predicate_free(pred);
+	mafw_filter_free(filter);
+
+	return match;
+}
+
+START_TEST(test_util_predicate)
+{
+	GHashTable *metadata;
+	MafwFilter *filter;
+	Predicate *pred;
+
+	metadata = mafw_metadata_new();
+	mafw_metadata_add_str(metadata, MAFW_METADATA_KEY_TITLE, "Beat It");
+	mafw_metadata_add_str(metadata, MAFW_METADATA_KEY_ARTIST,
+			      "Michael Jackson");
+	mafw_metadata_add_int(metadata, MAFW_METADATA_KEY_DURATION, 258);
+
+	/* Simple terms */
+	fail_unless(test_predicate("(artist=Michael Jackson)", metadata));
+	fail_if(test_predicate("(artist=michael jackson)", metadata));
+	fail_unless(test_predicate("(title<C)", metadata));
+	fail_unless(test_predicate("(title?)", metadata));
+	fail_if(test_predicate("(album?)", metadata));
+	fail_if(test_predicate("(album<z)", metadata));
+
+	/* Numbers compare as numbers */
+	fail_unless(test_predicate("(duration>99)", metadata));
+	fail_unless(test_predicate("(duration<1000)", metadata));
+	fail_unless(test_predicate("(duration=258)", metadata));
+
+	/* Approximate matches ignore case, wildcards anywhere */
+	fail_unless(test_predicate("(title~beat)", metadata));
+	fail_unless(test_predicate("(title~*IT)", metadata));
+	fail_unless(test_predicate("(title~b*t i*)", metadata));
+	fail_if(test_predicate("(title~it*beat)", metadata));
+	fail_unless(test_predicate("(duration~25)", metadata));
+
+	/* Complex expressions */
+	fail_unless(test_predicate("(|(album=x)(title=Beat It))", metadata));
+	fail_if(test_predicate("(&(title~beat)(!(artist~jackson)))",
+			       metadata));
+	fail_unless(test_predicate("(!(&(album?)(title~beat)))", metadata));
+
+	/* Only the keys to compile for the filter */
+	filter = mafw_filter_parse("(&(title~beat)(|(duration>1)(foo=1)))");
+	pred = predicate_compile(filter, NULL);
+	fail_if(predicate_get_keys(pred) !=
+		(MUPnPSrc_MKey_Title | MUPnPSrc_MKey_Duration));
+	predicate_free(pred);
+	mafw_filter_free(filter);
+
+	g_hash_table_unref(metadata);
+}
+END_TEST
+
+static void test_sorter_add(Sorter *sorter, gint i, gint duration)
+{
+	GHashTable *metadata;
+	gchar *oid, *title;
+
+	metadata = mafw_metadata_new();
+	title = g_strdup_printf("%c", 'a' + i % 26);
+	mafw_metadata_add_str(metadata, MAFW_METADATA_KEY_TITLE, title);
+	if (duration >= 0)
+		mafw_metadata_add_int(metadata, MAFW_METADATA_KEY_DURATION,
+				      duration);
+	oid = g_strdup_printf("uuid::%d", i);
+	fail_unless(sorter_add(sorter, oid, metadata, NULL));
+	g_hash_table_unref(metadata);
+	g_free(title);
+	g_free(oid);
+}
+
+START_TEST(test_util_sorter)
+{
+	static const gchar *const order[] = {
+		"uuid::2", "uuid::1", "uuid::3", "uuid::0"
+	};
+	Sorter *sorter;
+	GHashTable *metadata;
+	const GValue *value;
+	gchar *oid, *title;
+	gint i, duration, last;
+	guint n;
+
+	fail_if(sorter_new("title", SORTER_RUN_SIZE, NULL) != NULL);
+
+	/* In memory: missing values last, ties in arrival order */
+	sorter = sorter_new("+duration", SORTER_RUN_SIZE, NULL);
+	fail_if(sorter_get_keys(sorter) != MUPnPSrc_MKey_Duration);
+	test_sorter_add(sorter, 0, -1);
+	test_sorter_add(sorter, 1, 30);
+	test_sorter_add(sorter, 2, 5);
+	test_sorter_add(sorter, 3, 30);
+	fail_unless(sorter_finish(sorter, NULL));
+	for (i = 0; sorter_next(sorter, &oid, &metadata, NULL); i++)
+	{
+		fail_if(strcmp(oid, order[i]) != 0,
+			"Wrong item %s at %d", oid, i);
+		g_free(oid);
+		g_hash_table_unref(metadata);
+	}
+	fail_if(i != G_N_ELEMENTS(order));
+	sorter_free(sorter);
+
+	/* Through disk: a run every 3 items, more runs than are merged at
+	   a time */
+	sorter = sorter_new("-duration,+title", 3, NULL);
+	fail_if(sorter_get_keys(sorter) !=
+		(MUPnPSrc_MKey_Duration | MUPnPSrc_MKey_Title));
+	for (i = 0; i < 200; i++)
+		test_sorter_add(sorter, i, i % 10 == 0 ? -1 : (i * 7) % 50);
+	fail_unless(sorter_finish(sorter, NULL));
+	fail_if(sorter_get_n_items(sorter) != 200);
+
+	last = G_MAXINT;
+	title = NULL;
+	for (n = 0; sorter_next(sorter, &oid, &metadata, NULL); n++)
+	{
+		value = mafw_metadata_first(metadata,
+					    MAFW_METADATA_KEY_DURATION);
+		duration = value != NULL ? g_value_get_int(value) : -1;
+		fail_if(duration > last, "Not sorted at %u", n);
+		value = mafw_metadata_first(metadata,
+					    MAFW_METADATA_KEY_TITLE);
+		fail_if(value == NULL);
+		if (duration == last)
+			fail_if(strcmp(title, g_value_get_string(value)) > 0,
+				"Ties not sorted at %u", n);
+		g_free(title);
+		title = g_value_dup_string(value);
+		last = duration;
+		g_free(oid);
+		g_hash_table_unref(metadata);
+	}
+	fail_if(n != 200);
+	g_free(title);
+	sorter_free(sorter);
+}
+END_TEST
+
+static void test_criteria_term(const CriteriaTerm *term, MafwFilterType type,
+			       gboolean negate, const gchar *key)
+{
+	fail_if(term->parts != NULL);
+	fail_if(term->type != type, "Wrong type of %s", term->key);
+	fail_if(term->negate != negate, "Wrong negation of %s", term->key);
+	fail_if(strcmp(term->key, key) != 0,
+		"%s where %s expected", term->key, key);
+}
+
+START_TEST(test_util_criteria)
+{
+	ServerProfile *profile;
+	MafwFilter *filter;
+	CriteriaTerm *term;
+
+	/* Negations go down to the simple terms, "~*" is "?" */
+	filter = mafw_filter_parse("(!(!(!(title~**))))");
+	term = criteria_optimize(filter, NULL);
+	test_criteria_term(term, mafw_f_exists, TRUE, "title");
+	criteria_term_free(term);
+	mafw_filter_free(filter);
+
+	/* Nested alike operators flatten, duplicates go */
+	filter = mafw_filter_parse(
+		"(|(|(album=a)(artist=b))(!(&(!(album=a))(!(genre=c)))))");
+	term = criteria_optimize(filter, NULL);
+	fail_if(term->type != mafw_f_or || term->parts->len != 3);
+	test_criteria_term(g_ptr_array_index(term->parts, 0),
+			   mafw_f_eq, FALSE, "album");
+	test_criteria_term(g_ptr_array_index(term->parts, 1),
+			   mafw_f_eq, FALSE, "artist");
+	test_criteria_term(g_ptr_array_index(term->parts, 2),
+			   mafw_f_eq, FALSE, "genre");
+	criteria_term_free(term);
+	mafw_filter_free(filter);
+
+	/* Implied terms go, what is left collapses */
+	filter = mafw_filter_parse("(&(title?)(title~x)(title?))");
+	term = criteria_optimize(filter, NULL);
+	test_criteria_term(term, mafw_f_approx, FALSE, "title");
+	criteria_term_free(term);
+	mafw_filter_free(filter);
+
+	filter = mafw_filter_parse("(|(title<x)(title?)(album?))");
+	term = criteria_optimize(filter, NULL);
+	fail_if(term->type != mafw_f_or || term->parts->len != 2);
+	test_criteria_term(g_ptr_array_index(term->parts, 0),
+			   mafw_f_exists, FALSE, "title");
+	criteria_term_free(term);
+	mafw_filter_free(filter);
+
+	/* Selective and indexed terms first */
+	profile = server_profile_load(NULL);
+	server_profile_set_sort_caps(profile, "upnp:album");
+	filter = mafw_filter_parse(
+		"(&(|(a=1)(b=2))(!(genre=x))(title~x)(artist=y)(album=z))");
+	term = criteria_optimize(filter, profile);
+	fail_if(term->type != mafw_f_and || term->parts->len != 5);
+	test_criteria_term(g_ptr_array_index(term->parts, 0),
+			   mafw_f_eq, FALSE, "album");
+	test_criteria_term(g_ptr_array_index(term->parts, 1),
+			   mafw_f_eq, FALSE, "artist");
+	test_criteria_term(g_ptr_array_index(term->parts, 2),
+			   mafw_f_approx, FALSE, "title");
+	test_criteria_term(g_ptr_array_index(term->parts, 3),
+			   mafw_f_eq, TRUE, "genre");
+	fail_if(((CriteriaTerm *)g_ptr_array_index(term->parts, 4))->type !=
+		mafw_f_or);
+	criteria_term_free(term);
+	mafw_filter_free(filter);
+	server_profile_free(profile);
+}
+END_TEST
+
+START_TEST(test_util_criteria_translate)
+{
+	CriteriaCache *cache;
+	MafwFilter *filter;
+	GError *error = NULL;
+	GString *sexp;
+	gchar *upsc, *again;
+	guint i;
+
+	/* protocolInfo is matched approximately, quotes are escaped */
+	filter = mafw_filter_parse(
+		"(&(artist=a\"b)(!(|(title~*x*)(mime-type=audio/mpeg))))");
+	upsc = criteria_translate(filter, NULL, &error);
+	fail_if(upsc == NULL);
+	fail_if(strcmp(upsc, "(upnp:artist = \"a\\\"b\") and "
+		       "(dc:title doesNotContain \"x\") and "
+		       "(res@protocolInfo doesNotContain \"audio/mpeg\")")
+		!= 0, "Got %s", upsc);
+	g_free(upsc);
+	mafw_filter_free(filter);
+
+	filter = mafw_filter_parse("(title~a*b)");
+	fail_if(criteria_translate(filter, NULL, &error) != NULL);
+	fail_if(error == NULL);
+	g_error_free(error);
+	mafw_filter_free(filter);
+
+	/* Remembered, and told apart from filters alike */
+	cache = criteria_cache_new();
+	filter = mafw_filter_parse("(|(title=ab)(album=c))");
+	upsc = criteria_cache_translate(cache, filter, NULL, NULL);
+	again = criteria_cache_translate(cache, filter, NULL, NULL);
+	fail_if(upsc == NULL || again == NULL);
+	fail_if(strcmp(upsc, again) != 0);
+	g_free(again);
+	mafw_filter_free(filter);
+	filter = mafw_filter_parse("(|(title=a)(album=bc))");
+	again = criteria_cache_translate(cache, filter, NULL, NULL);
+	fail_if(again == NULL || strcmp(upsc, again) == 0);
+	g_free(again);
+	g_free(upsc);
+	mafw_filter_free(filter);
+
+	/* Nesting as deep as generated filters do */
+	sexp = g_string_new(NULL);
+	for (i = 0; i < 2000; i++)
+		g_string_append_printf(sexp, "(%c(title=%u)",
+				       i % 2 ? '|' : '&', i);
+	g_string_append(sexp, "(album=x)");
+	for (i = 0; i < 2000; i++)
+		g_string_append_c(sexp, ')');
+	filter = mafw_filter_parse(sexp->str);
+	fail_if(filter == NULL);
+	upsc = criteria_cache_translate(cache, filter, NULL, NULL);
+	fail_if(upsc == NULL);
+	fail_if(!g_str_has_prefix(upsc, "(dc:title = \"0\") and "
+				  "((dc:title = \"1\") or ((dc:title"),
+		"Got %.60s", upsc);
+	g_free(upsc);
+	mafw_filter_free(filter);
+	g_string_free(sexp, TRUE);
+	criteria_cache_free(cache);
+}
+END_TEST
+
+/* A server answering every browse with its titles from an idle, item by
+   item as they would come in pages, from the skip count on up to the item
+   count. */
+typedef struct {
+	MafwSource parent;
+	const gchar *const *titles;
+	MafwSourceBrowseResultCb cb;
+	gpointer user_data;
+	guint skip;
+	guint count;
+	guint idle_id;
+	gboolean cancelled;
+	guint browses;
+
+	/* Cancelled browses end without a last result */
+	gboolean quiet;
+} TestServer;
+
+typedef struct {
+	MafwSourceClass parent;
+} TestServerClass;
+
+G_DEFINE_TYPE(TestServer, test_server, MAFW_TYPE_SOURCE);
+
+static gboolean test_server_reply(TestServer *server)
+{
+	GHashTable *metadata;
+	gchar *oid;
+	guint i, n;
+
+	server->idle_id = 0;
+	n = g_strv_length((gchar **)server->titles);
+	if (server->count > 0)
+		n = MIN(n, server->skip + server->count);
+	for (i = server->skip; i < n && server->cb != NULL; i++)
+	{
+		oid = g_strdup_printf("%s::%u", mafw_extension_get_uuid(
+					      MAFW_EXTENSION(server)), i);
+		metadata = mafw_metadata_new();
+		mafw_metadata_add_str(metadata, MAFW_METADATA_KEY_TITLE,
+				      server->titles[i]);
+		server->cb(MAFW_SOURCE(server), 1, n - i - 1, i, oid,
+			   metadata, server->user_data, NULL);
+		g_hash_table_unref(metadata);
+		g_free(oid);
+	}
+	if (server->cb != NULL && server->skip >= n)
+		server->cb(MAFW_SOURCE(server), 1, 0, 0, NULL, NULL,
+			   server->user_data, NULL);
+	server->cb = NULL;
+
+	return FALSE;
+}
+
+static guint test_server_browse(MafwSource *source, const gchar *object_id,
+				gboolean recursive, const MafwFilter *filter,
+				const gchar *sort_criteria,
+				const gchar *const *mdkeys,
+				guint skip_count, guint item_count,
+				MafwSourceBrowseResultCb cb, gpointer user_data)
+{
+	TestServer *server = (TestServer *)source;
+
+	server->cb = cb;
+	server->user_data = user_data;
+	server->skip = skip_count;
+	server->count = item_count;
+	server->cancelled = FALSE;
+	server->browses++;
+	server->idle_id = g_idle_add((GSourceFunc)test_server_reply, server);
+
+	return 1;
+}
+
+static gboolean test_server_cancel_browse(MafwSource *source,
+					  guint browse_id, GError **error)
+{
+	TestServer *server = (TestServer *)source;
+	MafwSourceBrowseResultCb cb;
+
+	if (server->idle_id != 0)
+		g_source_remove(server->idle_id);
+	server->idle_id = 0;
+	server->cancelled = TRUE;
+
+	cb = server->cb;
+	server->cb = NULL;
+	if (cb != NULL && !server->quiet)
+		cb(source, browse_id, 0, 0, NULL, NULL, server->user_data,
+		   NULL);
+
+	return TRUE;
+}
+
+static void test_server_class_init(TestServerClass *klass)
+{
+	MAFW_SOURCE_CLASS(klass)->browse = test_server_browse;
+	MAFW_SOURCE_CLASS(klass)->cancel_browse = test_server_cancel_browse;
+}
+
+static void test_server_init(TestServer *server)
+{
+}
+
+static void test_federated_cb(MafwSource *source, guint browse_id,
+			      gint remaining, guint index,
+			      const gchar *objectid, GHashTable *metadata,
+			      gpointer user_data, const GError *error)
+{
+	GString *titles = user_data;
+
+	fail_if(error != NULL);
+	if (objectid != NULL)
+		g_string_append(titles, g_value_get_string(
+			mafw_metadata_first(metadata,
+					    MAFW_METADATA_KEY_TITLE)));
+	if (remaining == 0)
+		g_string_append_c(titles, '.');
+}
+
+START_TEST(test_util_federated)
+{
+	static const gchar *const odd[] = { "a", "c", "e", NULL };
+	static const gchar *const even[] = { "b", "d", NULL };
+	TestServer *servers[2];
+	MafwFilter *filter;
+	GString *titles;
+	GList *list;
+	gchar **many;
+	guint id, i;
+
+	servers[0] = g_object_new(test_server_get_type(), "uuid", "odd", NULL);
+	servers[0]->titles = odd;
+	servers[1] = g_object_new(test_server_get_type(), "uuid", "even",
+				  NULL);
+	servers[1]->titles = even;
+	list = g_list_append(g_list_append(NULL, servers[0]), servers[1]);
+	filter = mafw_filter_parse("(title?)");
+	titles = g_string_new(NULL);
+
+	/* Merged in order, nothing given out before the ID is */
+	id = federated_search_start(NULL, list, filter, "+title", NULL, 1, 0,
+				    test_federated_cb, titles);
+	fail_if(id == MAFW_SOURCE_INVALID_BROWSE_ID);
+	fail_if(titles->len != 0);
+	while (g_main_context_iteration(NULL, FALSE));
+	fail_if(strcmp(titles->str, "bcde.") != 0, "Got %s", titles->str);
+
+	/* In arrival order up to the item count, the rest cancelled */
+	g_string_truncate(titles, 0);
+	federated_search_start(NULL, list, filter, NULL, NULL, 0, 2,
+			       test_federated_cb, titles);
+	while (g_main_context_iteration(NULL, FALSE));
+	fail_if(strcmp(titles->str, "ac.") != 0, "Got %s", titles->str);
+	fail_unless(servers[1]->cancelled);
+
+	/* Cancelled by the client, and by no other source */
+	g_string_truncate(titles, 0);
+	id = federated_search_start(NULL, list, filter, NULL, NULL, 0, 0,
+				    test_federated_cb, titles);
+	fail_if(federated_search_cancel(MAFW_SOURCE(servers[0]), id));
+	fail_unless(federated_search_cancel(NULL, id));
+	fail_if(federated_search_cancel(NULL, id));
+	while (g_main_context_iteration(NULL, FALSE));
+	fail_if(strcmp(titles->str, ".") != 0, "Got %s", titles->str);
+	fail_unless(servers[0]->cancelled && servers[1]->cancelled);
+
+	/* Read a window at a time, sorted here and not by the servers */
+	many = g_new0(gchar *, 2 * FEDERATED_PART_WINDOW + 2);
+	for (i = 0; i <= 2 * FEDERATED_PART_WINDOW; i++)
+		many[i] = g_strdup_printf("%c", 'a' + i % 26);
+	servers[0]->titles = (const gchar *const *)many;
+	servers[0]->browses = 0;
+	g_string_truncate(titles, 0);
+	federated_search_start(NULL, list, filter, "-title", NULL, 0, 3,
+			       test_federated_cb, titles);
+	while (g_main_context_iteration(NULL, FALSE));
+	fail_if(strcmp(titles->str, "zzz.") != 0, "Got %s", titles->str);
+	fail_if(servers[0]->browses != 3);
+	servers[0]->titles = odd;
+	g_strfreev(many);
+
+	g_string_free(titles, TRUE);
+	mafw_filter_free(filter);
+	g_list_free(list);
+	g_object_unref(servers[0]);
+	g_object_unref(servers[1]);
+}
+END_TEST
+
+START_TEST(test_util_dedup)
+{
+	GHashTable *a, *b;
+	DedupIndex *index;
+	GPtrArray *copies;
+	gchar *fa, *fb, *oid;
+	guint i;
+
+	a = mafw_metadata_new();
+	mafw_metadata_add_str(a, MAFW_METADATA_KEY_TITLE, "Beat It");
+	mafw_metadata_add_str(a, MAFW_METADATA_KEY_ARTIST, "Michael Jackson");
+	mafw_metadata_add_int(a, MAFW_METADATA_KEY_DURATION, 258);
+	b = mafw_metadata_new();
+	mafw_metadata_add_str(b, MAFW_METADATA_KEY_TITLE, "BEAT IT");
+	mafw_metadata_add_str(b, MAFW_METADATA_KEY_ARTIST, "michael jackson");
+	mafw_metadata_add_int(b, MAFW_METADATA_KEY_DURATION, 258);
+
+	/* Case does not tell copies apart, the duration does */
+	fa = dedup_fingerprint(a);
+	fb = dedup_fingerprint(b);
+	fail_if(fa == NULL || fb == NULL);
+	fail_if(strcmp(fa, fb) != 0);
+	g_free(fb);
+	g_hash_table_remove(b, MAFW_METADATA_KEY_DURATION);
+	mafw_metadata_add_int(b, MAFW_METADATA_KEY_DURATION, 259);
+	fb = dedup_fingerprint(b);
+	fail_if(strcmp(fa, fb) == 0);
+
+	/* Nothing to tell an item by without a title */
+	g_hash_table_remove(b, MAFW_METADATA_KEY_TITLE);
+	fail_if(dedup_fingerprint(b) != NULL);
+
+	index = dedup_index_new();
+	fail_if(dedup_index_lookup(index, "nas::1") != NULL);
+	dedup_index_add(index, fa, "nas::1");
+	dedup_index_add(index, fb, "pc::7");
+	dedup_index_add(index, fa, "phone::3");
+	dedup_index_add(index, fa, "nas::1");
+	copies = dedup_index_lookup(index, "phone::3");
+	fail_if(copies == NULL || copies->len != 2);
+	fail_if(strcmp(g_ptr_array_index(copies, 0), "nas::1") != 0);
+	fail_if(dedup_index_lookup(index, "nas::1") != copies);
+	copies = dedup_index_lookup(index, "pc::7");
+	fail_if(copies == NULL || copies->len != 1);
+
+	/* When full, the tracks remembered first are forgotten */
+	for (i = 0; i < DEDUP_MAX_ITEMS; i++)
+	{
+		oid = g_strdup_printf("pc::%u", 100 + i);
+		dedup_index_add(index, oid, oid);
+		g_free(oid);
+	}
+	fail_if(dedup_index_lookup(index, "nas::1") != NULL);
+	fail_if(dedup_index_lookup(index, "pc::7") != NULL);
+	fail_if(dedup_index_lookup(index, "pc::100") == NULL);
+	dedup_index_free(index);
+
+	g_free(fa);
+	g_free(fb);
+	g_hash_table_unref(a);
+	g_hash_table_unref(b);
+}
+END_TEST
+
+static GPtrArray *search_text_index(TextIndex *index, const gchar *sexp,
+				    guint skip_count, guint item_count)
+{
+	MafwFilter *filter;
+	GPtrArray *hits;
+	GError *error = NULL;
+
+	filter = mafw_filter_parse(sexp);
+	fail_if(filter == NULL, "Cannot parse %s", sexp);
+	hits = text_index_search(index, filter, TEXT_INDEX_KEYS, skip_count,
+				 item_count, &error);
+	fail_if(hits == NULL, "Search %s failed", sexp);
+	mafw_filter_free(filter);
+
+	return hits;
+}
+
+START_TEST(test_util_text_index)
+{
+	static const gchar *const items[][4] = {
+		{ "srv::1", "10", "Déjà Vu", "Beyoncé" },
+		{ "srv::2", "10", "Crazy in Love", "Beyoncé" },
+		{ "srv::3", "20", "Love Me Do", "The Beatles" },
+		{ "srv::4", "20", "Yesterday", "The Beatles" },
+	};
+	TextIndex *index;
+	GHashTable *metadata;
+	GPtrArray *hits;
+	MafwFilter *filter;
+	TextIndexHit *hit;
+	guint i;
+
+	index = text_index_new();
+	fail_if(text_index_is_complete(index));
+	for (i = 0; i < G_N_ELEMENTS(items); i++)
+	{
+		metadata = mafw_metadata_new();
+		mafw_metadata_add_str(metadata, MAFW_METADATA_KEY_TITLE,
+				      items[i][2]);
+		mafw_metadata_add_str(metadata, MAFW_METADATA_KEY_ARTIST,
+				      items[i][3]);
+		mafw_metadata_add_int(metadata, MAFW_METADATA_KEY_DURATION,
+				      200 + i);
+		text_index_add(index, items[i][0], items[i][1], metadata);
+		g_hash_table_unref(metadata);
+	}
+	text_index_set_complete(index, TRUE);
+	fail_if(!text_index_is_complete(index));
+	fail_if(text_index_get_size(index) != 4);
+
+	/* Neither case nor diacritics matter, order is that of adding */
+	hits = search_text_index(index, "(artist~BEYONCE)", 0, 0);
+	fail_if(hits->len != 2);
+	hit = g_ptr_array_index(hits, 0);
+	fail_if(strcmp(hit->objectid, "srv::1") != 0);
+	fail_if(strcmp(g_value_get_string(mafw_metadata_first(
+		hit->metadata, MAFW_METADATA_KEY_TITLE)), "Déjà Vu") != 0);
+	fail_if(g_value_get_int(mafw_metadata_first(
+		hit->metadata, MAFW_METADATA_KEY_DURATION)) != 200);
+	text_index_hits_free(hits);
+
+	/* Parts of words, wildcards, and/or/not */
+	hits = search_text_index(index, "(title~deja*u)", 0, 0);
+	fail_if(hits->len != 1);
+	text_index_hits_free(hits);
+	hits = search_text_index(index, "(title~LOV)", 1, 0);
+	fail_if(hits->len != 1);
+	hit = g_ptr_array_index(hits, 0);
+	fail_if(strcmp(hit->objectid, "srv::3") != 0);
+	text_index_hits_free(hits);
+	hits = search_text_index(index,
+				 "(&(title~love)(!(artist~beyonce)))", 0, 0);
+	fail_if(hits->len != 1);
+	text_index_hits_free(hits);
+	hits = search_text_index(index, "(|(title~yester)(title~vu))", 0, 1);
+	fail_if(hits->len != 1);
+	hit = g_ptr_array_index(hits, 0);
+	fail_if(strcmp(hit->objectid, "srv::1") != 0);
+	text_index_hits_free(hits);
+	hits = search_text_index(index, "(title~zzz)", 0, 0);
+	fail_if(hits->len != 0);
+	text_index_hits_free(hits);
+
+	/* Only substrings and presence of the searchable keys */
+	filter = mafw_filter_parse("(title=Yesterday)");
+	fail_if(text_index_can_search(filter));
+	mafw_filter_free(filter);
+	filter = mafw_filter_parse("(uri~http)");
+	fail_if(text_index_can_search(filter));
+	mafw_filter_free(filter);
+
+	/* A changed container is forgotten until indexed again */
+	text_index_invalidate(index, "20");
+	fail_if(text_index_is_complete(index));
+	fail_if(text_index_get_size(index) != 2);
+	hits = search_text_index(index, "(artist~beatles)", 0, 0);
+	fail_if(hits->len != 0);
+	text_index_hits_free(hits);
+
+	/* Added again, an item replaces what was known of it */
+	metadata = mafw_metadata_new();
+	mafw_metadata_add_str(metadata, MAFW_METADATA_KEY_TITLE, "Halo");
+	text_index_add(index, "srv::1", "10", metadata);
+	g_hash_table_unref(metadata);
+	fail_if(text_index_get_size(index) != 2);
+	hits = search_text_index(index, "(title~vu)", 0, 0);
+	fail_if(hits->len != 0);
+	text_index_hits_free(hits);
+	hits = search_text_index(index, "(title~halo)", 0, 0);
+	fail_if(hits->len != 1);
+	text_index_hits_free(hits);
+
+	text_index_free(index);
+}
+END_TEST
+
+START_TEST(test_util_text_index_groups)
+{
+	static const gchar *const items[][4] = {
+		{ "srv::1", "10", "Beyoncé", "2003" },
+		{ "srv::2", "10", "BEYONCE", "2008" },
+		{ "srv::3", "20", "The Beatles", "1965" },
+		{ "srv::4", "30", "ABBA", "" },
+	};
+	TextIndex *index;
+	GHashTable *metadata;
+	GPtrArray *groups, *hits;
+	TextIndexGroup *group;
+	TextIndexHit *hit;
+	guint i;
+
+	index = text_index_new();
+	for (i = 0; i < G_N_ELEMENTS(items); i++)
+	{
+		metadata = mafw_metadata_new();
+		mafw_metadata_add_str(metadata, MAFW_METADATA_KEY_TITLE,
+				      items[i][0]);
+		mafw_metadata_add_str(metadata, MAFW_METADATA_KEY_ARTIST,
+				      items[i][2]);
+		if (*items[i][3] != '\0')
+			mafw_metadata_add_int(metadata, MAFW_METADATA_KEY_YEAR,
+					      atoi(items[i][3]));
+		text_index_add(index, items[i][0], items[i][1], metadata);
+		g_hash_table_unref(metadata);
+	}
+
+	/* One group regardless of case and diacritics, named as it came */
+	groups = text_index_get_groups(index, TEXT_INDEX_BY_ARTIST);
+	fail_if(groups->len != 3);
+	group = g_ptr_array_index(groups, 0);
+	fail_if(strcmp(group->label, "ABBA") != 0 || group->count != 1);
+	group = g_ptr_array_index(groups, 1);
+	fail_if(strcmp(group->label, "Beyoncé") != 0 || group->count != 2);
+	text_index_groups_free(groups);
+
+	hits = text_index_get_group(index, TEXT_INDEX_BY_ARTIST, "beyonce",
+				    TEXT_INDEX_KEYS, 1, 0);
+	fail_if(hits->len != 1);
+	hit = g_ptr_array_index(hits, 0);
+	fail_if(strcmp(hit->objectid, "srv::2") != 0);
+	fail_if(g_value_get_int(mafw_metadata_first(
+		hit->metadata, MAFW_METADATA_KEY_YEAR)) != 2008);
+	text_index_hits_free(hits);
+
+	/* Items without a year are in no year */
+	groups = text_index_get_groups(index, TEXT_INDEX_BY_YEAR);
+	fail_if(groups->len != 3);
+	group = g_ptr_array_index(groups, 0);
+	fail_if(strcmp(group->label, "1965") != 0);
+	text_index_groups_free(groups);
+	groups = text_index_get_groups(index, TEXT_INDEX_BY_GENRE);
+	fail_if(groups->len != 0);
+	text_index_groups_free(groups);
+
+	/* Groups follow the changes */
+	text_index_invalidate(index, "10");
+	groups = text_index_get_groups(index, TEXT_INDEX_BY_ARTIST);
+	fail_if(groups->len != 2);
+	text_index_groups_free(groups);
+	hits = text_index_get_group(index, TEXT_INDEX_BY_ARTIST, "Beyoncé",
+				    TEXT_INDEX_KEYS, 0, 0);
+	fail_if(hits->len != 0);
+	text_index_hits_free(hits);
+
+	text_index_free(index);
+}
+END_TEST
+
+START_TEST(test_util_jump)
+{
+	UpdateTracker *tracker;
+	JumpCache *cache;
+	JumpTable *table;
+	guint total, low, high, offset;
+
+	fail_if(jump_compare(NULL, "a") >= 0);
+	fail_if(jump_compare("Abba", "b") >= 0);
+	fail_if(jump_compare("beatles", "B") < 0);
+	fail_if(jump_compare("B", "b") != 0);
+
+	tracker = update_tracker_new();
+	update_tracker_set_container(tracker, "10", 5);
+	cache = jump_cache_new();
+	table = jump_cache_get(cache, "10", tracker);
+	fail_if(jump_table_get_total(table, &total));
+	fail_if(jump_table_get_search(table) != JUMP_SEARCH_UNKNOWN);
+	jump_table_set_total(table, 100);
+	jump_table_set_search(table, JUMP_SEARCH_UNUSABLE);
+
+	/* The children seen narrow the offset down */
+	jump_table_add_probe(table, 50, "Madonna");
+	fail_if(jump_table_bounds(table, "M", &low, &high));
+	fail_if(low != 0 || high != 50);
+	jump_table_add_probe(table, 49, "Lou Reed");
+	jump_table_add_probe(table, 49, "Lou Reed");
+	fail_if(!jump_table_bounds(table, "M", &low, &high));
+	fail_if(low != 50);
+	fail_if(jump_table_bounds(table, "B", &low, &high));
+	fail_if(low != 0 || high != 49);
+	fail_if(jump_table_bounds(table, "zz", &low, &high));
+	fail_if(low != 51 || high != 100);
+
+	/* Remembered regardless of case, until the container changes */
+	fail_if(jump_cache_get(cache, "10", tracker) != table);
+	fail_if(!jump_table_lookup(table, "m", &offset) || offset != 50);
+	fail_if(jump_table_lookup(table, "b", &offset));
+	update_tracker_set_container(tracker, "10", 6);
+	table = jump_cache_get(cache, "10", tracker);
+	fail_if(jump_table_lookup(table, "m", &offset));
+	fail_if(jump_table_get_total(table, &total));
+
+	jump_cache_free(cache);
+	update_tracker_free(tracker);
+}
+END_TEST
+
+static void test_type_ahead_cb(TypeAhead *ta, const gchar *text,
+			       guint remaining, const gchar *objectid,
+			       GHashTable *metadata, gpointer user_data,
+			       const GError *error)
+{
+	GString *titles = user_data;
+
+	fail_if(error != NULL);
+	if (objectid != NULL)
+		g_string_append_printf(titles, "%s,", g_value_get_string(
+			mafw_metadata_first(metadata,
+					    MAFW_METADATA_KEY_TITLE)));
+	if (remaining == 0)
+		g_string_append_c(titles, '.');
+}
+
+START_TEST(test_util_type_ahead)
+{
+	static const gchar *const titles[] = { "Beat It", "Beast", "Bear",
+					       NULL };
+	TestServer *server;
+	TypeAhead *ta;
+	GString *got;
+
+	server = g_object_new(test_server_get_type(), "uuid", "nas", NULL);
+	server->titles = titles;
+	got = g_string_new(NULL);
+	ta = type_ahead_new(MAFW_SOURCE(server), "nas::0",
+			    MAFW_METADATA_KEY_TITLE, NULL, 0,
+			    test_type_ahead_cb, got);
+
+	/* Only the text typed last is searched for */
+	type_ahead_set_text(ta, "b");
+	type_ahead_set_text(ta, "be");
+	fail_if(got->len != 0);
+	while (g_main_context_iteration(NULL, FALSE));
+	fail_if(server->browses != 1);
+	fail_if(strcmp(got->str, "Beat It,Beast,Bear,.") != 0,
+		"Got %s", got->str);
+
+	/* Refinements are looked for among the results at hand */
+	g_string_truncate(got, 0);
+	type_ahead_set_text(ta, "BEAT");
+	while (g_main_context_iteration(NULL, FALSE));
+	fail_if(strcmp(got->str, "Beat It,.") != 0, "Got %s", got->str);
+	g_string_truncate(got, 0);
+	type_ahead_set_text(ta, "beat x");
+	while (g_main_context_iteration(NULL, FALSE));
+	fail_if(strcmp(got->str, ".") != 0, "Got %s", got->str);
+	fail_if(server->browses != 1);
+
+	/* Typing on cancels the search running */
+	g_string_truncate(got, 0);
+	type_ahead_set_text(ta, "q");
+	g_main_context_iteration(NULL, TRUE);
+	fail_if(server->browses != 2);
+	type_ahead_set_text(ta, "qu");
+	fail_unless(server->cancelled);
+	fail_if(got->len != 0);
+	while (g_main_context_iteration(NULL, FALSE));
+	fail_if(server->browses != 3);
+	fail_if(strcmp(got->str, "Beat It,Beast,Bear,.") != 0,
+		"Got %s", got->str);
+
+	/* Also if the server ends cancelled browses without a word */
+	g_string_truncate(got, 0);
+	server->quiet = TRUE;
+	type_ahead_set_text(ta, "x");
+	g_main_context_iteration(NULL, TRUE);
+	fail_if(server->browses != 4);
+	type_ahead_set_text(ta, "xy");
+	fail_unless(server->cancelled);
+	while (g_main_context_iteration(NULL, FALSE));
+	fail_if(server->browses != 5);
+	fail_if(strcmp(got->str, "Beat It,Beast,Bear,.") != 0,
+		"Got %s", got->str);
+	server->quiet = FALSE;
+
+	/* Nothing typed, nothing found */
+	g_string_truncate(got, 0);
+	type_ahead_set_text(ta, "");
+	while (g_main_context_iteration(NULL, FALSE));
+	fail_if(strcmp(got->str, ".") != 0, "Got %s", got->str);
+
+	type_ahead_free(ta);
+	g_string_free(got, TRUE);
+	g_object_unref(server);
+}
+END_TEST
+
 int main(void)
 {
 	Suite *suite;
@@ -86,6 +1487,26 @@ int main(void)
 	tcase_add_test(tc, test_util_udn_to_uuid);
 	tcase_add_test(tc, test_util_uuid_to_udn);
 	tcase_add_test(tc, test_util_compare_uint);
+	tcase_add_test(tc, test_util_mdata_keys);
+	tcase_add_test(tc, test_util_page_scratch);
+	tcase_add_test(tc, test_util_column_page);
+	tcase_add_test(tc, test_util_catalog);
+	tcase_add_test(tc, test_util_update_tracker);
+	tcase_add_test(tc, test_util_crawler);
+	tcase_add_test(tc, test_util_container_diff);
+	tcase_add_test(tc, test_util_neg_cache);
+	tcase_add_test(tc, test_util_ancestry);
+	tcase_add_test(tc, test_util_server_profile);
+	tcase_add_test(tc, test_util_predicate);
+	tcase_add_test(tc, test_util_sorter);
+	tcase_add_test(tc, test_util_criteria);
+	tcase_add_test(tc, test_util_criteria_translate);
+	tcase_add_test(tc, test_util_federated);
+	tcase_add_test(tc, test_util_dedup);
+	tcase_add_test(tc, test_util_text_index);
+	tcase_add_test(tc, test_util_text_index_groups);
+	tcase_add_test(tc, test_util_jump);
+	tcase_add_test(tc, test_util_type_ahead);
 
 	sr = srunner_create(suite);
 	srunner_run_all(sr, CK_NORMAL);
@@ -0,0 +1,206 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <string.h>
+#include <glib.h>
+#include <libmafw/mafw.h>
+
+#include "mafw-upnp-source-ancestry.h"
+
+/*----------------------------------------------------------------------------
+  Parent chain cache
+  ----------------------------------------------------------------------------*/
+
+/* The parent and title of the containers seen in browse and metadata
+   results, so that the path from the root down to an object can be told
+   without a BrowseMetadata per level. */
+struct _Ancestry {
+	/* Object ID => AncestryNode */
+	GHashTable *nodes;
+};
+
+typedef struct {
+	/* NULL for the root */
+	gchar *parent_id;
+	gchar *title;
+} AncestryNode;
+
+static void ancestry_node_free(AncestryNode *node)
+{
+	g_free(node->parent_id);
+	g_free(node->title);
+	g_free(node);
+}
+
+Ancestry *ancestry_new(void)
+{
+	Ancestry *ancestry;
+
+	ancestry = g_new0(Ancestry, 1);
+	ancestry->nodes = g_hash_table_new_full(
+		g_str_hash, g_str_equal, g_free,
+		(GDestroyNotify)ancestry_node_free);
+
+	return ancestry;
+}
+
+void ancestry_free(Ancestry *ancestry)
+{
+	if (ancestry == NULL)
+		return;
+
+	g_hash_table_destroy(ancestry->nodes);
+	g_free(ancestry);
+}
+
+/**
+ * ancestry_add:
+ * @ancestry:  An #Ancestry
+ * @id:        UPnP object ID
+ * @parent_id: The parentID of the object, "-1" or %NULL for the root
+ * @title:     Title of the object, may be %NULL
+ *
+ * Remembers where an object is, replacing what was known of it.  When
+ * the cache is full it starts over, the upper levels come back with the
+ * next browses.
+ */
+void ancestry_add(Ancestry *ancestry, const gchar *id,
+		  const gchar *parent_id, const gchar *title)
+{
+	AncestryNode *node;
+
+	g_return_if_fail(ancestry != NULL);
+	g_return_if_fail(id != NULL);
+
+	if (parent_id != NULL &&
+	    (*parent_id == '\0' || strcmp(parent_id, "-1") == 0))
+		parent_id = NULL;
+
+	node = g_hash_table_lookup(ancestry->nodes, id);
+	if (node == NULL)
+	{
+		if (g_hash_table_size(ancestry->nodes) >= ANCESTRY_MAX_NODES)
+			g_hash_table_remove_all(ancestry->nodes);
+		node = g_new0(AncestryNode, 1);
+		g_hash_table_insert(ancestry->nodes, g_strdup(id), node);
+	}
+	else if (g_strcmp0(node->parent_id, parent_id) == 0 &&
+		 g_strcmp0(node->title, title) == 0)
+	{
+		return;
+	}
+
+	g_free(node->parent_id);
+	g_free(node->title);
+	node->parent_id = g_strdup(parent_id);
+	node->title = g_strdup(title);
+}
+
+/**
+ * ancestry_lookup:
+ * @ancestry:  An #Ancestry
+ * @id:        UPnP object ID
+ * @parent_id: Receives the parent ID, %NULL for the root
+ * @title:     Receives the title, may be %NULL
+ *
+ * Returns: %TRUE if @id is known.
+ */
+gboolean ancestry_lookup(const Ancestry *ancestry, const gchar *id,
+			 const gchar **parent_id, const gchar **title)
+{
+	AncestryNode *node;
+
+	g_return_val_if_fail(ancestry != NULL, FALSE);
+	g_return_val_if_fail(id != NULL, FALSE);
+
+	node = g_hash_table_lookup(ancestry->nodes, id);
+	if (node == NULL)
+		return FALSE;
+
+	if (parent_id != NULL)
+		*parent_id = node->parent_id;
+	if (title != NULL)
+		*title = node->title;
+
+	return TRUE;
+}
+
+/**
+ * ancestry_walk:
+ * @ancestry: An #Ancestry
+ * @id:       UPnP object ID
+ * @missing:  Receives the first object on the way up whose parent is not
+ *            known, or %NULL if the root was reached
+ * @error:    Location for the reason of failure
+ *
+ * Follows the parents of @id as far as they are known.  A chain longer
+ * than %ANCESTRY_MAX_DEPTH, which is what a loop gives, is an error
+ * rather than a path to the root.
+ *
+ * Returns: The IDs from @id upwards, valid until @ancestry is modified,
+ * or %NULL on error.  Free the array with g_ptr_array_free(array, TRUE).
+ */
+GPtrArray *ancestry_walk(const Ancestry *ancestry, const gchar *id,
+			 const gchar **missing, GError **error)
+{
+	GPtrArray *chain;
+	gpointer key;
+	gpointer value;
+	AncestryNode *node;
+
+	g_return_val_if_fail(ancestry != NULL, NULL);
+	g_return_val_if_fail(id != NULL && missing != NULL, NULL);
+
+	chain = g_ptr_array_new();
+	*missing = id;
+	while (*missing != NULL && chain->len < ANCESTRY_MAX_DEPTH)
+	{
+		if (!g_hash_table_lookup_extended(ancestry->nodes, *missing,
+						  &key, &value))
+			break;
+
+		node = value;
+		g_ptr_array_add(chain, key);
+		*missing = node->parent_id;
+	}
+
+	if (*missing != NULL && chain->len >= ANCESTRY_MAX_DEPTH)
+	{
+		g_set_error(error, MAFW_SOURCE_ERROR,
+			    MAFW_SOURCE_ERROR_BROWSE_RESULT_FAILED,
+			    "Parent chain of %s is too long or a loop", id);
+		*missing = NULL;
+		g_ptr_array_free(chain, TRUE);
+		return NULL;
+	}
+
+	return chain;
+}
+
+guint ancestry_get_size(const Ancestry *ancestry)
+{
+	g_return_val_if_fail(ancestry != NULL, 0);
+
+	return g_hash_table_size(ancestry->nodes);
+}
@@ -0,0 +1,53 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef MAFW_UPNP_SOURCE_ANCESTRY_H
+#define MAFW_UPNP_SOURCE_ANCESTRY_H
+
+#include <glib.h>
+
+/*----------------------------------------------------------------------------
+  Parent chain cache
+  ----------------------------------------------------------------------------*/
+
+/* Objects whose parent is remembered */
+#define ANCESTRY_MAX_NODES 8192
+
+/* Longest chain walked, guards against loops in broken servers */
+#define ANCESTRY_MAX_DEPTH 64
+
+typedef struct _Ancestry Ancestry;
+
+Ancestry *ancestry_new(void);
+void ancestry_free(Ancestry *ancestry);
+
+void ancestry_add(Ancestry *ancestry, const gchar *id,
+		  const gchar *parent_id, const gchar *title);
+gboolean ancestry_lookup(const Ancestry *ancestry, const gchar *id,
+			 const gchar **parent_id, const gchar **title);
+GPtrArray *ancestry_walk(const Ancestry *ancestry, const gchar *id,
+			 const gchar **missing, GError **error);
+guint ancestry_get_size(const Ancestry *ancestry);
+
+#endif
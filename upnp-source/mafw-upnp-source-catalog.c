@@ -0,0 +1,755 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <glib.h>
+#include <string.h>
+
+#include "mafw-upnp-source-catalog.h"
+
+/*----------------------------------------------------------------------------
+  File format
+  ----------------------------------------------------------------------------*/
+
+/* A catalog file holds the cached containers of one server and is used
+   straight from its memory mapping.  All numbers are in host byte order,
+   a file written on another architecture fails the magic check and is
+   simply ignored.  After the header comes a directory sorted by container
+   ID, then one section per container:
+
+	container ID, NUL terminated, padded to 4 bytes
+	n_rows guint32 string offsets for each ColumnPageString column
+	n_rows gint32 durations
+	the NUL separated strings, padded to 4 bytes
+
+   Every offset in the header and the directory is from the start of the
+   file, string offsets are from the start of the section's blob. */
+
+#define CATALOG_MAGIC   0x4350554dU	/* "MUPC" */
+#define CATALOG_VERSION 2
+
+#define CATALOG_HAS_UPDATE_ID (1 << 0)
+
+typedef struct {
+	guint32 magic;
+	guint32 version;
+	guint32 update_id;
+	guint32 flags;
+	guint32 n_containers;
+	guint32 reserved;
+} CatalogHeader;
+
+typedef struct {
+	guint32 id;
+	guint32 n_rows;
+	guint32 columns;
+	guint32 blob;
+	guint32 blob_len;
+} CatalogDirEntry;
+
+#define CATALOG_ROW_SIZE \
+	(COLUMN_PAGE_N_STRINGS * sizeof(guint32) + sizeof(gint32))
+
+struct _Catalog {
+	gchar *path;
+
+	/* The file as last written, NULL if there is none or it was
+	   invalidated */
+	GMappedFile *map;
+	const gchar *data;
+	gsize size;
+	const CatalogHeader *header;
+	const CatalogDirEntry *dir;
+
+	guint32 update_id;
+	gboolean has_update_id;
+
+	/* Container ID => ColumnPage stored since the file was written */
+	GHashTable *pending;
+
+	/* Container IDs revalidated against the server in this session */
+	GHashTable *validated;
+
+	gboolean dirty;
+	guint flush_id;
+};
+
+/*----------------------------------------------------------------------------
+  Mapping
+  ----------------------------------------------------------------------------*/
+
+static void catalog_unmap(Catalog *catalog)
+{
+	if (catalog->map != NULL)
+	{
+		g_mapped_file_unref(catalog->map);
+		catalog->map = NULL;
+	}
+	catalog->data = NULL;
+	catalog->size = 0;
+	catalog->header = NULL;
+	catalog->dir = NULL;
+}
+
+static gboolean catalog_map(Catalog *catalog)
+{
+	GError *error = NULL;
+	const CatalogHeader *header;
+
+	catalog->map = g_mapped_file_new(catalog->path, FALSE, &error);
+	if (catalog->map == NULL)
+	{
+		/* Nothing cached yet */
+		if (!g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+			g_warning("Cannot map catalog %s: %s", catalog->path,
+				  error->message);
+		g_error_free(error);
+		return FALSE;
+	}
+
+	catalog->data = g_mapped_file_get_contents(catalog->map);
+	catalog->size = g_mapped_file_get_length(catalog->map);
+
+	header = (const CatalogHeader *)catalog->data;
+	if (catalog->size < sizeof(CatalogHeader) ||
+	    header->magic != CATALOG_MAGIC ||
+	    header->version != CATALOG_VERSION ||
+	    (guint64)header->n_containers * sizeof(CatalogDirEntry) >
+	    catalog->size - sizeof(CatalogHeader))
+	{
+		g_warning("Ignoring invalid catalog %s", catalog->path);
+		catalog_unmap(catalog);
+		return FALSE;
+	}
+
+	catalog->header = header;
+	catalog->dir = (const CatalogDirEntry *)(header + 1);
+	return TRUE;
+}
+
+/* Returns the container ID of directory entry @i, or %NULL if it points
+   outside the file. */
+static const gchar *catalog_dir_id(const Catalog *catalog, guint i)
+{
+	guint32 offset;
+
+	offset = catalog->dir[i].id;
+	if (offset >= catalog->size ||
+	    memchr(catalog->data + offset, '\0',
+		   catalog->size - offset) == NULL)
+		return NULL;
+
+	return catalog->data + offset;
+}
+
+/* Fills @entry from directory entry @i after checking that everything it
+   refers to is inside the file. */
+static gboolean catalog_map_entry(const Catalog *catalog, guint i,
+				  CatalogEntry *entry)
+{
+	const CatalogDirEntry *dirent;
+	guint32 row;
+	gint col;
+
+	dirent = &catalog->dir[i];
+	if (dirent->columns % sizeof(guint32) != 0 ||
+	    dirent->columns + (guint64)dirent->n_rows * CATALOG_ROW_SIZE >
+	    catalog->size ||
+	    (guint64)dirent->blob + dirent->blob_len > catalog->size ||
+	    (dirent->blob_len > 0 &&
+	     catalog->data[dirent->blob + dirent->blob_len - 1] != '\0'))
+		return FALSE;
+
+	entry->n_rows = dirent->n_rows;
+	for (col = 0; col < COLUMN_PAGE_N_STRINGS; col++)
+		entry->strings[col] = (const guint32 *)(catalog->data +
+			dirent->columns +
+			col * dirent->n_rows * sizeof(guint32));
+	entry->durations = (const gint32 *)(catalog->data + dirent->columns +
+		COLUMN_PAGE_N_STRINGS * dirent->n_rows * sizeof(guint32));
+	entry->blob = catalog->data + dirent->blob;
+	entry->blob_len = dirent->blob_len;
+
+	for (col = 0; col < COLUMN_PAGE_N_STRINGS; col++)
+		for (row = 0; row < entry->n_rows; row++)
+			if (entry->strings[col][row] != COLUMN_PAGE_NONE &&
+			    entry->strings[col][row] >= entry->blob_len)
+				return FALSE;
+
+	return TRUE;
+}
+
+/* Binary searches the directory, returns the index of @container_id or
+   -1. */
+static gint catalog_dir_find(const Catalog *catalog,
+			     const gchar *container_id)
+{
+	gint lo, hi, mid, cmp;
+	const gchar *id;
+
+	if (catalog->header == NULL)
+		return -1;
+
+	lo = 0;
+	hi = (gint)catalog->header->n_containers - 1;
+	while (lo <= hi)
+	{
+		mid = lo + (hi - lo) / 2;
+		id = catalog_dir_id(catalog, mid);
+		if (id == NULL)
+			return -1;
+
+		cmp = strcmp(container_id, id);
+		if (cmp == 0)
+			return mid;
+		else if (cmp < 0)
+			hi = mid - 1;
+		else
+			lo = mid + 1;
+	}
+
+	return -1;
+}
+
+static void catalog_page_entry(const ColumnPage *page, CatalogEntry *entry)
+{
+	gint col;
+
+	entry->n_rows = column_page_get_n_rows(page);
+	for (col = 0; col < COLUMN_PAGE_N_STRINGS; col++)
+		entry->strings[col] = column_page_get_offsets(page, col);
+	entry->durations = column_page_get_durations(page);
+	entry->blob = column_page_get_blob(page, &entry->blob_len);
+}
+
+/*----------------------------------------------------------------------------
+  Catalog
+  ----------------------------------------------------------------------------*/
+
+/**
+ * catalog_get_dir:
+ *
+ * Returns: The directory of the files kept of each server, the catalogs
+ * among them.  Free with g_free().
+ */
+gchar *catalog_get_dir(void)
+{
+	const gchar *dir;
+
+	dir = g_getenv(CATALOG_DIR_ENV);
+	if (dir != NULL && *dir != '\0')
+		return g_strdup(dir);
+	else
+		return g_build_filename(g_get_user_cache_dir(),
+					CATALOG_DIR_NAME, NULL);
+}
+
+/**
+ * catalog_get_path:
+ * @uuid: UUID of the server, as returned by util_udn_to_uuid()
+ *
+ * Returns: The path of the catalog file of the server.  Free with g_free().
+ */
+gchar *catalog_get_path(const gchar *uuid)
+{
+	gchar *dir;
+	gchar *name;
+	gchar *path;
+
+	g_return_val_if_fail(uuid != NULL, NULL);
+
+	dir = catalog_get_dir();
+	name = g_strconcat(uuid, ".cat", NULL);
+	path = g_build_filename(dir, name, NULL);
+	g_free(name);
+	g_free(dir);
+
+	return path;
+}
+
+/**
+ * catalog_open:
+ * @path: Path of the catalog file
+ *
+ * Maps the catalog file at @path if there is a valid one.  A missing or
+ * broken file gives an empty catalog that will be written to @path.
+ *
+ * Returns: A new #Catalog.
+ */
+Catalog *catalog_open(const gchar *path)
+{
+	Catalog *catalog;
+
+	g_return_val_if_fail(path != NULL, NULL);
+
+	catalog = g_new0(Catalog, 1);
+	catalog->path = g_strdup(path);
+	catalog->pending = g_hash_table_new_full(
+		g_str_hash, g_str_equal, g_free,
+		(GDestroyNotify)column_page_free);
+	catalog->validated = g_hash_table_new_full(g_str_hash, g_str_equal,
+						   g_free, NULL);
+
+	if (catalog_map(catalog) &&
+	    (catalog->header->flags & CATALOG_HAS_UPDATE_ID) != 0)
+	{
+		catalog->update_id = catalog->header->update_id;
+		catalog->has_update_id = TRUE;
+	}
+
+	return catalog;
+}
+
+/**
+ * catalog_free:
+ * @catalog: A #Catalog, or %NULL
+ *
+ * Writes out the pending changes of @catalog and frees it.
+ */
+void catalog_free(Catalog *catalog)
+{
+	GError *error = NULL;
+
+	if (catalog == NULL)
+		return;
+
+	if (catalog->flush_id != 0)
+		g_source_remove(catalog->flush_id);
+	if (!catalog_flush(catalog, &error))
+	{
+		g_warning("Cannot write catalog %s: %s", catalog->path,
+			  error->message);
+		g_error_free(error);
+	}
+
+	catalog_unmap(catalog);
+	g_hash_table_destroy(catalog->pending);
+	g_hash_table_destroy(catalog->validated);
+	g_free(catalog->path);
+	g_free(catalog);
+}
+
+static gboolean catalog_flush_cb(Catalog *catalog)
+{
+	GError *error = NULL;
+
+	catalog->flush_id = 0;
+	if (!catalog_flush(catalog, &error))
+	{
+		g_warning("Cannot write catalog %s: %s", catalog->path,
+			  error->message);
+		g_error_free(error);
+	}
+
+	return FALSE;
+}
+
+static void catalog_changed(Catalog *catalog)
+{
+	catalog->dirty = TRUE;
+	if (catalog->flush_id == 0)
+		catalog->flush_id = g_timeout_add_seconds(
+			CATALOG_FLUSH_DELAY, (GSourceFunc)catalog_flush_cb,
+			catalog);
+}
+
+static gint catalog_compare_ids(const gchar **a, const gchar **b)
+{
+	return strcmp(*a, *b);
+}
+
+static void catalog_pad(GByteArray *buf)
+{
+	static const guint8 zeros[sizeof(guint32)];
+
+	if (buf->len % sizeof(guint32) != 0)
+		g_byte_array_append(buf, zeros,
+				    sizeof(guint32) -
+				    buf->len % sizeof(guint32));
+}
+
+/**
+ * catalog_flush:
+ * @catalog: A #Catalog
+ * @error:   Return location for a #GError, or %NULL
+ *
+ * Writes the catalog to its file if it has changed.  The file is replaced
+ * atomically so that a crash leaves either the old or the new catalog.
+ *
+ * Returns: %FALSE if the file could not be written.
+ */
+gboolean catalog_flush(Catalog *catalog, GError **error)
+{
+	GPtrArray *ids;
+	GByteArray *buf;
+	GHashTableIter iter;
+	gpointer key;
+	CatalogHeader header;
+	CatalogDirEntry *dir;
+	CatalogEntry entry;
+	const gchar *id;
+	gchar *dirname;
+	gboolean written;
+	guint i;
+	gint col;
+
+	g_return_val_if_fail(catalog != NULL, FALSE);
+
+	if (!catalog->dirty)
+		return TRUE;
+
+	/* Containers of the old file that were not replaced, and the new
+	   ones, in directory order */
+	ids = g_ptr_array_new();
+	if (catalog->header != NULL)
+	{
+		for (i = 0; i < catalog->header->n_containers; i++)
+		{
+			id = catalog_dir_id(catalog, i);
+			if (id != NULL &&
+			    !g_hash_table_lookup_extended(catalog->pending,
+							  id, NULL, NULL))
+				g_ptr_array_add(ids, (gpointer)id);
+		}
+	}
+	g_hash_table_iter_init(&iter, catalog->pending);
+	while (g_hash_table_iter_next(&iter, &key, NULL))
+		g_ptr_array_add(ids, key);
+	g_ptr_array_sort(ids, (GCompareFunc)catalog_compare_ids);
+
+	memset(&header, 0, sizeof(header));
+	header.magic = CATALOG_MAGIC;
+	header.version = CATALOG_VERSION;
+	header.update_id = catalog->update_id;
+	header.flags = catalog->has_update_id ? CATALOG_HAS_UPDATE_ID : 0;
+
+	buf = g_byte_array_new();
+	g_byte_array_append(buf, (const guint8 *)&header, sizeof(header));
+	dir = g_new0(CatalogDirEntry, ids->len);
+	g_byte_array_append(buf, (const guint8 *)dir,
+			    ids->len * sizeof(CatalogDirEntry));
+
+	for (i = 0; i < ids->len; i++)
+	{
+		id = g_ptr_array_index(ids, i);
+		if (!catalog_lookup(catalog, id, &entry))
+			continue;
+
+		dir[header.n_containers].id = buf->len;
+		g_byte_array_append(buf, (const guint8 *)id, strlen(id) + 1);
+		catalog_pad(buf);
+
+		dir[header.n_containers].n_rows = entry.n_rows;
+		dir[header.n_containers].columns = buf->len;
+		for (col = 0; col < COLUMN_PAGE_N_STRINGS; col++)
+			g_byte_array_append(buf,
+					    (const guint8 *)entry.strings[col],
+					    entry.n_rows * sizeof(guint32));
+		g_byte_array_append(buf, (const guint8 *)entry.durations,
+				    entry.n_rows * sizeof(gint32));
+
+		dir[header.n_containers].blob = buf->len;
+		dir[header.n_containers].blob_len = entry.blob_len;
+		g_byte_array_append(buf, (const guint8 *)entry.blob,
+				    entry.blob_len);
+		catalog_pad(buf);
+
+		header.n_containers++;
+	}
+
+	/* Only now that the sizes are known */
+	memcpy(buf->data, &header, sizeof(header));
+	memcpy(buf->data + sizeof(header), dir,
+	       header.n_containers * sizeof(CatalogDirEntry));
+	g_free(dir);
+	g_ptr_array_free(ids, TRUE);
+
+	dirname = g_path_get_dirname(catalog->path);
+	g_mkdir_with_parents(dirname, 0700);
+	g_free(dirname);
+
+	written = g_file_set_contents(catalog->path, (const gchar *)buf->data,
+				      buf->len, error);
+	g_byte_array_free(buf, TRUE);
+	if (!written)
+		return FALSE;
+
+	/* Everything pending is in the new file now */
+	catalog_unmap(catalog);
+	g_hash_table_remove_all(catalog->pending);
+	catalog->dirty = FALSE;
+	catalog_map(catalog);
+
+	return TRUE;
+}
+
+/**
+ * catalog_get_update_id:
+ * @catalog:   A #Catalog
+ * @update_id: Set to the SystemUpdateID the catalog was built under
+ *
+ * Returns: %FALSE if the catalog does not know its SystemUpdateID yet.
+ */
+gboolean catalog_get_update_id(const Catalog *catalog, guint32 *update_id)
+{
+	g_return_val_if_fail(catalog != NULL, FALSE);
+
+	if (update_id != NULL)
+		*update_id = catalog->update_id;
+	return catalog->has_update_id;
+}
+
+/**
+ * catalog_set_update_id:
+ * @catalog:   A #Catalog
+ * @update_id: Current SystemUpdateID of the server
+ *
+ * Validates the catalog against the server.  If the SystemUpdateID has
+ * changed since the catalog was built, or was never recorded, anything on
+ * the server may have changed and all cached containers are dropped.
+ *
+ * Returns: %TRUE if the catalog was invalidated.
+ */
+gboolean catalog_set_update_id(Catalog *catalog, guint32 update_id)
+{
+	g_return_val_if_fail(catalog != NULL, FALSE);
+
+	if (catalog->has_update_id && catalog->update_id == update_id)
+		return FALSE;
+
+	g_debug("Catalog %s invalidated, SystemUpdateID %u", catalog->path,
+		update_id);
+
+	catalog_unmap(catalog);
+	g_hash_table_remove_all(catalog->pending);
+	g_hash_table_remove_all(catalog->validated);
+	catalog->update_id = update_id;
+	catalog->has_update_id = TRUE;
+	catalog_changed(catalog);
+
+	return TRUE;
+}
+
+/**
+ * catalog_lookup:
+ * @catalog:      A #Catalog
+ * @container_id: UPnP ID of the container
+ * @entry:        Filled with a view of the cached container
+ *
+ * Returns: %TRUE if @container_id is cached.
+ */
+gboolean catalog_lookup(Catalog *catalog, const gchar *container_id,
+			CatalogEntry *entry)
+{
+	ColumnPage *page;
+	gint i;
+
+	g_return_val_if_fail(catalog != NULL, FALSE);
+	g_return_val_if_fail(container_id != NULL, FALSE);
+	g_return_val_if_fail(entry != NULL, FALSE);
+
+	page = g_hash_table_lookup(catalog->pending, container_id);
+	if (page != NULL)
+	{
+		catalog_page_entry(page, entry);
+		return TRUE;
+	}
+
+	i = catalog_dir_find(catalog, container_id);
+	if (i < 0)
+		return FALSE;
+
+	if (!catalog_map_entry(catalog, i, entry))
+	{
+		g_warning("Catalog %s has a broken entry for %s",
+			  catalog->path, container_id);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean catalog_entry_equal(const CatalogEntry *a,
+				    const CatalogEntry *b)
+{
+	const gchar *sa, *sb;
+	guint row;
+	gint col;
+
+	if (a->n_rows != b->n_rows)
+		return FALSE;
+
+	for (row = 0; row < a->n_rows; row++)
+	{
+		if (a->durations[row] != b->durations[row])
+			return FALSE;
+
+		for (col = 0; col < COLUMN_PAGE_N_STRINGS; col++)
+		{
+			sa = catalog_entry_get_string(a, row, col);
+			sb = catalog_entry_get_string(b, row, col);
+			if (sa != sb &&
+			    (sa == NULL || sb == NULL || strcmp(sa, sb) != 0))
+				return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/**
+ * catalog_store:
+ * @catalog:      A #Catalog
+ * @container_id: UPnP ID of the container
+ * @page:         All children of the container, in server order.  The
+ *                catalog takes ownership.
+ *
+ * Caches the contents of a container.  The catalog is written to disk
+ * %CATALOG_FLUSH_DELAY seconds later.
+ *
+ * Returns: %TRUE if a different version of the container was cached.
+ */
+gboolean catalog_store(Catalog *catalog, const gchar *container_id,
+		       ColumnPage *page)
+{
+	CatalogEntry old, cur;
+	gboolean changed = FALSE;
+
+	g_return_val_if_fail(catalog != NULL, FALSE);
+	g_return_val_if_fail(container_id != NULL, FALSE);
+	g_return_val_if_fail(page != NULL, FALSE);
+
+	if (column_page_get_n_rows(page) > CATALOG_MAX_ROWS)
+	{
+		column_page_free(page);
+		return FALSE;
+	}
+
+	column_page_seal(page);
+	catalog_page_entry(page, &cur);
+	if (catalog_lookup(catalog, container_id, &old))
+	{
+		changed = !catalog_entry_equal(&old, &cur);
+		if (!changed)
+		{
+			/* Spare the disk */
+			column_page_free(page);
+			return FALSE;
+		}
+	}
+
+	g_hash_table_replace(catalog->pending, g_strdup(container_id), page);
+	catalog_changed(catalog);
+
+	return changed;
+}
+
+/**
+ * catalog_is_validated:
+ * @catalog:      A #Catalog
+ * @container_id: UPnP ID of the container
+ *
+ * Returns: %TRUE if the cached copy of @container_id was checked against
+ * the server with catalog_set_validated() in this session.
+ */
+gboolean catalog_is_validated(Catalog *catalog, const gchar *container_id)
+{
+	g_return_val_if_fail(catalog != NULL, FALSE);
+
+	return g_hash_table_lookup_extended(catalog->validated, container_id,
+					    NULL, NULL);
+}
+
+void catalog_set_validated(Catalog *catalog, const gchar *container_id)
+{
+	g_return_if_fail(catalog != NULL);
+
+	g_hash_table_replace(catalog->validated, g_strdup(container_id),
+			     NULL);
+}
+
+/*----------------------------------------------------------------------------
+  Entries
+  ----------------------------------------------------------------------------*/
+
+/**
+ * catalog_entry_get_string:
+ * @entry:  A #CatalogEntry
+ * @row:    Row number, starting from 0
+ * @column: The string column
+ *
+ * Returns: The string, or %NULL if the row has none.
+ */
+const gchar *catalog_entry_get_string(const CatalogEntry *entry, guint row,
+				      ColumnPageString column)
+{
+	guint32 offset;
+
+	g_return_val_if_fail(entry != NULL, NULL);
+	g_return_val_if_fail(column < COLUMN_PAGE_N_STRINGS, NULL);
+	g_return_val_if_fail(row < entry->n_rows, NULL);
+
+	offset = entry->strings[column][row];
+	if (offset == COLUMN_PAGE_NONE)
+		return NULL;
+
+	return entry->blob + offset;
+}
+
+/**
+ * catalog_entry_to_page:
+ * @entry:      A #CatalogEntry
+ * @skip_count: Number of rows to skip
+ * @item_count: Number of rows wanted, 0 for all
+ *
+ * Returns: A new sealed #ColumnPage with the requested rows of @entry.
+ */
+ColumnPage *catalog_entry_to_page(const CatalogEntry *entry,
+				  guint skip_count, guint item_count)
+{
+	ColumnPage *page;
+	guint row, end;
+
+	g_return_val_if_fail(entry != NULL, NULL);
+
+	end = entry->n_rows;
+	if (item_count != 0 && skip_count < end && end - skip_count > item_count)
+		end = skip_count + item_count;
+
+	page = column_page_new(skip_count);
+	for (row = skip_count; row < end; row++)
+		column_page_append_row(
+			page,
+			catalog_entry_get_string(entry, row,
+						 COLUMN_PAGE_OBJECT_ID),
+			catalog_entry_get_string(entry, row, COLUMN_PAGE_TITLE),
+			catalog_entry_get_string(entry, row,
+						 COLUMN_PAGE_ARTIST),
+			catalog_entry_get_string(entry, row, COLUMN_PAGE_ALBUM),
+			catalog_entry_get_string(entry, row, COLUMN_PAGE_URI),
+			catalog_entry_get_string(entry, row, COLUMN_PAGE_MIME),
+			entry->durations[row]);
+	column_page_seal(page);
+
+	return page;
+}
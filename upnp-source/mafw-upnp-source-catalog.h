@@ -0,0 +1,83 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef MAFW_UPNP_SOURCE_CATALOG_H
+#define MAFW_UPNP_SOURCE_CATALOG_H
+
+#include <glib.h>
+
+#include "mafw-upnp-source-page.h"
+
+/*----------------------------------------------------------------------------
+  Persistent catalog cache
+  ----------------------------------------------------------------------------*/
+
+/* Catalog files live under this directory of g_get_user_cache_dir() */
+#define CATALOG_DIR_NAME "mafw-upnp-source"
+
+/* Overrides the catalog directory */
+#define CATALOG_DIR_ENV "MAFW_UPNP_SOURCE_CATALOG_DIR"
+
+/* Larger containers are not cached */
+#define CATALOG_MAX_ROWS 20000
+
+/* Stored containers are written to disk after this many seconds */
+#define CATALOG_FLUSH_DELAY 5
+
+typedef struct _Catalog Catalog;
+
+/* A read-only view of a cached container.  It stays valid until the next
+   call that modifies the catalog. */
+typedef struct {
+	guint n_rows;
+	const guint32 *strings[COLUMN_PAGE_N_STRINGS];
+	const gint32 *durations;
+	const gchar *blob;
+	gsize blob_len;
+} CatalogEntry;
+
+gchar *catalog_get_dir(void);
+gchar *catalog_get_path(const gchar *uuid);
+
+Catalog *catalog_open(const gchar *path);
+void catalog_free(Catalog *catalog);
+gboolean catalog_flush(Catalog *catalog, GError **error);
+
+gboolean catalog_get_update_id(const Catalog *catalog, guint32 *update_id);
+gboolean catalog_set_update_id(Catalog *catalog, guint32 update_id);
+
+gboolean catalog_lookup(Catalog *catalog, const gchar *container_id,
+			CatalogEntry *entry);
+gboolean catalog_store(Catalog *catalog, const gchar *container_id,
+		       ColumnPage *page);
+
+gboolean catalog_is_validated(Catalog *catalog, const gchar *container_id);
+void catalog_set_validated(Catalog *catalog, const gchar *container_id);
+
+const gchar *catalog_entry_get_string(const CatalogEntry *entry, guint row,
+				      ColumnPageString column);
+ColumnPage *catalog_entry_to_page(const CatalogEntry *entry,
+				  guint skip_count, guint item_count);
+
+#endif
@@ -0,0 +1,207 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <glib.h>
+
+#include "mafw-upnp-source-crawler.h"
+
+/*----------------------------------------------------------------------------
+  Catalog crawler
+  ----------------------------------------------------------------------------*/
+
+/* The crawl order of one server.  The initial walk goes breadth first
+   from the root so that the containers near the top, which users open
+   first, are mirrored first.  Containers known to have changed jump the
+   queue. */
+struct _Crawler {
+	/* Container IDs to browse, and the same as a set */
+	GQueue queue;
+	GHashTable *queued;
+
+	/* Containers browsed at least once */
+	GHashTable *visited;
+
+	/* Containers left out for %CRAWLER_MAX_CONTAINERS, or not browsed
+	   for an error: the walk has not seen everything */
+	gboolean truncated;
+	gboolean failed;
+};
+
+Crawler *crawler_new(void)
+{
+	Crawler *crawler;
+
+	crawler = g_new0(Crawler, 1);
+	g_queue_init(&crawler->queue);
+	crawler->queued = g_hash_table_new(g_str_hash, g_str_equal);
+	crawler->visited = g_hash_table_new_full(g_str_hash, g_str_equal,
+						 g_free, NULL);
+
+	return crawler;
+}
+
+void crawler_free(Crawler *crawler)
+{
+	gchar *id;
+
+	if (crawler == NULL)
+		return;
+
+	while ((id = g_queue_pop_head(&crawler->queue)) != NULL)
+		g_free(id);
+	g_hash_table_destroy(crawler->queued);
+	g_hash_table_destroy(crawler->visited);
+	g_free(crawler);
+}
+
+/**
+ * crawler_enqueue:
+ * @crawler:      A #Crawler
+ * @container_id: UPnP ID of a container
+ * @refresh:      %TRUE if the container is known to have changed
+ *
+ * Schedules a container for browsing.  Containers found by the walk are
+ * browsed once, after the ones already queued.  Changed containers are
+ * browsed again, before anything else.
+ *
+ * Returns: %TRUE if @container_id was queued.
+ */
+gboolean crawler_enqueue(Crawler *crawler, const gchar *container_id,
+			 gboolean refresh)
+{
+	gchar *id;
+
+	g_return_val_if_fail(crawler != NULL, FALSE);
+	g_return_val_if_fail(container_id != NULL, FALSE);
+
+	if (g_hash_table_lookup_extended(crawler->queued, container_id,
+					 NULL, NULL))
+		return FALSE;
+
+	if (!refresh &&
+	    g_hash_table_lookup_extended(crawler->visited, container_id,
+					 NULL, NULL))
+		return FALSE;
+	if (!refresh &&
+	    g_hash_table_size(crawler->visited) + crawler->queue.length >=
+	    CRAWLER_MAX_CONTAINERS)
+	{
+		crawler->truncated = TRUE;
+		return FALSE;
+	}
+
+	id = g_strdup(container_id);
+	g_hash_table_insert(crawler->queued, id, id);
+	if (refresh)
+		g_queue_push_head(&crawler->queue, id);
+	else
+		g_queue_push_tail(&crawler->queue, id);
+
+	return TRUE;
+}
+
+/**
+ * crawler_next:
+ * @crawler: A #Crawler
+ *
+ * Returns: The next container to browse, to be freed with g_free(), or
+ * %NULL if there is nothing to do.
+ */
+gchar *crawler_next(Crawler *crawler)
+{
+	gchar *id;
+
+	g_return_val_if_fail(crawler != NULL, NULL);
+
+	id = g_queue_pop_head(&crawler->queue);
+	if (id == NULL)
+		return NULL;
+
+	g_hash_table_remove(crawler->queued, id);
+	if (!g_hash_table_lookup_extended(crawler->visited, id, NULL, NULL))
+		g_hash_table_insert(crawler->visited, g_strdup(id), NULL);
+
+	return id;
+}
+
+/**
+ * crawler_restart:
+ * @crawler: A #Crawler
+ *
+ * Forgets the containers queued and browsed, so that the walk starts
+ * over from whatever is queued next, like after everything cached of the
+ * server was dropped.
+ */
+void crawler_restart(Crawler *crawler)
+{
+	gchar *id;
+
+	g_return_if_fail(crawler != NULL);
+
+	while ((id = g_queue_pop_head(&crawler->queue)) != NULL)
+		g_free(id);
+	g_hash_table_remove_all(crawler->queued);
+	g_hash_table_remove_all(crawler->visited);
+	crawler->truncated = FALSE;
+	crawler->failed = FALSE;
+}
+
+/**
+ * crawler_fail:
+ * @crawler: A #Crawler
+ *
+ * Notes that a container could not be browsed, so the walk is incomplete
+ * until it is restarted.
+ */
+void crawler_fail(Crawler *crawler)
+{
+	g_return_if_fail(crawler != NULL);
+	crawler->failed = TRUE;
+}
+
+/**
+ * crawler_is_complete:
+ * @crawler: A #Crawler
+ *
+ * Returns: %TRUE if nothing is queued and every container found was
+ * browsed without errors.
+ */
+gboolean crawler_is_complete(const Crawler *crawler)
+{
+	g_return_val_if_fail(crawler != NULL, FALSE);
+	return crawler->queue.length == 0 && !crawler->truncated &&
+		!crawler->failed;
+}
+
+guint crawler_get_pending(const Crawler *crawler)
+{
+	g_return_val_if_fail(crawler != NULL, 0);
+	return crawler->queue.length;
+}
+
+guint crawler_get_visited(const Crawler *crawler)
+{
+	g_return_val_if_fail(crawler != NULL, 0);
+	return g_hash_table_size(crawler->visited);
+}
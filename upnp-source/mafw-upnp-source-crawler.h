@@ -0,0 +1,55 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef MAFW_UPNP_SOURCE_CRAWLER_H
+#define MAFW_UPNP_SOURCE_CRAWLER_H
+
+#include <glib.h>
+
+/*----------------------------------------------------------------------------
+  Catalog crawler
+  ----------------------------------------------------------------------------*/
+
+/* Milliseconds between two container browses of the crawler */
+#define CRAWLER_INTERVAL 1000
+
+/* The initial walk stops discovering containers after this many */
+#define CRAWLER_MAX_CONTAINERS 10000
+
+typedef struct _Crawler Crawler;
+
+Crawler *crawler_new(void);
+void crawler_free(Crawler *crawler);
+
+gboolean crawler_enqueue(Crawler *crawler, const gchar *container_id,
+			 gboolean refresh);
+gchar *crawler_next(Crawler *crawler);
+void crawler_restart(Crawler *crawler);
+void crawler_fail(Crawler *crawler);
+gboolean crawler_is_complete(const Crawler *crawler);
+
+guint crawler_get_pending(const Crawler *crawler);
+guint crawler_get_visited(const Crawler *crawler);
+
+#endif
@@ -0,0 +1,923 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <glib.h>
+#include <string.h>
+#include <libgupnp-av/gupnp-av.h>
+#include <libmafw/mafw.h>
+
+#include "mafw-upnp-source-criteria.h"
+#include "mafw-upnp-source-didl.h"
+#include "mafw-upnp-source-util.h"
+
+/*----------------------------------------------------------------------------
+  Search criteria optimisation
+  ----------------------------------------------------------------------------*/
+
+/* Rank of terms the server has to evaluate as a whole */
+#define CRITERIA_RANK_COMPLEX 10
+#define CRITERIA_RANKS (CRITERIA_RANK_COMPLEX + 1)
+
+/* Operands up to which duplicates are looked for one by one */
+#define CRITERIA_DEDUP_LINEAR 8
+
+/* Generated filters may nest arbitrarily deep, so none of the functions
+   below recurse: they keep their own stacks instead. */
+
+/* A filter yet to be made a term of */
+typedef struct {
+	const MafwFilter *filter;
+	gboolean negate;
+
+	/* The operands of the term of its parent, %NULL for the root */
+	GPtrArray *parts;
+} CriteriaFrame;
+
+/* An operator to simplify and where it is among the operands of its
+   parent, which gets what it simplifies to */
+typedef struct {
+	CriteriaTerm *term;
+	GPtrArray *owner;
+	guint index;
+} CriteriaSlot;
+
+/* An operator being written out and its next operand */
+typedef struct {
+	const CriteriaTerm *term;
+	guint next;
+} CriteriaCursor;
+
+/**
+ * criteria_term_free:
+ * @term: A #CriteriaTerm, may be %NULL
+ *
+ * Frees @term and its operands.
+ */
+void criteria_term_free(CriteriaTerm *term)
+{
+	GPtrArray *stack;
+	guint i;
+
+	if (term == NULL)
+		return;
+
+	stack = g_ptr_array_new();
+	g_ptr_array_add(stack, term);
+	while (stack->len > 0)
+	{
+		term = g_ptr_array_remove_index(stack, stack->len - 1);
+		if (term->parts != NULL)
+		{
+			for (i = 0; i < term->parts->len; i++)
+				g_ptr_array_add(stack, g_ptr_array_index(
+							term->parts, i));
+			g_ptr_array_free(term->parts, TRUE);
+		}
+		g_free(term);
+	}
+	g_ptr_array_free(stack, TRUE);
+}
+
+static gboolean criteria_is_wildcard(const gchar *value)
+{
+	while (*value == '*')
+		value++;
+	return *value == '\0';
+}
+
+static void criteria_hash_simple(CriteriaTerm *term)
+{
+	term->hash = g_str_hash(term->key) * 33 + term->type * 2 +
+		term->negate;
+	if (term->value != NULL)
+		term->hash = term->hash * 33 + g_str_hash(term->value);
+}
+
+static void criteria_hash_complex(CriteriaTerm *term)
+{
+	guint i;
+
+	term->hash = term->type;
+	for (i = 0; i < term->parts->len; i++)
+		term->hash = term->hash * 31 + ((CriteriaTerm *)
+			g_ptr_array_index(term->parts, i))->hash;
+}
+
+/* Makes the term of @filter.  As there is no NOT in UPnP, negations go
+   down to the simple terms, swapping and for or on the way (De Morgan),
+   and double negations cancel out. */
+static CriteriaTerm *criteria_build(const MafwFilter *filter)
+{
+	CriteriaFrame frame;
+	CriteriaTerm *term, *root;
+	GArray *stack;
+	guint n;
+
+	root = NULL;
+	stack = g_array_new(FALSE, FALSE, sizeof(CriteriaFrame));
+	frame.filter = filter;
+	frame.negate = FALSE;
+	frame.parts = NULL;
+	g_array_append_val(stack, frame);
+	while (stack->len > 0)
+	{
+		frame = g_array_index(stack, CriteriaFrame, stack->len - 1);
+		g_array_set_size(stack, stack->len - 1);
+
+		filter = frame.filter;
+		while (filter->type == mafw_f_not)
+		{
+			filter = filter->parts[0];
+			frame.negate = !frame.negate;
+		}
+
+		term = g_new0(CriteriaTerm, 1);
+		if (frame.parts != NULL)
+			g_ptr_array_add(frame.parts, term);
+		else
+			root = term;
+
+		if (MAFW_FILTER_IS_SIMPLE(filter))
+		{
+			term->type = filter->type;
+			term->negate = frame.negate;
+			term->key = filter->key;
+			term->value = filter->value;
+
+			/* Every value of the property matches "~*", so it is
+			   the same as asking whether the property exists. */
+			if (term->type == mafw_f_approx &&
+			    criteria_is_wildcard(term->value))
+			{
+				term->type = mafw_f_exists;
+				term->value = NULL;
+			}
+			criteria_hash_simple(term);
+			continue;
+		}
+
+		if (filter->type == mafw_f_and)
+			term->type = frame.negate ? mafw_f_or : mafw_f_and;
+		else
+			term->type = frame.negate ? mafw_f_and : mafw_f_or;
+
+		for (n = 0; filter->parts[n] != NULL; n++)
+			;
+		term->parts = g_ptr_array_sized_new(n);
+
+		/* The last pushed is made first */
+		frame.parts = term->parts;
+		while (n-- > 0)
+		{
+			frame.filter = filter->parts[n];
+			g_array_append_val(stack, frame);
+		}
+	}
+	g_array_free(stack, TRUE);
+
+	return root;
+}
+
+static gboolean criteria_equal(const CriteriaTerm *a, const CriteriaTerm *b)
+{
+	GPtrArray *stack;
+	gboolean equal;
+	guint i;
+
+	equal = TRUE;
+	stack = g_ptr_array_new();
+	g_ptr_array_add(stack, (gpointer)a);
+	g_ptr_array_add(stack, (gpointer)b);
+	while (equal && stack->len > 0)
+	{
+		b = g_ptr_array_remove_index(stack, stack->len - 1);
+		a = g_ptr_array_remove_index(stack, stack->len - 1);
+
+		if (a->hash != b->hash || a->type != b->type ||
+		    a->negate != b->negate)
+			equal = FALSE;
+		else if (a->parts == NULL)
+			equal = strcmp(a->key, b->key) == 0 &&
+				g_strcmp0(a->value, b->value) == 0;
+		else if (a->parts->len != b->parts->len)
+			equal = FALSE;
+		else
+		{
+			for (i = 0; i < a->parts->len; i++)
+			{
+				g_ptr_array_add(stack, g_ptr_array_index(
+							a->parts, i));
+				g_ptr_array_add(stack, g_ptr_array_index(
+							b->parts, i));
+			}
+		}
+	}
+	g_ptr_array_free(stack, TRUE);
+
+	return equal;
+}
+
+static guint criteria_term_hash(gconstpointer term)
+{
+	return ((const CriteriaTerm *)term)->hash;
+}
+
+static gboolean criteria_term_equal(gconstpointer a, gconstpointer b)
+{
+	return criteria_equal(a, b);
+}
+
+/* Adds @term to @parts unless it is there already.  With many operands
+   @seen has those of @parts to look @term up in. */
+static void criteria_add(GPtrArray *parts, GHashTable *seen,
+			 CriteriaTerm *term)
+{
+	CriteriaTerm *other;
+	guint i;
+
+	if (seen != NULL)
+	{
+		if (g_hash_table_lookup(seen, term) != NULL)
+		{
+			criteria_term_free(term);
+			return;
+		}
+		g_hash_table_insert(seen, term, term);
+		g_ptr_array_add(parts, term);
+		return;
+	}
+
+	for (i = 0; i < parts->len; i++)
+	{
+		other = g_ptr_array_index(parts, i);
+		if (other->hash == term->hash && criteria_equal(other, term))
+		{
+			criteria_term_free(term);
+			return;
+		}
+	}
+	g_ptr_array_add(parts, term);
+}
+
+/* Whether @term compares @key to some value. */
+static gboolean criteria_compares(const CriteriaTerm *term, const gchar *key)
+{
+	return term->parts == NULL && !term->negate &&
+		term->type != mafw_f_exists && strcmp(term->key, key) == 0;
+}
+
+/* Drops the operands of @term that are implied by others: in an and,
+   "k exists true" next to a comparison of k, and in an or, comparisons of k
+   next to "k exists true". */
+static void criteria_absorb(CriteriaTerm *term)
+{
+	CriteriaTerm *exists, *other;
+	guint i, j;
+
+	for (i = 0; i < term->parts->len; i++)
+	{
+		exists = g_ptr_array_index(term->parts, i);
+		if (exists->parts != NULL || exists->negate ||
+		    exists->type != mafw_f_exists)
+			continue;
+
+		for (j = 0; j < term->parts->len; j++)
+		{
+			other = g_ptr_array_index(term->parts, j);
+			if (criteria_compares(other, exists->key))
+				break;
+		}
+		if (j == term->parts->len)
+			continue;
+
+		if (term->type == mafw_f_and)
+		{
+			g_ptr_array_remove_index(term->parts, i);
+			criteria_term_free(exists);
+			i--;
+			continue;
+		}
+
+		for (j = 0; j < term->parts->len; )
+		{
+			other = g_ptr_array_index(term->parts, j);
+			if (!criteria_compares(other, exists->key))
+			{
+				j++;
+				continue;
+			}
+			g_ptr_array_remove_index(term->parts, j);
+			criteria_term_free(other);
+			if (j < i)
+				i--;
+		}
+	}
+}
+
+/* How early @term should be evaluated in an and: exact matches narrow the
+   result most, negations the least.  Among terms alike, those on properties
+   the server sorts by go first, as it keeps those indexed. */
+static guint criteria_rank(const CriteriaTerm *term,
+			   const ServerProfile *profile)
+{
+	guint rank;
+
+	if (term->parts != NULL)
+		return CRITERIA_RANK_COMPLEX;
+
+	switch (term->type)
+	{
+	case mafw_f_eq:
+		rank = term->negate ? 8 : 0;
+		break;
+	case mafw_f_lt:
+	case mafw_f_gt:
+		rank = 2;
+		break;
+	case mafw_f_approx:
+		rank = term->negate ? 8 : 4;
+		break;
+	default:
+		rank = term->negate ? 8 : 6;
+		break;
+	}
+
+	if (profile != NULL &&
+	    !server_profile_can_sort(profile,
+				     util_mafwkey_to_upnp_filter(term->key)))
+		rank++;
+
+	return rank;
+}
+
+/* Stable counting sort of the operands of @term by criteria_rank(). */
+static void criteria_reorder(CriteriaTerm *term, const ServerProfile *profile)
+{
+	guint starts[CRITERIA_RANKS + 1];
+	guint *ranks, rank;
+	gpointer *sorted;
+	guint i;
+
+	memset(starts, 0, sizeof(starts));
+	ranks = g_new(guint, term->parts->len);
+	for (i = 0; i < term->parts->len; i++)
+	{
+		ranks[i] = criteria_rank(g_ptr_array_index(term->parts, i),
+					 profile);
+		starts[ranks[i] + 1]++;
+	}
+	for (rank = 1; rank <= CRITERIA_RANKS; rank++)
+		starts[rank] += starts[rank - 1];
+
+	sorted = g_new(gpointer, term->parts->len);
+	for (i = 0; i < term->parts->len; i++)
+		sorted[starts[ranks[i]]++] = term->parts->pdata[i];
+	memcpy(term->parts->pdata, sorted,
+	       term->parts->len * sizeof(gpointer));
+	g_free(sorted);
+	g_free(ranks);
+}
+
+/* Simplifies the operator @term, whose operands are simplified already.
+   Returns what takes its place. */
+static CriteriaTerm *criteria_simplify_term(CriteriaTerm *term,
+					    const ServerProfile *profile)
+{
+	CriteriaTerm *part, *result;
+	GHashTable *seen;
+	GPtrArray *parts;
+	guint i, j, n;
+
+	/* Pull up the operands of those with the same operator:
+	   (a and b) and c is a and b and c. */
+	n = 0;
+	for (i = 0; i < term->parts->len; i++)
+	{
+		part = g_ptr_array_index(term->parts, i);
+		n += part->type == term->type ? part->parts->len : 1;
+	}
+	seen = n > CRITERIA_DEDUP_LINEAR
+		? g_hash_table_new(criteria_term_hash, criteria_term_equal)
+		: NULL;
+
+	parts = g_ptr_array_sized_new(n);
+	for (i = 0; i < term->parts->len; i++)
+	{
+		part = g_ptr_array_index(term->parts, i);
+		if (part->type != term->type)
+		{
+			criteria_add(parts, seen, part);
+			continue;
+		}
+
+		for (j = 0; j < part->parts->len; j++)
+			criteria_add(parts, seen,
+				     g_ptr_array_index(part->parts, j));
+		g_ptr_array_set_size(part->parts, 0);
+		criteria_term_free(part);
+	}
+	if (seen != NULL)
+		g_hash_table_destroy(seen);
+	g_ptr_array_free(term->parts, TRUE);
+	term->parts = parts;
+
+	criteria_absorb(term);
+	if (term->type == mafw_f_and)
+		criteria_reorder(term, profile);
+
+	/* Duplicates may leave a single operand */
+	if (term->parts->len > 1)
+	{
+		criteria_hash_complex(term);
+		return term;
+	}
+
+	result = g_ptr_array_index(term->parts, 0);
+	g_ptr_array_set_size(term->parts, 0);
+	criteria_term_free(term);
+
+	return result;
+}
+
+static CriteriaTerm *criteria_simplify(CriteriaTerm *root,
+				       const ServerProfile *profile)
+{
+	CriteriaTerm *term;
+	CriteriaSlot slot;
+	GArray *order;
+	guint i, j;
+
+	if (root->parts == NULL)
+		return root;
+
+	/* Every operator before those among its operands... */
+	order = g_array_new(FALSE, FALSE, sizeof(CriteriaSlot));
+	slot.term = root;
+	slot.owner = NULL;
+	slot.index = 0;
+	g_array_append_val(order, slot);
+	for (i = 0; i < order->len; i++)
+	{
+		term = g_array_index(order, CriteriaSlot, i).term;
+		for (j = 0; j < term->parts->len; j++)
+		{
+			slot.term = g_ptr_array_index(term->parts, j);
+			if (slot.term->parts == NULL)
+				continue;
+			slot.owner = term->parts;
+			slot.index = j;
+			g_array_append_val(order, slot);
+		}
+	}
+
+	/* ...so that backwards the operands come first */
+	for (i = order->len; i-- > 0; )
+	{
+		slot = g_array_index(order, CriteriaSlot, i);
+		term = criteria_simplify_term(slot.term, profile);
+		if (slot.owner != NULL)
+			slot.owner->pdata[slot.index] = term;
+		else
+			root = term;
+	}
+	g_array_free(order, TRUE);
+
+	return root;
+}
+
+/**
+ * criteria_optimize:
+ * @filter:  A MAFW filter
+ * @profile: Profile of the server to search, may be %NULL
+ *
+ * Rewrites @filter into the shortest equivalent search criteria it can:
+ * negations are pushed down to the simple terms, nested ands and ors are
+ * flattened, duplicate and implied terms are dropped, "~*" becomes an
+ * existence test, and the operands of ands are ordered the most selective,
+ * indexed properties first for servers that evaluate them in order.
+ *
+ * The terms borrow the keys and values of @filter, which must outlive them.
+ *
+ * Returns: The optimised term, to be freed with criteria_term_free().
+ */
+CriteriaTerm *criteria_optimize(const MafwFilter *filter,
+				const ServerProfile *profile)
+{
+	g_return_val_if_fail(filter != NULL, NULL);
+
+	return criteria_simplify(criteria_build(filter), profile);
+}
+
+/*----------------------------------------------------------------------------
+  Search criteria translation
+  ----------------------------------------------------------------------------*/
+
+static const gchar *criteria_operator(MafwFilterType type, gboolean negate)
+{
+	switch (type)
+	{
+	case mafw_f_eq:
+		return negate ? " != " : " = ";
+	case mafw_f_lt:
+		return negate ? " >= " : " < ";
+	case mafw_f_gt:
+		return negate ? " <= " : " > ";
+	case mafw_f_approx:
+		return negate ? " doesNotContain " : " contains ";
+	case mafw_f_exists:
+		return negate ? " exists false" : " exists true";
+	default:
+		g_assert_not_reached();
+		return NULL;
+	}
+}
+
+/* Writes the MAFW-quoted @value as a UPnP string.  The runs of characters
+   needing no care are copied as they are. */
+static gboolean criteria_write_value(GString *upsc, const gchar *value,
+				     gboolean approx, GError **error)
+{
+	const gchar *str;
+	gsize run;
+	gchar c;
+
+	g_string_append_c(upsc, '"');
+	str = value;
+	while (*str != '\0')
+	{
+		run = strcspn(str, "\\*\"");
+		if (run > 0)
+		{
+			g_string_append_len(upsc, str, run);
+			str += run;
+			continue;
+		}
+
+		/* UPnP can search for a substring, but not for multiple
+		   substrings like "alpha*beta" in a property value, so
+		   only leading and trailing wildcards can go. */
+		if (approx && *str == '*')
+		{
+			if (str == value || str[1] == '\0')
+			{
+				str++;
+				continue;
+			}
+			g_set_error(error, MAFW_SOURCE_ERROR,
+				    MAFW_SOURCE_ERROR_INVALID_SEARCH_STRING,
+				    "Wildcards in the middle of approximated "
+				    "property values are not supported");
+			return FALSE;
+		}
+
+		/* mafw_filter_unquote_char() only returns NULL if @value
+		   is syntactically incorrect. */
+		str = mafw_filter_unquote_char(str, &c);
+		if (str == NULL)
+		{
+			g_set_error(error, MAFW_SOURCE_ERROR,
+				    MAFW_SOURCE_ERROR_INVALID_SEARCH_STRING,
+				    "Invalid escape sequence");
+			return FALSE;
+		}
+
+		/* We can't do anything about NILs for they are interpreted
+		   as terminators by gupnp and there is no way to quote
+		   them. */
+		if (c == '\0')
+		{
+			g_set_error(error, MAFW_SOURCE_ERROR,
+				    MAFW_SOURCE_ERROR_INVALID_SEARCH_STRING,
+				    "NIL in property value");
+			return FALSE;
+		}
+
+		if (c == '\\' || c == '"')
+			g_string_append_c(upsc, '\\');
+		g_string_append_c(upsc, c);
+	}
+	g_string_append_c(upsc, '"');
+
+	return TRUE;
+}
+
+static gboolean criteria_write_simple(GString *upsc, const CriteriaTerm *term,
+				      GError **error)
+{
+	const gchar *didl_key;
+	MafwFilterType type;
+
+	didl_key = util_mafwkey_to_upnp_filter(term->key);
+	type = term->type;
+
+	/* Since protocolInfo contains sub-strings like MIME type and
+	   protocol, we must change the exact match to approximate match.
+	   UPnP doesn't seem to support wildcards in protocolInfo fields
+	   during searching. */
+	if (type == mafw_f_eq &&
+	    strcmp(didl_key, DIDL_RES "@" DIDL_RES_PROTOCOL_INFO) == 0)
+		type = mafw_f_approx;
+
+	g_string_append(upsc, didl_key);
+	g_string_append(upsc, criteria_operator(type, term->negate));
+	if (type == mafw_f_exists)
+		return TRUE;
+
+	g_assert(term->value != NULL);
+	return criteria_write_value(upsc, term->value,
+				    type == mafw_f_approx, error);
+}
+
+/**
+ * criteria_to_string:
+ * @term:  An optimised term
+ * @error: Return location for a #GError, or %NULL
+ *
+ * Writes @term as UPnP search criteria, every operand of an and or an or
+ * in parentheses.  There is no NOT operator in UPnP, criteria_optimize()
+ * has pushed the negations down to the simple terms of @term.
+ *
+ * Returns: The search criteria, or %NULL if a value cannot be searched
+ * for.
+ */
+gchar *criteria_to_string(const CriteriaTerm *term, GError **error)
+{
+	CriteriaCursor cursor, *top;
+	GString *upsc;
+	GArray *stack;
+	gboolean ok;
+
+	g_return_val_if_fail(term != NULL, NULL);
+
+	ok = TRUE;
+	upsc = g_string_new(NULL);
+	stack = g_array_new(FALSE, FALSE, sizeof(CriteriaCursor));
+	cursor.term = term;
+	cursor.next = 0;
+	g_array_append_val(stack, cursor);
+	while (ok && stack->len > 0)
+	{
+		top = &g_array_index(stack, CriteriaCursor, stack->len - 1);
+		term = top->term;
+		if (term->parts == NULL)
+		{
+			ok = criteria_write_simple(upsc, term, error);
+			g_array_set_size(stack, stack->len - 1);
+			continue;
+		}
+
+		if (top->next == term->parts->len)
+		{
+			g_array_set_size(stack, stack->len - 1);
+			if (stack->len > 0)
+				g_string_append_c(upsc, ')');
+			continue;
+		}
+
+		if (top->next > 0)
+			g_string_append(upsc, term->type == mafw_f_and
+					? " and " : " or ");
+		g_string_append_c(upsc, '(');
+
+		cursor.term = g_ptr_array_index(term->parts, top->next++);
+		cursor.next = 0;
+		if (cursor.term->parts == NULL)
+		{
+			ok = criteria_write_simple(upsc, cursor.term, error);
+			g_string_append_c(upsc, ')');
+		}
+		else
+			g_array_append_val(stack, cursor);
+	}
+	g_array_free(stack, TRUE);
+
+	return g_string_free(upsc, !ok);
+}
+
+/**
+ * criteria_translate:
+ * @filter:  A MAFW filter
+ * @profile: Profile of the server to search, may be %NULL
+ * @error:   Return location for a #GError, or %NULL
+ *
+ * Converts @filter to UPnP search criteria optimised for @profile by
+ * criteria_optimize().
+ *
+ * Returns: The search criteria, or %NULL if a value cannot be searched
+ * for.
+ */
+gchar *criteria_translate(const MafwFilter *filter,
+			  const ServerProfile *profile, GError **error)
+{
+	CriteriaTerm *term;
+	gchar *criteria;
+
+	g_return_val_if_fail(filter != NULL, NULL);
+
+	term = criteria_optimize(filter, profile);
+	criteria = criteria_to_string(term, error);
+	criteria_term_free(term);
+
+	return criteria;
+}
+
+/*----------------------------------------------------------------------------
+  Search criteria cache
+  ----------------------------------------------------------------------------*/
+
+/* Translations of the filters used lately.  Clients tend to browse with
+   the same few filters over and over, some generated and big, and the
+   filter is only walked through once to look it up. */
+struct _CriteriaCache {
+	/* Fingerprint -> CriteriaEntry */
+	GHashTable *entries;
+
+	/* CriteriaEntries, the latest used first */
+	GQueue lru;
+};
+
+typedef struct {
+	gchar *fingerprint;
+	gchar *criteria;
+	GList *link;
+} CriteriaEntry;
+
+/* What tells @filter apart from every other filter: its nodes in
+   pre-order, operators with the number of their operands, simple filters
+   with their key and value, each prefixed with its length. */
+static gchar *criteria_fingerprint(const MafwFilter *filter)
+{
+	GPtrArray *stack;
+	GString *str;
+	guint n;
+
+	str = g_string_sized_new(64);
+	stack = g_ptr_array_new();
+	g_ptr_array_add(stack, (gpointer)filter);
+	while (stack->len > 0)
+	{
+		filter = g_ptr_array_remove_index(stack, stack->len - 1);
+		if (MAFW_FILTER_IS_SIMPLE(filter))
+		{
+			g_string_append_printf(str, "%d:%u:", filter->type,
+					       (guint)strlen(filter->key));
+			g_string_append(str, filter->key);
+			if (filter->value == NULL)
+			{
+				g_string_append_c(str, '-');
+				continue;
+			}
+			g_string_append_printf(str, "%u:",
+					       (guint)strlen(filter->value));
+			g_string_append(str, filter->value);
+			continue;
+		}
+
+		for (n = 0; filter->parts[n] != NULL; n++)
+			;
+		g_string_append_printf(str, "%d/%u", filter->type, n);
+		while (n-- > 0)
+			g_ptr_array_add(stack, filter->parts[n]);
+	}
+	g_ptr_array_free(stack, TRUE);
+
+	return g_string_free(str, FALSE);
+}
+
+static void criteria_entry_free(CriteriaEntry *entry)
+{
+	g_list_free_1(entry->link);
+	g_free(entry->fingerprint);
+	g_free(entry->criteria);
+	g_free(entry);
+}
+
+/**
+ * criteria_cache_new:
+ *
+ * Returns: An empty cache of at most %CRITERIA_CACHE_SIZE translations.
+ */
+CriteriaCache *criteria_cache_new(void)
+{
+	CriteriaCache *cache;
+
+	cache = g_new0(CriteriaCache, 1);
+	cache->entries = g_hash_table_new(g_str_hash, g_str_equal);
+	g_queue_init(&cache->lru);
+
+	return cache;
+}
+
+/**
+ * criteria_cache_clear:
+ * @cache: A #CriteriaCache
+ *
+ * Forgets every translation, like when the profile they were optimised
+ * for changes.
+ */
+void criteria_cache_clear(CriteriaCache *cache)
+{
+	GList *link;
+
+	while ((link = g_queue_pop_head_link(&cache->lru)) != NULL)
+		criteria_entry_free(link->data);
+	g_hash_table_remove_all(cache->entries);
+}
+
+/**
+ * criteria_cache_free:
+ * @cache: A #CriteriaCache, may be %NULL
+ *
+ * Frees @cache and its translations.
+ */
+void criteria_cache_free(CriteriaCache *cache)
+{
+	if (cache == NULL)
+		return;
+
+	criteria_cache_clear(cache);
+	g_hash_table_destroy(cache->entries);
+	g_free(cache);
+}
+
+/**
+ * criteria_cache_translate:
+ * @cache:   A #CriteriaCache
+ * @filter:  A MAFW filter
+ * @profile: Profile of the server to search, may be %NULL
+ * @error:   Return location for a #GError, or %NULL
+ *
+ * Like criteria_translate(), but remembers the translation of @filter and
+ * answers from there when a filter alike comes again.  The cache has to be
+ * cleared whenever @profile learns what the server sorts by.
+ *
+ * Returns: The search criteria, to be freed with g_free(), or %NULL if a
+ * value cannot be searched for.
+ */
+gchar *criteria_cache_translate(CriteriaCache *cache,
+				const MafwFilter *filter,
+				const ServerProfile *profile, GError **error)
+{
+	CriteriaEntry *entry;
+	gchar *fingerprint, *criteria;
+	GList *link;
+
+	g_return_val_if_fail(cache != NULL && filter != NULL, NULL);
+
+	fingerprint = criteria_fingerprint(filter);
+	entry = g_hash_table_lookup(cache->entries, fingerprint);
+	if (entry != NULL)
+	{
+		g_free(fingerprint);
+		g_queue_unlink(&cache->lru, entry->link);
+		g_queue_push_head_link(&cache->lru, entry->link);
+		return g_strdup(entry->criteria);
+	}
+
+	/* Filters that cannot be searched by are rare, not remembered */
+	criteria = criteria_translate(filter, profile, error);
+	if (criteria == NULL)
+	{
+		g_free(fingerprint);
+		return NULL;
+	}
+
+	if (g_queue_get_length(&cache->lru) == CRITERIA_CACHE_SIZE)
+	{
+		link = g_queue_pop_tail_link(&cache->lru);
+		entry = link->data;
+		g_hash_table_remove(cache->entries, entry->fingerprint);
+		criteria_entry_free(entry);
+	}
+
+	entry = g_new0(CriteriaEntry, 1);
+	entry->fingerprint = fingerprint;
+	entry->criteria = g_strdup(criteria);
+	entry->link = g_list_alloc();
+	entry->link->data = entry;
+	g_queue_push_head_link(&cache->lru, entry->link);
+	g_hash_table_insert(cache->entries, entry->fingerprint, entry);
+
+	return criteria;
+}
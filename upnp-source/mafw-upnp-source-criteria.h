@@ -0,0 +1,82 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef MAFW_UPNP_SOURCE_CRITERIA_H
+#define MAFW_UPNP_SOURCE_CRITERIA_H
+
+#include <glib.h>
+#include <libmafw/mafw.h>
+
+#include "mafw-upnp-source-profile.h"
+
+/*----------------------------------------------------------------------------
+  Search criteria optimisation
+  ----------------------------------------------------------------------------*/
+
+typedef struct _CriteriaTerm CriteriaTerm;
+
+/* A MafwFilter in the shape UPnP search criteria are written in: there is
+   no NOT, negations are pushed down into the simple terms. */
+struct _CriteriaTerm {
+	/* mafw_f_and, mafw_f_or or one of the simple types */
+	MafwFilterType type;
+
+	/* Simple terms: negated, the key and the quoted value, borrowed
+	   from the filter the term was made of */
+	gboolean negate;
+	const gchar *key;
+	const gchar *value;
+
+	/* mafw_f_and and mafw_f_or: at least two CriteriaTerms */
+	GPtrArray *parts;
+
+	/* Of the whole term, equal terms hash alike */
+	guint hash;
+};
+
+CriteriaTerm *criteria_optimize(const MafwFilter *filter,
+				const ServerProfile *profile);
+void criteria_term_free(CriteriaTerm *term);
+
+/*----------------------------------------------------------------------------
+  Search criteria translation
+  ----------------------------------------------------------------------------*/
+
+/* Translations a CriteriaCache remembers */
+#define CRITERIA_CACHE_SIZE 32
+
+typedef struct _CriteriaCache CriteriaCache;
+
+gchar *criteria_to_string(const CriteriaTerm *term, GError **error);
+gchar *criteria_translate(const MafwFilter *filter,
+			  const ServerProfile *profile, GError **error);
+
+CriteriaCache *criteria_cache_new(void);
+void criteria_cache_free(CriteriaCache *cache);
+void criteria_cache_clear(CriteriaCache *cache);
+gchar *criteria_cache_translate(CriteriaCache *cache,
+				const MafwFilter *filter,
+				const ServerProfile *profile, GError **error);
+
+#endif
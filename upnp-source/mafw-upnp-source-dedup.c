@@ -0,0 +1,223 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <glib.h>
+#include <glib-object.h>
+#include <string.h>
+#include <libmafw/mafw.h>
+
+#include "mafw-upnp-source-dedup.h"
+
+/*----------------------------------------------------------------------------
+  Cross-server duplicates
+  ----------------------------------------------------------------------------*/
+
+/* The same track on several servers: items of equal fingerprints, by the
+   object IDs they have on each server.  Every object ID maps to the array
+   of all the object IDs of its fingerprint, shared among them. */
+struct _DedupIndex {
+	/* Fingerprint -> GPtrArray of object IDs */
+	GHashTable *fingerprints;
+
+	/* Object ID -> the GPtrArray of its fingerprint */
+	GHashTable *objectids;
+
+	/* The fingerprints, the oldest first */
+	GQueue order;
+};
+
+/* The metadata a copy of a track has alike on every server */
+static const gchar *const dedup_keys[] = {
+	MAFW_METADATA_KEY_TITLE,
+	MAFW_METADATA_KEY_ARTIST,
+	MAFW_METADATA_KEY_ALBUM,
+	MAFW_METADATA_KEY_DURATION,
+	MAFW_METADATA_KEY_FILESIZE,
+	NULL
+};
+
+/**
+ * dedup_get_keys:
+ *
+ * Returns: The metadata keys dedup_fingerprint() looks at.
+ */
+const gchar *const *dedup_get_keys(void)
+{
+	return dedup_keys;
+}
+
+/**
+ * dedup_fingerprint:
+ * @metadata: Metadata of an item
+ *
+ * Strings are compared regardless of case and of the way they are
+ * composed, the key separated from the next by a unit separator.
+ *
+ * Returns: The fingerprint of the item, or %NULL if it has no title to
+ * tell it by.
+ */
+gchar *dedup_fingerprint(GHashTable *metadata)
+{
+	const gchar *const *key;
+	const GValue *value;
+	GString *fingerprint;
+	gchar *str, *folded;
+
+	g_return_val_if_fail(metadata != NULL, NULL);
+
+	if (mafw_metadata_first(metadata, MAFW_METADATA_KEY_TITLE) == NULL)
+		return NULL;
+
+	fingerprint = g_string_new(NULL);
+	for (key = dedup_keys; *key != NULL; key++)
+	{
+		if (key != dedup_keys)
+			g_string_append_c(fingerprint, '\x1f');
+
+		value = mafw_metadata_first(metadata, *key);
+		if (value == NULL)
+			continue;
+
+		if (!G_VALUE_HOLDS_STRING(value))
+		{
+			str = g_strdup_value_contents(value);
+			g_string_append(fingerprint, str);
+			g_free(str);
+			continue;
+		}
+
+		if (g_value_get_string(value) == NULL)
+			continue;
+		str = g_utf8_normalize(g_value_get_string(value), -1,
+				       G_NORMALIZE_ALL);
+		if (str == NULL)
+			continue;
+		folded = g_utf8_casefold(str, -1);
+		g_string_append(fingerprint, folded);
+		g_free(folded);
+		g_free(str);
+	}
+
+	return g_string_free(fingerprint, FALSE);
+}
+
+static void dedup_objectids_free(GPtrArray *objectids)
+{
+	g_ptr_array_foreach(objectids, (GFunc)g_free, NULL);
+	g_ptr_array_free(objectids, TRUE);
+}
+
+DedupIndex *dedup_index_new(void)
+{
+	DedupIndex *index;
+
+	index = g_new0(DedupIndex, 1);
+	index->fingerprints = g_hash_table_new_full(
+		g_str_hash, g_str_equal, g_free,
+		(GDestroyNotify)dedup_objectids_free);
+	index->objectids = g_hash_table_new(g_str_hash, g_str_equal);
+	g_queue_init(&index->order);
+
+	return index;
+}
+
+void dedup_index_free(DedupIndex *index)
+{
+	if (index == NULL)
+		return;
+
+	g_queue_clear(&index->order);
+	g_hash_table_destroy(index->objectids);
+	g_hash_table_destroy(index->fingerprints);
+	g_free(index);
+}
+
+/* Forgets the copies of the track remembered first. */
+static void dedup_index_evict(DedupIndex *index)
+{
+	GPtrArray *objectids;
+	gchar *fingerprint;
+	guint i;
+
+	fingerprint = g_queue_pop_head(&index->order);
+	objectids = g_hash_table_lookup(index->fingerprints, fingerprint);
+	for (i = 0; i < objectids->len; i++)
+		g_hash_table_remove(index->objectids,
+				    g_ptr_array_index(objectids, i));
+	g_hash_table_remove(index->fingerprints, fingerprint);
+}
+
+/**
+ * dedup_index_add:
+ * @index:       A #DedupIndex
+ * @fingerprint: dedup_fingerprint() of the item
+ * @objectid:    Object ID of the item
+ *
+ * Remembers @objectid as a copy of the track of @fingerprint.
+ */
+void dedup_index_add(DedupIndex *index, const gchar *fingerprint,
+		     const gchar *objectid)
+{
+	GPtrArray *objectids;
+	gchar *copy;
+
+	g_return_if_fail(index != NULL);
+	g_return_if_fail(fingerprint != NULL && objectid != NULL);
+
+	if (g_hash_table_lookup(index->objectids, objectid) != NULL)
+		return;
+
+	while (g_hash_table_size(index->objectids) >= DEDUP_MAX_ITEMS)
+		dedup_index_evict(index);
+
+	objectids = g_hash_table_lookup(index->fingerprints, fingerprint);
+	if (objectids == NULL)
+	{
+		objectids = g_ptr_array_new();
+		copy = g_strdup(fingerprint);
+		g_hash_table_insert(index->fingerprints, copy, objectids);
+		g_queue_push_tail(&index->order, copy);
+	}
+
+	/* The key of @objectids is owned by the array */
+	copy = g_strdup(objectid);
+	g_ptr_array_add(objectids, copy);
+	g_hash_table_insert(index->objectids, copy, objectids);
+}
+
+/**
+ * dedup_index_lookup:
+ * @index:    A #DedupIndex
+ * @objectid: Object ID of an item
+ *
+ * Returns: The object IDs of every copy of the item known, @objectid
+ * among them, or %NULL if the item is not known.  The array belongs to
+ * @index and is valid until it is changed.
+ */
+GPtrArray *dedup_index_lookup(DedupIndex *index, const gchar *objectid)
+{
+	g_return_val_if_fail(index != NULL && objectid != NULL, NULL);
+
+	return g_hash_table_lookup(index->objectids, objectid);
+}
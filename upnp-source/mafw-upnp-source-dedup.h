@@ -0,0 +1,49 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef MAFW_UPNP_SOURCE_DEDUP_H
+#define MAFW_UPNP_SOURCE_DEDUP_H
+
+#include <glib.h>
+
+/*----------------------------------------------------------------------------
+  Cross-server duplicates
+  ----------------------------------------------------------------------------*/
+
+/* Object IDs remembered at most, the oldest tracks are forgotten beyond */
+#define DEDUP_MAX_ITEMS 65536
+
+typedef struct _DedupIndex DedupIndex;
+
+const gchar *const *dedup_get_keys(void);
+gchar *dedup_fingerprint(GHashTable *metadata);
+
+DedupIndex *dedup_index_new(void);
+void dedup_index_free(DedupIndex *index);
+
+void dedup_index_add(DedupIndex *index, const gchar *fingerprint,
+		     const gchar *objectid);
+GPtrArray *dedup_index_lookup(DedupIndex *index, const gchar *objectid);
+
+#endif
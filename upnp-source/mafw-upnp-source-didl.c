@@ -23,6 +23,7 @@
  */
 
 #include <glib.h>
+#include <errno.h>
 #include <string.h>
 #include <libmafw/mafw.h>
 #include <libgupnp/gupnp.h>
@@ -31,6 +32,224 @@
 #include "mafw-upnp-source-didl.h"
 #include "mafw-upnp-source-util.h"
 
+/*----------------------------------------------------------------------------
+  Parse caches
+  ----------------------------------------------------------------------------*/
+
+/* A server uses only a handful of distinct protocolInfo and upnp:class
+   strings, so both are parsed once and looked up from these tables.  The
+   tables are flushed by didl_parse_cache_trim() if a misbehaving server
+   makes them grow beyond DIDL_PARSE_CACHE_MAX entries. */
+#define DIDL_PARSE_CACHE_MAX 256
+
+static GHashTable *protocol_info_cache;
+static GHashTable *class_cache;
+
+static void didl_protocol_info_free(DidlProtocolInfo *info)
+{
+	g_free(info->raw);
+	g_free(info->protocol);
+	g_free(info->network);
+	g_free(info->mime_type);
+	g_free(info->additional_info);
+	g_free(info->dlna_profile);
+	g_free(info);
+}
+
+static DidlMediaClass didl_mime_to_media_class(const gchar *mime)
+{
+	if (g_str_has_prefix(mime, "audio"))
+		return DIDL_MEDIA_AUDIO;
+	else if (g_str_has_prefix(mime, "video"))
+		return DIDL_MEDIA_VIDEO;
+	else if (g_str_has_prefix(mime, "image"))
+		return DIDL_MEDIA_IMAGE;
+	else
+		return DIDL_MEDIA_OTHER;
+}
+
+static void didl_parse_dlna_fields(DidlProtocolInfo *info)
+{
+	gchar **fields;
+	gint i;
+
+	/* The 4th field: "DLNA.ORG_PN=MP3;DLNA.ORG_OP=01;..." */
+	fields = g_strsplit(info->additional_info, ";", 0);
+	for (i = 0; fields[i] != NULL; i++)
+	{
+		const gchar *field = fields[i];
+
+		if (!g_str_has_prefix(field, "DLNA."))
+			continue;
+		info->has_dlna = TRUE;
+
+		if (g_str_has_prefix(field, "DLNA.ORG_PN="))
+		{
+			g_free(info->dlna_profile);
+			info->dlna_profile = g_strdup(field +
+						      strlen("DLNA.ORG_PN="));
+		}
+		else if (g_str_has_prefix(field, "DLNA.ORG_OP="))
+		{
+			info->dlna_operation = (guint)g_ascii_strtoull(
+				field + strlen("DLNA.ORG_OP="), NULL, 16);
+		}
+		else if (g_str_has_prefix(field, "DLNA.ORG_FLAGS="))
+		{
+			gchar primary[9];
+
+			/* Only the first 8 of the 32 hex digits are used */
+			g_strlcpy(primary, field + strlen("DLNA.ORG_FLAGS="),
+				  sizeof(primary));
+			info->dlna_flags = (guint32)g_ascii_strtoull(primary,
+								     NULL, 16);
+		}
+	}
+	g_strfreev(fields);
+}
+
+static DidlProtocolInfo *didl_protocol_info_parse(const gchar *raw)
+{
+	DidlProtocolInfo *info;
+	gchar **fields;
+
+	info = g_new0(DidlProtocolInfo, 1);
+	info->raw = g_strdup(raw);
+
+	/* Split the protocol info field into 4 fields:
+	   0:protocol, 1:network, 2:mime-type and 3:additional info. */
+	fields = g_strsplit(raw, ":", 4);
+	if (g_strv_length(fields) == 4)
+	{
+		info->protocol = g_strdup(fields[0]);
+		info->network = g_strdup(fields[1]);
+		info->mime_type = g_strdup(fields[2]);
+		info->additional_info = g_strdup(fields[3]);
+
+		info->is_http = strcmp(info->protocol,
+				       DIDL_RES_PROTOCOL_INFO_HTTP) == 0;
+		info->media_class = didl_mime_to_media_class(info->mime_type);
+		didl_parse_dlna_fields(info);
+	}
+	g_strfreev(fields);
+
+	return info;
+}
+
+/**
+ * didl_protocol_info_lookup:
+ * @raw:	A protocolInfo string
+ *
+ * Looks up the pre-parsed form of @raw, parsing and caching it on the first
+ * occurrence.
+ *
+ * Returns: a cached record, valid until the next didl_parse_cache_trim().
+ */
+const DidlProtocolInfo *didl_protocol_info_lookup(const gchar *raw)
+{
+	DidlProtocolInfo *info;
+
+	g_return_val_if_fail(raw != NULL, NULL);
+
+	if (protocol_info_cache == NULL)
+		protocol_info_cache = g_hash_table_new_full(
+			g_str_hash, g_str_equal, NULL,
+			(GDestroyNotify)didl_protocol_info_free);
+
+	info = g_hash_table_lookup(protocol_info_cache, raw);
+	if (info == NULL)
+	{
+		info = didl_protocol_info_parse(raw);
+		g_hash_table_insert(protocol_info_cache, info->raw, info);
+	}
+
+	return info;
+}
+
+/**
+ * didl_resource_get_info:
+ * @res:	A DIDL-Lite resource
+ *
+ * Returns the pre-parsed protocolInfo of @res, without creating a
+ * #GUPnPProtocolInfo for it.
+ *
+ * Returns: a cached record or %NULL if @res has no protocolInfo.
+ */
+const DidlProtocolInfo *didl_resource_get_info(GUPnPDIDLLiteResource *res)
+{
+	xmlNode *node;
+	xmlAttr *attr;
+
+	node = gupnp_didl_lite_resource_get_xml_node(res);
+	if (node == NULL)
+		return NULL;
+
+	for (attr = node->properties; attr; attr = attr->next)
+	{
+		if (attr->name &&
+		    !strcmp((const char*)attr->name, DIDL_RES_PROTOCOL_INFO))
+			break;
+	}
+	if (!attr || !attr->children || !attr->children->content)
+		return NULL;
+
+	return didl_protocol_info_lookup((const gchar*)attr->children->content);
+}
+
+/**
+ * didl_class_lookup:
+ * @upnp_class:	An upnp:class string
+ *
+ * Returns: the media type of @upnp_class.
+ */
+DidlMediaClass didl_class_lookup(const gchar *upnp_class)
+{
+	gpointer cached;
+	DidlMediaClass media_class;
+
+	if (upnp_class == NULL)
+		return DIDL_MEDIA_OTHER;
+
+	if (class_cache == NULL)
+		class_cache = g_hash_table_new_full(g_str_hash, g_str_equal,
+						    g_free, NULL);
+
+	/* Stored +1 so that DIDL_MEDIA_OTHER is not confused with a miss */
+	cached = g_hash_table_lookup(class_cache, upnp_class);
+	if (cached != NULL)
+		return GPOINTER_TO_INT(cached) - 1;
+
+	if (strstr(upnp_class, DIDL_CLASS_AUDIO) != NULL)
+		media_class = DIDL_MEDIA_AUDIO;
+	else if (strstr(upnp_class, DIDL_CLASS_VIDEO) != NULL)
+		media_class = DIDL_MEDIA_VIDEO;
+	else if (strstr(upnp_class, DIDL_CLASS_IMAGE) != NULL)
+		media_class = DIDL_MEDIA_IMAGE;
+	else
+		media_class = DIDL_MEDIA_OTHER;
+
+	g_hash_table_insert(class_cache, g_strdup(upnp_class),
+			    GINT_TO_POINTER(media_class + 1));
+	return media_class;
+}
+
+/**
+ * didl_parse_cache_trim:
+ *
+ * Flushes the parse caches if they have grown too big.  Must be called only
+ * between items, because it invalidates the records returned by
+ * didl_protocol_info_lookup().
+ */
+void didl_parse_cache_trim(void)
+{
+	if (protocol_info_cache != NULL &&
+	    g_hash_table_size(protocol_info_cache) > DIDL_PARSE_CACHE_MAX)
+		g_hash_table_remove_all(protocol_info_cache);
+	if (class_cache != NULL &&
+	    g_hash_table_size(class_cache) > DIDL_PARSE_CACHE_MAX)
+		g_hash_table_remove_all(class_cache);
+}
+
 /*----------------------------------------------------------------------------
   Resource information extraction
   ----------------------------------------------------------------------------*/
@@ -47,12 +266,16 @@ GList *didl_get_supported_resources(GUPnPDIDLLiteObject *didlobject)
 {
 	GList *resources, *node, *prev;
 
+	/* A new item begins, records of the previous one are not used
+	   anymore. */
+	didl_parse_cache_trim();
+
 	resources = gupnp_didl_lite_object_get_resources(didlobject);
 
 	node = resources;
 	while (node)
 	{
-		const gchar *protocol = NULL;
+		const DidlProtocolInfo *info;
 
 		if (node->data == NULL)
 		{
@@ -62,11 +285,9 @@ GList *didl_get_supported_resources(GUPnPDIDLLiteObject *didlobject)
 			continue;
 		}
 
-		protocol = gupnp_protocol_info_get_protocol(
-				gupnp_didl_lite_resource_get_protocol_info(
-						(GUPnPDIDLLiteResource*)node->data));
-		if (protocol != NULL &&
-		    strcmp(protocol, DIDL_RES_PROTOCOL_INFO_HTTP) != 0)
+		info = didl_resource_get_info(
+				(GUPnPDIDLLiteResource*)node->data);
+		if (info != NULL && info->protocol != NULL && !info->is_http)
 		{
 			g_object_unref(node->data);
 			prev = node;
@@ -88,23 +309,24 @@ GList *didl_get_supported_resources(GUPnPDIDLLiteObject *didlobject)
  */
 gboolean didl_check_filetype(GUPnPDIDLLiteObject *didlobject, gboolean *is_supported)
 {
-	const gchar *class;
 	gboolean is_audio = TRUE;
 
-	class = gupnp_didl_lite_object_get_upnp_class(didlobject);
-	if (class && strstr(class, DIDL_CLASS_AUDIO) != NULL)
+	switch (didl_class_lookup(
+			gupnp_didl_lite_object_get_upnp_class(didlobject)))
 	{
+	case DIDL_MEDIA_AUDIO:
 		is_audio = TRUE;
 		*is_supported = TRUE;
-	}
-	else if (class && strstr(class, DIDL_CLASS_VIDEO) != NULL)
-	{
+		break;
+	case DIDL_MEDIA_VIDEO:
 		is_audio = FALSE;
 		*is_supported = TRUE;
-	}
-	else
+		break;
+	default:
 		*is_supported = FALSE;
-	
+		break;
+	}
+
 	return is_audio;
 }
 
@@ -123,8 +345,8 @@ void didl_get_http_res_uri(GHashTable *metadata, GList *resources,
 {
 	GList* node;
 	GUPnPDIDLLiteResource* res;
+	const DidlProtocolInfo *info;
 	const gchar *uri;
-	const gchar *mimetype;
 	gboolean uri_added = FALSE;
 
 	for (node = resources; node != NULL; node = node->next)
@@ -132,11 +354,10 @@ void didl_get_http_res_uri(GHashTable *metadata, GList *resources,
 		res = (GUPnPDIDLLiteResource*) node->data;
 
 		/* Get the first resource with http-get protocol */
-		mimetype = gupnp_protocol_info_get_mime_type(
-				gupnp_didl_lite_resource_get_protocol_info(res));
-		if (mimetype &&
-			((is_audio && g_str_has_prefix(mimetype, "audio")) || 
-				(!is_audio && g_str_has_prefix(mimetype, "video")))
+		info = didl_resource_get_info(res);
+		if (info && info->mime_type &&
+			((is_audio && info->media_class == DIDL_MEDIA_AUDIO) ||
+			 (!is_audio && info->media_class == DIDL_MEDIA_VIDEO))
 			)
 		{
 			uri = gupnp_didl_lite_resource_get_uri(res);
@@ -163,6 +384,7 @@ void didl_get_http_res_uri(GHashTable *metadata, GList *resources,
 /**
  * didl_get_mimetype:
  * @metadata:	Metadata hash-table to fill.
+ * @pool:	Pool sharing repeated MIME types, or %NULL
  * @properties:	Resource property list
  * @is_audio:	TRUE, if items are audio items
  * @is_container: TRUE, if item is a container
@@ -174,13 +396,15 @@ void didl_get_http_res_uri(GHashTable *metadata, GList *resources,
  * MAFW_METADATA_VALUE_MIME_VIDEO.
  *
  **/
-void didl_get_mimetype(GHashTable *metadata, gboolean is_container,
-			gboolean is_audio, GList* resources)
+void didl_get_mimetype(GHashTable *metadata, InternPool *pool,
+			gboolean is_container, gboolean is_audio,
+			GList* resources)
 {
-	const gchar *value;
+	const DidlProtocolInfo *info;
 
 	if (is_container)
-			mafw_metadata_add_str(metadata, MAFW_METADATA_KEY_MIME,
+			intern_pool_add_static_str(metadata,
+				MAFW_METADATA_KEY_MIME,
 				MAFW_METADATA_VALUE_MIME_CONTAINER);
 	else
 	{
@@ -188,23 +412,24 @@ void didl_get_mimetype(GHashTable *metadata, gboolean is_container,
 			return;
 		if (g_list_length(resources) == 1)
 		{
-			value = gupnp_protocol_info_get_mime_type(
-					gupnp_didl_lite_resource_get_protocol_info(
-					(GUPnPDIDLLiteResource*)resources->data));
-			mafw_metadata_add_str(metadata,
-				MAFW_METADATA_KEY_MIME, value);
+			info = didl_resource_get_info(
+					(GUPnPDIDLLiteResource*)resources->data);
+			if (info && info->mime_type)
+				intern_pool_add_str(pool, metadata,
+					MAFW_METADATA_KEY_MIME,
+					info->mime_type);
 		}
 		else
 		{/* Multiple resources */
 			if (is_audio)
 			{
-				mafw_metadata_add_str(metadata,
+				intern_pool_add_static_str(metadata,
 					MAFW_METADATA_KEY_MIME,
 					MAFW_METADATA_VALUE_MIME_AUDIO);
 			}
 			else
 			{
-				mafw_metadata_add_str(metadata,
+				intern_pool_add_static_str(metadata,
 					MAFW_METADATA_KEY_MIME,
 					MAFW_METADATA_VALUE_MIME_VIDEO);
 			}
@@ -212,6 +437,119 @@ void didl_get_mimetype(GHashTable *metadata, gboolean is_container,
 	}
 }
 
+/**
+ * didl_res_peek:
+ * @res:	A DIDL-Lite resource
+ * @attr:	Name of the attribute
+ *
+ * Returns: the value of the attribute @attr of @res, pointing directly to
+ * the parsed XML tree (must not be freed), or %NULL.
+ */
+const gchar *didl_res_peek(GUPnPDIDLLiteResource *res, const gchar *attr)
+{
+	xmlNode *node;
+	xmlAttr *prop;
+
+	if (res == NULL)
+		return NULL;
+
+	node = gupnp_didl_lite_resource_get_xml_node(res);
+	if (node == NULL)
+		return NULL;
+
+	for (prop = node->properties; prop; prop = prop->next)
+	{
+		if (!prop->name)
+			continue;
+		if (!strcmp(attr, (const char*)prop->name))
+			break;
+	}
+	if (!prop || !prop->children)
+		return NULL;
+
+	return (const gchar*)prop->children->content;
+}
+
+/**
+ * didl_peek_value:
+ * @didl_object: A DIDL-Lite object to search the key from
+ * @first_res:   The first supported resource of @didl_object or %NULL
+ * @mapped_key:  Local name of the property or resource attribute
+ * @copy:        Set to a string that must be freed by the caller, if the
+ *               value could not be returned without copying
+ *
+ * Finds the given property either from the object's properties or from the
+ * first http res property's attributes.  In the common case the value is
+ * returned directly from the XML tree, without copying.
+ *
+ * Returns: The value or %NULL.
+ */
+const gchar *didl_peek_value(GUPnPDIDLLiteObject *didl_object,
+			     GUPnPDIDLLiteResource *first_res,
+			     const gchar *mapped_key, gchar **copy)
+{
+	xmlNode *node;
+
+	*copy = NULL;
+
+	node = gupnp_didl_lite_object_get_xml_node(didl_object);
+	for (node = node ? node->children : NULL; node; node = node->next)
+	{
+		if (node->type != XML_ELEMENT_NODE || !node->name)
+			continue;
+		if (strcmp(mapped_key, (const char*)node->name) != 0)
+			continue;
+
+		/* A plain text element needs no copying */
+		if (node->children == NULL)
+			return "";
+		if (node->children->type == XML_TEXT_NODE &&
+		    node->children->next == NULL)
+			return (const gchar*)node->children->content;
+
+		*copy = (gchar*)xmlNodeGetContent(node);
+		return *copy;
+	}
+
+	return didl_res_peek(first_res, mapped_key);
+}
+
+/**
+ * didl_decode_fallback:
+ * @metadata:    Metadata hash-table to fill
+ * @pool:        Pool sharing repeated string values, or %NULL
+ * @didl_object: A DIDL-Lite object to search the key from
+ * @first_res:   The first supported resource of @didl_object or %NULL
+ * @id:          The metadata id to search for
+ *
+ * Looks up the metadata @id like didl_fallback() does, and adds it to
+ * @metadata with the type decoder of @id.
+ *
+ * Returns: %TRUE if @id has a mapping.
+ */
+gboolean didl_decode_fallback(GHashTable *metadata, InternPool *pool,
+			      GUPnPDIDLLiteObject *didl_object,
+			      GUPnPDIDLLiteResource *first_res, gint id)
+{
+	const gchar *mapped_key, *mafw_key, *text;
+	DidlValueDecoder decode;
+	gchar *copy;
+	gint type;
+
+	mapped_key = util_mafwkey_to_upnp_result(id, &type);
+	decode = util_get_decoder_from_id(id);
+	mafw_key = util_get_metadatakey_from_id(id);
+	if (!mapped_key || !decode || !mafw_key)
+		return FALSE;
+
+	text = didl_peek_value(didl_object, first_res, mapped_key, &copy);
+	if (text != NULL && text[0] != '\0')
+		decode(metadata, pool, mafw_key, text);
+	xmlFree(copy);
+
+	return TRUE;
+}
+
 /**
  * didl_fallback:
  * @didl_object: A DIDL-Lite object to search the key from
@@ -226,51 +564,379 @@ void didl_get_mimetype(GHashTable *metadata, gboolean is_container,
 gchar* didl_fallback(GUPnPDIDLLiteObject* didl_object,
 			GUPnPDIDLLiteResource* first_res, gint id, gint* type)
 {
-	GList* list;
-	gchar* val = NULL;
 	const gchar* mapped_key;
+	const gchar* text;
+	gchar* copy;
+	gchar* val;
 
 	mapped_key = util_mafwkey_to_upnp_result(id, type);
 	if (!mapped_key)
 		return NULL;
 
-	list = gupnp_didl_lite_object_get_properties(didl_object, mapped_key);
-	if (list != NULL)
+	text = didl_peek_value(didl_object, first_res, mapped_key, &copy);
+	val = g_strdup(text);
+	xmlFree(copy);
+
+	return val;
+}
+
+/*----------------------------------------------------------------------------
+  Typed value decoders
+  ----------------------------------------------------------------------------*/
+
+/* Parses an unsigned decimal number of at most @max_digits digits from *@p,
+   advancing *@p.  Returns -1 if there are no digits. */
+static glong parse_digits(const gchar **p, guint max_digits)
+{
+	glong value = -1;
+	guint n;
+
+	for (n = 0; n < max_digits && g_ascii_isdigit(**p); n++, (*p)++)
+		value = (value < 0 ? 0 : value * 10) + (**p - '0');
+
+	return value;
+}
+
+/**
+ * didl_parse_int:
+ * @text:  A decimal number with optional leading whitespace and sign
+ * @value: Set to the parsed value
+ *
+ * Parses the leading integer of @text like atoi() does, but fails if there
+ * is none.  Values are clamped to the range of #gint.
+ *
+ * Returns: %TRUE if a number was found.
+ */
+gboolean didl_parse_int(const gchar *text, gint *value)
+{
+	gboolean negative = FALSE;
+	gint64 number = 0;
+	const gchar *p;
+
+	if (text == NULL)
+		return FALSE;
+
+	for (p = text; g_ascii_isspace(*p); p++)
+		;
+	if (*p == '-' || *p == '+')
+		negative = *p++ == '-';
+	if (!g_ascii_isdigit(*p))
+		return FALSE;
+
+	for (; g_ascii_isdigit(*p); p++)
 	{
-		xmlChar *content = xmlNodeGetContent((xmlNode*) list->data);
+		number = number * 10 + (*p - '0');
+		if (number > G_MAXINT)
+			number = (gint64)G_MAXINT + 1;
+	}
+
+	if (negative)
+		number = -number;
+	*value = (gint)CLAMP(number, G_MININT, G_MAXINT);
+	return TRUE;
+}
+
+/**
+ * didl_parse_size:
+ * @text: A decimal byte count with optional leading whitespace
+ * @size: Set to the parsed value
+ *
+ * Parses the leading unsigned integer of @text into 64 bits, as sizes of
+ * files over 2 GB do not fit a #gint.
+ *
+ * Returns: %TRUE if a number was found and it fits 64 bits.
+ */
+gboolean didl_parse_size(const gchar *text, guint64 *size)
+{
+	const gchar *p;
+	gchar *end;
+
+	if (text == NULL)
+		return FALSE;
 
-		val = g_strdup((gchar*)content);
-		xmlFree(content);
+	for (p = text; g_ascii_isspace(*p); p++)
+		;
+	if (!g_ascii_isdigit(*p))
+		return FALSE;
 
-		g_list_free(list);
+	errno = 0;
+	*size = g_ascii_strtoull(p, &end, 10);
+	return errno != ERANGE;
+}
+
+/**
+ * didl_parse_float:
+ * @text:  A decimal number or a fraction like "30000/1001"
+ * @value: Set to the parsed value
+ *
+ * Returns: %TRUE if a number was found.
+ */
+gboolean didl_parse_float(const gchar *text, gfloat *value)
+{
+	gdouble number, denominator;
+	gchar *end;
+
+	if (text == NULL)
+		return FALSE;
+
+	number = g_ascii_strtod(text, &end);
+	if (end == text)
+		return FALSE;
+
+	if (*end == '/')
+	{
+		const gchar *den = end + 1;
+
+		denominator = g_ascii_strtod(den, &end);
+		if (end == den || denominator == 0)
+			return FALSE;
+		number /= denominator;
 	}
-	else
+
+	*value = (gfloat)number;
+	return TRUE;
+}
+
+/* Days since 1970-01-01 of a proleptic Gregorian calendar date. */
+static glong days_from_civil(glong y, glong m, glong d)
+{
+	glong era, yoe, doy, doe;
+
+	y -= m <= 2;
+	era = (y >= 0 ? y : y - 399) / 400;
+	yoe = y - era * 400;
+	doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+	return era * 146097 + doe - 719468;
+}
+
+/**
+ * didl_parse_date:
+ * @text:  An ISO 8601 date like dc:date, e.g. "2009-02-13T23:31:30+02:00"
+ * @epoch: Set to seconds since the Epoch
+ *
+ * Accepts "YYYY", "YYYY-MM", "YYYY-MM-DD", optionally followed by a time
+ * "Thh:mm[:ss[.fff]]" and a zone designator "Z" or "+hh[:]mm".  Times
+ * without a zone designator are taken as UTC.
+ *
+ * Returns: %TRUE if @text is a valid date.
+ */
+gboolean didl_parse_date(const gchar *text, glong *epoch)
+{
+	glong year, month = 1, day = 1, hour = 0, min = 0, sec = 0;
+	glong offset = 0;
+	const gchar *p = text;
+
+	if (text == NULL)
+		return FALSE;
+
+	year = parse_digits(&p, 4);
+	if (year < 0 || p - text != 4)
+		return FALSE;
+
+	if (*p == '-')
 	{
-		if (first_res != NULL)
+		p++;
+		month = parse_digits(&p, 2);
+		if (month < 1 || month > 12)
+			return FALSE;
+		if (*p == '-')
 		{
-			xmlNode *node = gupnp_didl_lite_resource_get_xml_node(
-						first_res);
-			xmlAttr *attr;
-			
-			
-			for (attr = node->properties; attr; attr = attr->next)
-			{
-				if (!attr->name)
-					continue;
-				if (!strcmp(mapped_key, (const char*)attr->name))
-					break;
-			}
-			if (attr)
-			{
-				xmlChar *cont;
+			p++;
+			day = parse_digits(&p, 2);
+			if (day < 1 || day > 31 ||
+			    !g_date_valid_dmy((GDateDay)day,
+					      (GDateMonth)month,
+					      (GDateYear)year))
+				return FALSE;
+		}
+	}
 
-				cont = xmlNodeGetContent(attr->children);
-				val = g_strdup((gchar*)cont);
-				xmlFree(cont);
-			}
+	if (*p == 'T' || *p == ' ')
+	{
+		p++;
+		hour = parse_digits(&p, 2);
+		if (hour < 0 || hour > 24 || *p++ != ':')
+			return FALSE;
+		min = parse_digits(&p, 2);
+		if (min < 0 || min > 59)
+			return FALSE;
+		if (*p == ':')
+		{
+			p++;
+			sec = parse_digits(&p, 2);
+			if (sec < 0 || sec > 60)
+				return FALSE;
+			if (*p == '.' || *p == ',')
+				for (p++; g_ascii_isdigit(*p); p++)
+					;
+		}
 
+		if (*p == 'Z')
+		{
+			p++;
+		}
+		else if (*p == '+' || *p == '-')
+		{
+			glong sign = *p++ == '-' ? -1 : 1;
+			glong oh, om = 0;
+
+			oh = parse_digits(&p, 2);
+			if (oh < 0)
+				return FALSE;
+			if (*p == ':')
+				p++;
+			if (g_ascii_isdigit(*p))
+				om = parse_digits(&p, 2);
+			offset = sign * (oh * 3600 + om * 60);
 		}
 	}
-	
-	return val;
+
+	if (*p != '\0' && !g_ascii_isspace(*p))
+		return FALSE;
+
+	*epoch = days_from_civil(year, month, day) * 86400 +
+		hour * 3600 + min * 60 + sec - offset;
+	return TRUE;
+}
+
+/**
+ * didl_parse_duration:
+ * @text:    A DIDL-Lite duration "H+:MM:SS[.F+|.F0/F1]"
+ * @seconds: Set to the duration in whole seconds
+ *
+ * Returns: %TRUE if @text is a valid, non-negative duration.
+ */
+gboolean didl_parse_duration(const gchar *text, gint *seconds)
+{
+	glong hours, mins, secs;
+	const gchar *p = text;
+
+	if (text == NULL)
+		return FALSE;
+
+	if (*p == '+')
+		p++;
+	hours = parse_digits(&p, 9);
+	if (hours < 0 || *p++ != ':')
+		return FALSE;
+	mins = parse_digits(&p, 2);
+	if (mins < 0 || mins > 59 || *p++ != ':')
+		return FALSE;
+	secs = parse_digits(&p, 2);
+	if (secs < 0 || secs > 59)
+		return FALSE;
+
+	/* Fractions of a second are ignored */
+	if (*p != '\0' && *p != '.')
+		return FALSE;
+
+	*seconds = (gint)MIN(hours * 3600 + mins * 60 + secs, G_MAXINT);
+	return TRUE;
+}
+
+/**
+ * didl_parse_resolution:
+ * @text: A resolution "WxH"
+ * @x:    Set to the width
+ * @y:    Set to the height
+ *
+ * Returns: %TRUE if @text is a valid resolution.
+ */
+gboolean didl_parse_resolution(const gchar *text, gint *x, gint *y)
+{
+	glong w, h;
+	const gchar *p = text;
+
+	if (text == NULL)
+		return FALSE;
+
+	w = parse_digits(&p, 9);
+	if (w <= 0 || (*p != 'x' && *p != 'X'))
+		return FALSE;
+	p++;
+	h = parse_digits(&p, 9);
+	if (h <= 0 || *p != '\0')
+		return FALSE;
+
+	*x = (gint)w;
+	*y = (gint)h;
+	return TRUE;
+}
+
+void didl_decode_string(GHashTable *metadata, InternPool *pool,
+			const gchar *key, const gchar *text)
+{
+	mafw_metadata_add_str(metadata, key, text);
+}
+
+void didl_decode_shared(GHashTable *metadata, InternPool *pool,
+			const gchar *key, const gchar *text)
+{
+	intern_pool_add_str(pool, metadata, key, text);
+}
+
+void didl_decode_int(GHashTable *metadata, InternPool *pool,
+		     const gchar *key, const gchar *text)
+{
+	gint number;
+
+	if (didl_parse_int(text, &number))
+		mafw_metadata_add_int(metadata, key, number);
+}
+
+/* Sizes are #gint, those beyond are left out rather than given wrong */
+void didl_decode_size(GHashTable *metadata, InternPool *pool,
+		      const gchar *key, const gchar *text)
+{
+	guint64 size;
+
+	if (didl_parse_size(text, &size) && size <= G_MAXINT)
+		mafw_metadata_add_int(metadata, key, (gint)size);
+}
+
+void didl_decode_float(GHashTable *metadata, InternPool *pool,
+		       const gchar *key, const gchar *text)
+{
+	gfloat number;
+
+	if (didl_parse_float(text, &number))
+		mafw_metadata_add_float(metadata, key, number);
+}
+
+void didl_decode_date(GHashTable *metadata, InternPool *pool,
+		      const gchar *key, const gchar *text)
+{
+	glong epoch;
+
+	if (didl_parse_date(text, &epoch))
+		mafw_metadata_add_long(metadata, key, epoch);
+}
+
+void didl_decode_duration(GHashTable *metadata, InternPool *pool,
+			  const gchar *key, const gchar *text)
+{
+	gint seconds;
+
+	if (didl_parse_duration(text, &seconds))
+		mafw_metadata_add_int(metadata, key, seconds);
+}
+
+void didl_decode_res_x(GHashTable *metadata, InternPool *pool,
+		       const gchar *key, const gchar *text)
+{
+	gint x, y;
+
+	if (didl_parse_resolution(text, &x, &y))
+		mafw_metadata_add_int(metadata, key, x);
+}
+
+void didl_decode_res_y(GHashTable *metadata, InternPool *pool,
+		       const gchar *key, const gchar *text)
+{
+	gint x, y;
+
+	if (didl_parse_resolution(text, &x, &y))
+		mafw_metadata_add_int(metadata, key, y);
 }
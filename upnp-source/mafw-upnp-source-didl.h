@@ -25,6 +25,8 @@
 #ifndef MAFW_UPNP_SOURCE_DIDL_H
 #define MAFW_UPNP_SOURCE_DIDL_H
 
+#include "mafw-upnp-source-intern.h"
+
 /*----------------------------------------------------------------------------
   DIDL-Lite identifiers
   ----------------------------------------------------------------------------*/
@@ -48,6 +50,54 @@
 
 #define DIDL_CLASS_AUDIO "object.item.audioItem"
 #define DIDL_CLASS_VIDEO "object.item.videoItem"
+#define DIDL_CLASS_IMAGE "object.item.imageItem"
+
+/*----------------------------------------------------------------------------
+  Parse caches
+  ----------------------------------------------------------------------------*/
+
+/** Media type of an upnp:class or a protocolInfo MIME type */
+typedef enum {
+	DIDL_MEDIA_OTHER = 0,
+	DIDL_MEDIA_AUDIO,
+	DIDL_MEDIA_VIDEO,
+	DIDL_MEDIA_IMAGE
+} DidlMediaClass;
+
+/** Pre-parsed protocolInfo, shared by all resources having the same string */
+typedef struct {
+	/** The raw protocolInfo string this record was parsed from */
+	gchar *raw;
+
+	/** The four protocolInfo fields, NULL if the string is malformed */
+	gchar *protocol;
+	gchar *network;
+	gchar *mime_type;
+	gchar *additional_info;
+
+	/** DLNA.ORG_PN, or NULL if not given */
+	gchar *dlna_profile;
+
+	/** DLNA.ORG_OP as #GUPnPDLNAOperation bits */
+	guint dlna_operation;
+
+	/** Primary DLNA.ORG_FLAGS (the first 8 hex digits) */
+	guint32 dlna_flags;
+
+	/** TRUE if the additional info contains any DLNA.ORG_* field */
+	gboolean has_dlna;
+
+	/** TRUE if the protocol is http-get */
+	gboolean is_http;
+
+	/** Media type guessed from the MIME type */
+	DidlMediaClass media_class;
+} DidlProtocolInfo;
+
+const DidlProtocolInfo *didl_protocol_info_lookup(const gchar *raw);
+const DidlProtocolInfo *didl_resource_get_info(GUPnPDIDLLiteResource *res);
+DidlMediaClass didl_class_lookup(const gchar *upnp_class);
+void didl_parse_cache_trim(void);
 
 /*----------------------------------------------------------------------------
   Resource information extraction
@@ -57,11 +107,55 @@ void didl_get_http_res_uri(GHashTable *metadata, GList *resources,
 				gboolean is_audio);
 gboolean didl_check_filetype(GUPnPDIDLLiteObject *didlobject, gboolean *is_supported);
 
-void didl_get_mimetype(GHashTable *metadata, gboolean is_container,
-			gboolean is_audio, GList* resources);
+void didl_get_mimetype(GHashTable *metadata, InternPool *pool,
+			gboolean is_container, gboolean is_audio,
+			GList* resources);
 
 gchar* didl_fallback(GUPnPDIDLLiteObject* didl_object,
 			GUPnPDIDLLiteResource* first_res, gint id, gint* type);
 
+const gchar *didl_res_peek(GUPnPDIDLLiteResource *res, const gchar *attr);
+const gchar *didl_peek_value(GUPnPDIDLLiteObject *didl_object,
+			     GUPnPDIDLLiteResource *first_res,
+			     const gchar *mapped_key, gchar **copy);
+gboolean didl_decode_fallback(GHashTable *metadata, InternPool *pool,
+			      GUPnPDIDLLiteObject *didl_object,
+			      GUPnPDIDLLiteResource *first_res, gint id);
+
+/*----------------------------------------------------------------------------
+  Typed value decoders
+  ----------------------------------------------------------------------------*/
+
+/* Decodes @text and adds it to @metadata under @key, if it is valid.
+   String values may be shared through @pool, which can be %NULL. */
+typedef void (*DidlValueDecoder)(GHashTable *metadata, InternPool *pool,
+				 const gchar *key, const gchar *text);
+
+gboolean didl_parse_int(const gchar *text, gint *value);
+gboolean didl_parse_size(const gchar *text, guint64 *size);
+gboolean didl_parse_float(const gchar *text, gfloat *value);
+gboolean didl_parse_date(const gchar *text, glong *epoch);
+gboolean didl_parse_duration(const gchar *text, gint *seconds);
+gboolean didl_parse_resolution(const gchar *text, gint *x, gint *y);
+
+void didl_decode_string(GHashTable *metadata, InternPool *pool,
+			const gchar *key, const gchar *text);
+void didl_decode_shared(GHashTable *metadata, InternPool *pool,
+			const gchar *key, const gchar *text);
+void didl_decode_int(GHashTable *metadata, InternPool *pool,
+		     const gchar *key, const gchar *text);
+void didl_decode_size(GHashTable *metadata, InternPool *pool,
+		      const gchar *key, const gchar *text);
+void didl_decode_float(GHashTable *metadata, InternPool *pool,
+		       const gchar *key, const gchar *text);
+void didl_decode_date(GHashTable *metadata, InternPool *pool,
+		      const gchar *key, const gchar *text);
+void didl_decode_duration(GHashTable *metadata, InternPool *pool,
+			  const gchar *key, const gchar *text);
+void didl_decode_res_x(GHashTable *metadata, InternPool *pool,
+		       const gchar *key, const gchar *text);
+void didl_decode_res_y(GHashTable *metadata, InternPool *pool,
+		       const gchar *key, const gchar *text);
+
 
 #endif /* MAFW_UPNP_SOURCE_DIDL_H */
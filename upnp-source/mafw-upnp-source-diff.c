@@ -0,0 +1,146 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <glib.h>
+#include <string.h>
+
+#include "mafw-upnp-source-diff.h"
+
+/*----------------------------------------------------------------------------
+  Container diffs
+  ----------------------------------------------------------------------------*/
+
+static gboolean container_diff_row_equal(const ColumnPage *a, guint row_a,
+					 const ColumnPage *b, guint row_b)
+{
+	const gchar *sa, *sb;
+	gint col;
+
+	if (column_page_get_duration(a, row_a) !=
+	    column_page_get_duration(b, row_b))
+		return FALSE;
+
+	for (col = COLUMN_PAGE_TITLE; col < COLUMN_PAGE_N_STRINGS; col++)
+	{
+		sa = column_page_get_string(a, row_a, col);
+		sb = column_page_get_string(b, row_b, col);
+		if (sa != sb &&
+		    (sa == NULL || sb == NULL || strcmp(sa, sb) != 0))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * container_diff_new:
+ * @old: Earlier snapshot of a container
+ * @cur: Current snapshot of the same container
+ *
+ * Matches the items of the snapshots by object ID in linear time.
+ *
+ * Returns: A new #ContainerDiff, free with container_diff_free().
+ */
+ContainerDiff *container_diff_new(const ColumnPage *old,
+				  const ColumnPage *cur)
+{
+	ContainerDiff *diff;
+	GHashTable *old_rows;
+	GHashTableIter iter;
+	gpointer key, value;
+	const gchar *id;
+	guint row, n_rows;
+
+	g_return_val_if_fail(old != NULL && cur != NULL, NULL);
+
+	diff = g_new0(ContainerDiff, 1);
+	diff->added = column_page_new(0);
+	diff->modified = column_page_new(0);
+	diff->removed = g_ptr_array_new_with_free_func(g_free);
+
+	/* Object ID => row + 1 of the old snapshot; what remains at the end
+	   was removed */
+	old_rows = g_hash_table_new(g_str_hash, g_str_equal);
+	n_rows = column_page_get_n_rows(old);
+	for (row = 0; row < n_rows; row++)
+	{
+		id = column_page_get_string(old, row, COLUMN_PAGE_OBJECT_ID);
+		if (id != NULL)
+			g_hash_table_insert(old_rows, (gpointer)id,
+					    GUINT_TO_POINTER(row + 1));
+	}
+
+	n_rows = column_page_get_n_rows(cur);
+	for (row = 0; row < n_rows; row++)
+	{
+		id = column_page_get_string(cur, row, COLUMN_PAGE_OBJECT_ID);
+		if (id == NULL)
+			continue;
+
+		value = g_hash_table_lookup(old_rows, id);
+		if (value == NULL)
+		{
+			column_page_append_copy(diff->added, cur, row);
+		}
+		else
+		{
+			if (!container_diff_row_equal(
+				    old, GPOINTER_TO_UINT(value) - 1,
+				    cur, row))
+				column_page_append_copy(diff->modified,
+							cur, row);
+			g_hash_table_remove(old_rows, id);
+		}
+	}
+
+	g_hash_table_iter_init(&iter, old_rows);
+	while (g_hash_table_iter_next(&iter, &key, NULL))
+		g_ptr_array_add(diff->removed, g_strdup(key));
+	g_hash_table_destroy(old_rows);
+
+	column_page_seal(diff->added);
+	column_page_seal(diff->modified);
+
+	return diff;
+}
+
+gboolean container_diff_is_empty(const ContainerDiff *diff)
+{
+	g_return_val_if_fail(diff != NULL, TRUE);
+
+	return column_page_get_n_rows(diff->added) == 0 &&
+		column_page_get_n_rows(diff->modified) == 0 &&
+		diff->removed->len == 0;
+}
+
+void container_diff_free(ContainerDiff *diff)
+{
+	if (diff == NULL)
+		return;
+
+	column_page_free(diff->added);
+	column_page_free(diff->modified);
+	g_ptr_array_free(diff->removed, TRUE);
+	g_free(diff);
+}
@@ -0,0 +1,52 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef MAFW_UPNP_SOURCE_DIFF_H
+#define MAFW_UPNP_SOURCE_DIFF_H
+
+#include <glib.h>
+
+#include "mafw-upnp-source-page.h"
+
+/*----------------------------------------------------------------------------
+  Container diffs
+  ----------------------------------------------------------------------------*/
+
+/* What changed between two snapshots of a container.  Items are matched
+   by object ID, a mere change of order is not reported. */
+typedef struct {
+	/* Items new in the container, with their metadata */
+	ColumnPage *added;
+	/* Items whose title, URI, MIME type or duration changed */
+	ColumnPage *modified;
+	/* Object IDs of the items no longer in the container */
+	GPtrArray *removed;
+} ContainerDiff;
+
+ContainerDiff *container_diff_new(const ColumnPage *old,
+				  const ColumnPage *cur);
+gboolean container_diff_is_empty(const ContainerDiff *diff);
+void container_diff_free(ContainerDiff *diff);
+
+#endif
@@ -0,0 +1,726 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <glib.h>
+#include <glib-object.h>
+#include <string.h>
+#include <libmafw/mafw.h>
+
+#include "mafw-upnp-source-federated.h"
+#include "mafw-upnp-source-sorter.h"
+
+/*----------------------------------------------------------------------------
+  Federated search
+  ----------------------------------------------------------------------------*/
+
+/* A search over several servers at once.  Every server is browsed
+   recursively from its root with the filter, in parallel, a window of
+   FEDERATED_PART_WINDOW items at a time: the next window is asked for only
+   once everything of the last one left the server's queue, so a fast
+   server cannot pile up items while the others lag.  Unsorted, the results
+   are given out in arrival order.  Sorted, the servers' own order is no
+   use, each collates its own way, so they are browsed unsorted and all of
+   their items sorted here, spilling to disk as needed, then given out once
+   every server is done.  Once the item count is reached the servers still
+   searching are cancelled. */
+typedef struct _FederatedSearch FederatedSearch;
+
+typedef struct {
+	gchar *objectid;
+	GHashTable *metadata;
+} FederatedItem;
+
+typedef struct {
+	FederatedSearch *search;
+	MafwSource *server;
+	guint browse_id;
+
+	/* FederatedItems received but not given out or sorted yet */
+	GQueue items;
+
+	/* Items received in all and in the current window, and the size of
+	   that window */
+	guint fetched;
+	guint window;
+	guint requested;
+
+	/* The remaining count the server gave last */
+	guint remaining;
+
+	/* Its window is over but the server has more */
+	gboolean paused;
+	gboolean done;
+} FederatedPart;
+
+struct _FederatedSearch {
+	/* Held by federated_searches until finished, by every part until
+	   its server is done, and by the idles starting the merge and
+	   reading on */
+	gint refcount;
+
+	guint browse_id;
+	MafwSource *source;
+	MafwSourceBrowseResultCb callback;
+	gpointer user_data;
+
+	/* What every server is browsed with, and the items each has to
+	   give (0: all) */
+	MafwFilter *filter;
+	const gchar **keys;
+	guint wanted;
+
+	/* FederatedPart per server */
+	GPtrArray *parts;
+
+	/* Sorts the results if there is a sort criteria, and the items in
+	   it not given out yet */
+	Sorter *sorter;
+	guint sorting;
+	gboolean sorted;
+
+	/* Items still to skip, the item count (0: all) and the items given
+	   out so far */
+	guint skip;
+	guint limit;
+	guint delivered;
+	guint index;
+
+	/* Decides on every result before it is skipped or given out */
+	FederatedAdmitFunc admit;
+	gpointer admit_data;
+	GDestroyNotify admit_destroy;
+
+	/* The first error of a server and the servers failed */
+	GError *error;
+	guint n_failed;
+
+	/* Nothing is given out before federated_search_start() returns */
+	guint idle_id;
+	guint resume_id;
+	gboolean finished;
+};
+
+/* Browse ID -> FederatedSearch.  The IDs are shared by every source
+   searching, so each search is looked up for its own source only. */
+static GHashTable *federated_searches;
+static guint federated_next_id;
+
+static void federated_part_cb(MafwSource *server, guint browse_id,
+			      gint remaining_count, guint index,
+			      const gchar *objectid, GHashTable *metadata,
+			      gpointer user_data, const GError *error);
+
+static void federated_item_free(FederatedItem *item)
+{
+	g_free(item->objectid);
+	g_hash_table_unref(item->metadata);
+	g_free(item);
+}
+
+static void federated_search_unref(FederatedSearch *search)
+{
+	FederatedPart *part;
+	FederatedItem *item;
+	guint i;
+
+	g_assert(search->refcount > 0);
+	if (--search->refcount > 0)
+		return;
+
+	for (i = 0; i < search->parts->len; i++)
+	{
+		part = g_ptr_array_index(search->parts, i);
+		while ((item = g_queue_pop_head(&part->items)) != NULL)
+			federated_item_free(item);
+		g_object_unref(part->server);
+		g_free(part);
+	}
+	g_ptr_array_free(search->parts, TRUE);
+	sorter_free(search->sorter);
+	if (search->filter != NULL)
+		mafw_filter_free(search->filter);
+	g_free(search->keys);
+	if (search->admit_destroy != NULL)
+		search->admit_destroy(search->admit_data);
+	if (search->error != NULL)
+		g_error_free(search->error);
+	g_free(search);
+}
+
+/* Stops the search, cancelling the servers still searching. */
+static void federated_finish(FederatedSearch *search)
+{
+	FederatedPart *part;
+	guint i;
+
+	if (search->finished)
+		return;
+	search->finished = TRUE;
+
+	search->refcount++;
+	g_hash_table_remove(federated_searches,
+			    GUINT_TO_POINTER(search->browse_id));
+	federated_search_unref(search);
+
+	if (search->idle_id != 0)
+	{
+		g_source_remove(search->idle_id);
+		search->idle_id = 0;
+		federated_search_unref(search);
+	}
+	if (search->resume_id != 0)
+	{
+		g_source_remove(search->resume_id);
+		search->resume_id = 0;
+		federated_search_unref(search);
+	}
+
+	for (i = 0; i < search->parts->len; i++)
+	{
+		part = g_ptr_array_index(search->parts, i);
+		if (part->done)
+			continue;
+
+		if (part->browse_id != MAFW_SOURCE_INVALID_BROWSE_ID)
+		{
+			mafw_source_cancel_browse(part->server,
+						  part->browse_id, NULL);
+		}
+		else if (part->paused)
+		{
+			/* Not to be read on */
+			part->paused = FALSE;
+			part->done = TRUE;
+			federated_search_unref(search);
+		}
+	}
+
+	federated_search_unref(search);
+}
+
+/* Gives the final result with @error and stops the search. */
+static void federated_fail(FederatedSearch *search, const GError *error)
+{
+	search->callback(search->source, search->browse_id, 0, search->index,
+			 NULL, NULL, search->user_data, error);
+	federated_finish(search);
+}
+
+/* Whether every server is done and everything they sent was given out. */
+static gboolean federated_exhausted(const FederatedSearch *search)
+{
+	FederatedPart *part;
+	guint i;
+
+	if (search->sorting > 0)
+		return FALSE;
+	for (i = 0; i < search->parts->len; i++)
+	{
+		part = g_ptr_array_index(search->parts, i);
+		if (!part->done || !g_queue_is_empty(&part->items))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/* The items that may still come, never more than the item count left. */
+static guint federated_remaining(const FederatedSearch *search)
+{
+	FederatedPart *part;
+	guint i, remaining;
+
+	remaining = search->sorting;
+	for (i = 0; i < search->parts->len; i++)
+	{
+		part = g_ptr_array_index(search->parts, i);
+		remaining += g_queue_get_length(
+			(GQueue *)&part->items);
+		if (!part->done)
+			remaining += part->remaining;
+	}
+	if (search->limit > 0)
+		remaining = MIN(remaining, search->limit - search->delivered);
+
+	return MAX(remaining, 1);
+}
+
+/* Asks the server of @part for its next window of items. */
+static void federated_part_browse(FederatedPart *part)
+{
+	FederatedSearch *search = part->search;
+	gchar *objectid;
+	guint browse_id;
+
+	part->paused = FALSE;
+	part->window = 0;
+	part->requested = FEDERATED_PART_WINDOW;
+	if (search->wanted > 0)
+		part->requested = MIN(part->requested,
+				      search->wanted - part->fetched);
+
+	objectid = g_strconcat(mafw_extension_get_uuid(
+				       MAFW_EXTENSION(part->server)),
+			       "::", NULL);
+	browse_id = mafw_source_browse(part->server, objectid, TRUE,
+				       search->filter, NULL, search->keys,
+				       part->fetched, part->requested,
+				       federated_part_cb, part);
+	g_free(objectid);
+
+	/* The window may be over already */
+	if (part->done || part->paused)
+		return;
+	if (browse_id != MAFW_SOURCE_INVALID_BROWSE_ID)
+	{
+		part->browse_id = browse_id;
+		return;
+	}
+
+	part->done = TRUE;
+	search->n_failed++;
+	federated_search_unref(search);
+}
+
+static gboolean federated_resume_idle(FederatedSearch *search)
+{
+	FederatedPart *part;
+	guint i;
+
+	search->resume_id = 0;
+	for (i = 0; i < search->parts->len && !search->finished; i++)
+	{
+		part = g_ptr_array_index(search->parts, i);
+		if (part->paused && g_queue_is_empty(&part->items))
+			federated_part_browse(part);
+	}
+	federated_search_unref(search);
+	return FALSE;
+}
+
+/* Reads on the servers whose window was taken out of their queue. */
+static void federated_resume(FederatedSearch *search)
+{
+	FederatedPart *part;
+	guint i;
+
+	if (search->resume_id != 0 || search->finished)
+		return;
+	for (i = 0; i < search->parts->len; i++)
+	{
+		part = g_ptr_array_index(search->parts, i);
+		if (part->paused && g_queue_is_empty(&part->items))
+			break;
+	}
+	if (i == search->parts->len)
+		return;
+
+	/* Not from within the callback of a server */
+	search->refcount++;
+	search->resume_id = g_idle_add((GSourceFunc)federated_resume_idle,
+				       search);
+}
+
+/* Moves the items received into the sorter, and once every server is done
+   sorts them.  Returns %FALSE on error. */
+static gboolean federated_sort(FederatedSearch *search, GError **error)
+{
+	FederatedPart *part;
+	FederatedItem *item;
+	gboolean done;
+	guint i;
+
+	done = TRUE;
+	for (i = 0; i < search->parts->len; i++)
+	{
+		part = g_ptr_array_index(search->parts, i);
+		while ((item = g_queue_pop_head(&part->items)) != NULL)
+		{
+			if (!sorter_add(search->sorter, item->objectid,
+					item->metadata, error))
+			{
+				federated_item_free(item);
+				return FALSE;
+			}
+			search->sorting++;
+			federated_item_free(item);
+		}
+		done = done && part->done;
+	}
+
+	if (done && !search->sorted)
+	{
+		search->sorted = TRUE;
+		return sorter_finish(search->sorter, error);
+	}
+	return TRUE;
+}
+
+/* The next item to give out, or %NULL if there is none yet or on error. */
+static FederatedItem *federated_next_item(FederatedSearch *search,
+					  GError **error)
+{
+	FederatedPart *part;
+	FederatedItem *item;
+	guint i;
+
+	if (search->sorter == NULL)
+	{
+		for (i = 0; i < search->parts->len; i++)
+		{
+			part = g_ptr_array_index(search->parts, i);
+			if (!g_queue_is_empty(&part->items))
+				return g_queue_pop_head(&part->items);
+		}
+		return NULL;
+	}
+
+	if (!federated_sort(search, error) || !search->sorted ||
+	    search->sorting == 0)
+		return NULL;
+
+	item = g_new0(FederatedItem, 1);
+	if (!sorter_next(search->sorter, &item->objectid, &item->metadata,
+			 error))
+	{
+		g_free(item);
+		return NULL;
+	}
+	search->sorting--;
+
+	return item;
+}
+
+/* Gives out what can be given out, and ends the search when it is over. */
+static void federated_flush(FederatedSearch *search)
+{
+	FederatedItem *item;
+	GError *error;
+	guint remaining;
+
+	if (search->idle_id != 0)
+		return;
+
+	search->refcount++;
+	while (!search->finished)
+	{
+		error = NULL;
+		item = federated_next_item(search, &error);
+		if (error != NULL)
+		{
+			federated_fail(search, error);
+			g_error_free(error);
+			break;
+		}
+		if (item == NULL)
+		{
+			if (!federated_exhausted(search))
+				break;
+
+			/* Fail only if every server did */
+			federated_fail(search,
+				       search->n_failed == search->parts->len ?
+				       search->error : NULL);
+			break;
+		}
+
+		if (search->admit != NULL &&
+		    !search->admit(item->objectid, item->metadata,
+				   search->admit_data))
+		{
+			federated_item_free(item);
+			continue;
+		}
+		if (search->skip > 0)
+		{
+			search->skip--;
+			federated_item_free(item);
+			continue;
+		}
+
+		search->delivered++;
+		if ((search->limit > 0 && search->delivered == search->limit) ||
+		    federated_exhausted(search))
+			remaining = 0;
+		else
+			remaining = federated_remaining(search);
+
+		search->callback(search->source, search->browse_id,
+				 remaining, search->index++, item->objectid,
+				 item->metadata, search->user_data, NULL);
+		federated_item_free(item);
+
+		if (remaining == 0)
+			federated_finish(search);
+	}
+	federated_resume(search);
+	federated_search_unref(search);
+}
+
+static void federated_part_cb(MafwSource *server, guint browse_id,
+			      gint remaining_count, guint index,
+			      const gchar *objectid, GHashTable *metadata,
+			      gpointer user_data, const GError *error)
+{
+	FederatedPart *part = user_data;
+	FederatedSearch *search = part->search;
+	FederatedItem *item;
+	gboolean last;
+
+	if (part->done || part->paused)
+		return;
+
+	if (error != NULL)
+	{
+		g_debug("Federated search failed on %s: %s",
+			mafw_extension_get_name(MAFW_EXTENSION(server)),
+			error->message);
+		if (search->error == NULL)
+			search->error = g_error_copy(error);
+		search->n_failed++;
+	}
+	else if (objectid != NULL && metadata != NULL && !search->finished)
+	{
+		item = g_new0(FederatedItem, 1);
+		item->objectid = g_strdup(objectid);
+		item->metadata = g_hash_table_ref(metadata);
+		g_queue_push_tail(&part->items, item);
+		part->fetched++;
+		part->window++;
+	}
+
+	part->remaining = MAX(remaining_count, 0);
+	last = FALSE;
+	if (error != NULL || remaining_count <= 0)
+	{
+		part->browse_id = MAFW_SOURCE_INVALID_BROWSE_ID;
+
+		/* A full window may be followed by another */
+		if (error == NULL && !search->finished &&
+		    part->window >= part->requested &&
+		    (search->wanted == 0 || part->fetched < search->wanted))
+		{
+			part->paused = TRUE;
+		}
+		else
+		{
+			part->done = TRUE;
+			last = TRUE;
+		}
+	}
+
+	/* Finishing may cancel this very server, which then calls back
+	   with its last result right away. */
+	if (!search->finished)
+		federated_flush(search);
+
+	/* The server will not call back any more */
+	if (last)
+		federated_search_unref(search);
+}
+
+static gboolean federated_start_idle(FederatedSearch *search)
+{
+	search->idle_id = 0;
+	federated_flush(search);
+	federated_search_unref(search);
+	return FALSE;
+}
+
+/* @metadata_keys and the keys to sort by, to be freed with g_free().  No
+   keys at all stands for every key already. */
+static const gchar **federated_keys(const gchar *const *metadata_keys,
+				    const Sorter *sorter)
+{
+	const gchar *const *key;
+	GPtrArray *keys;
+	guint i;
+
+	keys = g_ptr_array_new();
+	if (metadata_keys != NULL)
+		for (key = metadata_keys; *key != NULL; key++)
+			g_ptr_array_add(keys, (gpointer)*key);
+
+	if (sorter != NULL && (metadata_keys == NULL || keys->len > 0))
+	{
+		for (key = sorter_get_sort_keys(sorter); *key != NULL; key++)
+		{
+			for (i = 0; i < keys->len; i++)
+				if (strcmp(g_ptr_array_index(keys, i),
+					   *key) == 0)
+					break;
+			if (i == keys->len)
+				g_ptr_array_add(keys, (gpointer)*key);
+		}
+	}
+	g_ptr_array_add(keys, NULL);
+
+	return (const gchar **)g_ptr_array_free(keys, FALSE);
+}
+
+/**
+ * federated_search_start:
+ * @source:        The source the results are given out by
+ * @servers:       The sources to search
+ * @filter:        The filter to search with
+ * @sort_criteria: MAFW sort criteria of the merged results, may be %NULL
+ * @metadata_keys: Metadata keys of the results
+ * @skip_count:    Results to skip from the merged results
+ * @item_count:    Results to give out at most, 0 for all
+ * @callback:      Browse result callback
+ * @user_data:     Data for @callback
+ *
+ * Searches @servers recursively from their roots, at once, merging their
+ * results as they come.  Sorted results carry the keys sorted by as well,
+ * and are given out only after every server is done.
+ *
+ * Returns: The browse ID of the search, or %MAFW_SOURCE_INVALID_BROWSE_ID
+ * if @sort_criteria is malformed.
+ */
+guint federated_search_start(MafwSource *source, GList *servers,
+			     const MafwFilter *filter,
+			     const gchar *sort_criteria,
+			     const gchar *const *metadata_keys,
+			     guint skip_count, guint item_count,
+			     MafwSourceBrowseResultCb callback,
+			     gpointer user_data)
+{
+	FederatedSearch *search;
+	FederatedPart *part;
+	GError *error;
+
+	g_return_val_if_fail(callback != NULL, MAFW_SOURCE_INVALID_BROWSE_ID);
+
+	search = g_new0(FederatedSearch, 1);
+	if (sort_criteria != NULL)
+	{
+		error = NULL;
+		search->sorter = sorter_new(sort_criteria, SORTER_RUN_SIZE,
+					    &error);
+		if (search->sorter == NULL)
+		{
+			callback(source, MAFW_SOURCE_INVALID_BROWSE_ID, 0, 0,
+				 NULL, NULL, user_data, error);
+			g_error_free(error);
+			g_free(search);
+			return MAFW_SOURCE_INVALID_BROWSE_ID;
+		}
+	}
+
+	if (federated_searches == NULL)
+		federated_searches = g_hash_table_new(NULL, NULL);
+
+	search->refcount = 1;
+	search->browse_id = federated_next_id++;
+	search->source = source;
+	search->callback = callback;
+	search->user_data = user_data;
+	search->filter = filter != NULL ? mafw_filter_copy(filter) : NULL;
+	search->keys = federated_keys(metadata_keys, search->sorter);
+	search->parts = g_ptr_array_new();
+	search->skip = skip_count;
+	search->limit = item_count;
+	search->index = skip_count;
+	g_hash_table_insert(federated_searches,
+			    GUINT_TO_POINTER(search->browse_id), search);
+
+	/* Every server has to give the items skipped as well, nobody knows
+	   whose they are, and all of them when sorted here. */
+	if (search->sorter == NULL && item_count > 0)
+		search->wanted = skip_count + item_count;
+
+	/* Hold the results back until the caller has the browse ID */
+	search->refcount++;
+	search->idle_id = g_idle_add((GSourceFunc)federated_start_idle,
+				     search);
+
+	for (; servers != NULL; servers = servers->next)
+	{
+		part = g_new0(FederatedPart, 1);
+		part->search = search;
+		part->server = g_object_ref(servers->data);
+		part->browse_id = MAFW_SOURCE_INVALID_BROWSE_ID;
+		g_queue_init(&part->items);
+		g_ptr_array_add(search->parts, part);
+		search->refcount++;
+
+		federated_part_browse(part);
+	}
+
+	return search->browse_id;
+}
+
+/**
+ * federated_search_set_admit:
+ * @browse_id: A browse ID of federated_search_start()
+ * @admit:     Function deciding on the results
+ * @user_data: Data for @admit
+ * @destroy:   Frees @user_data with the search, may be %NULL
+ *
+ * Has @admit decide on every result of the search in the order they are
+ * merged, like to drop duplicates.  To be set right after starting, before
+ * any result is given out.
+ */
+void federated_search_set_admit(guint browse_id, FederatedAdmitFunc admit,
+				gpointer user_data, GDestroyNotify destroy)
+{
+	FederatedSearch *search;
+
+	search = g_hash_table_lookup(federated_searches,
+				     GUINT_TO_POINTER(browse_id));
+	g_return_if_fail(search != NULL && search->delivered == 0);
+
+	search->admit = admit;
+	search->admit_data = user_data;
+	search->admit_destroy = destroy;
+}
+
+/**
+ * federated_search_cancel:
+ * @source:    The source the search was started by
+ * @browse_id: A browse ID of federated_search_start()
+ *
+ * Cancels the search, giving the final result to its callback.
+ *
+ * Returns: %FALSE if @source has no such search going on.
+ */
+gboolean federated_search_cancel(MafwSource *source, guint browse_id)
+{
+	FederatedSearch *search;
+
+	if (federated_searches == NULL)
+		return FALSE;
+
+	search = g_hash_table_lookup(federated_searches,
+				     GUINT_TO_POINTER(browse_id));
+	if (search == NULL || search->source != source)
+		return FALSE;
+
+	search->refcount++;
+	search->callback(search->source, search->browse_id, 0, search->index,
+			 NULL, NULL, search->user_data, NULL);
+	federated_finish(search);
+	federated_search_unref(search);
+
+	return TRUE;
+}
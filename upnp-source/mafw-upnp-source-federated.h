@@ -0,0 +1,54 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef MAFW_UPNP_SOURCE_FEDERATED_H
+#define MAFW_UPNP_SOURCE_FEDERATED_H
+
+#include <glib.h>
+#include <libmafw/mafw.h>
+
+/*----------------------------------------------------------------------------
+  Federated search
+  ----------------------------------------------------------------------------*/
+
+/* Items asked of a server at a time, and so queued for it at most */
+#define FEDERATED_PART_WINDOW 256
+
+/* Whether to give out a result, or to drop it */
+typedef gboolean (*FederatedAdmitFunc)(const gchar *objectid,
+				       GHashTable *metadata,
+				       gpointer user_data);
+
+guint federated_search_start(MafwSource *source, GList *servers,
+			     const MafwFilter *filter,
+			     const gchar *sort_criteria,
+			     const gchar *const *metadata_keys,
+			     guint skip_count, guint item_count,
+			     MafwSourceBrowseResultCb callback,
+			     gpointer user_data);
+void federated_search_set_admit(guint browse_id, FederatedAdmitFunc admit,
+				gpointer user_data, GDestroyNotify destroy);
+gboolean federated_search_cancel(MafwSource *source, guint browse_id);
+
+#endif
@@ -0,0 +1,254 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <glib.h>
+#include <glib-object.h>
+#include <string.h>
+#include <libmafw/mafw.h>
+
+#include "mafw-upnp-source-intern.h"
+
+/*----------------------------------------------------------------------------
+  String interning pool
+  ----------------------------------------------------------------------------*/
+
+/* Values such as artist, album, genre or the MIME type repeat across a
+   whole library.  A value is admitted to the pool the second time it is
+   seen, so that unique values (titles, URIs) are not pinned for nothing.
+
+   A GValue of a string cannot hold a reference, and clients may keep
+   metadata for as long as they like, so admitted strings are interned
+   in GLib for good and shared by every pool.  Only so many bytes are
+   interned by all pools together, past that values are copied again.
+   The pool itself only refers to the interned strings, within a byte
+   budget: when that is full the pinned table is swept, like the
+   candidates are when they pile up. */
+struct _InternPool {
+	/* value => the interned string, not owned */
+	GHashTable *pinned;
+	/* Seen-once values (owned keys) */
+	GHashTable *candidates;
+	gsize max_bytes;
+	InternPoolStats stats;
+};
+
+/* GValues holding interned strings are shared instead of duplicated by
+   g_value_copy() only since GLib 2.66. */
+#if GLIB_CHECK_VERSION(2,66,0)
+# define INTERN_SHARES_STORAGE 1
+#else
+# define INTERN_SHARES_STORAGE 0
+#endif
+
+/* Bytes interned for good by all pools */
+static gsize intern_permanent_bytes;
+
+/* Returns: The interned copy of @value, or %NULL if the permanent budget
+   does not allow one. */
+static const gchar *intern_permanent(const gchar *value, gsize size)
+{
+	GQuark quark;
+
+	/* Already interned costs nothing more */
+	quark = g_quark_try_string(value);
+	if (quark != 0)
+		return g_quark_to_string(quark);
+
+	if (intern_permanent_bytes + size > INTERN_MAX_PERMANENT_BYTES)
+		return NULL;
+
+	intern_permanent_bytes += size;
+	return g_intern_string(value);
+}
+
+static void intern_add_value(GHashTable *metadata, const gchar *key,
+			     const gchar *interned)
+{
+	GValue value = G_VALUE_INIT;
+
+	g_value_init(&value, G_TYPE_STRING);
+#if INTERN_SHARES_STORAGE
+	g_value_set_interned_string(&value, interned);
+#else
+	g_value_set_static_string(&value, interned);
+#endif
+	mafw_metadata_add_val(metadata, key, &value);
+	g_value_unset(&value);
+}
+
+/**
+ * intern_pool_new:
+ * @max_bytes: Maximum number of string bytes the pool may pin
+ *
+ * Returns: A new, empty #InternPool.
+ */
+InternPool *intern_pool_new(gsize max_bytes)
+{
+	InternPool *pool;
+
+	pool = g_new0(InternPool, 1);
+	pool->pinned = g_hash_table_new(g_str_hash, g_str_equal);
+	pool->candidates = g_hash_table_new_full(g_str_hash, g_str_equal,
+						 g_free, NULL);
+	pool->max_bytes = max_bytes;
+
+	return pool;
+}
+
+/**
+ * intern_pool_free:
+ * @pool: An #InternPool, or %NULL
+ *
+ * Frees @pool.  Values shared from it stay valid, the strings are interned
+ * for good.
+ */
+void intern_pool_free(InternPool *pool)
+{
+	if (pool == NULL)
+		return;
+
+	g_hash_table_destroy(pool->pinned);
+	g_hash_table_destroy(pool->candidates);
+	g_free(pool);
+}
+
+/**
+ * intern_pool_lookup:
+ * @pool:  An #InternPool
+ * @value: The string to look up
+ *
+ * Returns: The shared copy of @value, or %NULL if @value has to be copied.
+ */
+static const gchar *intern_pool_lookup(InternPool *pool, const gchar *value)
+{
+	const gchar *interned;
+	gsize size;
+
+	interned = g_hash_table_lookup(pool->pinned, value);
+	if (interned != NULL)
+	{
+		pool->stats.hits++;
+		if (INTERN_SHARES_STORAGE)
+			pool->stats.saved_bytes += strlen(interned) + 1;
+		return interned;
+	}
+
+	size = strlen(value) + 1;
+	if (size > pool->max_bytes)
+		return NULL;
+
+	/* Second sighting: admit it */
+	if (g_hash_table_remove(pool->candidates, value))
+	{
+		interned = intern_permanent(value, size);
+		if (interned == NULL)
+			return NULL;
+
+		if (pool->stats.pinned_bytes + size > pool->max_bytes)
+		{
+			/* Evict, the strings stay interned for the values
+			   already handed out */
+			g_hash_table_remove_all(pool->pinned);
+			pool->stats.strings = 0;
+			pool->stats.pinned_bytes = 0;
+			pool->stats.evictions++;
+		}
+		g_hash_table_insert(pool->pinned, (gpointer)interned,
+				    (gpointer)interned);
+		pool->stats.strings++;
+		pool->stats.pinned_bytes += size;
+		return interned;
+	}
+
+	if (g_hash_table_size(pool->candidates) >= INTERN_POOL_MAX_CANDIDATES)
+	{
+		g_hash_table_remove_all(pool->candidates);
+		pool->stats.evictions++;
+	}
+	g_hash_table_insert(pool->candidates, g_strdup(value), NULL);
+
+	return NULL;
+}
+
+/**
+ * intern_pool_add_str:
+ * @pool:     An #InternPool, or %NULL to always copy
+ * @metadata: Metadata hash-table to fill
+ * @key:      The metadata key
+ * @value:    The string value
+ *
+ * Adds @value to @metadata, sharing its storage with earlier occurrences
+ * when @pool has admitted it.
+ */
+void intern_pool_add_str(InternPool *pool, GHashTable *metadata,
+			 const gchar *key, const gchar *value)
+{
+	const gchar *interned = NULL;
+
+	g_return_if_fail(value != NULL);
+
+	if (pool != NULL)
+		interned = intern_pool_lookup(pool, value);
+
+	if (interned != NULL)
+	{
+		intern_add_value(metadata, key, interned);
+	}
+	else
+	{
+		if (pool != NULL)
+			pool->stats.copies++;
+		mafw_metadata_add_str(metadata, key, value);
+	}
+}
+
+/**
+ * intern_pool_add_static_str:
+ * @metadata: Metadata hash-table to fill
+ * @key:      The metadata key
+ * @value:    A string literal
+ *
+ * Adds the constant @value to @metadata without copying it.
+ */
+void intern_pool_add_static_str(GHashTable *metadata, const gchar *key,
+				const gchar *value)
+{
+	intern_add_value(metadata, key, g_intern_static_string(value));
+}
+
+/**
+ * intern_pool_get_stats:
+ * @pool:  An #InternPool
+ * @stats: Filled with the counters of @pool
+ */
+void intern_pool_get_stats(InternPool *pool, InternPoolStats *stats)
+{
+	g_return_if_fail(pool != NULL);
+	g_return_if_fail(stats != NULL);
+
+	*stats = pool->stats;
+	stats->candidates = g_hash_table_size(pool->candidates);
+}
+
+/* vi: set noexpandtab ts=8 sw=8 cino=t0,(0: */
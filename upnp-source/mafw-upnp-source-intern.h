@@ -0,0 +1,70 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef MAFW_UPNP_SOURCE_INTERN_H
+#define MAFW_UPNP_SOURCE_INTERN_H
+
+#include <glib.h>
+
+/*----------------------------------------------------------------------------
+  String interning pool
+  ----------------------------------------------------------------------------*/
+
+/* Default budget of pinned string bytes per source */
+#define INTERN_POOL_MAX_BYTES (256 * 1024)
+
+/* Bytes all pools together may intern for the life of the process */
+#define INTERN_MAX_PERMANENT_BYTES (1024 * 1024)
+
+/* Seen-once values remembered before the candidate table is swept */
+#define INTERN_POOL_MAX_CANDIDATES 4096
+
+typedef struct _InternPool InternPool;
+
+typedef struct {
+	/* Values admitted to the pool, and their size in bytes */
+	guint strings;
+	gsize pinned_bytes;
+	/* Values seen once, waiting for a second occurrence */
+	guint candidates;
+	/* Values served from the pool, and the bytes not copied for them */
+	guint64 hits;
+	guint64 saved_bytes;
+	/* Values that were copied into the metadata as usual */
+	guint64 copies;
+	/* Number of sweeps of the candidate or the pinned table */
+	guint evictions;
+} InternPoolStats;
+
+InternPool *intern_pool_new(gsize max_bytes);
+void intern_pool_free(InternPool *pool);
+
+void intern_pool_add_str(InternPool *pool, GHashTable *metadata,
+			 const gchar *key, const gchar *value);
+void intern_pool_add_static_str(GHashTable *metadata, const gchar *key,
+				const gchar *value);
+
+void intern_pool_get_stats(InternPool *pool, InternPoolStats *stats);
+
+#endif
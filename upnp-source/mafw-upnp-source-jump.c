@@ -0,0 +1,313 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <glib.h>
+#include <string.h>
+
+#include "mafw-upnp-source-jump.h"
+
+/*----------------------------------------------------------------------------
+  Jump-to-letter offsets
+  ----------------------------------------------------------------------------*/
+
+/* A child of a container at a known offset of the sorted listing */
+typedef struct {
+	guint index;
+	gchar *folded;
+} JumpProbe;
+
+/* What is known of one version of a container sorted by title: the
+   number of children, the children seen and the offsets found */
+struct _JumpTable {
+	UpdateStamp stamp;
+
+	guint total;
+	gboolean has_total;
+	JumpSearch search;
+
+	/* JumpProbe, ascending by index */
+	GArray *probes;
+
+	/* Folded letter -> offset */
+	GHashTable *offsets;
+};
+
+struct _JumpCache {
+	/* Container ID -> JumpTable */
+	GHashTable *tables;
+};
+
+static gchar *jump_fold(const gchar *str)
+{
+	gchar *normalized, *folded;
+
+	normalized = g_utf8_normalize(str, -1, G_NORMALIZE_ALL);
+	if (normalized == NULL)
+		return g_strdup(str);
+	folded = g_utf8_casefold(normalized, -1);
+	g_free(normalized);
+
+	return folded;
+}
+
+/**
+ * jump_compare:
+ * @title:  Title of an item, or %NULL
+ * @letter: What to jump to, a letter or a longer prefix
+ *
+ * Compares regardless of case, by code points, which is the order most
+ * servers sort in.  Items without a title come first.
+ *
+ * Returns: Less than zero if @title sorts before @letter, zero or more if
+ * it does not.
+ */
+gint jump_compare(const gchar *title, const gchar *letter)
+{
+	gchar *a, *b;
+	gint cmp;
+
+	if (title == NULL)
+		return -1;
+
+	a = jump_fold(title);
+	b = jump_fold(letter);
+	cmp = strcmp(a, b);
+	g_free(a);
+	g_free(b);
+
+	return cmp;
+}
+
+static JumpTable *jump_table_new(const UpdateTracker *tracker,
+				 const gchar *container_id)
+{
+	JumpTable *table;
+
+	table = g_new0(JumpTable, 1);
+	update_tracker_get_stamp(tracker, container_id, &table->stamp);
+	table->probes = g_array_new(FALSE, FALSE, sizeof(JumpProbe));
+	table->offsets = g_hash_table_new_full(g_str_hash, g_str_equal,
+					       g_free, NULL);
+
+	return table;
+}
+
+static void jump_table_free(JumpTable *table)
+{
+	guint i;
+
+	for (i = 0; i < table->probes->len; i++)
+		g_free(g_array_index(table->probes, JumpProbe, i).folded);
+	g_array_free(table->probes, TRUE);
+	g_hash_table_destroy(table->offsets);
+	g_free(table);
+}
+
+JumpCache *jump_cache_new(void)
+{
+	JumpCache *cache;
+
+	cache = g_new0(JumpCache, 1);
+	cache->tables = g_hash_table_new_full(g_str_hash, g_str_equal,
+					      g_free,
+					      (GDestroyNotify)jump_table_free);
+
+	return cache;
+}
+
+void jump_cache_free(JumpCache *cache)
+{
+	if (cache == NULL)
+		return;
+
+	g_hash_table_destroy(cache->tables);
+	g_free(cache);
+}
+
+/**
+ * jump_cache_get:
+ * @cache:        A #JumpCache
+ * @container_id: UPnP ID of a container
+ * @tracker:      The update IDs the server has told
+ *
+ * Returns: What is known of the current version of @container_id,
+ * starting afresh if the server has reported it changed.  The table
+ * belongs to @cache and is valid until the next call.
+ */
+JumpTable *jump_cache_get(JumpCache *cache, const gchar *container_id,
+			  const UpdateTracker *tracker)
+{
+	JumpTable *table;
+
+	g_return_val_if_fail(cache != NULL && container_id != NULL, NULL);
+	g_return_val_if_fail(tracker != NULL, NULL);
+
+	table = g_hash_table_lookup(cache->tables, container_id);
+	if (table != NULL &&
+	    update_tracker_changed_since(tracker, container_id,
+					 &table->stamp) != UPDATE_CHANGED)
+		return table;
+
+	if (table == NULL &&
+	    g_hash_table_size(cache->tables) >= JUMP_CACHE_MAX_CONTAINERS)
+		g_hash_table_remove_all(cache->tables);
+
+	table = jump_table_new(tracker, container_id);
+	g_hash_table_replace(cache->tables, g_strdup(container_id), table);
+
+	return table;
+}
+
+gboolean jump_table_get_total(const JumpTable *table, guint *total)
+{
+	g_return_val_if_fail(table != NULL && total != NULL, FALSE);
+
+	*total = table->total;
+	return table->has_total;
+}
+
+void jump_table_set_total(JumpTable *table, guint total)
+{
+	g_return_if_fail(table != NULL);
+
+	table->total = total;
+	table->has_total = TRUE;
+}
+
+JumpSearch jump_table_get_search(const JumpTable *table)
+{
+	g_return_val_if_fail(table != NULL, JUMP_SEARCH_UNUSABLE);
+
+	return table->search;
+}
+
+void jump_table_set_search(JumpTable *table, JumpSearch search)
+{
+	g_return_if_fail(table != NULL);
+
+	table->search = search;
+}
+
+/**
+ * jump_table_lookup:
+ * @table:  A #JumpTable
+ * @letter: What to jump to
+ * @offset: Set to the offset found earlier
+ *
+ * Returns: Whether the offset of @letter is known.
+ */
+gboolean jump_table_lookup(const JumpTable *table, const gchar *letter,
+			   guint *offset)
+{
+	gpointer key, value;
+	gchar *folded;
+	gboolean found;
+
+	g_return_val_if_fail(table != NULL && letter != NULL, FALSE);
+
+	folded = jump_fold(letter);
+	found = g_hash_table_lookup_extended(table->offsets, folded,
+					     &key, &value);
+	g_free(folded);
+	if (found && offset != NULL)
+		*offset = GPOINTER_TO_UINT(value);
+
+	return found;
+}
+
+/**
+ * jump_table_add_probe:
+ * @table: A #JumpTable
+ * @index: Offset of a child in the listing sorted by title
+ * @title: Title of the child, or %NULL if it has none
+ */
+void jump_table_add_probe(JumpTable *table, guint index, const gchar *title)
+{
+	JumpProbe probe, *at;
+	guint i;
+
+	g_return_if_fail(table != NULL);
+
+	for (i = 0; i < table->probes->len; i++)
+	{
+		at = &g_array_index(table->probes, JumpProbe, i);
+		if (at->index == index)
+			return;
+		if (at->index > index)
+			break;
+	}
+
+	probe.index = index;
+	probe.folded = title != NULL ? jump_fold(title) : NULL;
+	g_array_insert_val(table->probes, i, probe);
+}
+
+/**
+ * jump_table_bounds:
+ * @table:  A #JumpTable with the total number of children set
+ * @letter: What to jump to
+ * @low:    Set to the lowest offset @letter may have
+ * @high:   Set to the highest offset @letter may have
+ *
+ * Narrows down the offset of @letter by the children seen.  When that
+ * leaves one offset, it is remembered for jump_table_lookup().  Children
+ * out of order, as far as jump_compare() can tell, make the first child
+ * known not to sort before @letter the answer.
+ *
+ * Returns: Whether the offset is found, @low then.
+ */
+gboolean jump_table_bounds(JumpTable *table, const gchar *letter,
+			   guint *low, guint *high)
+{
+	const JumpProbe *probe;
+	gchar *folded;
+	guint i;
+
+	g_return_val_if_fail(table != NULL && table->has_total, FALSE);
+	g_return_val_if_fail(letter != NULL && low != NULL && high != NULL,
+			     FALSE);
+
+	folded = jump_fold(letter);
+	*low = 0;
+	*high = table->total;
+	for (i = 0; i < table->probes->len; i++)
+	{
+		probe = &g_array_index(table->probes, JumpProbe, i);
+		if (probe->folded == NULL || strcmp(probe->folded, folded) < 0)
+			*low = MAX(*low, probe->index + 1);
+		else
+			*high = MIN(*high, probe->index);
+	}
+
+	if (*low < *high)
+	{
+		g_free(folded);
+		return FALSE;
+	}
+
+	*low = *high;
+	g_hash_table_replace(table->offsets, folded,
+			     GUINT_TO_POINTER(*low));
+	return TRUE;
+}
@@ -0,0 +1,67 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef MAFW_UPNP_SOURCE_JUMP_H
+#define MAFW_UPNP_SOURCE_JUMP_H
+
+#include <glib.h>
+
+#include "mafw-upnp-source-updates.h"
+
+/*----------------------------------------------------------------------------
+  Jump-to-letter offsets
+  ----------------------------------------------------------------------------*/
+
+/* Containers whose offsets are remembered */
+#define JUMP_CACHE_MAX_CONTAINERS 64
+
+/* Whether the children of a container can be counted by a Search */
+typedef enum {
+	JUMP_SEARCH_UNKNOWN,
+	JUMP_SEARCH_USABLE,
+	JUMP_SEARCH_UNUSABLE
+} JumpSearch;
+
+typedef struct _JumpTable JumpTable;
+typedef struct _JumpCache JumpCache;
+
+gint jump_compare(const gchar *title, const gchar *letter);
+
+JumpCache *jump_cache_new(void);
+void jump_cache_free(JumpCache *cache);
+JumpTable *jump_cache_get(JumpCache *cache, const gchar *container_id,
+			  const UpdateTracker *tracker);
+
+gboolean jump_table_get_total(const JumpTable *table, guint *total);
+void jump_table_set_total(JumpTable *table, guint total);
+JumpSearch jump_table_get_search(const JumpTable *table);
+void jump_table_set_search(JumpTable *table, JumpSearch search);
+
+gboolean jump_table_lookup(const JumpTable *table, const gchar *letter,
+			   guint *offset);
+void jump_table_add_probe(JumpTable *table, guint index, const gchar *title);
+gboolean jump_table_bounds(JumpTable *table, const gchar *letter,
+			   guint *low, guint *high);
+
+#endif
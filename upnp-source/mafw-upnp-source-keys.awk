@@ -0,0 +1,217 @@
+#
+# mafw-upnp-source-keys.awk: generates the metadata key tables of the MAFW
+# UPnP source from mafw-upnp-source-keys.list.
+#
+# Usage: LC_ALL=C awk -v mode=header|tables -f mafw-upnp-source-keys.awk \
+#		mafw-upnp-source-keys.list > output.h
+#
+#   mode=header	MUPnPSrc_MKey_* bit definitions (mafw-upnp-source-keys.h)
+#   mode=tables	filter, key and perfect hash tables, only to be included
+#		by mafw-upnp-source-util.c (mafw-upnp-source-keytab.h)
+#
+# The perfect hash must stay in sync with util_key_hash() in
+# mafw-upnp-source-util.c.  Two string hashes are combined with the seed:
+#
+#	a = 5381; b = 0; for each byte c:
+#		a = (a * 33 + c) & 0xFFFFF; b = (b * 31 + c) & 0xFFFFF
+#	slot = ((a + seed * b) & 0xFFFFF) >> 12
+#
+# Copyright (C) 2007, 2008, 2009 Nokia. All rights reserved.
+#
+
+BEGIN {
+	FS = "[ \t]*[|][ \t]*"
+	HASH_SIZE = 256
+	HASH_MASK = 1048576
+	nfilters = 0
+	nkeys = 0
+	for (i = 1; i < 128; i++)
+		ord[sprintf("%c", i)] = i
+}
+
+function die(msg) {
+	printf("%s:%d: %s\n", FILENAME, FNR, msg) > "/dev/stderr"
+	failed = 1
+	exit 1
+}
+
+function strip(s) {
+	sub(/^[ \t]+/, "", s)
+	sub(/[ \t]+$/, "", s)
+	return s
+}
+
+/^[ \t]*(#|$)/ { next }
+
+{
+	for (i = 1; i <= NF; i++)
+		$i = strip($i)
+}
+
+$1 == "filter" {
+	if (NF != 3)
+		die("filter lines have 3 columns")
+	if ($2 in filter_id)
+		die("duplicate filter " $2)
+	filter_id[$2] = nfilters
+	filter_expr[nfilters] = $3
+	nfilters++
+	next
+}
+
+$1 == "key" {
+	if (NF != 8)
+		die("key lines have 8 columns")
+	if ($4 in key_id)
+		die("duplicate key " $4)
+	if (!($7 in filter_id))
+		die("unknown filter " $7)
+	key_id[$4] = nkeys
+	key_name[nkeys] = $2
+	key_macro[nkeys] = $3
+	key_literal[nkeys] = $4
+	key_gtype[nkeys] = $5
+	key_upnp[nkeys] = $6 == "-" ? "NULL" : $6
+	key_filter[nkeys] = filter_id[$7]
+	key_decode[nkeys] = $8 == "-" ? "NULL" : $8
+	nkeys++
+	next
+}
+
+{ die("unknown line type " $1) }
+
+# Hex digits of 1 << bit, without leaning on printf("%x") for values that
+# do not fit in 32 bits.
+function bit_hex(bit,	s, i) {
+	s = substr("1248", bit % 4 + 1, 1)
+	for (i = 0; i < int(bit / 4); i++)
+		s = s "0"
+	return "0x" s
+}
+
+function key_hashes(n, str,	a, b, c, i) {
+	a = 5381
+	b = 0
+	for (i = 1; i <= length(str); i++) {
+		c = ord[substr(str, i, 1)]
+		a = (a * 33 + c) % HASH_MASK
+		b = (b * 31 + c) % HASH_MASK
+	}
+	hash_a[n] = a
+	hash_b[n] = b
+}
+
+# Finds the first seed that places every key literal in its own slot.
+function find_seed(	seed, i, slot, used, ok) {
+	for (i = 0; i < nkeys; i++)
+		key_hashes(i, key_literal[i])
+	for (seed = 1; seed < HASH_MASK; seed++) {
+		split("", used)
+		ok = 1
+		for (i = 0; i < nkeys; i++) {
+			slot = int(((hash_a[i] + seed * hash_b[i]) % HASH_MASK) \
+				   / (HASH_MASK / HASH_SIZE))
+			if (slot in used) {
+				ok = 0
+				break
+			}
+			used[slot] = i
+		}
+		if (ok) {
+			for (slot in used)
+				hash_slot[slot] = used[slot]
+			return seed
+		}
+	}
+	return -1
+}
+
+function emit_header(	i) {
+	print "#ifndef MAFW_UPNP_SOURCE_KEYS_H"
+	print "#define MAFW_UPNP_SOURCE_KEYS_H"
+	print ""
+	for (i = 0; i < nkeys; i++)
+		printf("#define MUPnPSrc_MKey_%-24s G_GUINT64_CONSTANT(%s)\n",
+		       key_name[i], bit_hex(i))
+	print ""
+	printf("#define MUPnPSrc_MKey_COUNT %d\n", nkeys)
+	print ""
+	print "#endif /* MAFW_UPNP_SOURCE_KEYS_H */"
+}
+
+function emit_tables(	i, seed, all, sep, used) {
+	seed = find_seed()
+	if (seed < 0)
+		die("no perfect hash seed found, grow HASH_SIZE")
+
+	printf("#define UPNP_FILTER_COUNT %d\n", nfilters)
+	printf("#define UPNP_KEY_HASH_SEED %d\n", seed)
+	printf("#define UPNP_KEY_HASH_SIZE %d\n", HASH_SIZE)
+	print ""
+
+	print "static const gchar *upnp_filters[] = {"
+	for (i = 0; i < nfilters; i++)
+		printf("\t%s%s\n", filter_expr[i], i < nfilters - 1 ? "," : "")
+	print "};"
+	print ""
+
+	print "/* Filters with their separating comma, ready to be appended. */"
+	print "static const struct _upnp_filter_fragment upnp_filter_fragments[] = {"
+	for (i = 0; i < nfilters; i++)
+		printf("\t{ \",\" %s, sizeof(\",\" %s) - 1 }%s\n",
+		       filter_expr[i], filter_expr[i],
+		       i < nfilters - 1 ? "," : "")
+	print "};"
+	print ""
+
+	# The filter for MAFW_SOURCE_ALL_KEYS, in filter order.
+	for (i = 0; i < nkeys; i++)
+		used[key_filter[i]] = 1
+	all = ""
+	sep = ""
+	for (i = 0; i < nfilters; i++) {
+		if (!(i in used))
+			continue
+		all = all sep "\n\t" filter_expr[i]
+		sep = " \",\""
+	}
+	print "static const gchar upnp_all_keys_filter[] =" all ";"
+	print ""
+
+	print "static const struct _upnp_map upnpmaps[] = {"
+	for (i = 0; i < nkeys; i++)
+		printf("\t{%s, %s, %s, %d, %s}%s\n", key_gtype[i],
+		       key_upnp[i], key_macro[i], key_filter[i],
+		       key_decode[i], i < nkeys - 1 ? "," : "")
+	print "};"
+	print ""
+
+	print "/* Perfect hash slot -> key ID + 1 (0: empty slot). */"
+	printf("static const guint8 upnp_key_hash_table[UPNP_KEY_HASH_SIZE] = {")
+	for (i = 0; i < HASH_SIZE; i++)
+		printf("%s%d%s", i % 16 == 0 ? "\n\t" : " ",
+		       (i in hash_slot) ? hash_slot[i] + 1 : 0,
+		       i < HASH_SIZE - 1 ? "," : "")
+	print "\n};"
+}
+
+END {
+	if (failed)
+		exit 1
+	if (nkeys > 64)
+		die("more than 64 keys do not fit in the guint64 key mask")
+	if (nfilters > 64)
+		die("more than 64 filters do not fit in the guint64 filter mask")
+	if (nkeys > 255)
+		die("key IDs must fit in the guint8 hash table")
+
+	print "/* Generated from mafw-upnp-source-keys.list by"
+	print " * mafw-upnp-source-keys.awk.  Do not edit. */"
+	print ""
+	if (mode == "header")
+		emit_header()
+	else if (mode == "tables")
+		emit_tables()
+	else
+		die("mode must be header or tables")
+}
@@ -0,0 +1,183 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <glib.h>
+
+#include "mafw-upnp-source-negcache.h"
+
+/*----------------------------------------------------------------------------
+  Negative result cache
+  ----------------------------------------------------------------------------*/
+
+/* Remembers for a short while which actions failed on which objects, so
+   that a client retrying a dead object, such as a stale playlist entry,
+   is answered locally instead of asking the server again. */
+struct _NegCache {
+	/* Microseconds an entry lives */
+	gint64 ttl;
+
+	/* "<action>:<item ID>" => NegEntry */
+	GHashTable *entries;
+};
+
+typedef struct {
+	GError *error;
+	/* Monotonic time the entry expires at */
+	gint64 expires;
+} NegEntry;
+
+static void neg_entry_free(NegEntry *entry)
+{
+	g_error_free(entry->error);
+	g_free(entry);
+}
+
+/* Action names have no colons, so the key is unambiguous. */
+static gchar *neg_cache_key(const gchar *action, const gchar *itemid)
+{
+	return g_strconcat(action, ":", itemid, NULL);
+}
+
+/**
+ * neg_cache_new:
+ * @ttl: Seconds a failure is remembered
+ *
+ * Returns: An empty #NegCache.
+ */
+NegCache *neg_cache_new(guint ttl)
+{
+	NegCache *cache;
+
+	cache = g_new0(NegCache, 1);
+	cache->ttl = (gint64)ttl * G_USEC_PER_SEC;
+	cache->entries = g_hash_table_new_full(
+		g_str_hash, g_str_equal, g_free,
+		(GDestroyNotify)neg_entry_free);
+
+	return cache;
+}
+
+void neg_cache_free(NegCache *cache)
+{
+	if (cache == NULL)
+		return;
+
+	g_hash_table_destroy(cache->entries);
+	g_free(cache);
+}
+
+static gboolean neg_cache_expired(gpointer key, NegEntry *entry,
+				  const gint64 *now)
+{
+	return entry->expires <= *now;
+}
+
+/**
+ * neg_cache_add:
+ * @cache:  A #NegCache
+ * @action: Name of the failed action, like "BrowseMetadata"
+ * @itemid: UPnP ID of the object it failed on
+ * @error:  The error to answer with until the entry expires
+ *
+ * Remembers a failure.  When the cache is full, the expired entries go
+ * first, and all of them if that is not enough.
+ */
+void neg_cache_add(NegCache *cache, const gchar *action,
+		   const gchar *itemid, const GError *error)
+{
+	NegEntry *entry;
+	gint64 now;
+
+	g_return_if_fail(cache != NULL);
+	g_return_if_fail(action != NULL && itemid != NULL && error != NULL);
+
+	now = g_get_monotonic_time();
+	if (g_hash_table_size(cache->entries) >= NEG_CACHE_MAX_ENTRIES)
+	{
+		g_hash_table_foreach_remove(cache->entries,
+					    (GHRFunc)neg_cache_expired, &now);
+		if (g_hash_table_size(cache->entries) >= NEG_CACHE_MAX_ENTRIES)
+			g_hash_table_remove_all(cache->entries);
+	}
+
+	entry = g_new(NegEntry, 1);
+	entry->error = g_error_copy(error);
+	entry->expires = now + cache->ttl;
+	g_hash_table_replace(cache->entries, neg_cache_key(action, itemid),
+			     entry);
+}
+
+/**
+ * neg_cache_lookup:
+ * @cache:  A #NegCache
+ * @action: Name of the action about to be invoked
+ * @itemid: UPnP ID of the object it is about
+ * @error:  Receives a copy of the remembered error
+ *
+ * Returns: %TRUE if the action recently failed on the object.
+ */
+gboolean neg_cache_lookup(NegCache *cache, const gchar *action,
+			  const gchar *itemid, GError **error)
+{
+	NegEntry *entry;
+	gchar *key;
+	gboolean found;
+
+	g_return_val_if_fail(cache != NULL, FALSE);
+	g_return_val_if_fail(action != NULL && itemid != NULL, FALSE);
+
+	if (g_hash_table_size(cache->entries) == 0)
+		return FALSE;
+
+	key = neg_cache_key(action, itemid);
+	entry = g_hash_table_lookup(cache->entries, key);
+	found = entry != NULL && entry->expires > g_get_monotonic_time();
+	if (found)
+		g_propagate_error(error, g_error_copy(entry->error));
+	else if (entry != NULL)
+		g_hash_table_remove(cache->entries, key);
+	g_free(key);
+
+	return found;
+}
+
+/**
+ * neg_cache_clear:
+ * @cache: A #NegCache
+ *
+ * Forgets all failures, when the content of the server has changed.
+ */
+void neg_cache_clear(NegCache *cache)
+{
+	g_return_if_fail(cache != NULL);
+
+	g_hash_table_remove_all(cache->entries);
+}
+
+guint neg_cache_get_size(const NegCache *cache)
+{
+	g_return_val_if_fail(cache != NULL, 0);
+
+	return g_hash_table_size(cache->entries);
+}
@@ -0,0 +1,52 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef MAFW_UPNP_SOURCE_NEGCACHE_H
+#define MAFW_UPNP_SOURCE_NEGCACHE_H
+
+#include <glib.h>
+
+/*----------------------------------------------------------------------------
+  Negative result cache
+  ----------------------------------------------------------------------------*/
+
+/* Seconds a failure is remembered */
+#define NEG_CACHE_TTL 30
+
+/* Failures remembered at a time */
+#define NEG_CACHE_MAX_ENTRIES 1024
+
+typedef struct _NegCache NegCache;
+
+NegCache *neg_cache_new(guint ttl);
+void neg_cache_free(NegCache *cache);
+
+void neg_cache_add(NegCache *cache, const gchar *action,
+		   const gchar *itemid, const GError *error);
+gboolean neg_cache_lookup(NegCache *cache, const gchar *action,
+			  const gchar *itemid, GError **error);
+void neg_cache_clear(NegCache *cache);
+guint neg_cache_get_size(const NegCache *cache);
+
+#endif
@@ -0,0 +1,361 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <glib.h>
+#include <glib-object.h>
+#include <string.h>
+#include <libmafw/mafw.h>
+
+#include "mafw-upnp-source-page.h"
+
+/*----------------------------------------------------------------------------
+  Columnar result pages
+  ----------------------------------------------------------------------------*/
+
+/* A page of browse results stored column by column: every string column is
+   an array of offsets into one shared blob, durations are a plain array.
+   Consumers holding thousands of rows pay a few bytes per field instead of
+   a metadata hash table of boxed values per item. */
+struct _ColumnPage {
+	guint first_index;
+	guint n_rows;
+
+	/* guint32 offsets into @blob, COLUMN_PAGE_NONE if missing */
+	GArray *strings[COLUMN_PAGE_N_STRINGS];
+	/* gint32 seconds, COLUMN_PAGE_NO_DURATION if missing */
+	GArray *durations;
+	GString *blob;
+
+	/* MIME type, artist or album => offset, only while the page is
+	   being built */
+	GHashTable *shared_offsets;
+};
+
+/**
+ * column_page_new:
+ * @first_index: Browse index of the first row
+ *
+ * Returns: A new, empty #ColumnPage.
+ */
+ColumnPage *column_page_new(guint first_index)
+{
+	ColumnPage *page;
+	gint i;
+
+	page = g_new0(ColumnPage, 1);
+	page->first_index = first_index;
+	for (i = 0; i < COLUMN_PAGE_N_STRINGS; i++)
+		page->strings[i] = g_array_new(FALSE, FALSE, sizeof(guint32));
+	page->durations = g_array_new(FALSE, FALSE, sizeof(gint32));
+	page->blob = g_string_sized_new(1024);
+	page->shared_offsets = g_hash_table_new_full(g_str_hash, g_str_equal,
+						     g_free, NULL);
+
+	return page;
+}
+
+static guint32 column_page_add_string(ColumnPage *page, const gchar *str)
+{
+	guint32 offset;
+
+	if (str == NULL)
+		return COLUMN_PAGE_NONE;
+
+	offset = page->blob->len;
+	g_string_append_len(page->blob, str, strlen(str) + 1);
+
+	return offset;
+}
+
+/* Adds a value repeating across the page, like the MIME type or the
+   album: a page has a handful of distinct ones, stored once each. */
+static guint32 column_page_add_shared(ColumnPage *page, const gchar *str)
+{
+	gpointer cached;
+	guint32 offset;
+
+	if (str == NULL)
+		return COLUMN_PAGE_NONE;
+
+	if (g_hash_table_lookup_extended(page->shared_offsets, str,
+					 NULL, &cached))
+		return GPOINTER_TO_UINT(cached);
+
+	offset = column_page_add_string(page, str);
+	g_hash_table_insert(page->shared_offsets, g_strdup(str),
+			    GUINT_TO_POINTER(offset));
+
+	return offset;
+}
+
+static const gchar *column_page_first_string(GHashTable *metadata,
+					     const gchar *key)
+{
+	GValue *value;
+
+	value = mafw_metadata_first(metadata, key);
+	if (value == NULL || !G_VALUE_HOLDS_STRING(value))
+		return NULL;
+
+	return g_value_get_string(value);
+}
+
+/**
+ * column_page_append_row:
+ * @page:     A #ColumnPage that is not sealed yet
+ * @objectid: MAFW object ID of the row
+ * @title:    Title, or %NULL
+ * @artist:   Artist, or %NULL
+ * @album:    Album, or %NULL
+ * @uri:      URI, or %NULL
+ * @mime:     MIME type, or %NULL
+ * @duration: Duration in seconds, or %COLUMN_PAGE_NO_DURATION
+ *
+ * Appends a row from its fields.
+ */
+void column_page_append_row(ColumnPage *page, const gchar *objectid,
+			    const gchar *title, const gchar *artist,
+			    const gchar *album, const gchar *uri,
+			    const gchar *mime, gint duration)
+{
+	guint32 offset;
+	gint32 duration32 = duration;
+
+	g_return_if_fail(page != NULL && page->shared_offsets != NULL);
+
+	offset = column_page_add_string(page, objectid);
+	g_array_append_val(page->strings[COLUMN_PAGE_OBJECT_ID], offset);
+
+	offset = column_page_add_string(page, title);
+	g_array_append_val(page->strings[COLUMN_PAGE_TITLE], offset);
+
+	offset = column_page_add_string(page, uri);
+	g_array_append_val(page->strings[COLUMN_PAGE_URI], offset);
+
+	offset = column_page_add_shared(page, mime);
+	g_array_append_val(page->strings[COLUMN_PAGE_MIME], offset);
+
+	offset = column_page_add_shared(page, artist);
+	g_array_append_val(page->strings[COLUMN_PAGE_ARTIST], offset);
+
+	offset = column_page_add_shared(page, album);
+	g_array_append_val(page->strings[COLUMN_PAGE_ALBUM], offset);
+
+	g_array_append_val(page->durations, duration32);
+
+	page->n_rows++;
+}
+
+/**
+ * column_page_append_copy:
+ * @page: A #ColumnPage that is not sealed yet
+ * @src:  Another #ColumnPage
+ * @row:  Row of @src to copy
+ *
+ * Appends a copy of a row of @src.
+ */
+void column_page_append_copy(ColumnPage *page, const ColumnPage *src,
+			     guint row)
+{
+	g_return_if_fail(src != NULL && row < src->n_rows);
+
+	column_page_append_row(
+		page,
+		column_page_get_string(src, row, COLUMN_PAGE_OBJECT_ID),
+		column_page_get_string(src, row, COLUMN_PAGE_TITLE),
+		column_page_get_string(src, row, COLUMN_PAGE_ARTIST),
+		column_page_get_string(src, row, COLUMN_PAGE_ALBUM),
+		column_page_get_string(src, row, COLUMN_PAGE_URI),
+		column_page_get_string(src, row, COLUMN_PAGE_MIME),
+		column_page_get_duration(src, row));
+}
+
+/**
+ * column_page_append:
+ * @page:     A #ColumnPage that is not sealed yet
+ * @objectid: MAFW object ID of the row
+ * @metadata: Metadata of the row
+ *
+ * Appends a row taking the title, artist, album, URI, MIME type and
+ * duration from @metadata.  @metadata is not referenced and can be reused afterwards.
+ */
+void column_page_append(ColumnPage *page, const gchar *objectid,
+			GHashTable *metadata)
+{
+	GValue *value;
+	gint duration = COLUMN_PAGE_NO_DURATION;
+
+	value = mafw_metadata_first(metadata, MAFW_METADATA_KEY_DURATION);
+	if (value != NULL && G_VALUE_HOLDS_INT(value))
+		duration = g_value_get_int(value);
+
+	column_page_append_row(page, objectid,
+		column_page_first_string(metadata, MAFW_METADATA_KEY_TITLE),
+		column_page_first_string(metadata, MAFW_METADATA_KEY_ARTIST),
+		column_page_first_string(metadata, MAFW_METADATA_KEY_ALBUM),
+		column_page_first_string(metadata, MAFW_METADATA_KEY_URI),
+		column_page_first_string(metadata, MAFW_METADATA_KEY_MIME),
+		duration);
+}
+
+/**
+ * column_page_seal:
+ * @page: A #ColumnPage
+ *
+ * Drops the bookkeeping only needed while appending rows.  No rows may be
+ * appended to a sealed page.
+ */
+void column_page_seal(ColumnPage *page)
+{
+	g_return_if_fail(page != NULL);
+
+	if (page->shared_offsets != NULL)
+	{
+		g_hash_table_destroy(page->shared_offsets);
+		page->shared_offsets = NULL;
+	}
+}
+
+/**
+ * column_page_free:
+ * @page: A #ColumnPage, or %NULL
+ */
+void column_page_free(ColumnPage *page)
+{
+	gint i;
+
+	if (page == NULL)
+		return;
+
+	column_page_seal(page);
+	for (i = 0; i < COLUMN_PAGE_N_STRINGS; i++)
+		g_array_free(page->strings[i], TRUE);
+	g_array_free(page->durations, TRUE);
+	g_string_free(page->blob, TRUE);
+	g_free(page);
+}
+
+guint column_page_get_n_rows(const ColumnPage *page)
+{
+	g_return_val_if_fail(page != NULL, 0);
+	return page->n_rows;
+}
+
+guint column_page_get_first_index(const ColumnPage *page)
+{
+	g_return_val_if_fail(page != NULL, 0);
+	return page->first_index;
+}
+
+/**
+ * column_page_get_string:
+ * @page:   A #ColumnPage
+ * @row:    Row number, starting from 0
+ * @column: The string column
+ *
+ * Returns: The string, owned by @page, or %NULL if the row has none.
+ */
+const gchar *column_page_get_string(const ColumnPage *page, guint row,
+				    ColumnPageString column)
+{
+	guint32 offset;
+
+	g_return_val_if_fail(page != NULL, NULL);
+	g_return_val_if_fail(column < COLUMN_PAGE_N_STRINGS, NULL);
+	g_return_val_if_fail(row < page->n_rows, NULL);
+
+	offset = g_array_index(page->strings[column], guint32, row);
+	if (offset == COLUMN_PAGE_NONE)
+		return NULL;
+
+	return page->blob->str + offset;
+}
+
+/**
+ * column_page_get_duration:
+ * @page: A #ColumnPage
+ * @row:  Row number, starting from 0
+ *
+ * Returns: The duration in seconds, or %COLUMN_PAGE_NO_DURATION.
+ */
+gint column_page_get_duration(const ColumnPage *page, guint row)
+{
+	g_return_val_if_fail(page != NULL, COLUMN_PAGE_NO_DURATION);
+	g_return_val_if_fail(row < page->n_rows, COLUMN_PAGE_NO_DURATION);
+
+	return g_array_index(page->durations, gint32, row);
+}
+
+/**
+ * column_page_get_offsets:
+ * @page:   A #ColumnPage
+ * @column: The string column
+ *
+ * Returns: The n_rows blob offsets of @column, for consumers that walk the
+ * columns directly.
+ */
+const guint32 *column_page_get_offsets(const ColumnPage *page,
+				       ColumnPageString column)
+{
+	g_return_val_if_fail(page != NULL, NULL);
+	g_return_val_if_fail(column < COLUMN_PAGE_N_STRINGS, NULL);
+
+	return (const guint32 *)page->strings[column]->data;
+}
+
+const gint32 *column_page_get_durations(const ColumnPage *page)
+{
+	g_return_val_if_fail(page != NULL, NULL);
+	return (const gint32 *)page->durations->data;
+}
+
+/**
+ * column_page_get_blob:
+ * @page:   A #ColumnPage
+ * @length: Set to the length of the blob, or %NULL
+ *
+ * Returns: The NUL-separated strings that the offsets point into.
+ */
+const gchar *column_page_get_blob(const ColumnPage *page, gsize *length)
+{
+	g_return_val_if_fail(page != NULL, NULL);
+
+	if (length != NULL)
+		*length = page->blob->len;
+	return page->blob->str;
+}
+
+/**
+ * column_page_get_size:
+ * @page: A #ColumnPage
+ *
+ * Returns: The number of bytes used by the rows of @page.
+ */
+gsize column_page_get_size(const ColumnPage *page)
+{
+	g_return_val_if_fail(page != NULL, 0);
+
+	return page->n_rows * (COLUMN_PAGE_N_STRINGS * sizeof(guint32) +
+			       sizeof(gint32)) + page->blob->len;
+}
@@ -0,0 +1,77 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef MAFW_UPNP_SOURCE_PAGE_H
+#define MAFW_UPNP_SOURCE_PAGE_H
+
+#include <glib.h>
+
+/*----------------------------------------------------------------------------
+  Columnar result pages
+  ----------------------------------------------------------------------------*/
+
+/* String columns of a #ColumnPage */
+typedef enum {
+	COLUMN_PAGE_OBJECT_ID,
+	COLUMN_PAGE_TITLE,
+	COLUMN_PAGE_URI,
+	COLUMN_PAGE_MIME,
+	COLUMN_PAGE_ARTIST,
+	COLUMN_PAGE_ALBUM,
+	COLUMN_PAGE_N_STRINGS
+} ColumnPageString;
+
+/* Offset of a missing string */
+#define COLUMN_PAGE_NONE G_MAXUINT32
+
+/* Duration of an item without one */
+#define COLUMN_PAGE_NO_DURATION (-1)
+
+typedef struct _ColumnPage ColumnPage;
+
+ColumnPage *column_page_new(guint first_index);
+void column_page_append_row(ColumnPage *page, const gchar *objectid,
+			    const gchar *title, const gchar *artist,
+			    const gchar *album, const gchar *uri,
+			    const gchar *mime, gint duration);
+void column_page_append_copy(ColumnPage *page, const ColumnPage *src,
+			     guint row);
+void column_page_append(ColumnPage *page, const gchar *objectid,
+			GHashTable *metadata);
+void column_page_seal(ColumnPage *page);
+void column_page_free(ColumnPage *page);
+
+guint column_page_get_n_rows(const ColumnPage *page);
+guint column_page_get_first_index(const ColumnPage *page);
+const gchar *column_page_get_string(const ColumnPage *page, guint row,
+				    ColumnPageString column);
+gint column_page_get_duration(const ColumnPage *page, guint row);
+
+const guint32 *column_page_get_offsets(const ColumnPage *page,
+				       ColumnPageString column);
+const gint32 *column_page_get_durations(const ColumnPage *page);
+const gchar *column_page_get_blob(const ColumnPage *page, gsize *length);
+gsize column_page_get_size(const ColumnPage *page);
+
+#endif
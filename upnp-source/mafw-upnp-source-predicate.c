@@ -0,0 +1,396 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <glib.h>
+#include <glib-object.h>
+#include <string.h>
+#include <libgupnp-av/gupnp-av.h>
+#include <libmafw/mafw.h>
+
+#include "mafw-upnp-source-predicate.h"
+#include "mafw-upnp-source-util.h"
+
+/*----------------------------------------------------------------------------
+  Local filter evaluation
+  ----------------------------------------------------------------------------*/
+
+/* A MafwFilter compiled for matching items of a browse, when the server
+   cannot search by it.  The filter tree is flattened into one array in
+   prefix order: the operands of an operator follow it, and every op knows
+   where its subtree ends, so that and/or can short-circuit by jumping over
+   the operands left.  Values are unquoted and parsed once here instead of
+   for every item. */
+typedef struct {
+	MafwFilterType type;
+
+	/* Index of the op following this subtree */
+	guint end;
+
+	/* Simple filters: the metadata key and the unquoted value */
+	gchar *key;
+	gchar *text;
+
+	/* @text as an integer, for comparing numeric metadata */
+	gint64 number;
+	gboolean is_number;
+
+	/* mafw_f_approx: the parts of @text between wildcards */
+	gchar **segments;
+} PredOp;
+
+struct _Predicate {
+	PredOp *ops;
+	guint n_ops;
+
+	/* The metadata keys the filter looks at, MUPnPSrc_MKey_* */
+	guint64 keys;
+};
+
+static guint predicate_count(const MafwFilter *filter)
+{
+	MafwFilter *const *part;
+	guint n;
+
+	n = 1;
+	if (!MAFW_FILTER_IS_SIMPLE(filter))
+		for (part = filter->parts; *part != NULL; part++)
+			n += predicate_count(*part);
+
+	return n;
+}
+
+/* Unquotes the value of a simple filter into @op.  Unquoted wildcards
+   only mean something to mafw_f_approx; unlike UPnP searches, they may be
+   anywhere in the value. */
+static gboolean predicate_unquote(PredOp *op, const gchar *value,
+				  GError **error)
+{
+	GPtrArray *segments;
+	GString *text;
+	gchar c;
+
+	segments = g_ptr_array_new();
+	text = g_string_new(NULL);
+	while (*value != '\0')
+	{
+		if (op->type == mafw_f_approx && *value == '*')
+		{
+			if (text->len > 0)
+				g_ptr_array_add(segments,
+						g_strndup(text->str,
+							  text->len));
+			g_string_truncate(text, 0);
+			value++;
+			continue;
+		}
+
+		value = mafw_filter_unquote_char(value, &c);
+		if (value == NULL || c == '\0')
+		{
+			g_set_error(error, MAFW_SOURCE_ERROR,
+				    MAFW_SOURCE_ERROR_INVALID_SEARCH_STRING,
+				    "%s", value == NULL
+				    ? "Invalid escape sequence"
+				    : "NIL in property value");
+			g_ptr_array_foreach(segments, (GFunc)g_free, NULL);
+			g_ptr_array_free(segments, TRUE);
+			g_string_free(text, TRUE);
+			return FALSE;
+		}
+		g_string_append_c(text, c);
+	}
+
+	if (op->type == mafw_f_approx)
+	{
+		if (text->len > 0)
+			g_ptr_array_add(segments, g_strndup(text->str,
+							    text->len));
+		g_ptr_array_add(segments, NULL);
+		op->segments = (gchar **)g_ptr_array_free(segments, FALSE);
+		g_string_free(text, TRUE);
+		return TRUE;
+	}
+
+	g_ptr_array_free(segments, TRUE);
+	op->text = g_string_free(text, FALSE);
+	if (*op->text != '\0')
+	{
+		gchar *end;
+
+		op->number = g_ascii_strtoll(op->text, &end, 10);
+		op->is_number = *end == '\0';
+	}
+
+	return TRUE;
+}
+
+static gboolean predicate_fill(Predicate *pred, const MafwFilter *filter,
+			       guint *next, GError **error)
+{
+	MafwFilter *const *part;
+	PredOp *op;
+
+	op = &pred->ops[(*next)++];
+	op->type = filter->type;
+
+	if (MAFW_FILTER_IS_SIMPLE(filter))
+	{
+		op->end = *next;
+		op->key = g_strdup(filter->key);
+		pred->keys |= util_get_upnpflag_from_mafwkey(filter->key);
+		if (filter->type == mafw_f_exists)
+			return TRUE;
+
+		g_assert(filter->value != NULL);
+		return predicate_unquote(op, filter->value, error);
+	}
+
+	g_assert(filter->parts != NULL && filter->parts[0] != NULL);
+	for (part = filter->parts; *part != NULL; part++)
+		if (!predicate_fill(pred, *part, next, error))
+			return FALSE;
+	op->end = *next;
+
+	return TRUE;
+}
+
+/**
+ * predicate_compile:
+ * @filter: A #MafwFilter
+ * @error:  Set if the values of @filter are malformed
+ *
+ * Compiles @filter for predicate_match().
+ *
+ * Returns: A #Predicate, or %NULL on error.
+ */
+Predicate *predicate_compile(const MafwFilter *filter, GError **error)
+{
+	Predicate *pred;
+	guint next;
+
+	g_return_val_if_fail(filter != NULL, NULL);
+
+	pred = g_new0(Predicate, 1);
+	pred->n_ops = predicate_count(filter);
+	pred->ops = g_new0(PredOp, pred->n_ops);
+
+	next = 0;
+	if (!predicate_fill(pred, filter, &next, error))
+	{
+		predicate_free(pred);
+		return NULL;
+	}
+	g_assert(next == pred->n_ops);
+
+	return pred;
+}
+
+void predicate_free(Predicate *pred)
+{
+	guint i;
+
+	if (pred == NULL)
+		return;
+
+	for (i = 0; i < pred->n_ops; i++)
+	{
+		g_free(pred->ops[i].key);
+		g_free(pred->ops[i].text);
+		g_strfreev(pred->ops[i].segments);
+	}
+	g_free(pred->ops);
+	g_free(pred);
+}
+
+/**
+ * predicate_get_keys:
+ * @pred: A #Predicate
+ *
+ * Returns: The MUPnPSrc_MKey_* flags of the metadata keys @pred needs to
+ * be matched against.  Keys the source does not know are never present.
+ */
+guint64 predicate_get_keys(const Predicate *pred)
+{
+	g_return_val_if_fail(pred != NULL, 0);
+
+	return pred->keys;
+}
+
+static gboolean predicate_value_number(const GValue *value, gint64 *number)
+{
+	switch (G_VALUE_TYPE(value))
+	{
+	case G_TYPE_INT:
+		*number = g_value_get_int(value);
+		return TRUE;
+	case G_TYPE_UINT:
+		*number = g_value_get_uint(value);
+		return TRUE;
+	case G_TYPE_LONG:
+		*number = g_value_get_long(value);
+		return TRUE;
+	case G_TYPE_INT64:
+		*number = g_value_get_int64(value);
+		return TRUE;
+	case G_TYPE_BOOLEAN:
+		*number = g_value_get_boolean(value);
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+/* strstr() that ignores the case of ASCII letters.  Metadata is UTF-8, so
+   no multi-byte character can match half of another one. */
+static const gchar *predicate_strcasestr(const gchar *haystack,
+					 const gchar *needle)
+{
+	gsize i;
+
+	for (; *haystack != '\0'; haystack++)
+	{
+		for (i = 0; needle[i] != '\0'; i++)
+			if (g_ascii_tolower(haystack[i]) !=
+			    g_ascii_tolower(needle[i]))
+				break;
+		if (needle[i] == '\0')
+			return haystack;
+	}
+
+	return NULL;
+}
+
+/* Whether @str has the segments of @op in order, case-insensitively. */
+static gboolean predicate_approx(const PredOp *op, const gchar *str)
+{
+	gchar **segment;
+
+	for (segment = op->segments; *segment != NULL; segment++)
+	{
+		str = predicate_strcasestr(str, *segment);
+		if (str == NULL)
+			return FALSE;
+		str += strlen(*segment);
+	}
+
+	return TRUE;
+}
+
+static gboolean predicate_match_simple(const PredOp *op,
+				       GHashTable *metadata)
+{
+	const GValue *value;
+	gchar buf[32];
+	const gchar *str;
+	gint64 number = 0;
+	gint cmp;
+
+	value = mafw_metadata_first(metadata, op->key);
+	if (value == NULL)
+		return FALSE;
+	if (op->type == mafw_f_exists)
+		return TRUE;
+
+	if (G_VALUE_HOLDS_STRING(value))
+		str = g_value_get_string(value);
+	else if (predicate_value_number(value, &number))
+	{
+		g_snprintf(buf, sizeof(buf), "%" G_GINT64_FORMAT, number);
+		str = buf;
+	}
+	else
+		return FALSE;
+	if (str == NULL)
+		return FALSE;
+
+	if (op->type == mafw_f_approx)
+		return predicate_approx(op, str);
+
+	/* Numbers compare as numbers, so that "9" < "10" */
+	if (op->is_number && !G_VALUE_HOLDS_STRING(value))
+		cmp = number < op->number ? -1 : number > op->number;
+	else
+		cmp = strcmp(str, op->text);
+
+	switch (op->type)
+	{
+	case mafw_f_eq:
+		return cmp == 0;
+	case mafw_f_lt:
+		return cmp < 0;
+	case mafw_f_gt:
+		return cmp > 0;
+	default:
+		g_assert_not_reached();
+		return FALSE;
+	}
+}
+
+static gboolean predicate_eval(const PredOp *ops, guint i,
+			       GHashTable *metadata)
+{
+	const PredOp *op = &ops[i];
+	guint part;
+
+	switch (op->type)
+	{
+	case mafw_f_and:
+		for (part = i + 1; part < op->end; part = ops[part].end)
+			if (!predicate_eval(ops, part, metadata))
+				return FALSE;
+		return TRUE;
+	case mafw_f_or:
+		for (part = i + 1; part < op->end; part = ops[part].end)
+			if (predicate_eval(ops, part, metadata))
+				return TRUE;
+		return FALSE;
+	case mafw_f_not:
+		return !predicate_eval(ops, i + 1, metadata);
+	default:
+		return predicate_match_simple(op, metadata);
+	}
+}
+
+/**
+ * predicate_match:
+ * @pred:     A #Predicate
+ * @metadata: Metadata of an item, with at least the keys of
+ *            predicate_get_keys()
+ *
+ * Evaluates the filter @pred was compiled from on an item.  Simple
+ * filters on a key the item lacks are false.  Comparisons are numeric
+ * when the metadata is a number and the value of the filter too, and
+ * string comparisons otherwise; mafw_f_approx is a substring match
+ * ignoring the case of ASCII letters, with wildcards between substrings
+ * that must appear in order.
+ *
+ * Returns: Whether the item passes the filter.
+ */
+gboolean predicate_match(const Predicate *pred, GHashTable *metadata)
+{
+	g_return_val_if_fail(pred != NULL, FALSE);
+	g_return_val_if_fail(metadata != NULL, FALSE);
+
+	return predicate_eval(pred->ops, 0, metadata);
+}
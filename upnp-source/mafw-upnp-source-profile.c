@@ -0,0 +1,551 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <string.h>
+#include <glib.h>
+
+#include "mafw-upnp-source-profile.h"
+#include "mafw-upnp-source-catalog.h"
+
+/*----------------------------------------------------------------------------
+  Server profile
+  ----------------------------------------------------------------------------*/
+
+#define PROFILE_GROUP "Server"
+
+/* What has been learned of a server across sessions: its capabilities and
+   how it deviates from the ContentDirectory specification, so that the
+   browse path does not repeat the requests that do not work. */
+struct _ServerProfile {
+	/* Where to save, NULL to keep in memory only */
+	gchar *path;
+	gboolean dirty;
+	guint save_id;
+
+	/* From GetSortCapabilities and GetSearchCapabilities, NULL until
+	   known */
+	gchar *sort_caps;
+	gchar *search_caps;
+
+	/* RequestedCount the server caps pages at, 0 if not seen */
+	guint max_count;
+
+	/* Most items the server has returned in one page */
+	guint max_returned;
+
+	/* Whether a page shorter than asked means the end */
+	ProfileAnswer short_page_ends;
+
+	/* Whether TotalMatches agrees with what the server returns */
+	ProfileAnswer total_matches_reliable;
+
+	/* Response times */
+	guint requests;
+	guint latency;
+};
+
+/**
+ * server_profile_get_path:
+ * @uuid: UUID of the server, as returned by util_udn_to_uuid()
+ *
+ * Returns: The path of the profile of the server, next to its catalog.
+ * Free with g_free().
+ */
+gchar *server_profile_get_path(const gchar *uuid)
+{
+	gchar *dir;
+	gchar *name;
+	gchar *path;
+
+	g_return_val_if_fail(uuid != NULL, NULL);
+
+	dir = catalog_get_dir();
+	name = g_strconcat(uuid, ".profile", NULL);
+	path = g_build_filename(dir, name, NULL);
+	g_free(name);
+	g_free(dir);
+
+	return path;
+}
+
+static ProfileAnswer profile_get_answer(GKeyFile *file, const gchar *key)
+{
+	gint answer;
+
+	answer = g_key_file_get_integer(file, PROFILE_GROUP, key, NULL);
+	if (answer != PROFILE_NO && answer != PROFILE_YES)
+		return PROFILE_UNKNOWN;
+
+	return answer;
+}
+
+/**
+ * server_profile_load:
+ * @path: Path of the profile file, or %NULL
+ *
+ * Reads what is known of a server.  A missing or broken file gives an
+ * empty profile that will be written to @path.  Without @path the profile
+ * is not saved.
+ *
+ * Returns: A new #ServerProfile.
+ */
+ServerProfile *server_profile_load(const gchar *path)
+{
+	ServerProfile *profile;
+	GKeyFile *file;
+	gint value;
+
+	profile = g_new0(ServerProfile, 1);
+	profile->path = g_strdup(path);
+	if (path == NULL)
+		return profile;
+
+	file = g_key_file_new();
+	if (g_key_file_load_from_file(file, path, 0, NULL))
+	{
+		profile->sort_caps = g_key_file_get_string(
+			file, PROFILE_GROUP, "SortCaps", NULL);
+		profile->search_caps = g_key_file_get_string(
+			file, PROFILE_GROUP, "SearchCaps", NULL);
+		value = g_key_file_get_integer(file, PROFILE_GROUP,
+					       "MaxRequestedCount", NULL);
+		profile->max_count = MAX(value, 0);
+		value = g_key_file_get_integer(file, PROFILE_GROUP,
+					       "MaxNumberReturned", NULL);
+		profile->max_returned = MAX(value, 0);
+		profile->short_page_ends = profile_get_answer(
+			file, "ShortPageEnds");
+		profile->total_matches_reliable = profile_get_answer(
+			file, "TotalMatchesReliable");
+		value = g_key_file_get_integer(file, PROFILE_GROUP,
+					       "Requests", NULL);
+		profile->requests = MAX(value, 0);
+		value = g_key_file_get_integer(file, PROFILE_GROUP,
+					       "Latency", NULL);
+		profile->latency = MAX(value, 0);
+	}
+	g_key_file_free(file);
+
+	return profile;
+}
+
+/**
+ * server_profile_save:
+ * @profile: A #ServerProfile
+ * @error:   Location for the reason of failure
+ *
+ * Writes the profile to its file, if it has changed.
+ *
+ * Returns: %FALSE if the profile could not be written.
+ */
+gboolean server_profile_save(ServerProfile *profile, GError **error)
+{
+	GKeyFile *file;
+	gchar *dirname;
+	gchar *data;
+	gsize length;
+	gboolean written;
+
+	g_return_val_if_fail(profile != NULL, FALSE);
+
+	if (profile->save_id != 0)
+	{
+		g_source_remove(profile->save_id);
+		profile->save_id = 0;
+	}
+	if (!profile->dirty || profile->path == NULL)
+		return TRUE;
+
+	file = g_key_file_new();
+	if (profile->sort_caps != NULL)
+		g_key_file_set_string(file, PROFILE_GROUP, "SortCaps",
+				      profile->sort_caps);
+	if (profile->search_caps != NULL)
+		g_key_file_set_string(file, PROFILE_GROUP, "SearchCaps",
+				      profile->search_caps);
+	g_key_file_set_integer(file, PROFILE_GROUP, "MaxRequestedCount",
+			       profile->max_count);
+	g_key_file_set_integer(file, PROFILE_GROUP, "MaxNumberReturned",
+			       profile->max_returned);
+	g_key_file_set_integer(file, PROFILE_GROUP, "ShortPageEnds",
+			       profile->short_page_ends);
+	g_key_file_set_integer(file, PROFILE_GROUP, "TotalMatchesReliable",
+			       profile->total_matches_reliable);
+	g_key_file_set_integer(file, PROFILE_GROUP, "Requests",
+			       profile->requests);
+	g_key_file_set_integer(file, PROFILE_GROUP, "Latency",
+			       profile->latency);
+	data = g_key_file_to_data(file, &length, NULL);
+	g_key_file_free(file);
+
+	dirname = g_path_get_dirname(profile->path);
+	g_mkdir_with_parents(dirname, 0700);
+	g_free(dirname);
+
+	written = g_file_set_contents(profile->path, data, length, error);
+	g_free(data);
+	if (written)
+		profile->dirty = FALSE;
+
+	return written;
+}
+
+/**
+ * server_profile_free:
+ * @profile: A #ServerProfile, or %NULL
+ *
+ * Saves @profile if needed and frees it.
+ */
+void server_profile_free(ServerProfile *profile)
+{
+	GError *error = NULL;
+
+	if (profile == NULL)
+		return;
+
+	if (!server_profile_save(profile, &error))
+	{
+		g_warning("Cannot write server profile %s: %s",
+			  profile->path, error->message);
+		g_error_free(error);
+	}
+
+	g_free(profile->path);
+	g_free(profile->sort_caps);
+	g_free(profile->search_caps);
+	g_free(profile);
+}
+
+static gboolean profile_save_cb(ServerProfile *profile)
+{
+	GError *error = NULL;
+
+	profile->save_id = 0;
+	if (!server_profile_save(profile, &error))
+	{
+		g_warning("Cannot write server profile %s: %s",
+			  profile->path, error->message);
+		g_error_free(error);
+	}
+
+	return FALSE;
+}
+
+/* Something was learned.  Statistics alone are saved with the next
+   quirk or at exit. */
+static void profile_changed(ServerProfile *profile, gboolean learned)
+{
+	profile->dirty = TRUE;
+	if (learned && profile->path != NULL && profile->save_id == 0)
+		profile->save_id = g_timeout_add_seconds(
+			PROFILE_SAVE_DELAY, (GSourceFunc)profile_save_cb,
+			profile);
+}
+
+static void profile_set_caps(ServerProfile *profile, gchar **field,
+			     const gchar *caps)
+{
+	if (caps == NULL || g_strcmp0(*field, caps) == 0)
+		return;
+
+	g_free(*field);
+	*field = g_strdup(caps);
+	profile_changed(profile, TRUE);
+}
+
+void server_profile_set_sort_caps(ServerProfile *profile, const gchar *caps)
+{
+	g_return_if_fail(profile != NULL);
+
+	profile_set_caps(profile, &profile->sort_caps, caps);
+}
+
+void server_profile_set_search_caps(ServerProfile *profile,
+				    const gchar *caps)
+{
+	g_return_if_fail(profile != NULL);
+
+	profile_set_caps(profile, &profile->search_caps, caps);
+}
+
+/* Whether the comma separated @caps list @property */
+static gboolean profile_caps_have(const gchar *caps, const gchar *property,
+				  gsize length)
+{
+	const gchar *end;
+
+	while (*caps != '\0')
+	{
+		end = strchr(caps, ',');
+		if (end == NULL)
+			end = caps + strlen(caps);
+		if ((gsize)(end - caps) == length &&
+		    strncmp(caps, property, length) == 0)
+			return TRUE;
+		caps = *end != '\0' ? end + 1 : end;
+	}
+
+	return FALSE;
+}
+
+/**
+ * server_profile_can_sort:
+ * @profile:       A #ServerProfile
+ * @sort_criteria: UPnP SortCriteria, like "+dc:title,-upnp:album"
+ *
+ * Returns: %FALSE if the server is known not to sort by every property of
+ * @sort_criteria.
+ */
+gboolean server_profile_can_sort(const ServerProfile *profile,
+				 const gchar *sort_criteria)
+{
+	const gchar *end;
+
+	g_return_val_if_fail(profile != NULL, TRUE);
+	g_return_val_if_fail(sort_criteria != NULL, TRUE);
+
+	if (profile->sort_caps == NULL || strcmp(profile->sort_caps, "*") == 0)
+		return TRUE;
+
+	while (*sort_criteria != '\0')
+	{
+		if (*sort_criteria == '+' || *sort_criteria == '-')
+			sort_criteria++;
+		end = strchr(sort_criteria, ',');
+		if (end == NULL)
+			end = sort_criteria + strlen(sort_criteria);
+		if (!profile_caps_have(profile->sort_caps, sort_criteria,
+				       end - sort_criteria))
+			return FALSE;
+		sort_criteria = *end != '\0' ? end + 1 : end;
+	}
+
+	return TRUE;
+}
+
+/**
+ * server_profile_can_search:
+ * @profile: A #ServerProfile
+ *
+ * Returns: %FALSE if the server is known not to support Search at all.
+ */
+gboolean server_profile_can_search(const ServerProfile *profile)
+{
+	g_return_val_if_fail(profile != NULL, TRUE);
+
+	return profile->search_caps == NULL || *profile->search_caps != '\0';
+}
+
+/**
+ * server_profile_can_search_by:
+ * @profile:  A #ServerProfile
+ * @property: A DIDL-Lite property, like "upnp:artist"
+ *
+ * Returns: %FALSE if the server is known not to search by @property.
+ */
+gboolean server_profile_can_search_by(const ServerProfile *profile,
+				      const gchar *property)
+{
+	g_return_val_if_fail(profile != NULL, TRUE);
+	g_return_val_if_fail(property != NULL, TRUE);
+
+	if (profile->search_caps == NULL ||
+	    strcmp(profile->search_caps, "*") == 0)
+		return TRUE;
+
+	return profile_caps_have(profile->search_caps, property,
+				 strlen(property));
+}
+
+/**
+ * server_profile_get_page_size:
+ * @profile:      A #ServerProfile
+ * @default_size: RequestedCount to use if the server does not cap pages
+ *
+ * Returns: The RequestedCount to browse with.
+ */
+guint server_profile_get_page_size(const ServerProfile *profile,
+				   guint default_size)
+{
+	g_return_val_if_fail(profile != NULL, default_size);
+
+	if (profile->max_count != 0 && profile->max_count < default_size)
+		return profile->max_count;
+
+	return default_size;
+}
+
+/**
+ * server_profile_short_page:
+ * @profile:   A #ServerProfile
+ * @requested: RequestedCount of a request
+ * @returned:  Items it returned, less than @requested
+ * @was_end:   Whether the next request returned nothing
+ *
+ * Learns from a page shorter than asked.  If more items followed, the
+ * server caps pages at @returned.  If more items followed even though the
+ * cap was respected, short pages do not tell anything.
+ */
+void server_profile_short_page(ServerProfile *profile, guint requested,
+			       guint returned, gboolean was_end)
+{
+	g_return_if_fail(profile != NULL);
+	g_return_if_fail(returned < requested);
+
+	if (was_end)
+	{
+		if (profile->short_page_ends == PROFILE_UNKNOWN)
+		{
+			profile->short_page_ends = PROFILE_YES;
+			profile_changed(profile, TRUE);
+		}
+	}
+	else if (profile->max_count == 0 || requested > profile->max_count)
+	{
+		g_debug("Server caps pages at %u items", returned);
+		profile->max_count = returned;
+		profile_changed(profile, TRUE);
+	}
+	else if (profile->short_page_ends != PROFILE_NO)
+	{
+		profile->short_page_ends = PROFILE_NO;
+		profile_changed(profile, TRUE);
+	}
+}
+
+ProfileAnswer server_profile_short_page_ends(const ServerProfile *profile)
+{
+	g_return_val_if_fail(profile != NULL, PROFILE_UNKNOWN);
+
+	return profile->short_page_ends;
+}
+
+/**
+ * server_profile_page:
+ * @profile:  A #ServerProfile
+ * @returned: Items a request returned
+ *
+ * Learns the size of the largest page the server gives.
+ */
+void server_profile_page(ServerProfile *profile, guint returned)
+{
+	g_return_if_fail(profile != NULL);
+
+	if (returned > profile->max_returned)
+	{
+		profile->max_returned = returned;
+		profile_changed(profile, TRUE);
+	}
+}
+
+/**
+ * server_profile_short_page_is_end:
+ * @profile:  A #ServerProfile
+ * @returned: Items a request returned, less than asked
+ *
+ * A short page is the last one only with servers known to end with one,
+ * and only if it is shorter than the pages of the server can be: than the
+ * cap learned, or without one, than a page it has returned.  Otherwise
+ * the page may have been capped, and the next one is asked to find out.
+ *
+ * Returns: %TRUE if the page of @returned items is known to be the last.
+ */
+gboolean server_profile_short_page_is_end(const ServerProfile *profile,
+					  guint returned)
+{
+	guint limit;
+
+	g_return_val_if_fail(profile != NULL, FALSE);
+
+	if (profile->short_page_ends != PROFILE_YES)
+		return FALSE;
+
+	limit = profile->max_count != 0 ? profile->max_count
+		: profile->max_returned;
+
+	return returned < limit;
+}
+
+/**
+ * server_profile_total_matches:
+ * @profile: A #ServerProfile
+ * @right:   Whether TotalMatches was the number of items there were
+ *
+ * Learns from the end of a browse.  One wrong TotalMatches is enough to
+ * not trust it anymore.
+ */
+void server_profile_total_matches(ServerProfile *profile, gboolean right)
+{
+	g_return_if_fail(profile != NULL);
+
+	if (profile->total_matches_reliable == PROFILE_NO ||
+	    (right && profile->total_matches_reliable == PROFILE_YES))
+		return;
+
+	profile->total_matches_reliable = right ? PROFILE_YES : PROFILE_NO;
+	profile_changed(profile, TRUE);
+}
+
+ProfileAnswer server_profile_total_matches_reliable(
+	const ServerProfile *profile)
+{
+	g_return_val_if_fail(profile != NULL, PROFILE_UNKNOWN);
+
+	return profile->total_matches_reliable;
+}
+
+/**
+ * server_profile_add_latency:
+ * @profile: A #ServerProfile
+ * @msecs:   Response time of a request
+ *
+ * Updates the moving mean of the response time.
+ */
+void server_profile_add_latency(ServerProfile *profile, guint msecs)
+{
+	g_return_if_fail(profile != NULL);
+
+	if (profile->requests == 0)
+		profile->latency = msecs;
+	else
+		profile->latency = (profile->latency *
+				    (PROFILE_LATENCY_WEIGHT - 1) + msecs) /
+			PROFILE_LATENCY_WEIGHT;
+	if (profile->requests < G_MAXINT)
+		profile->requests++;
+	profile_changed(profile, FALSE);
+}
+
+/**
+ * server_profile_get_latency:
+ * @profile: A #ServerProfile
+ *
+ * Returns: The mean response time in milliseconds, 0 if not known.
+ */
+guint server_profile_get_latency(const ServerProfile *profile)
+{
+	g_return_val_if_fail(profile != NULL, 0);
+
+	return profile->latency;
+}
@@ -0,0 +1,78 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef MAFW_UPNP_SOURCE_PROFILE_H
+#define MAFW_UPNP_SOURCE_PROFILE_H
+
+#include <glib.h>
+
+/*----------------------------------------------------------------------------
+  Server profile
+  ----------------------------------------------------------------------------*/
+
+/* Seconds a learned quirk waits before it is written out */
+#define PROFILE_SAVE_DELAY 5
+
+/* Weight of the latest request in the mean response time, 1/n */
+#define PROFILE_LATENCY_WEIGHT 8
+
+typedef enum {
+	PROFILE_UNKNOWN,
+	PROFILE_NO,
+	PROFILE_YES
+} ProfileAnswer;
+
+typedef struct _ServerProfile ServerProfile;
+
+gchar *server_profile_get_path(const gchar *uuid);
+ServerProfile *server_profile_load(const gchar *path);
+gboolean server_profile_save(ServerProfile *profile, GError **error);
+void server_profile_free(ServerProfile *profile);
+
+void server_profile_set_sort_caps(ServerProfile *profile, const gchar *caps);
+void server_profile_set_search_caps(ServerProfile *profile,
+				    const gchar *caps);
+gboolean server_profile_can_sort(const ServerProfile *profile,
+				 const gchar *sort_criteria);
+gboolean server_profile_can_search(const ServerProfile *profile);
+gboolean server_profile_can_search_by(const ServerProfile *profile,
+				      const gchar *property);
+
+guint server_profile_get_page_size(const ServerProfile *profile,
+				   guint default_size);
+void server_profile_short_page(ServerProfile *profile, guint requested,
+			       guint returned, gboolean was_end);
+ProfileAnswer server_profile_short_page_ends(const ServerProfile *profile);
+void server_profile_page(ServerProfile *profile, guint returned);
+gboolean server_profile_short_page_is_end(const ServerProfile *profile,
+					  guint returned);
+
+void server_profile_total_matches(ServerProfile *profile, gboolean right);
+ProfileAnswer server_profile_total_matches_reliable(
+	const ServerProfile *profile);
+
+void server_profile_add_latency(ServerProfile *profile, guint msecs);
+guint server_profile_get_latency(const ServerProfile *profile);
+
+#endif
@@ -0,0 +1,170 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <glib.h>
+#include <string.h>
+#include <libmafw/mafw.h>
+#include <libgupnp-av/gupnp-av.h>
+
+#include "mafw-upnp-source-scratch.h"
+
+/*----------------------------------------------------------------------------
+  Per-page scratch
+  ----------------------------------------------------------------------------*/
+
+/* Buffers reused from one page of browse results to the next instead of
+   being allocated for every item: the object ID of the current item and,
+   for the columnar browse, the metadata tables that never leave the
+   source. */
+struct _PageScratch {
+	/* "<uuid>::" followed by the ID of the current item */
+	GString *objectid;
+	gsize prefix_len;
+	/* Emptied metadata tables ready for reuse */
+	GQueue spare_tables;
+};
+
+/**
+ * page_scratch_new:
+ * @uuid: UUID of the source whose pages are processed
+ *
+ * Returns: A new #PageScratch.
+ */
+PageScratch *page_scratch_new(const gchar *uuid)
+{
+	PageScratch *scratch;
+
+	scratch = g_new0(PageScratch, 1);
+	scratch->objectid = g_string_sized_new(64);
+	g_string_append(scratch->objectid, uuid);
+	g_string_append(scratch->objectid, "::");
+	scratch->prefix_len = scratch->objectid->len;
+	g_queue_init(&scratch->spare_tables);
+
+	return scratch;
+}
+
+/**
+ * page_scratch_reset:
+ * @scratch: A #PageScratch
+ *
+ * Forgets the object ID of the last item.  Spare metadata tables are kept
+ * for the next page.
+ */
+void page_scratch_reset(PageScratch *scratch)
+{
+	g_return_if_fail(scratch != NULL);
+
+	g_string_truncate(scratch->objectid, scratch->prefix_len);
+}
+
+/**
+ * page_scratch_free:
+ * @scratch: A #PageScratch, or %NULL
+ */
+void page_scratch_free(PageScratch *scratch)
+{
+	GHashTable *table;
+
+	if (scratch == NULL)
+		return;
+
+	while ((table = g_queue_pop_head(&scratch->spare_tables)) != NULL)
+		g_hash_table_unref(table);
+	g_string_free(scratch->objectid, TRUE);
+	g_free(scratch);
+}
+
+/**
+ * page_scratch_objectid:
+ * @scratch:    A #PageScratch
+ * @didlobject: A DIDL-Lite object
+ *
+ * Like util_create_objectid(), but the object ID is built into a buffer of
+ * @scratch that already holds the "<uuid>::" prefix.
+ *
+ * Returns: The MAFW object ID of @didlobject, valid until the next call, or
+ * %NULL if @didlobject has no ID.
+ */
+const gchar *page_scratch_objectid(PageScratch *scratch,
+				   GUPnPDIDLLiteObject *didlobject)
+{
+	const gchar *itemid;
+
+	g_return_val_if_fail(scratch != NULL, NULL);
+
+	itemid = gupnp_didl_lite_object_get_id(didlobject);
+	if (itemid == NULL)
+		return NULL;
+
+	g_string_truncate(scratch->objectid, scratch->prefix_len);
+	g_string_append(scratch->objectid, itemid);
+
+	return scratch->objectid->str;
+}
+
+/**
+ * page_scratch_take_metadata:
+ * @scratch: A #PageScratch
+ *
+ * Returns: An empty metadata table, recycled if one is available.
+ */
+GHashTable *page_scratch_take_metadata(PageScratch *scratch)
+{
+	GHashTable *table;
+
+	g_return_val_if_fail(scratch != NULL, NULL);
+
+	table = g_queue_pop_head(&scratch->spare_tables);
+	if (table == NULL)
+		table = mafw_metadata_new();
+
+	return table;
+}
+
+/**
+ * page_scratch_recycle_metadata:
+ * @scratch:  A #PageScratch
+ * @metadata: A table from page_scratch_take_metadata()
+ *
+ * Empties @metadata and keeps it for reuse.  Only tables that were never
+ * handed to a browse or metadata callback may be recycled, since the
+ * receiver of those is allowed to keep a reference.
+ */
+void page_scratch_recycle_metadata(PageScratch *scratch,
+				   GHashTable *metadata)
+{
+	g_return_if_fail(scratch != NULL);
+	g_return_if_fail(metadata != NULL);
+
+	if (g_queue_get_length(&scratch->spare_tables) >=
+	    PAGE_SCRATCH_MAX_SPARE_TABLES)
+	{
+		g_hash_table_unref(metadata);
+		return;
+	}
+
+	g_hash_table_remove_all(metadata);
+	g_queue_push_head(&scratch->spare_tables, metadata);
+}
@@ -0,0 +1,51 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef MAFW_UPNP_SOURCE_SCRATCH_H
+#define MAFW_UPNP_SOURCE_SCRATCH_H
+
+#include <glib.h>
+#include <libgupnp-av/gupnp-av.h>
+
+/*----------------------------------------------------------------------------
+  Per-page scratch
+  ----------------------------------------------------------------------------*/
+
+/* Metadata tables kept for reuse between pages */
+#define PAGE_SCRATCH_MAX_SPARE_TABLES 64
+
+typedef struct _PageScratch PageScratch;
+
+PageScratch *page_scratch_new(const gchar *uuid);
+void page_scratch_reset(PageScratch *scratch);
+void page_scratch_free(PageScratch *scratch);
+
+const gchar *page_scratch_objectid(PageScratch *scratch,
+				   GUPnPDIDLLiteObject *didlobject);
+
+GHashTable *page_scratch_take_metadata(PageScratch *scratch);
+void page_scratch_recycle_metadata(PageScratch *scratch,
+				   GHashTable *metadata);
+
+#endif
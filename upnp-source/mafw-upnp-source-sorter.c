@@ -0,0 +1,745 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <glib.h>
+#include <glib-object.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <libgupnp-av/gupnp-av.h>
+#include <libmafw/mafw.h>
+#include <libmafw/mafw-metadata-serializer.h>
+
+#include "mafw-upnp-source-sorter.h"
+#include "mafw-upnp-source-util.h"
+
+/*----------------------------------------------------------------------------
+  Local sort
+  ----------------------------------------------------------------------------*/
+
+/* Sorts browse results the server cannot sort.  Items come with a
+   collation key per sort criterion, computed once when they are added.
+   Every SORTER_RUN_SIZE items are sorted and written to a temporary file
+   as a run, and the runs are merged when the results are read out, so
+   only one run and the head of every other one are ever in memory.
+   Too many runs are merged into one on the way. */
+typedef struct {
+	/* Order of arrival, ties keep it */
+	guint32 seq;
+
+	/* Collation key per criterion, NULL if the item has no value */
+	gchar **keys;
+
+	gchar *objectid;
+
+	/* In memory, or frozen as read back from a run */
+	GHashTable *metadata;
+	gchar *frozen;
+	guint32 frozen_size;
+} SortRow;
+
+typedef struct {
+	FILE *file;
+
+	/* The next row of the run, NULL at its end */
+	SortRow *head;
+} SortRun;
+
+struct _Sorter {
+	/* The MAFW keys to sort by and their directions */
+	gchar **sort_keys;
+	gboolean *descending;
+	guint n_criteria;
+
+	/* MUPnPSrc_MKey_* flags of @sort_keys */
+	guint64 keys;
+
+	guint run_size;
+	guint32 n_items;
+
+	/* Rows not written out yet */
+	GPtrArray *rows;
+
+	/* SortRun* on disk */
+	GPtrArray *runs;
+
+	/* After sorter_finish(): the next row of @rows if nothing went to
+	   disk, otherwise @runs as a binary heap on their heads */
+	guint next;
+	gboolean finished;
+};
+
+static void sort_row_free(SortRow *row, const Sorter *sorter)
+{
+	if (row == NULL)
+		return;
+
+	sorter_collated_free(sorter, row->keys);
+	g_free(row->objectid);
+	if (row->metadata != NULL)
+		g_hash_table_unref(row->metadata);
+	g_free(row->frozen);
+	g_free(row);
+}
+
+static void sort_run_free(SortRun *run, const Sorter *sorter)
+{
+	if (run->file != NULL)
+		fclose(run->file);
+	sort_row_free(run->head, sorter);
+	g_free(run);
+}
+
+/**
+ * sorter_new:
+ * @sort_criteria: MAFW sort criteria, like "+artist,-duration"
+ * @run_size:      Items sorted in memory at a time
+ * @error:         Set if @sort_criteria is malformed
+ *
+ * Returns: An empty #Sorter, or %NULL on error.
+ */
+Sorter *sorter_new(const gchar *sort_criteria, guint run_size,
+		   GError **error)
+{
+	Sorter *sorter;
+	gchar **criteria;
+	guint i;
+
+	g_return_val_if_fail(sort_criteria != NULL, NULL);
+	g_return_val_if_fail(run_size > 0, NULL);
+
+	criteria = g_strsplit(sort_criteria, ",", 0);
+	sorter = g_new0(Sorter, 1);
+	sorter->n_criteria = g_strv_length(criteria);
+	sorter->sort_keys = g_new0(gchar *, sorter->n_criteria + 1);
+	sorter->descending = g_new0(gboolean, sorter->n_criteria);
+	sorter->run_size = run_size;
+	sorter->rows = g_ptr_array_new();
+	sorter->runs = g_ptr_array_new();
+
+	for (i = 0; i < sorter->n_criteria; i++)
+	{
+		if ((criteria[i][0] != '+' && criteria[i][0] != '-') ||
+		    criteria[i][1] == '\0')
+		{
+			g_set_error(error, MAFW_SOURCE_ERROR,
+				    MAFW_SOURCE_ERROR_INVALID_SORT_STRING,
+				    "Invalid sort criteria: %s",
+				    sort_criteria);
+			g_strfreev(criteria);
+			sorter_free(sorter);
+			return NULL;
+		}
+
+		sorter->descending[i] = criteria[i][0] == '-';
+		sorter->sort_keys[i] = g_strdup(criteria[i] + 1);
+		sorter->keys |= util_get_upnpflag_from_mafwkey(
+			sorter->sort_keys[i]);
+	}
+	g_strfreev(criteria);
+
+	return sorter;
+}
+
+void sorter_free(Sorter *sorter)
+{
+	if (sorter == NULL)
+		return;
+
+	g_ptr_array_foreach(sorter->rows, (GFunc)sort_row_free, sorter);
+	g_ptr_array_free(sorter->rows, TRUE);
+	g_ptr_array_foreach(sorter->runs, (GFunc)sort_run_free, sorter);
+	g_ptr_array_free(sorter->runs, TRUE);
+	g_strfreev(sorter->sort_keys);
+	g_free(sorter->descending);
+	g_free(sorter);
+}
+
+/**
+ * sorter_get_keys:
+ * @sorter: A #Sorter
+ *
+ * Returns: The MUPnPSrc_MKey_* flags of the metadata keys the items need
+ * for sorting.
+ */
+guint64 sorter_get_keys(const Sorter *sorter)
+{
+	g_return_val_if_fail(sorter != NULL, 0);
+
+	return sorter->keys;
+}
+
+guint sorter_get_n_items(const Sorter *sorter)
+{
+	g_return_val_if_fail(sorter != NULL, 0);
+
+	return sorter->n_items;
+}
+
+/**
+ * sorter_get_sort_keys:
+ * @sorter: A #Sorter
+ *
+ * Returns: The MAFW metadata keys to sort by, %NULL-terminated.
+ */
+const gchar *const *sorter_get_sort_keys(const Sorter *sorter)
+{
+	g_return_val_if_fail(sorter != NULL, NULL);
+
+	return (const gchar *const *)sorter->sort_keys;
+}
+
+/* Sorts numbers in their order and strings in that of the locale, both
+   with a plain strcmp() afterwards. */
+static gchar *sorter_collation_key(const GValue *value)
+{
+	guint64 number;
+
+	if (value == NULL)
+		return NULL;
+
+	switch (G_VALUE_TYPE(value))
+	{
+	case G_TYPE_STRING:
+		if (g_value_get_string(value) == NULL)
+			return NULL;
+		return g_utf8_collate_key(g_value_get_string(value), -1);
+	case G_TYPE_INT:
+		number = (guint64)(gint64)g_value_get_int(value);
+		break;
+	case G_TYPE_UINT:
+		number = g_value_get_uint(value);
+		break;
+	case G_TYPE_LONG:
+		number = (guint64)(gint64)g_value_get_long(value);
+		break;
+	case G_TYPE_INT64:
+		number = (guint64)g_value_get_int64(value);
+		break;
+	case G_TYPE_BOOLEAN:
+		number = g_value_get_boolean(value);
+		break;
+	default:
+		return NULL;
+	}
+
+	/* Flip the sign bit so that negative numbers come first */
+	if (G_VALUE_TYPE(value) != G_TYPE_UINT)
+		number ^= G_GUINT64_CONSTANT(1) << 63;
+	return g_strdup_printf("%016" G_GINT64_MODIFIER "x", number);
+}
+
+/**
+ * sorter_collate:
+ * @sorter:   A #Sorter
+ * @metadata: Metadata of an item
+ *
+ * Returns: The collation keys of @metadata by the criteria of @sorter, for
+ * sorter_compare_collated(), to be freed with sorter_collated_free().
+ */
+gchar **sorter_collate(const Sorter *sorter, GHashTable *metadata)
+{
+	gchar **keys;
+	guint i;
+
+	keys = g_new0(gchar *, sorter->n_criteria + 1);
+	for (i = 0; i < sorter->n_criteria; i++)
+		keys[i] = sorter_collation_key(
+			mafw_metadata_first(metadata, sorter->sort_keys[i]));
+
+	return keys;
+}
+
+/* The keys may have holes, g_strfreev() would stop at the first one. */
+void sorter_collated_free(const Sorter *sorter, gchar **keys)
+{
+	guint i;
+
+	if (keys == NULL)
+		return;
+
+	for (i = 0; i < sorter->n_criteria; i++)
+		g_free(keys[i]);
+	g_free(keys);
+}
+
+/**
+ * sorter_compare_collated:
+ * @sorter: A #Sorter
+ * @a:      Collation keys of an item
+ * @b:      Collation keys of another item
+ *
+ * Items without a value come last in either direction.
+ *
+ * Returns: Negative if @a sorts first, positive if @b does, 0 on a tie.
+ */
+gint sorter_compare_collated(const Sorter *sorter, gchar **a, gchar **b)
+{
+	guint i;
+	gint cmp;
+
+	for (i = 0; i < sorter->n_criteria; i++)
+	{
+		if (a[i] == NULL || b[i] == NULL)
+		{
+			if (a[i] != b[i])
+				return a[i] == NULL ? 1 : -1;
+			continue;
+		}
+
+		cmp = strcmp(a[i], b[i]);
+		if (cmp != 0)
+			return sorter->descending[i] ? -cmp : cmp;
+	}
+
+	return 0;
+}
+
+static gint sorter_compare(const Sorter *sorter, const SortRow *a,
+			   const SortRow *b)
+{
+	gint cmp;
+
+	cmp = sorter_compare_collated(sorter, a->keys, b->keys);
+	if (cmp != 0)
+		return cmp;
+
+	return a->seq < b->seq ? -1 : a->seq > b->seq;
+}
+
+static gint sorter_compare_rows(gconstpointer a, gconstpointer b,
+				gpointer sorter)
+{
+	return sorter_compare(sorter, *(SortRow **)a, *(SortRow **)b);
+}
+
+/*----------------------------------------------------------------------------
+  Runs on disk
+  ----------------------------------------------------------------------------*/
+
+/* A run is a sequence of rows, each one as
+	seq, (key length, key) per criterion, objectid length, objectid,
+	metadata length, frozen metadata
+   with native 32-bit lengths.  A key length of G_MAXUINT32 stands for a
+   missing value.  The files are unlinked as soon as they are opened, they
+   go away with the process. */
+
+static FILE *sorter_open_tmp(GError **error)
+{
+	gchar *path;
+	FILE *file;
+	gint fd;
+
+	fd = g_file_open_tmp("mafw-upnp-sort-XXXXXX", &path, error);
+	if (fd < 0)
+		return NULL;
+
+	unlink(path);
+	g_free(path);
+	file = fdopen(fd, "w+b");
+	if (file == NULL)
+	{
+		close(fd);
+		g_set_error(error, MAFW_SOURCE_ERROR,
+			    MAFW_SOURCE_ERROR_BROWSE_RESULT_FAILED,
+			    "Cannot open a temporary file for sorting");
+	}
+
+	return file;
+}
+
+static gboolean sorter_write(FILE *file, const void *data, gsize size)
+{
+	return size == 0 || fwrite(data, size, 1, file) == 1;
+}
+
+static gboolean sorter_write_string(FILE *file, const gchar *str,
+				    guint32 len)
+{
+	return sorter_write(file, &len, sizeof(len)) &&
+		sorter_write(file, str, len);
+}
+
+static gboolean sorter_write_row(const Sorter *sorter, FILE *file,
+				 SortRow *row)
+{
+	guint32 missing = G_MAXUINT32;
+	gsize size;
+	guint i;
+
+	if (row->frozen == NULL)
+	{
+		row->frozen = mafw_metadata_freeze(row->metadata, &size);
+		row->frozen_size = size;
+	}
+
+	if (!sorter_write(file, &row->seq, sizeof(row->seq)))
+		return FALSE;
+	for (i = 0; i < sorter->n_criteria; i++)
+	{
+		if (row->keys[i] == NULL
+		    ? !sorter_write(file, &missing, sizeof(missing))
+		    : !sorter_write_string(file, row->keys[i],
+					   strlen(row->keys[i])))
+			return FALSE;
+	}
+
+	return sorter_write_string(file, row->objectid,
+				   strlen(row->objectid)) &&
+		sorter_write_string(file, row->frozen, row->frozen_size);
+}
+
+/* Reads a string of the length read first, or NULL if it is missing. */
+static gboolean sorter_read_string(FILE *file, gchar **str, guint32 *len)
+{
+	if (fread(len, sizeof(*len), 1, file) != 1)
+		return FALSE;
+
+	*str = NULL;
+	if (*len == G_MAXUINT32)
+		return TRUE;
+
+	*str = g_malloc(*len + 1);
+	(*str)[*len] = '\0';
+	return *len == 0 || fread(*str, *len, 1, file) == 1;
+}
+
+/**
+ * sorter_read_row:
+ *
+ * Reads the next row of a run into @row, %NULL at the end of the run.
+ *
+ * Returns: %FALSE on error.
+ */
+static gboolean sorter_read_row(const Sorter *sorter, FILE *file,
+				SortRow **row, GError **error)
+{
+	SortRow *r;
+	guint32 seq, len;
+	guint i;
+
+	*row = NULL;
+	if (fread(&seq, sizeof(seq), 1, file) != 1)
+	{
+		if (feof(file))
+			return TRUE;
+		goto err;
+	}
+
+	r = g_new0(SortRow, 1);
+	r->seq = seq;
+	r->keys = g_new0(gchar *, sorter->n_criteria + 1);
+	*row = r;
+	for (i = 0; i < sorter->n_criteria; i++)
+		if (!sorter_read_string(file, &r->keys[i], &len))
+			goto err;
+	if (!sorter_read_string(file, &r->objectid, &len) ||
+	    r->objectid == NULL ||
+	    !sorter_read_string(file, &r->frozen, &r->frozen_size) ||
+	    r->frozen == NULL)
+		goto err;
+
+	return TRUE;
+
+err:
+	sort_row_free(*row, sorter);
+	*row = NULL;
+	g_set_error(error, MAFW_SOURCE_ERROR,
+		    MAFW_SOURCE_ERROR_BROWSE_RESULT_FAILED,
+		    "Cannot read back sorted results");
+	return FALSE;
+}
+
+static SortRun *sorter_run_new(FILE *file)
+{
+	SortRun *run;
+
+	rewind(file);
+	run = g_new0(SortRun, 1);
+	run->file = file;
+
+	return run;
+}
+
+static void sorter_heap_down(Sorter *sorter, guint i)
+{
+	SortRun **heap = (SortRun **)sorter->runs->pdata;
+	guint n = sorter->runs->len;
+	guint child;
+	SortRun *tmp;
+
+	for (;;)
+	{
+		child = 2 * i + 1;
+		if (child >= n)
+			break;
+		if (child + 1 < n &&
+		    sorter_compare(sorter, heap[child + 1]->head,
+				   heap[child]->head) < 0)
+			child++;
+		if (sorter_compare(sorter, heap[i]->head,
+				   heap[child]->head) <= 0)
+			break;
+
+		tmp = heap[i];
+		heap[i] = heap[child];
+		heap[child] = tmp;
+		i = child;
+	}
+}
+
+/* Reads the head of every run and orders the runs by them. */
+static gboolean sorter_heap_build(Sorter *sorter, GError **error)
+{
+	SortRun *run;
+	guint i;
+
+	for (i = 0; i < sorter->runs->len;)
+	{
+		run = g_ptr_array_index(sorter->runs, i);
+		if (!sorter_read_row(sorter, run->file, &run->head, error))
+			return FALSE;
+		if (run->head == NULL)
+		{
+			g_ptr_array_remove_index_fast(sorter->runs, i);
+			sort_run_free(run, sorter);
+		}
+		else
+			i++;
+	}
+
+	for (i = sorter->runs->len / 2; i > 0; i--)
+		sorter_heap_down(sorter, i - 1);
+
+	return TRUE;
+}
+
+/* Takes the smallest head of all runs, %NULL once they are all done. */
+static gboolean sorter_heap_pop(Sorter *sorter, SortRow **row,
+				GError **error)
+{
+	SortRun *run;
+
+	*row = NULL;
+	if (sorter->runs->len == 0)
+		return TRUE;
+
+	run = g_ptr_array_index(sorter->runs, 0);
+	*row = run->head;
+	if (!sorter_read_row(sorter, run->file, &run->head, error))
+	{
+		sort_row_free(*row, sorter);
+		*row = NULL;
+		return FALSE;
+	}
+	if (run->head == NULL)
+	{
+		g_ptr_array_remove_index_fast(sorter->runs, 0);
+		sort_run_free(run, sorter);
+	}
+	if (sorter->runs->len > 0)
+		sorter_heap_down(sorter, 0);
+
+	return TRUE;
+}
+
+/* Merges all runs into one. */
+static gboolean sorter_cascade(Sorter *sorter, GError **error)
+{
+	SortRow *row;
+	FILE *file;
+
+	file = sorter_open_tmp(error);
+	if (file == NULL || !sorter_heap_build(sorter, error))
+		goto err;
+
+	for (;;)
+	{
+		if (!sorter_heap_pop(sorter, &row, error))
+			goto err;
+		if (row == NULL)
+			break;
+		if (!sorter_write_row(sorter, file, row))
+		{
+			sort_row_free(row, sorter);
+			g_set_error(error, MAFW_SOURCE_ERROR,
+				    MAFW_SOURCE_ERROR_BROWSE_RESULT_FAILED,
+				    "Cannot write sorted results");
+			goto err;
+		}
+		sort_row_free(row, sorter);
+	}
+
+	g_ptr_array_add(sorter->runs, sorter_run_new(file));
+	return TRUE;
+
+err:
+	if (file != NULL)
+		fclose(file);
+	return FALSE;
+}
+
+/* Sorts the rows in memory and writes them out as a run. */
+static gboolean sorter_spill(Sorter *sorter, GError **error)
+{
+	FILE *file;
+	guint i;
+
+	if (sorter->rows->len == 0)
+		return TRUE;
+
+	file = sorter_open_tmp(error);
+	if (file == NULL)
+		return FALSE;
+
+	g_ptr_array_sort_with_data(sorter->rows, sorter_compare_rows,
+				   sorter);
+	for (i = 0; i < sorter->rows->len; i++)
+	{
+		if (!sorter_write_row(sorter, file,
+				      g_ptr_array_index(sorter->rows, i)))
+		{
+			fclose(file);
+			g_set_error(error, MAFW_SOURCE_ERROR,
+				    MAFW_SOURCE_ERROR_BROWSE_RESULT_FAILED,
+				    "Cannot write sorted results");
+			return FALSE;
+		}
+	}
+	g_ptr_array_foreach(sorter->rows, (GFunc)sort_row_free, sorter);
+	g_ptr_array_set_size(sorter->rows, 0);
+
+	g_ptr_array_add(sorter->runs, sorter_run_new(file));
+	if (sorter->runs->len >= SORTER_MAX_RUNS)
+		return sorter_cascade(sorter, error);
+
+	return TRUE;
+}
+
+/*----------------------------------------------------------------------------
+  Sorting
+  ----------------------------------------------------------------------------*/
+
+/**
+ * sorter_add:
+ * @sorter:   A #Sorter
+ * @objectid: Object ID of an item
+ * @metadata: Its metadata, with the keys of sorter_get_keys(); the sorter
+ *            takes a reference
+ * @error:    Set if the temporary files fail
+ *
+ * Adds an item to sort.
+ *
+ * Returns: %FALSE on error.
+ */
+gboolean sorter_add(Sorter *sorter, const gchar *objectid,
+		    GHashTable *metadata, GError **error)
+{
+	SortRow *row;
+
+	g_return_val_if_fail(sorter != NULL && !sorter->finished, FALSE);
+	g_return_val_if_fail(objectid != NULL && metadata != NULL, FALSE);
+
+	row = g_new0(SortRow, 1);
+	row->seq = sorter->n_items++;
+	row->keys = sorter_collate(sorter, metadata);
+	row->objectid = g_strdup(objectid);
+	row->metadata = g_hash_table_ref(metadata);
+	g_ptr_array_add(sorter->rows, row);
+
+	if (sorter->rows->len >= sorter->run_size)
+		return sorter_spill(sorter, error);
+
+	return TRUE;
+}
+
+/**
+ * sorter_finish:
+ * @sorter: A #Sorter
+ * @error:  Set if the temporary files fail
+ *
+ * Sorts the items added, to be read out with sorter_next().
+ *
+ * Returns: %FALSE on error.
+ */
+gboolean sorter_finish(Sorter *sorter, GError **error)
+{
+	g_return_val_if_fail(sorter != NULL && !sorter->finished, FALSE);
+
+	sorter->finished = TRUE;
+	if (sorter->runs->len == 0)
+	{
+		/* All in memory */
+		g_ptr_array_sort_with_data(sorter->rows, sorter_compare_rows,
+					   sorter);
+		return TRUE;
+	}
+
+	return sorter_spill(sorter, error) &&
+		sorter_heap_build(sorter, error);
+}
+
+/**
+ * sorter_next:
+ * @sorter:   A finished #Sorter
+ * @objectid: The object ID of the next item, to be freed
+ * @metadata: Its metadata, to be unreferenced
+ * @error:    Set if the temporary files fail
+ *
+ * Returns: %FALSE after the last item or on error.
+ */
+gboolean sorter_next(Sorter *sorter, gchar **objectid,
+		     GHashTable **metadata, GError **error)
+{
+	SortRow *row;
+
+	g_return_val_if_fail(sorter != NULL && sorter->finished, FALSE);
+
+	if (sorter->next < sorter->rows->len)
+	{
+		/* Taken out of the array; it is freed by sorter_free() */
+		row = g_ptr_array_index(sorter->rows, sorter->next);
+		g_ptr_array_index(sorter->rows, sorter->next++) = NULL;
+	}
+	else if (!sorter_heap_pop(sorter, &row, error) || row == NULL)
+	{
+		return FALSE;
+	}
+
+	*objectid = row->objectid;
+	row->objectid = NULL;
+	if (row->metadata != NULL)
+	{
+		*metadata = row->metadata;
+		row->metadata = NULL;
+	}
+	else
+	{
+		*metadata = mafw_metadata_thaw(row->frozen,
+					       row->frozen_size);
+	}
+	sort_row_free(row, sorter);
+
+	return TRUE;
+}
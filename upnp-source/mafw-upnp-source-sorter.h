@@ -0,0 +1,60 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef MAFW_UPNP_SOURCE_SORTER_H
+#define MAFW_UPNP_SOURCE_SORTER_H
+
+#include <glib.h>
+
+/*----------------------------------------------------------------------------
+  Local sort
+  ----------------------------------------------------------------------------*/
+
+/* Items sorted in memory before they go to disk as a sorted run */
+#define SORTER_RUN_SIZE 2048
+
+/* Runs on disk at a time, more are merged into one */
+#define SORTER_MAX_RUNS 32
+
+typedef struct _Sorter Sorter;
+
+Sorter *sorter_new(const gchar *sort_criteria, guint run_size,
+		   GError **error);
+void sorter_free(Sorter *sorter);
+
+guint64 sorter_get_keys(const Sorter *sorter);
+guint sorter_get_n_items(const Sorter *sorter);
+const gchar *const *sorter_get_sort_keys(const Sorter *sorter);
+
+gchar **sorter_collate(const Sorter *sorter, GHashTable *metadata);
+void sorter_collated_free(const Sorter *sorter, gchar **keys);
+gint sorter_compare_collated(const Sorter *sorter, gchar **a, gchar **b);
+
+gboolean sorter_add(Sorter *sorter, const gchar *objectid,
+		    GHashTable *metadata, GError **error);
+gboolean sorter_finish(Sorter *sorter, GError **error);
+gboolean sorter_next(Sorter *sorter, gchar **objectid,
+		     GHashTable **metadata, GError **error);
+
+#endif
@@ -0,0 +1,1104 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <glib.h>
+#include <glib-object.h>
+#include <string.h>
+#include <libmafw/mafw.h>
+
+#include "mafw-upnp-source-textindex.h"
+
+/*----------------------------------------------------------------------------
+  Local full-text index
+  ----------------------------------------------------------------------------*/
+
+/* The searchable metadata of an item */
+enum {
+	TEXT_FIELD_TITLE,
+	TEXT_FIELD_ARTIST,
+	TEXT_FIELD_ALBUM,
+	TEXT_FIELD_GENRE,
+	TEXT_N_FIELDS
+};
+
+static const gchar *const text_fields[TEXT_N_FIELDS] = {
+	MAFW_METADATA_KEY_TITLE,
+	MAFW_METADATA_KEY_ARTIST,
+	MAFW_METADATA_KEY_ALBUM,
+	MAFW_METADATA_KEY_GENRE
+};
+
+static const guint64 text_field_keys[TEXT_N_FIELDS] = {
+	MUPnPSrc_MKey_Title,
+	MUPnPSrc_MKey_Artist,
+	MUPnPSrc_MKey_Album,
+	MUPnPSrc_MKey_Genre
+};
+
+/* Dead items are dropped by rebuilding the index when they are at least
+   this many and outnumber the live ones */
+#define TEXT_INDEX_COMPACT_MIN 1024
+
+/* The searchable field of each grouping but the year */
+static const gint text_grouping_fields[TEXT_INDEX_N_GROUPINGS] = {
+	TEXT_FIELD_ARTIST,
+	TEXT_FIELD_ALBUM,
+	TEXT_FIELD_GENRE,
+	-1
+};
+
+/* An item, its strings in the string chunk of the index.  @objectid is
+   %NULL once the item is replaced or its container changes.  Items are
+   grouped by the folded field, or the year as a string. */
+typedef struct {
+	const gchar *objectid;
+	const gchar *parentid;
+	const gchar *fields[TEXT_N_FIELDS];
+	const gchar *folded[TEXT_N_FIELDS];
+	const gchar *uri;
+	const gchar *mime;
+	gint duration;
+	gint year;
+	const gchar *groups[TEXT_INDEX_N_GROUPINGS];
+} TextDoc;
+
+/* The items of an artist, album, genre or year: the label is the value
+   of the first item as it came */
+typedef struct {
+	const gchar *label;
+	GArray *docs;
+	guint live;
+} TextGroup;
+
+/* Items are numbered in the order they were added, which is the order of
+   the server as far as the crawl goes.  Every token of the searchable
+   metadata lists the numbers of the items that have it, in ascending
+   order. */
+struct _TextIndex {
+	GArray *docs;
+	guint n_dead;
+
+	GStringChunk *strings;
+
+	/* Object ID -> item number + 1 */
+	GHashTable *objectids;
+
+	/* Token -> GArray of item numbers */
+	GHashTable *postings;
+
+	/* Group key -> TextGroup, for each grouping */
+	GHashTable *groups[TEXT_INDEX_N_GROUPINGS];
+
+	/* Whether every item of the server is in */
+	gboolean complete;
+};
+
+/* A filter compiled for the index: values unquoted and folded */
+typedef struct _TextQuery TextQuery;
+struct _TextQuery {
+	MafwFilterType type;
+
+	/* Simple filters: the searchable field and, for mafw_f_approx, the
+	   folded parts of the value between wildcards */
+	gint field;
+	gchar **segments;
+
+	/* Complex filters: the operands */
+	GPtrArray *parts;
+};
+
+/**
+ * text_index_fold:
+ * @str: A string
+ *
+ * Decomposes @str, strips the combining marks and folds the case, so
+ * that "Beyoncé" and "BEYONCE" look the same.
+ *
+ * Returns: The folded string, or %NULL if @str is not valid UTF-8.
+ */
+static gchar *text_index_fold(const gchar *str)
+{
+	gchar *decomposed, *folded;
+	GString *stripped;
+	const gchar *p;
+	gunichar c;
+
+	decomposed = g_utf8_normalize(str, -1, G_NORMALIZE_ALL);
+	if (decomposed == NULL)
+		return NULL;
+
+	stripped = g_string_sized_new(strlen(decomposed));
+	for (p = decomposed; *p != '\0'; p = g_utf8_next_char(p))
+	{
+		c = g_utf8_get_char(p);
+		if (!g_unichar_ismark(c))
+			g_string_append_unichar(stripped, c);
+	}
+	g_free(decomposed);
+
+	folded = g_utf8_casefold(stripped->str, stripped->len);
+	g_string_free(stripped, TRUE);
+
+	return folded;
+}
+
+/* Adds the alphanumeric words of a folded string to @tokens. */
+static void text_index_tokenize(const gchar *folded, GPtrArray *tokens)
+{
+	const gchar *p, *start;
+
+	start = NULL;
+	for (p = folded; ; p = g_utf8_next_char(p))
+	{
+		if (*p != '\0' && g_unichar_isalnum(g_utf8_get_char(p)))
+		{
+			if (start == NULL)
+				start = p;
+			continue;
+		}
+
+		if (start != NULL)
+			g_ptr_array_add(tokens, g_strndup(start, p - start));
+		start = NULL;
+		if (*p == '\0')
+			break;
+	}
+}
+
+static void text_index_posting_free(GArray *posting)
+{
+	g_array_free(posting, TRUE);
+}
+
+static void text_group_free(TextGroup *group)
+{
+	g_array_free(group->docs, TRUE);
+	g_free(group);
+}
+
+static void text_index_init(TextIndex *index)
+{
+	guint grouping;
+
+	for (grouping = 0; grouping < TEXT_INDEX_N_GROUPINGS; grouping++)
+		index->groups[grouping] = g_hash_table_new_full(
+			g_str_hash, g_str_equal, NULL,
+			(GDestroyNotify)text_group_free);
+	index->docs = g_array_new(FALSE, FALSE, sizeof(TextDoc));
+	index->n_dead = 0;
+	index->strings = g_string_chunk_new(4096);
+	index->objectids = g_hash_table_new(g_str_hash, g_str_equal);
+	index->postings = g_hash_table_new_full(
+		g_str_hash, g_str_equal, NULL,
+		(GDestroyNotify)text_index_posting_free);
+}
+
+static void text_index_clear(TextIndex *index)
+{
+	guint grouping;
+
+	for (grouping = 0; grouping < TEXT_INDEX_N_GROUPINGS; grouping++)
+		g_hash_table_destroy(index->groups[grouping]);
+	g_hash_table_destroy(index->postings);
+	g_hash_table_destroy(index->objectids);
+	g_string_chunk_free(index->strings);
+	g_array_free(index->docs, TRUE);
+}
+
+TextIndex *text_index_new(void)
+{
+	TextIndex *index;
+
+	index = g_new0(TextIndex, 1);
+	text_index_init(index);
+
+	return index;
+}
+
+void text_index_free(TextIndex *index)
+{
+	if (index == NULL)
+		return;
+
+	text_index_clear(index);
+	g_free(index);
+}
+
+static void text_index_kill(TextIndex *index, guint docno)
+{
+	TextDoc *doc;
+	TextGroup *group;
+	guint grouping;
+
+	doc = &g_array_index(index->docs, TextDoc, docno);
+	for (grouping = 0; grouping < TEXT_INDEX_N_GROUPINGS; grouping++)
+	{
+		if (doc->groups[grouping] == NULL)
+			continue;
+		group = g_hash_table_lookup(index->groups[grouping],
+					    doc->groups[grouping]);
+		group->live--;
+	}
+	g_hash_table_remove(index->objectids, doc->objectid);
+	doc->objectid = NULL;
+	index->n_dead++;
+}
+
+/* Appends @doc to the index, its strings already in the string chunk
+   of the index except the folded ones, which are filled in. */
+static void text_index_insert(TextIndex *index, TextDoc *doc)
+{
+	GPtrArray *tokens;
+	GArray *posting;
+	TextGroup *group;
+	gchar *folded;
+	gchar *token;
+	gchar year[16];
+	guint docno;
+	guint field, grouping, i;
+	gint gfield;
+
+	docno = index->docs->len;
+	tokens = g_ptr_array_new();
+	for (field = 0; field < TEXT_N_FIELDS; field++)
+	{
+		doc->folded[field] = NULL;
+		if (doc->fields[field] == NULL)
+			continue;
+
+		folded = text_index_fold(doc->fields[field]);
+		if (folded == NULL)
+			continue;
+		doc->folded[field] = g_string_chunk_insert_const(
+			index->strings, folded);
+		text_index_tokenize(folded, tokens);
+		g_free(folded);
+	}
+
+	for (i = 0; i < tokens->len; i++)
+	{
+		token = g_ptr_array_index(tokens, i);
+		posting = g_hash_table_lookup(index->postings, token);
+		if (posting == NULL)
+		{
+			posting = g_array_new(FALSE, FALSE, sizeof(guint));
+			g_hash_table_insert(index->postings,
+					    g_string_chunk_insert_const(
+						    index->strings, token),
+					    posting);
+		}
+
+		/* Once for every token of the item */
+		if (posting->len == 0 ||
+		    g_array_index(posting, guint, posting->len - 1) != docno)
+			g_array_append_val(posting, docno);
+		g_free(token);
+	}
+	g_ptr_array_free(tokens, TRUE);
+
+	for (grouping = 0; grouping < TEXT_INDEX_N_GROUPINGS; grouping++)
+	{
+		gfield = text_grouping_fields[grouping];
+		if (gfield >= 0)
+			doc->groups[grouping] = doc->folded[gfield];
+		else if (doc->year > 0)
+		{
+			g_snprintf(year, sizeof(year), "%d", doc->year);
+			doc->groups[grouping] = g_string_chunk_insert_const(
+				index->strings, year);
+		}
+		else
+			doc->groups[grouping] = NULL;
+		if (doc->groups[grouping] == NULL)
+			continue;
+
+		group = g_hash_table_lookup(index->groups[grouping],
+					    doc->groups[grouping]);
+		if (group == NULL)
+		{
+			group = g_new0(TextGroup, 1);
+			group->label = gfield >= 0
+				? doc->fields[gfield] : doc->groups[grouping];
+			group->docs = g_array_new(FALSE, FALSE,
+						  sizeof(guint));
+			g_hash_table_insert(index->groups[grouping],
+					    (gpointer)doc->groups[grouping],
+					    group);
+		}
+		g_array_append_val(group->docs, docno);
+		group->live++;
+	}
+
+	g_array_append_val(index->docs, *doc);
+	g_hash_table_insert(index->objectids, (gpointer)doc->objectid,
+			    GUINT_TO_POINTER(docno + 1));
+}
+
+/* Rebuilds the index of its live items. */
+static void text_index_compact(TextIndex *index)
+{
+	TextIndex old;
+	TextDoc *doc, copy;
+	guint docno, field;
+
+	old = *index;
+	text_index_init(index);
+	index->complete = old.complete;
+
+	for (docno = 0; docno < old.docs->len; docno++)
+	{
+		doc = &g_array_index(old.docs, TextDoc, docno);
+		if (doc->objectid == NULL)
+			continue;
+
+		copy.objectid = g_string_chunk_insert(index->strings,
+						      doc->objectid);
+		copy.parentid = g_string_chunk_insert_const(index->strings,
+							    doc->parentid);
+		for (field = 0; field < TEXT_N_FIELDS; field++)
+			copy.fields[field] = doc->fields[field] == NULL
+				? NULL
+				: g_string_chunk_insert_const(
+					index->strings, doc->fields[field]);
+		copy.uri = doc->uri == NULL ? NULL
+			: g_string_chunk_insert(index->strings, doc->uri);
+		copy.mime = doc->mime == NULL ? NULL
+			: g_string_chunk_insert_const(index->strings,
+						      doc->mime);
+		copy.duration = doc->duration;
+		copy.year = doc->year;
+		text_index_insert(index, &copy);
+	}
+
+	text_index_clear(&old);
+}
+
+static const gchar *text_index_get_string(TextIndex *index,
+					  GHashTable *metadata,
+					  const gchar *key, gboolean shared)
+{
+	const GValue *value;
+
+	value = mafw_metadata_first(metadata, key);
+	if (value == NULL || !G_VALUE_HOLDS_STRING(value) ||
+	    g_value_get_string(value) == NULL)
+		return NULL;
+
+	return shared
+		? g_string_chunk_insert_const(index->strings,
+					      g_value_get_string(value))
+		: g_string_chunk_insert(index->strings,
+					g_value_get_string(value));
+}
+
+/**
+ * text_index_add:
+ * @index:    A #TextIndex
+ * @objectid: Object ID of an item
+ * @parentid: UPnP ID of the container of the item
+ * @metadata: Metadata of the item, with the keys of %TEXT_INDEX_KEYS it
+ *            has
+ *
+ * Indexes an item, replacing what was known of @objectid before.  The
+ * index stops growing at %TEXT_INDEX_MAX_ITEMS and is not complete
+ * anymore then.
+ */
+void text_index_add(TextIndex *index, const gchar *objectid,
+		    const gchar *parentid, GHashTable *metadata)
+{
+	const GValue *value;
+	TextDoc doc;
+	gpointer docno;
+	guint field;
+
+	g_return_if_fail(index != NULL);
+	g_return_if_fail(objectid != NULL && parentid != NULL);
+	g_return_if_fail(metadata != NULL);
+
+	docno = g_hash_table_lookup(index->objectids, objectid);
+	if (docno != NULL)
+		text_index_kill(index, GPOINTER_TO_UINT(docno) - 1);
+
+	if (index->n_dead >= TEXT_INDEX_COMPACT_MIN &&
+	    index->n_dead > index->docs->len - index->n_dead)
+		text_index_compact(index);
+
+	if (index->docs->len - index->n_dead >= TEXT_INDEX_MAX_ITEMS)
+	{
+		index->complete = FALSE;
+		return;
+	}
+
+	doc.objectid = g_string_chunk_insert(index->strings, objectid);
+	doc.parentid = g_string_chunk_insert_const(index->strings, parentid);
+	for (field = 0; field < TEXT_N_FIELDS; field++)
+		doc.fields[field] = text_index_get_string(
+			index, metadata, text_fields[field], TRUE);
+	doc.uri = text_index_get_string(index, metadata,
+					MAFW_METADATA_KEY_URI, FALSE);
+	doc.mime = text_index_get_string(index, metadata,
+					 MAFW_METADATA_KEY_MIME, TRUE);
+	value = mafw_metadata_first(metadata, MAFW_METADATA_KEY_DURATION);
+	doc.duration = value != NULL && G_VALUE_HOLDS_INT(value)
+		? g_value_get_int(value) : -1;
+	value = mafw_metadata_first(metadata, MAFW_METADATA_KEY_YEAR);
+	doc.year = value != NULL && G_VALUE_HOLDS_INT(value)
+		? g_value_get_int(value) : -1;
+
+	text_index_insert(index, &doc);
+}
+
+/**
+ * text_index_invalidate:
+ * @index:    A #TextIndex
+ * @parentid: UPnP ID of a container that has changed
+ *
+ * Forgets the items of @parentid.  The index is not complete until they
+ * are added again.
+ */
+void text_index_invalidate(TextIndex *index, const gchar *parentid)
+{
+	TextDoc *doc;
+	guint docno;
+
+	g_return_if_fail(index != NULL && parentid != NULL);
+
+	for (docno = 0; docno < index->docs->len; docno++)
+	{
+		doc = &g_array_index(index->docs, TextDoc, docno);
+		if (doc->objectid != NULL &&
+		    strcmp(doc->parentid, parentid) == 0)
+			text_index_kill(index, docno);
+	}
+	index->complete = FALSE;
+}
+
+/**
+ * text_index_set_complete:
+ * @index:    A #TextIndex
+ * @complete: Whether every item of the server has been added
+ *
+ * Only a complete index answers searches, see text_index_search().
+ */
+void text_index_set_complete(TextIndex *index, gboolean complete)
+{
+	g_return_if_fail(index != NULL);
+
+	index->complete = complete &&
+		index->docs->len - index->n_dead < TEXT_INDEX_MAX_ITEMS;
+}
+
+gboolean text_index_is_complete(const TextIndex *index)
+{
+	g_return_val_if_fail(index != NULL, FALSE);
+
+	return index->complete;
+}
+
+/**
+ * text_index_get_size:
+ * @index: A #TextIndex
+ *
+ * Returns: The number of items indexed.
+ */
+guint text_index_get_size(const TextIndex *index)
+{
+	g_return_val_if_fail(index != NULL, 0);
+
+	return index->docs->len - index->n_dead;
+}
+
+/*----------------------------------------------------------------------------
+  Searching
+  ----------------------------------------------------------------------------*/
+
+static gint text_index_field(const gchar *key)
+{
+	gint field;
+
+	for (field = 0; field < TEXT_N_FIELDS; field++)
+		if (strcmp(key, text_fields[field]) == 0)
+			return field;
+
+	return -1;
+}
+
+/**
+ * text_index_can_search:
+ * @filter: A #MafwFilter
+ *
+ * Returns: Whether @filter only looks for substrings or presence of the
+ * searchable metadata of the index: title, artist, album and genre.
+ */
+gboolean text_index_can_search(const MafwFilter *filter)
+{
+	MafwFilter *const *part;
+
+	g_return_val_if_fail(filter != NULL, FALSE);
+
+	if (MAFW_FILTER_IS_SIMPLE(filter))
+		return (filter->type == mafw_f_approx ||
+			filter->type == mafw_f_exists) &&
+			text_index_field(filter->key) >= 0;
+
+	for (part = filter->parts; *part != NULL; part++)
+		if (!text_index_can_search(*part))
+			return FALSE;
+
+	return TRUE;
+}
+
+static void text_query_free(TextQuery *query)
+{
+	if (query == NULL)
+		return;
+
+	if (query->parts != NULL)
+	{
+		g_ptr_array_foreach(query->parts, (GFunc)text_query_free,
+				    NULL);
+		g_ptr_array_free(query->parts, TRUE);
+	}
+	g_strfreev(query->segments);
+	g_free(query);
+}
+
+/* Unquotes the value of a mafw_f_approx filter, splits it at the
+   unquoted wildcards and folds the parts. */
+static gchar **text_query_segments(const gchar *value, GError **error)
+{
+	GPtrArray *segments;
+	GString *text;
+	gchar *folded;
+	gchar c;
+
+	segments = g_ptr_array_new();
+	text = g_string_new(NULL);
+	for (;;)
+	{
+		if (*value == '*' || *value == '\0')
+		{
+			folded = text->len > 0
+				? text_index_fold(text->str) : NULL;
+			if (folded != NULL && *folded != '\0')
+				g_ptr_array_add(segments, folded);
+			else
+				g_free(folded);
+			g_string_truncate(text, 0);
+			if (*value == '\0')
+				break;
+			value++;
+			continue;
+		}
+
+		value = mafw_filter_unquote_char(value, &c);
+		if (value == NULL || c == '\0')
+		{
+			g_set_error(error, MAFW_SOURCE_ERROR,
+				    MAFW_SOURCE_ERROR_INVALID_SEARCH_STRING,
+				    "%s", value == NULL
+				    ? "Invalid escape sequence"
+				    : "NIL in property value");
+			g_ptr_array_foreach(segments, (GFunc)g_free, NULL);
+			g_ptr_array_free(segments, TRUE);
+			g_string_free(text, TRUE);
+			return NULL;
+		}
+		g_string_append_c(text, c);
+	}
+	g_string_free(text, TRUE);
+
+	g_ptr_array_add(segments, NULL);
+	return (gchar **)g_ptr_array_free(segments, FALSE);
+}
+
+static TextQuery *text_query_compile(const MafwFilter *filter,
+				     GError **error)
+{
+	MafwFilter *const *part;
+	TextQuery *query, *sub;
+
+	query = g_new0(TextQuery, 1);
+	query->type = filter->type;
+	if (MAFW_FILTER_IS_SIMPLE(filter))
+	{
+		query->field = text_index_field(filter->key);
+		if (filter->type == mafw_f_approx)
+		{
+			query->segments = text_query_segments(filter->value,
+							      error);
+			if (query->segments == NULL)
+			{
+				text_query_free(query);
+				return NULL;
+			}
+		}
+		return query;
+	}
+
+	query->parts = g_ptr_array_new();
+	for (part = filter->parts; *part != NULL; part++)
+	{
+		sub = text_query_compile(*part, error);
+		if (sub == NULL)
+		{
+			text_query_free(query);
+			return NULL;
+		}
+		g_ptr_array_add(query->parts, sub);
+	}
+
+	return query;
+}
+
+static gint text_index_compare_docno(gconstpointer a, gconstpointer b)
+{
+	guint x = *(const guint *)a, y = *(const guint *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Sorts @set and drops the duplicates. */
+static void text_index_set_uniq(GArray *set)
+{
+	guint i, n;
+
+	g_array_sort(set, text_index_compare_docno);
+	for (i = n = 0; i < set->len; i++)
+		if (n == 0 || g_array_index(set, guint, n - 1) !=
+		    g_array_index(set, guint, i))
+			g_array_index(set, guint, n++) =
+				g_array_index(set, guint, i);
+	g_array_set_size(set, n);
+}
+
+/* Keeps the item numbers of @a that are also in @b, both ascending. */
+static void text_index_set_intersect(GArray *a, const GArray *b)
+{
+	guint i, j, n;
+	guint x, y;
+
+	for (i = j = n = 0; i < a->len && j < b->len; )
+	{
+		x = g_array_index(a, guint, i);
+		y = g_array_index(b, guint, j);
+		if (x < y)
+			i++;
+		else if (x > y)
+			j++;
+		else
+		{
+			g_array_index(a, guint, n++) = x;
+			i++;
+			j++;
+		}
+	}
+	g_array_set_size(a, n);
+}
+
+/* The items having a token that contains @word. */
+static GArray *text_index_word_postings(TextIndex *index, const gchar *word)
+{
+	GHashTableIter iter;
+	gpointer token;
+	GArray *posting;
+	GArray *set;
+
+	set = g_array_new(FALSE, FALSE, sizeof(guint));
+	g_hash_table_iter_init(&iter, index->postings);
+	while (g_hash_table_iter_next(&iter, &token, (gpointer *)&posting))
+		if (strstr(token, word) != NULL)
+			g_array_append_vals(set, posting->data, posting->len);
+	text_index_set_uniq(set);
+
+	return set;
+}
+
+/**
+ * text_index_candidates:
+ *
+ * Narrows down the items that may match @query by the tokens of its
+ * substrings.  The words of a substring appear whole or, at its ends, in
+ * part in the tokens of an item that contains it.
+ *
+ * Returns: The ascending numbers of the items to check, or %NULL for all
+ * of them.
+ */
+static GArray *text_index_candidates(TextIndex *index,
+				     const TextQuery *query)
+{
+	GPtrArray *words;
+	GArray *set, *sub;
+	gchar **segment;
+	guint i;
+
+	switch (query->type)
+	{
+	case mafw_f_approx:
+		words = g_ptr_array_new();
+		for (segment = query->segments; *segment != NULL; segment++)
+			text_index_tokenize(*segment, words);
+		set = NULL;
+		for (i = 0; i < words->len; i++)
+		{
+			sub = text_index_word_postings(
+				index, g_ptr_array_index(words, i));
+			if (set == NULL)
+				set = sub;
+			else
+			{
+				text_index_set_intersect(set, sub);
+				g_array_free(sub, TRUE);
+			}
+		}
+		g_ptr_array_foreach(words, (GFunc)g_free, NULL);
+		g_ptr_array_free(words, TRUE);
+		return set;
+	case mafw_f_and:
+		set = NULL;
+		for (i = 0; i < query->parts->len; i++)
+		{
+			sub = text_index_candidates(
+				index, g_ptr_array_index(query->parts, i));
+			if (sub == NULL)
+				continue;
+			if (set == NULL)
+				set = sub;
+			else
+			{
+				text_index_set_intersect(set, sub);
+				g_array_free(sub, TRUE);
+			}
+		}
+		return set;
+	case mafw_f_or:
+		set = g_array_new(FALSE, FALSE, sizeof(guint));
+		for (i = 0; i < query->parts->len; i++)
+		{
+			sub = text_index_candidates(
+				index, g_ptr_array_index(query->parts, i));
+			if (sub == NULL)
+			{
+				g_array_free(set, TRUE);
+				return NULL;
+			}
+			g_array_append_vals(set, sub->data, sub->len);
+			g_array_free(sub, TRUE);
+		}
+		text_index_set_uniq(set);
+		return set;
+	default:
+		/* Negations and presence say nothing of the tokens */
+		return NULL;
+	}
+}
+
+static gboolean text_query_match(const TextQuery *query, const TextDoc *doc)
+{
+	gchar **segment;
+	const gchar *str;
+	guint i;
+
+	switch (query->type)
+	{
+	case mafw_f_and:
+		for (i = 0; i < query->parts->len; i++)
+			if (!text_query_match(g_ptr_array_index(query->parts,
+								i), doc))
+				return FALSE;
+		return TRUE;
+	case mafw_f_or:
+		for (i = 0; i < query->parts->len; i++)
+			if (text_query_match(g_ptr_array_index(query->parts,
+							       i), doc))
+				return TRUE;
+		return FALSE;
+	case mafw_f_not:
+		return !text_query_match(g_ptr_array_index(query->parts, 0),
+					 doc);
+	case mafw_f_exists:
+		return doc->fields[query->field] != NULL;
+	case mafw_f_approx:
+		str = doc->folded[query->field];
+		if (str == NULL)
+			return FALSE;
+		for (segment = query->segments; *segment != NULL; segment++)
+		{
+			str = strstr(str, *segment);
+			if (str == NULL)
+				return FALSE;
+			str += strlen(*segment);
+		}
+		return TRUE;
+	default:
+		g_assert_not_reached();
+		return FALSE;
+	}
+}
+
+static GHashTable *text_index_metadata(const TextDoc *doc, guint64 keys)
+{
+	GHashTable *metadata;
+	guint field;
+
+	metadata = mafw_metadata_new();
+	for (field = 0; field < TEXT_N_FIELDS; field++)
+		if (doc->fields[field] != NULL &&
+		    keys & text_field_keys[field])
+			mafw_metadata_add_str(metadata, text_fields[field],
+					      doc->fields[field]);
+	if (doc->uri != NULL && keys & MUPnPSrc_MKey_URI)
+		mafw_metadata_add_str(metadata, MAFW_METADATA_KEY_URI,
+				      doc->uri);
+	if (doc->mime != NULL && keys & MUPnPSrc_MKey_MimeType)
+		mafw_metadata_add_str(metadata, MAFW_METADATA_KEY_MIME,
+				      doc->mime);
+	if (doc->duration >= 0 && keys & MUPnPSrc_MKey_Duration)
+		mafw_metadata_add_int(metadata, MAFW_METADATA_KEY_DURATION,
+				      doc->duration);
+	if (doc->year > 0 && keys & MUPnPSrc_MKey_Year)
+		mafw_metadata_add_int(metadata, MAFW_METADATA_KEY_YEAR,
+				      doc->year);
+
+	return metadata;
+}
+
+/**
+ * text_index_search:
+ * @index:      A #TextIndex
+ * @filter:     A filter text_index_can_search() accepts
+ * @keys:       The metadata to return, MUPnPSrc_MKey_* of %TEXT_INDEX_KEYS
+ * @skip_count: Number of matching items to skip
+ * @item_count: Number of matching items to return at most, 0 for all
+ * @error:      Return location for a #GError, or %NULL
+ *
+ * Finds the items matching @filter, in the order they were added.
+ * Substrings are matched regardless of case and diacritics.  The hits
+ * are copies, the index may change while the caller goes through them.
+ *
+ * Returns: A #GPtrArray of #TextIndexHit<!-- -->s, to be freed with
+ * text_index_hits_free(), or %NULL on error.
+ */
+GPtrArray *text_index_search(TextIndex *index, const MafwFilter *filter,
+			     guint64 keys, guint skip_count,
+			     guint item_count, GError **error)
+{
+	TextQuery *query;
+	GArray *candidates;
+	GPtrArray *hits;
+	TextIndexHit *hit;
+	const TextDoc *doc;
+	guint docno, i, n;
+
+	g_return_val_if_fail(index != NULL && filter != NULL, NULL);
+
+	if (!text_index_can_search(filter))
+	{
+		g_set_error(error, MAFW_SOURCE_ERROR,
+			    MAFW_SOURCE_ERROR_INVALID_SEARCH_STRING,
+			    "Filter cannot be searched from the index");
+		return NULL;
+	}
+	query = text_query_compile(filter, error);
+	if (query == NULL)
+		return NULL;
+
+	candidates = text_index_candidates(index, query);
+	n = candidates != NULL ? candidates->len : index->docs->len;
+	hits = g_ptr_array_new();
+	for (i = 0; i < n; i++)
+	{
+		if (item_count > 0 && hits->len == item_count)
+			break;
+
+		docno = candidates != NULL
+			? g_array_index(candidates, guint, i) : i;
+		doc = &g_array_index(index->docs, TextDoc, docno);
+		if (doc->objectid == NULL || !text_query_match(query, doc))
+			continue;
+		if (skip_count > 0)
+		{
+			skip_count--;
+			continue;
+		}
+
+		hit = g_new(TextIndexHit, 1);
+		hit->objectid = g_strdup(doc->objectid);
+		hit->metadata = text_index_metadata(doc, keys);
+		g_ptr_array_add(hits, hit);
+	}
+
+	if (candidates != NULL)
+		g_array_free(candidates, TRUE);
+	text_query_free(query);
+
+	return hits;
+}
+
+void text_index_hits_free(GPtrArray *hits)
+{
+	TextIndexHit *hit;
+	guint i;
+
+	if (hits == NULL)
+		return;
+
+	for (i = 0; i < hits->len; i++)
+	{
+		hit = g_ptr_array_index(hits, i);
+		g_free(hit->objectid);
+		if (hit->metadata != NULL)
+			g_hash_table_unref(hit->metadata);
+		g_free(hit);
+	}
+	g_ptr_array_free(hits, TRUE);
+}
+
+/*----------------------------------------------------------------------------
+  Grouping
+  ----------------------------------------------------------------------------*/
+
+static gint text_index_compare_groups(gconstpointer a, gconstpointer b)
+{
+	const TextIndexGroup *x = *(TextIndexGroup *const *)a;
+	const TextIndexGroup *y = *(TextIndexGroup *const *)b;
+
+	return g_utf8_collate(x->label, y->label);
+}
+
+/**
+ * text_index_get_groups:
+ * @index:    A #TextIndex
+ * @grouping: How to group the items
+ *
+ * Lists the artists, albums, genres or years of the items.  Values
+ * differing only in case or diacritics are one group, labelled as the
+ * first item has it.
+ *
+ * Returns: A #GPtrArray of #TextIndexGroup<!-- -->s in the order of their
+ * labels, to be freed with text_index_groups_free().
+ */
+GPtrArray *text_index_get_groups(TextIndex *index,
+				 TextIndexGrouping grouping)
+{
+	GHashTableIter iter;
+	TextGroup *group;
+	TextIndexGroup *out;
+	GPtrArray *groups;
+
+	g_return_val_if_fail(index != NULL, NULL);
+	g_return_val_if_fail(grouping < TEXT_INDEX_N_GROUPINGS, NULL);
+
+	groups = g_ptr_array_new();
+	g_hash_table_iter_init(&iter, index->groups[grouping]);
+	while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&group))
+	{
+		if (group->live == 0)
+			continue;
+		out = g_new(TextIndexGroup, 1);
+		out->label = g_strdup(group->label);
+		out->count = group->live;
+		g_ptr_array_add(groups, out);
+	}
+	g_ptr_array_sort(groups, text_index_compare_groups);
+
+	return groups;
+}
+
+void text_index_groups_free(GPtrArray *groups)
+{
+	TextIndexGroup *group;
+	guint i;
+
+	if (groups == NULL)
+		return;
+
+	for (i = 0; i < groups->len; i++)
+	{
+		group = g_ptr_array_index(groups, i);
+		g_free(group->label);
+		g_free(group);
+	}
+	g_ptr_array_free(groups, TRUE);
+}
+
+/**
+ * text_index_get_group:
+ * @index:      A #TextIndex
+ * @grouping:   How the items are grouped
+ * @label:      Label of a group, see text_index_get_groups()
+ * @keys:       The metadata to return, MUPnPSrc_MKey_* of %TEXT_INDEX_KEYS
+ * @skip_count: Number of items to skip
+ * @item_count: Number of items to return at most, 0 for all
+ *
+ * Returns: The items of the group in the order they were added, as a
+ * #GPtrArray of #TextIndexHit<!-- -->s to be freed with
+ * text_index_hits_free().  Empty if there is no such group.
+ */
+GPtrArray *text_index_get_group(TextIndex *index, TextIndexGrouping grouping,
+				const gchar *label, guint64 keys,
+				guint skip_count, guint item_count)
+{
+	GPtrArray *hits;
+	TextIndexHit *hit;
+	const TextGroup *group;
+	const TextDoc *doc;
+	gchar *key;
+	guint i;
+
+	g_return_val_if_fail(index != NULL && label != NULL, NULL);
+	g_return_val_if_fail(grouping < TEXT_INDEX_N_GROUPINGS, NULL);
+
+	hits = g_ptr_array_new();
+	key = text_grouping_fields[grouping] >= 0
+		? text_index_fold(label) : g_strdup(label);
+	group = key != NULL
+		? g_hash_table_lookup(index->groups[grouping], key) : NULL;
+	g_free(key);
+	if (group == NULL)
+		return hits;
+
+	for (i = 0; i < group->docs->len; i++)
+	{
+		if (item_count > 0 && hits->len == item_count)
+			break;
+
+		doc = &g_array_index(index->docs, TextDoc,
+				     g_array_index(group->docs, guint, i));
+		if (doc->objectid == NULL)
+			continue;
+		if (skip_count > 0)
+		{
+			skip_count--;
+			continue;
+		}
+
+		hit = g_new(TextIndexHit, 1);
+		hit->objectid = g_strdup(doc->objectid);
+		hit->metadata = text_index_metadata(doc, keys);
+		g_ptr_array_add(hits, hit);
+	}
+
+	return hits;
+}
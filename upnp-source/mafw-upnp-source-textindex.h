@@ -0,0 +1,91 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef MAFW_UPNP_SOURCE_TEXTINDEX_H
+#define MAFW_UPNP_SOURCE_TEXTINDEX_H
+
+#include <glib.h>
+#include <libmafw/mafw.h>
+
+#include "mafw-upnp-source-keys.h"
+
+/*----------------------------------------------------------------------------
+  Local full-text index
+  ----------------------------------------------------------------------------*/
+
+/* Items indexed at most, the index never becomes complete beyond */
+#define TEXT_INDEX_MAX_ITEMS 65536
+
+/* The metadata kept of each item; the searchable ones are the first four */
+#define TEXT_INDEX_KEYS (MUPnPSrc_MKey_Title | MUPnPSrc_MKey_Artist | \
+			 MUPnPSrc_MKey_Album | MUPnPSrc_MKey_Genre | \
+			 MUPnPSrc_MKey_URI | MUPnPSrc_MKey_MimeType | \
+			 MUPnPSrc_MKey_Duration | MUPnPSrc_MKey_Year)
+
+typedef struct _TextIndex TextIndex;
+
+typedef struct {
+	gchar *objectid;
+	GHashTable *metadata;
+} TextIndexHit;
+
+/* The ways items are grouped for browsing */
+typedef enum {
+	TEXT_INDEX_BY_ARTIST,
+	TEXT_INDEX_BY_ALBUM,
+	TEXT_INDEX_BY_GENRE,
+	TEXT_INDEX_BY_YEAR,
+	TEXT_INDEX_N_GROUPINGS
+} TextIndexGrouping;
+
+typedef struct {
+	gchar *label;
+	guint count;
+} TextIndexGroup;
+
+TextIndex *text_index_new(void);
+void text_index_free(TextIndex *index);
+
+void text_index_add(TextIndex *index, const gchar *objectid,
+		    const gchar *parentid, GHashTable *metadata);
+void text_index_invalidate(TextIndex *index, const gchar *parentid);
+
+void text_index_set_complete(TextIndex *index, gboolean complete);
+gboolean text_index_is_complete(const TextIndex *index);
+guint text_index_get_size(const TextIndex *index);
+
+gboolean text_index_can_search(const MafwFilter *filter);
+GPtrArray *text_index_search(TextIndex *index, const MafwFilter *filter,
+			     guint64 keys, guint skip_count,
+			     guint item_count, GError **error);
+void text_index_hits_free(GPtrArray *hits);
+
+GPtrArray *text_index_get_groups(TextIndex *index,
+				 TextIndexGrouping grouping);
+void text_index_groups_free(GPtrArray *groups);
+GPtrArray *text_index_get_group(TextIndex *index, TextIndexGrouping grouping,
+				const gchar *label, guint64 keys,
+				guint skip_count, guint item_count);
+
+#endif
@@ -0,0 +1,552 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <glib.h>
+#include <string.h>
+#include <libmafw/mafw.h>
+
+#include "mafw-upnp-source-typeahead.h"
+#include "mafw-upnp-source-predicate.h"
+
+/*----------------------------------------------------------------------------
+  Type-ahead search
+  ----------------------------------------------------------------------------*/
+
+/* Searches as the user types.  The text is only searched for once the
+   typing pauses, and a search for older text still running is cancelled
+   right away.  The results of the last few searches are kept, so that text
+   containing the text of one of them, like "beat" after "bea", is answered
+   by filtering those results here instead of searching the source again:
+   whatever contains "beat" contains "bea" as well. */
+
+typedef struct {
+	gchar *objectid;
+	GHashTable *metadata;
+} TypeAheadItem;
+
+/* The results of a search */
+typedef struct {
+	/* The text searched for in ASCII lowercase, as mafw_f_approx
+	   compares */
+	gchar *folded;
+
+	/* TypeAheadItems in the order the source gave them */
+	GPtrArray *items;
+} TypeAheadSet;
+
+typedef struct {
+	/* Held by the browse until its last result, and while starting
+	   and calling back */
+	gint refcount;
+
+	/* %NULL once superseded */
+	TypeAhead *ta;
+	gchar *text;
+	guint browse_id;
+	gboolean done;
+
+	/* The results so far, %NULL once too many to keep */
+	TypeAheadSet *set;
+} TypeAheadQuery;
+
+struct _TypeAhead {
+	MafwSource *source;
+	gchar *object_id;
+	gchar *key;
+	gchar **keys;
+	guint delay;
+	TypeAheadResultCb callback;
+	gpointer user_data;
+
+	/* The text waiting for the typing to pause */
+	gchar *text;
+	guint timeout_id;
+
+	/* The search running */
+	TypeAheadQuery *query;
+
+	/* TypeAheadSets to refine, the latest last */
+	GPtrArray *sets;
+
+	/* type_ahead_free() leaves freeing to whoever is calling back */
+	guint busy;
+	gboolean freed;
+};
+
+static void type_ahead_set_free(TypeAheadSet *set)
+{
+	TypeAheadItem *item;
+	guint i;
+
+	for (i = 0; i < set->items->len; i++)
+	{
+		item = g_ptr_array_index(set->items, i);
+		g_free(item->objectid);
+		g_hash_table_unref(item->metadata);
+		g_free(item);
+	}
+	g_ptr_array_free(set->items, TRUE);
+	g_free(set->folded);
+	g_free(set);
+}
+
+static TypeAheadSet *type_ahead_set_new(gchar *folded)
+{
+	TypeAheadSet *set;
+
+	set = g_new0(TypeAheadSet, 1);
+	set->folded = folded;
+	set->items = g_ptr_array_new();
+
+	return set;
+}
+
+static void type_ahead_set_add(TypeAheadSet *set, const gchar *objectid,
+			       GHashTable *metadata)
+{
+	TypeAheadItem *item;
+
+	item = g_new0(TypeAheadItem, 1);
+	item->objectid = g_strdup(objectid);
+	item->metadata = g_hash_table_ref(metadata);
+	g_ptr_array_add(set->items, item);
+}
+
+/* Keeps @set to refine, instead of any set for the same text, forgetting
+   the oldest set if there are too many. */
+static void type_ahead_keep(TypeAhead *ta, TypeAheadSet *set)
+{
+	TypeAheadSet *old;
+	guint i;
+
+	for (i = 0; i < ta->sets->len; i++)
+	{
+		old = g_ptr_array_index(ta->sets, i);
+		if (strcmp(old->folded, set->folded) == 0)
+		{
+			g_ptr_array_remove_index(ta->sets, i);
+			type_ahead_set_free(old);
+			break;
+		}
+	}
+	if (ta->sets->len == TYPE_AHEAD_MAX_SETS)
+		type_ahead_set_free(g_ptr_array_remove_index(ta->sets, 0));
+	g_ptr_array_add(ta->sets, set);
+}
+
+/* The set the results for @folded are among, the one searched for the
+   longest text if there are more, or %NULL. */
+static const TypeAheadSet *type_ahead_find(const TypeAhead *ta,
+					   const gchar *folded)
+{
+	const TypeAheadSet *set, *best;
+	guint i;
+
+	best = NULL;
+	for (i = 0; i < ta->sets->len; i++)
+	{
+		set = g_ptr_array_index(ta->sets, i);
+		if (strstr(folded, set->folded) != NULL &&
+		    (best == NULL ||
+		     strlen(set->folded) > strlen(best->folded)))
+			best = set;
+	}
+
+	return best;
+}
+
+static void type_ahead_query_unref(TypeAheadQuery *query)
+{
+	g_assert(query->refcount > 0);
+	if (--query->refcount > 0)
+		return;
+
+	if (query->set != NULL)
+		type_ahead_set_free(query->set);
+	g_free(query->text);
+	g_free(query);
+}
+
+/* Cancels the browse of @query and drops its reference right away,
+   whether the source calls back with a last result or not.  Anything it
+   still says goes unheard. */
+static void type_ahead_query_stop(MafwSource *source, TypeAheadQuery *query)
+{
+	if (query->done || query->browse_id == MAFW_SOURCE_INVALID_BROWSE_ID)
+		return;
+
+	query->done = TRUE;
+	mafw_source_cancel_browse(source, query->browse_id, NULL);
+	type_ahead_query_unref(query);
+}
+
+/* Cancels the search running, if any.  A search still starting is
+   stopped once it has its browse ID. */
+static void type_ahead_cancel(TypeAhead *ta)
+{
+	TypeAheadQuery *query;
+
+	query = ta->query;
+	if (query == NULL)
+		return;
+	ta->query = NULL;
+	query->ta = NULL;
+
+	type_ahead_query_stop(ta->source, query);
+}
+
+static void type_ahead_destroy(TypeAhead *ta)
+{
+	g_ptr_array_foreach(ta->sets, (GFunc)type_ahead_set_free, NULL);
+	g_ptr_array_free(ta->sets, TRUE);
+	g_strfreev(ta->keys);
+	g_free(ta->key);
+	g_free(ta->object_id);
+	g_free(ta->text);
+	g_object_unref(ta->source);
+	g_free(ta);
+}
+
+/* Ends calling back.  Returns whether @ta is still there to use. */
+static gboolean type_ahead_release(TypeAhead *ta)
+{
+	g_assert(ta->busy > 0);
+	ta->busy--;
+	if (!ta->freed)
+		return TRUE;
+
+	if (ta->busy == 0)
+		type_ahead_destroy(ta);
+	return FALSE;
+}
+
+static gboolean type_ahead_call(TypeAhead *ta, const gchar *text,
+				guint remaining_count, const gchar *objectid,
+				GHashTable *metadata, const GError *error)
+{
+	ta->busy++;
+	ta->callback(ta, text, remaining_count, objectid, metadata,
+		     ta->user_data, error);
+	return type_ahead_release(ta);
+}
+
+static void type_ahead_browse_cb(MafwSource *source, guint browse_id,
+				 gint remaining_count, guint index,
+				 const gchar *objectid, GHashTable *metadata,
+				 gpointer user_data, const GError *error)
+{
+	TypeAheadQuery *query = user_data;
+	TypeAhead *ta;
+	gboolean last;
+
+	if (query->done)
+		return;
+
+	query->refcount++;
+	if (error == NULL && objectid != NULL && metadata != NULL &&
+	    query->set != NULL)
+	{
+		if (query->set->items->len < TYPE_AHEAD_MAX_RESULTS)
+			type_ahead_set_add(query->set, objectid, metadata);
+		else
+		{
+			type_ahead_set_free(query->set);
+			query->set = NULL;
+		}
+	}
+
+	last = error != NULL || remaining_count <= 0;
+	if (last)
+		query->done = TRUE;
+
+	ta = query->ta;
+	if (ta != NULL && last)
+	{
+		/* Over before the callback could type on */
+		ta->query = NULL;
+		query->ta = NULL;
+		if (error == NULL && query->set != NULL)
+		{
+			type_ahead_keep(ta, query->set);
+			query->set = NULL;
+		}
+		type_ahead_call(ta, query->text, 0, objectid, metadata,
+				error);
+	}
+	else if (ta != NULL)
+		type_ahead_call(ta, query->text, remaining_count, objectid,
+				metadata, NULL);
+
+	/* The source will not call back any more */
+	if (last)
+		type_ahead_query_unref(query);
+	type_ahead_query_unref(query);
+}
+
+static MafwFilter *type_ahead_filter(const TypeAhead *ta, const gchar *text)
+{
+	MafwFilter *filter;
+	gchar *quoted;
+
+	quoted = mafw_filter_quote(text);
+	filter = mafw_filter_new(mafw_f_approx, ta->key, quoted);
+	g_free(quoted);
+
+	return filter;
+}
+
+/* Searches the source for @text, keeping the results to refine later. */
+static void type_ahead_browse(TypeAhead *ta, const gchar *text,
+			      gchar *folded, const MafwFilter *filter)
+{
+	TypeAheadQuery *query;
+	GError *error;
+	guint browse_id;
+
+	query = g_new0(TypeAheadQuery, 1);
+	query->refcount = 2;
+	query->ta = ta;
+	query->text = g_strdup(text);
+	query->browse_id = MAFW_SOURCE_INVALID_BROWSE_ID;
+	query->set = type_ahead_set_new(folded);
+	ta->query = query;
+
+	browse_id = mafw_source_browse(ta->source, ta->object_id, TRUE,
+				       filter, NULL,
+				       (const gchar *const *)ta->keys, 0, 0,
+				       type_ahead_browse_cb, query);
+	if (browse_id != MAFW_SOURCE_INVALID_BROWSE_ID)
+	{
+		query->browse_id = browse_id;
+
+		/* Typed on from a result given out while starting */
+		if (query->ta == NULL)
+			type_ahead_query_stop(ta->source, query);
+	}
+	else if (!query->done)
+	{
+		/* Failed without a word */
+		query->done = TRUE;
+		type_ahead_query_unref(query);
+		if (query->ta != NULL)
+		{
+			ta->query = NULL;
+			query->ta = NULL;
+			error = g_error_new(MAFW_SOURCE_ERROR,
+					    MAFW_SOURCE_ERROR_BROWSE_RESULT_FAILED,
+					    "Cannot search %s",
+					    ta->object_id);
+			type_ahead_call(ta, text, 0, NULL, NULL, error);
+			g_error_free(error);
+		}
+	}
+	type_ahead_query_unref(query);
+}
+
+/* Answers @text from the results of an earlier search. */
+static void type_ahead_refine(TypeAhead *ta, const TypeAheadSet *base,
+			      const gchar *text, gchar *folded,
+			      const MafwFilter *filter)
+{
+	const TypeAheadItem *item;
+	TypeAheadSet *set;
+	Predicate *pred;
+	GError *error;
+	guint i;
+
+	error = NULL;
+	pred = predicate_compile(filter, &error);
+	if (pred == NULL)
+	{
+		type_ahead_call(ta, text, 0, NULL, NULL, error);
+		g_error_free(error);
+		g_free(folded);
+		return;
+	}
+
+	set = type_ahead_set_new(folded);
+	for (i = 0; i < base->items->len; i++)
+	{
+		item = g_ptr_array_index(base->items, i);
+		if (predicate_match(pred, item->metadata))
+			type_ahead_set_add(set, item->objectid,
+					   item->metadata);
+	}
+	predicate_free(pred);
+
+	if (set->items->len == 0 &&
+	    !type_ahead_call(ta, text, 0, NULL, NULL, NULL))
+	{
+		type_ahead_set_free(set);
+		return;
+	}
+	for (i = 0; i < set->items->len; i++)
+	{
+		item = g_ptr_array_index(set->items, i);
+		if (!type_ahead_call(ta, text, set->items->len - i - 1,
+				     item->objectid, item->metadata, NULL))
+		{
+			type_ahead_set_free(set);
+			return;
+		}
+	}
+	type_ahead_keep(ta, set);
+}
+
+static gboolean type_ahead_timeout(TypeAhead *ta)
+{
+	const TypeAheadSet *base;
+	MafwFilter *filter;
+	gchar *text, *folded;
+
+	ta->timeout_id = 0;
+	text = ta->text;
+	ta->text = NULL;
+
+	ta->busy++;
+	if (*text == '\0')
+		/* Nothing to look for, nothing found */
+		type_ahead_call(ta, text, 0, NULL, NULL, NULL);
+	else
+	{
+		folded = g_ascii_strdown(text, -1);
+		filter = type_ahead_filter(ta, text);
+		base = type_ahead_find(ta, folded);
+		if (base != NULL)
+			type_ahead_refine(ta, base, text, folded, filter);
+		else
+			type_ahead_browse(ta, text, folded, filter);
+		mafw_filter_free(filter);
+	}
+	type_ahead_release(ta);
+	g_free(text);
+
+	return FALSE;
+}
+
+/**
+ * type_ahead_new:
+ * @source:        The source to search
+ * @object_id:     The container to search recursively
+ * @key:           The metadata key to look for the text in
+ * @metadata_keys: Metadata keys of the results
+ * @delay:         Milliseconds the typing has to pause for before
+ *                 searching, like %TYPE_AHEAD_DELAY
+ * @callback:      Called with the results
+ * @user_data:     Data for @callback
+ *
+ * Prepares to search @object_id for items whose @key contains the text
+ * typed, as with mafw_f_approx.  The results come to @callback like those
+ * of a browse, along with the text they are for; the last one has no
+ * remaining count.  @callback may type on and may free the search.
+ *
+ * Returns: The type-ahead search, to be freed with type_ahead_free().
+ */
+TypeAhead *type_ahead_new(MafwSource *source, const gchar *object_id,
+			  const gchar *key,
+			  const gchar *const *metadata_keys, guint delay,
+			  TypeAheadResultCb callback, gpointer user_data)
+{
+	TypeAhead *ta;
+	GPtrArray *keys;
+	guint i;
+
+	g_return_val_if_fail(source != NULL && object_id != NULL, NULL);
+	g_return_val_if_fail(key != NULL && callback != NULL, NULL);
+
+	ta = g_new0(TypeAhead, 1);
+	ta->source = g_object_ref(source);
+	ta->object_id = g_strdup(object_id);
+	ta->key = g_strdup(key);
+	ta->delay = delay;
+	ta->callback = callback;
+	ta->user_data = user_data;
+	ta->sets = g_ptr_array_new();
+
+	/* Refining needs @key.  No keys at all stands for every key. */
+	if (metadata_keys != NULL && *metadata_keys != NULL)
+	{
+		keys = g_ptr_array_new();
+		for (i = 0; metadata_keys[i] != NULL; i++)
+			g_ptr_array_add(keys, g_strdup(metadata_keys[i]));
+		for (i = 0; metadata_keys[i] != NULL; i++)
+			if (strcmp(metadata_keys[i], key) == 0)
+				break;
+		if (metadata_keys[i] == NULL)
+			g_ptr_array_add(keys, g_strdup(key));
+		g_ptr_array_add(keys, NULL);
+		ta->keys = (gchar **)g_ptr_array_free(keys, FALSE);
+	}
+	else
+		ta->keys = g_strdupv((gchar **)metadata_keys);
+
+	return ta;
+}
+
+/**
+ * type_ahead_set_text:
+ * @ta:   A type-ahead search
+ * @text: The text typed so far
+ *
+ * Searches for @text once the typing pauses.  The results still coming
+ * for the text before are dropped and their search cancelled.  Text
+ * containing the text of an earlier search is looked for among its
+ * results rather than searched for again.
+ */
+void type_ahead_set_text(TypeAhead *ta, const gchar *text)
+{
+	g_return_if_fail(ta != NULL && text != NULL);
+
+	type_ahead_cancel(ta);
+	g_free(ta->text);
+	ta->text = g_strdup(text);
+	if (ta->timeout_id != 0)
+		g_source_remove(ta->timeout_id);
+	ta->timeout_id = g_timeout_add(ta->delay,
+				       (GSourceFunc)type_ahead_timeout, ta);
+}
+
+/**
+ * type_ahead_free:
+ * @ta: A type-ahead search
+ *
+ * Cancels the search running and frees @ta.
+ */
+void type_ahead_free(TypeAhead *ta)
+{
+	if (ta == NULL || ta->freed)
+		return;
+
+	type_ahead_cancel(ta);
+	if (ta->timeout_id != 0)
+	{
+		g_source_remove(ta->timeout_id);
+		ta->timeout_id = 0;
+	}
+
+	if (ta->busy > 0)
+		ta->freed = TRUE;
+	else
+		type_ahead_destroy(ta);
+}
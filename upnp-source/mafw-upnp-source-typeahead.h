@@ -0,0 +1,59 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef MAFW_UPNP_SOURCE_TYPEAHEAD_H
+#define MAFW_UPNP_SOURCE_TYPEAHEAD_H
+
+#include <glib.h>
+#include <libmafw/mafw.h>
+
+/*----------------------------------------------------------------------------
+  Type-ahead search
+  ----------------------------------------------------------------------------*/
+
+/* Milliseconds the typing has to pause for before searching */
+#define TYPE_AHEAD_DELAY 150
+
+/* Result sets larger than this are not kept for refining */
+#define TYPE_AHEAD_MAX_RESULTS 4096
+
+/* Result sets kept for refining */
+#define TYPE_AHEAD_MAX_SETS 8
+
+typedef struct _TypeAhead TypeAhead;
+
+typedef void (*TypeAheadResultCb)(TypeAhead *ta, const gchar *text,
+				  guint remaining_count,
+				  const gchar *objectid, GHashTable *metadata,
+				  gpointer user_data, const GError *error);
+
+TypeAhead *type_ahead_new(MafwSource *source, const gchar *object_id,
+			  const gchar *key,
+			  const gchar *const *metadata_keys, guint delay,
+			  TypeAheadResultCb callback, gpointer user_data);
+void type_ahead_free(TypeAhead *ta);
+
+void type_ahead_set_text(TypeAhead *ta, const gchar *text);
+
+#endif
@@ -0,0 +1,209 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <glib.h>
+
+#include "mafw-upnp-source-updates.h"
+
+/*----------------------------------------------------------------------------
+  Update ID tracking
+  ----------------------------------------------------------------------------*/
+
+/* What the server has told about its versions: the SystemUpdateID, which
+   changes on every modification anywhere, and the containerUpdateID of the
+   containers seen in browse results, which changes only with the
+   container. */
+struct _UpdateTracker {
+	guint32 system_update_id;
+	gboolean has_system;
+
+	/* Container ID => containerUpdateID */
+	GHashTable *containers;
+};
+
+UpdateTracker *update_tracker_new(void)
+{
+	UpdateTracker *tracker;
+
+	tracker = g_new0(UpdateTracker, 1);
+	tracker->containers = g_hash_table_new_full(g_str_hash, g_str_equal,
+						    g_free, NULL);
+
+	return tracker;
+}
+
+void update_tracker_free(UpdateTracker *tracker)
+{
+	if (tracker == NULL)
+		return;
+
+	g_hash_table_destroy(tracker->containers);
+	g_free(tracker);
+}
+
+/**
+ * update_tracker_set_system:
+ * @tracker:   An #UpdateTracker
+ * @update_id: SystemUpdateID from GetSystemUpdateID or an event
+ *
+ * Returns: %TRUE if the SystemUpdateID was not known or has changed.
+ */
+gboolean update_tracker_set_system(UpdateTracker *tracker,
+				   guint32 update_id)
+{
+	g_return_val_if_fail(tracker != NULL, FALSE);
+
+	if (tracker->has_system && tracker->system_update_id == update_id)
+		return FALSE;
+
+	tracker->system_update_id = update_id;
+	tracker->has_system = TRUE;
+	return TRUE;
+}
+
+gboolean update_tracker_get_system(const UpdateTracker *tracker,
+				   guint32 *update_id)
+{
+	g_return_val_if_fail(tracker != NULL, FALSE);
+
+	if (update_id != NULL)
+		*update_id = tracker->system_update_id;
+	return tracker->has_system;
+}
+
+/**
+ * update_tracker_set_container:
+ * @tracker:      An #UpdateTracker
+ * @container_id: UPnP ID of a container
+ * @update_id:    Its upnp:containerUpdateID
+ *
+ * Returns: %TRUE if the update ID was not known or has changed.
+ */
+gboolean update_tracker_set_container(UpdateTracker *tracker,
+				      const gchar *container_id,
+				      guint32 update_id)
+{
+	gpointer old;
+
+	g_return_val_if_fail(tracker != NULL, FALSE);
+	g_return_val_if_fail(container_id != NULL, FALSE);
+
+	if (g_hash_table_lookup_extended(tracker->containers, container_id,
+					 NULL, &old))
+	{
+		if (GPOINTER_TO_UINT(old) == update_id)
+			return FALSE;
+	}
+	else if (g_hash_table_size(tracker->containers) >=
+		 UPDATE_TRACKER_MAX_CONTAINERS)
+	{
+		/* Forgetting only costs a refetch */
+		g_hash_table_remove_all(tracker->containers);
+	}
+
+	g_hash_table_replace(tracker->containers, g_strdup(container_id),
+			     GUINT_TO_POINTER(update_id));
+	return TRUE;
+}
+
+gboolean update_tracker_get_container(const UpdateTracker *tracker,
+				      const gchar *container_id,
+				      guint32 *update_id)
+{
+	gpointer value;
+
+	g_return_val_if_fail(tracker != NULL, FALSE);
+	g_return_val_if_fail(container_id != NULL, FALSE);
+
+	if (!g_hash_table_lookup_extended(tracker->containers, container_id,
+					  NULL, &value))
+		return FALSE;
+
+	if (update_id != NULL)
+		*update_id = GPOINTER_TO_UINT(value);
+	return TRUE;
+}
+
+/**
+ * update_tracker_get_stamp:
+ * @tracker:      An #UpdateTracker
+ * @container_id: UPnP ID of a container
+ * @stamp:        Filled with the known versions of @container_id
+ *
+ * Records the current version of a container, to be given to
+ * update_tracker_changed_since() later.
+ */
+void update_tracker_get_stamp(const UpdateTracker *tracker,
+			      const gchar *container_id,
+			      UpdateStamp *stamp)
+{
+	g_return_if_fail(tracker != NULL);
+	g_return_if_fail(stamp != NULL);
+
+	stamp->flags = 0;
+	stamp->system_update_id = 0;
+	stamp->container_update_id = 0;
+
+	if (update_tracker_get_system(tracker, &stamp->system_update_id))
+		stamp->flags |= UPDATE_STAMP_SYSTEM;
+	if (container_id != NULL &&
+	    update_tracker_get_container(tracker, container_id,
+					 &stamp->container_update_id))
+		stamp->flags |= UPDATE_STAMP_CONTAINER;
+}
+
+/**
+ * update_tracker_changed_since:
+ * @tracker:      An #UpdateTracker
+ * @container_id: UPnP ID of a container
+ * @stamp:        A version from update_tracker_get_stamp()
+ *
+ * Compares the container update IDs if both are known, otherwise the
+ * SystemUpdateIDs.  A changed SystemUpdateID only tells that something on
+ * the server has changed, so %UPDATE_CHANGED means "may have changed" then.
+ *
+ * Returns: Whether @container_id has changed since @stamp was taken.
+ */
+UpdateChange update_tracker_changed_since(const UpdateTracker *tracker,
+					  const gchar *container_id,
+					  const UpdateStamp *stamp)
+{
+	guint32 update_id;
+
+	g_return_val_if_fail(tracker != NULL, UPDATE_UNKNOWN);
+	g_return_val_if_fail(stamp != NULL, UPDATE_UNKNOWN);
+
+	if ((stamp->flags & UPDATE_STAMP_CONTAINER) != 0 &&
+	    container_id != NULL &&
+	    update_tracker_get_container(tracker, container_id, &update_id))
+		return update_id == stamp->container_update_id ?
+			UPDATE_UNCHANGED : UPDATE_CHANGED;
+
+	if ((stamp->flags & UPDATE_STAMP_SYSTEM) != 0 &&
+	    update_tracker_get_system(tracker, &update_id))
+		return update_id == stamp->system_update_id ?
+			UPDATE_UNCHANGED : UPDATE_CHANGED;
+
+	return UPDATE_UNKNOWN;
+}
@@ -0,0 +1,78 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef MAFW_UPNP_SOURCE_UPDATES_H
+#define MAFW_UPNP_SOURCE_UPDATES_H
+
+#include <glib.h>
+
+/*----------------------------------------------------------------------------
+  Update ID tracking
+  ----------------------------------------------------------------------------*/
+
+/* Containers whose update ID is remembered */
+#define UPDATE_TRACKER_MAX_CONTAINERS 4096
+
+/* Valid fields of an #UpdateStamp */
+#define UPDATE_STAMP_SYSTEM    (1 << 0)
+#define UPDATE_STAMP_CONTAINER (1 << 1)
+
+/* The version of a container as far as the server has told */
+typedef struct {
+	guint flags;
+	guint32 system_update_id;
+	guint32 container_update_id;
+} UpdateStamp;
+
+typedef enum {
+	UPDATE_UNKNOWN,
+	UPDATE_UNCHANGED,
+	UPDATE_CHANGED
+} UpdateChange;
+
+typedef struct _UpdateTracker UpdateTracker;
+
+UpdateTracker *update_tracker_new(void);
+void update_tracker_free(UpdateTracker *tracker);
+
+gboolean update_tracker_set_system(UpdateTracker *tracker,
+				   guint32 update_id);
+gboolean update_tracker_get_system(const UpdateTracker *tracker,
+				   guint32 *update_id);
+
+gboolean update_tracker_set_container(UpdateTracker *tracker,
+				      const gchar *container_id,
+				      guint32 update_id);
+gboolean update_tracker_get_container(const UpdateTracker *tracker,
+				      const gchar *container_id,
+				      guint32 *update_id);
+
+void update_tracker_get_stamp(const UpdateTracker *tracker,
+			      const gchar *container_id,
+			      UpdateStamp *stamp);
+UpdateChange update_tracker_changed_since(const UpdateTracker *tracker,
+					  const gchar *container_id,
+					  const UpdateStamp *stamp);
+
+#endif
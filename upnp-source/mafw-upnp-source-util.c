@@ -105,104 +105,18 @@ struct _upnp_map{
 	const gchar *upnp_key;
 	const gchar *mafw_key;
 	gint upnp_filterid;
+	DidlValueDecoder decode;
 };
 
-static const gchar *upnp_filters[] = {
-	DIDL_RES,
-	DIDL_RES "@" DIDL_RES_PROTOCOL_INFO,
-	DIDL_RES "@" DIDL_RES_DURATION,
-	DIDL_RES "@" DIDL_RES_BITRATE,
-	DIDL_RES "@" DIDL_RES_SIZE,
-	DIDL_RES "@" DIDL_RES_COLORDEPTH,
-	DIDL_RES "@" DIDL_RES_RESOLUTION,
-	DIDL_ALBUM_ART_URI,
-	DIDL_LYRICS_URI,
-	DIDL_DISCOGRAPHY_URI,
-	DIDL_TITLE,
-	DIDL_ARTIST,
-	DIDL_GENRE,
-	DIDL_ALBUM,
-	MAFW_METADATA_KEY_CHILDCOUNT_1,
-	MAFW_METADATA_KEY_DIDL,
-	MAFW_METADATA_KEY_IS_SEEKABLE,
-	MAFW_METADATA_KEY_TRACK,
-	MAFW_METADATA_KEY_YEAR,
-	MAFW_METADATA_KEY_COUNT,
-	MAFW_METADATA_KEY_PLAY_COUNT,
-	MAFW_METADATA_KEY_DESCRIPTION,
-	MAFW_METADATA_KEY_ENCODING,
-	MAFW_METADATA_KEY_ADDED,
-	MAFW_METADATA_KEY_MODIFIED,
-	MAFW_METADATA_KEY_THUMBNAIL,
-	MAFW_METADATA_KEY_COMMENT,
-	MAFW_METADATA_KEY_TAGS,
-	MAFW_METADATA_KEY_ALBUM_INFO_URI,
-	MAFW_METADATA_KEY_LYRICS,
-	MAFW_METADATA_KEY_RATING,
-	MAFW_METADATA_KEY_COMPOSER,
-	MAFW_METADATA_KEY_FILENAME,
-	MAFW_METADATA_KEY_COPYRIGHT,
-	MAFW_METADATA_KEY_AUDIO_CODEC,
-	MAFW_METADATA_KEY_ALBUM_ART_URI,
-	MAFW_METADATA_KEY_ALBUM_ART,
-	MAFW_METADATA_KEY_VIDEO_CODEC,
-	MAFW_METADATA_KEY_VIDEO_FRAMERATE,
-	MAFW_METADATA_KEY_EXIF_XML,
-	MAFW_METADATA_KEY_ICON_URI,
-	MAFW_METADATA_KEY_ICON
+struct _upnp_filter_fragment {
+	const gchar *str;
+	gsize len;
 };
 
-static struct _upnp_map upnpmaps[] = {
-	{0, NULL, MAFW_METADATA_KEY_URI, 0},
-	{0, NULL, MAFW_METADATA_KEY_CHILDCOUNT_1, 14},
-	{0, NULL, MAFW_METADATA_KEY_MIME, 1},
-	{0, NULL, MAFW_METADATA_KEY_DURATION, 2},
-	{0, NULL, MAFW_METADATA_KEY_THUMBNAIL_URI, 1},
-	{0, NULL, MAFW_METADATA_KEY_DIDL, 15},
-	{0, NULL, MAFW_METADATA_KEY_IS_SEEKABLE, 16},
-	{G_TYPE_STRING, DIDL_LYRICS_URI, MAFW_METADATA_KEY_LYRICS_URI, 8},
-	{G_TYPE_STRING, DIDL_RES_PROTOCOL_INFO, MAFW_METADATA_KEY_PROTOCOL_INFO, 1},
-	{G_TYPE_STRING, DIDL_ALBUM_ART_URI, MAFW_METADATA_KEY_ALBUM_ART_SMALL_URI, 7},
-	{G_TYPE_STRING, DIDL_ALBUM_ART_URI, MAFW_METADATA_KEY_ALBUM_ART_MEDIUM_URI, 7},
-	{G_TYPE_STRING, DIDL_ALBUM_ART_URI, MAFW_METADATA_KEY_ALBUM_ART_LARGE_URI, 7},
-	{G_TYPE_STRING, DIDL_DISCOGRAPHY_URI, MAFW_METADATA_KEY_ARTIST_INFO_URI, 9},
-	{G_TYPE_INT, DIDL_RES_BITRATE, MAFW_METADATA_KEY_AUDIO_BITRATE, 3},
-	{G_TYPE_INT, DIDL_RES_BITRATE, MAFW_METADATA_KEY_VIDEO_BITRATE, 3},
-	{G_TYPE_INT, DIDL_RES_BITRATE, MAFW_METADATA_KEY_BITRATE, 3},
-	{G_TYPE_INT, DIDL_RES_SIZE, MAFW_METADATA_KEY_FILESIZE, 4},
-	{G_TYPE_INT, DIDL_RES_COLORDEPTH, MAFW_METADATA_KEY_BPP, 5},
-	{G_TYPE_STRING, MAFW_METADATA_KEY_TITLE, MAFW_METADATA_KEY_TITLE, 10},
-	{G_TYPE_STRING, MAFW_METADATA_KEY_ARTIST, MAFW_METADATA_KEY_ARTIST, 11},
-	{G_TYPE_STRING, MAFW_METADATA_KEY_ALBUM, MAFW_METADATA_KEY_ALBUM, 13},
-	{G_TYPE_STRING, MAFW_METADATA_KEY_GENRE, MAFW_METADATA_KEY_GENRE, 12},
-	{G_TYPE_STRING, MAFW_METADATA_KEY_TRACK, MAFW_METADATA_KEY_TRACK, 17},
-	{G_TYPE_INT, MAFW_METADATA_KEY_YEAR, MAFW_METADATA_KEY_YEAR, 18},
-	{G_TYPE_INT, MAFW_METADATA_KEY_COUNT, MAFW_METADATA_KEY_COUNT, 19},
-	{G_TYPE_INT, MAFW_METADATA_KEY_PLAY_COUNT, MAFW_METADATA_KEY_PLAY_COUNT, 20},
-	{G_TYPE_STRING, MAFW_METADATA_KEY_DESCRIPTION, MAFW_METADATA_KEY_DESCRIPTION, 21},
-	{G_TYPE_STRING, MAFW_METADATA_KEY_ENCODING, MAFW_METADATA_KEY_ENCODING, 22},
-	{G_TYPE_LONG, MAFW_METADATA_KEY_ADDED, MAFW_METADATA_KEY_ADDED, 23},
-	{G_TYPE_LONG, MAFW_METADATA_KEY_MODIFIED, MAFW_METADATA_KEY_MODIFIED, 24},
-	{G_TYPE_STRING, MAFW_METADATA_KEY_THUMBNAIL, MAFW_METADATA_KEY_THUMBNAIL, 25},
-	{G_TYPE_INT, MAFW_METADATA_KEY_RES_X, MAFW_METADATA_KEY_RES_X, 6},
-	{G_TYPE_INT, MAFW_METADATA_KEY_RES_Y, MAFW_METADATA_KEY_RES_Y, 6},
-	{G_TYPE_STRING, MAFW_METADATA_KEY_COMMENT, MAFW_METADATA_KEY_COMMENT, 26},
-	{G_TYPE_STRING, MAFW_METADATA_KEY_TAGS, MAFW_METADATA_KEY_TAGS, 27},
-	{G_TYPE_STRING, MAFW_METADATA_KEY_ALBUM_INFO_URI, MAFW_METADATA_KEY_ALBUM_INFO_URI, 28},
-	{G_TYPE_STRING, MAFW_METADATA_KEY_LYRICS, MAFW_METADATA_KEY_LYRICS, 29},
-	{G_TYPE_INT, MAFW_METADATA_KEY_RATING, MAFW_METADATA_KEY_RATING, 30},
-	{G_TYPE_STRING, MAFW_METADATA_KEY_COMPOSER, MAFW_METADATA_KEY_COMPOSER, 31},
-	{G_TYPE_STRING, MAFW_METADATA_KEY_FILENAME, MAFW_METADATA_KEY_FILENAME, 32},
-	{G_TYPE_STRING, MAFW_METADATA_KEY_COPYRIGHT, MAFW_METADATA_KEY_COPYRIGHT, 33},
-	{G_TYPE_STRING, MAFW_METADATA_KEY_AUDIO_CODEC, MAFW_METADATA_KEY_AUDIO_CODEC, 34},
-	{G_TYPE_STRING, MAFW_METADATA_KEY_ALBUM_ART_URI, MAFW_METADATA_KEY_ALBUM_ART_URI, 35},
-	{G_TYPE_STRING, MAFW_METADATA_KEY_ALBUM_ART, MAFW_METADATA_KEY_ALBUM_ART, 36},
-	{G_TYPE_STRING, MAFW_METADATA_KEY_VIDEO_CODEC, MAFW_METADATA_KEY_VIDEO_CODEC, 37},
-	{G_TYPE_FLOAT, MAFW_METADATA_KEY_VIDEO_FRAMERATE, MAFW_METADATA_KEY_VIDEO_FRAMERATE, 38},
-	{G_TYPE_STRING, MAFW_METADATA_KEY_EXIF_XML, MAFW_METADATA_KEY_EXIF_XML, 39},
-	{G_TYPE_STRING, MAFW_METADATA_KEY_ICON_URI, MAFW_METADATA_KEY_ICON_URI, 40},
-	{G_TYPE_STRING, MAFW_METADATA_KEY_ICON, MAFW_METADATA_KEY_ICON, 41}
-};
+/* upnp_filters[], upnp_filter_fragments[], upnp_all_keys_filter,
+ * upnpmaps[] and upnp_key_hash_table[] are generated from
+ * mafw-upnp-source-keys.list. */
+#include "mafw-upnp-source-keytab.h"
 
 /**
  * util_get_upnp_filter_by_id:
@@ -214,8 +128,6 @@ const gchar *util_get_upnp_filter_by_id(gint id)
 	return upnp_filters[upnpmaps[id].upnp_filterid];
 }
 
-static GHashTable *_mafw_to_upnphash;
-
 /*----------------------------------------------------------------------------
   Browse filter
   ----------------------------------------------------------------------------*/
@@ -234,37 +146,37 @@ static GHashTable *_mafw_to_upnphash;
 gchar* util_mafwkey_array_to_upnp_filter(guint64 keys)
 {
 	GString* filter;
-	gint i;
-	gint id = 0;
-	gboolean asked_filters[G_N_ELEMENTS(upnp_filters)];
+	guint64 filters = 0;
+	gint id;
 
-	memset(&asked_filters, 0, sizeof(asked_filters));
+	if (keys == G_MAXUINT64)
+		return g_strdup(upnp_all_keys_filter);
 
-	filter = g_string_new("");
-	
-	while (keys)
+	for (id = 0; keys && id < G_N_ELEMENTS(upnpmaps); id++, keys >>= 1)
 	{
 		if ((keys & 1) == 1)
-		{
-			gint filter_id = util_get_upnp_filterid_from_id(id);
-			if (filter_id >= 0)			
-				asked_filters[filter_id] = TRUE;
-		}
-		keys >>= 1;
-		id++;
+			filters |= G_GUINT64_CONSTANT(1) <<
+				upnpmaps[id].upnp_filterid;
 	}
-	
-	for (i = 0; i < G_N_ELEMENTS(upnp_filters); i++)
+
+	filter = g_string_sized_new(sizeof(upnp_all_keys_filter));
+	for (id = 0; filters; id++, filters >>= 1)
 	{
-		if (asked_filters[i])
-		{
-			const gchar* mapping = util_get_upnp_filter_by_id(i);
-			if (filter->len > 0)
-				g_string_append(filter, ",");
-			g_string_append(filter, mapping);
-		}
+		const struct _upnp_filter_fragment *frag;
+
+		if ((filters & 1) == 0)
+			continue;
+
+		/* Every fragment starts with its separator, drop the first
+		 * one. */
+		frag = &upnp_filter_fragments[id];
+		if (filter->len == 0)
+			g_string_append_len(filter, frag->str + 1,
+					    frag->len - 1);
+		else
+			g_string_append_len(filter, frag->str, frag->len);
 	}
-	
+
 	/* Don't free the buffer -> FALSE */
 	return g_string_free(filter, FALSE);
 }
@@ -294,26 +206,55 @@ const gchar* util_mafwkey_to_upnp_filter(const gchar* mafwkey)
 }
 
 
+/**
+ * util_key_hash:
+ * @key: MAFW metadata key
+ *
+ * The perfect hash of mafw-upnp-source-keys.awk: every supported key lands
+ * in its own slot of upnp_key_hash_table[].
+ *
+ * Returns: The slot of @key.
+ */
+static guint util_key_hash(const gchar *key)
+{
+	guint32 a = 5381, b = 0;
+
+	for (; *key; key++)
+	{
+		a = (a * 33 + (guchar)*key) & 0xFFFFF;
+		b = (b * 31 + (guchar)*key) & 0xFFFFF;
+	}
+
+	return ((a + UPNP_KEY_HASH_SEED * b) & 0xFFFFF) >> 12;
+}
+
 /**
  * util_init:
  *
- * Initializes the needed hash-table, to speed up the mafw-key->flags mapping
+ * Checks that the generated key tables agree with the MAFW headers we are
+ * compiled against.  A key whose literal in mafw-upnp-source-keys.list
+ * differs from its libmafw macro would silently become unsupported.
  */
 void util_init(void)
 {
-	gint i = 0, keynum = G_N_ELEMENTS(upnpmaps);
+	static gboolean checked;
+	gint i;
+
+	G_STATIC_ASSERT(UPNP_KEY_HASH_SIZE == 1 << 8);
+	G_STATIC_ASSERT(G_N_ELEMENTS(upnpmaps) == MUPnPSrc_MKey_COUNT);
+	G_STATIC_ASSERT(G_N_ELEMENTS(upnp_filters) == UPNP_FILTER_COUNT);
 
-	if (_mafw_to_upnphash)
+	if (checked)
 		return;
+	checked = TRUE;
 
-	_mafw_to_upnphash = g_hash_table_new(g_str_hash, g_str_equal);
-	g_assert(_mafw_to_upnphash);
-	
-	for(i=0; i < keynum; i++)
+	for (i = 0; i < G_N_ELEMENTS(upnpmaps); i++)
 	{
-		g_hash_table_insert(_mafw_to_upnphash,
-					(gpointer)upnpmaps[i].mafw_key,
-					GINT_TO_POINTER(i+1));
+		if (util_get_id_from_mafwkey(upnpmaps[i].mafw_key) != i)
+			g_critical("Metadata key '%s' is missing from the "
+				   "generated key hash, regenerate it from "
+				   "mafw-upnp-source-keys.list",
+				   upnpmaps[i].mafw_key);
 	}
 }
 
@@ -324,8 +265,13 @@ void util_init(void)
  */
 static gint util_get_id_from_mafwkey(const gchar *mafwkey)
 {
-	return GPOINTER_TO_INT(g_hash_table_lookup(_mafw_to_upnphash,
-					mafwkey)) - 1;
+	gint id;
+
+	id = upnp_key_hash_table[util_key_hash(mafwkey)] - 1;
+	if (id < 0 || strcmp(upnpmaps[id].mafw_key, mafwkey) != 0)
+		return -1;
+
+	return id;
 }
 
 /**
@@ -334,7 +280,7 @@ static gint util_get_id_from_mafwkey(const gchar *mafwkey)
  *
  * Returns the flag of the asked metadata-key, or 0, if not supported
  */
-static guint64 util_get_upnpflag_from_mafwkey(const gchar *mafwkey)
+guint64 util_get_upnpflag_from_mafwkey(const gchar *mafwkey)
 {
 	guint64 flagn = 1;
 	gint id = util_get_id_from_mafwkey(mafwkey);
@@ -393,7 +339,22 @@ const gchar *util_get_metadatakey_from_id(gint id)
 }
 
 /**
- * util_get_metadatakey_from_id:
+ * util_get_decoder_from_id:
+ * @id:	ID of the metadata
+ *
+ * Returns the decoder that converts the DIDL-Lite text of the metadata @id
+ * into a value of the right type, or %NULL.
+ */
+DidlValueDecoder util_get_decoder_from_id(gint id)
+{
+	if (id > G_N_ELEMENTS(upnpmaps)-1)
+		return NULL;
+
+	return upnpmaps[id].decode;
+}
+
+/**
+ * util_get_upnp_filterid_from_id:
  * @id:	ID of the metadata
  *
  * Returns the upnp-filterid defined by the ID.
@@ -452,6 +413,33 @@ gint util_compare_uint(guint a, guint b)
 		return  0;
 }
 
+/**
+ * util_parse_update_id:
+ * @text:      A SystemUpdateID or containerUpdateID, a ui4 in decimal
+ * @update_id: Set to the parsed value
+ *
+ * Returns: %TRUE if @text was a valid update ID.
+ */
+gboolean util_parse_update_id(const gchar *text, guint32 *update_id)
+{
+	guint64 value;
+	gchar *end;
+
+	while (g_ascii_isspace(*text))
+		text++;
+	if (!g_ascii_isdigit(*text))
+		return FALSE;
+
+	value = g_ascii_strtoull(text, &end, 10);
+	while (g_ascii_isspace(*end))
+		end++;
+	if (*end != '\0' || value > G_MAXUINT32)
+		return FALSE;
+
+	*update_id = (guint32)value;
+	return TRUE;
+}
+
 /**
  * util_create_objectid:
  * @source: A #MafwUPnPSource that provided the @didl_node
@@ -26,18 +26,22 @@
 #define MAFW_UPNP_RENDERER_UTIL_H
 
 #include "mafw-upnp-source.h"
+#include "mafw-upnp-source-didl.h"
 
 gchar* util_udn_to_uuid(const gchar* uuid);
 gchar* util_uuid_to_udn(const gchar* uuid);
 
 guint64 util_compile_mdata_keys(const gchar* const* original);
+guint64 util_get_upnpflag_from_mafwkey(const gchar *mafwkey);
 
 gint util_compare_uint(guint a, guint b);
+gboolean util_parse_update_id(const gchar *text, guint32 *update_id);
 gchar* util_create_objectid(MafwUPnPSource* source, GUPnPDIDLLiteObject* didlobject);
 
 const gchar* util_mafwkey_to_upnp_result(gint id, gint* type);
 const gchar *util_get_metadatakey_from_id(gint id);
 gint util_get_upnp_filterid_from_id(gint id);
+DidlValueDecoder util_get_decoder_from_id(gint id);
 const gchar *util_get_upnp_filter_by_id(gint id);
 void util_init(void);
 /*----------------------------------------------------------------------------
@@ -37,11 +37,25 @@
 #include "mafw-upnp-source.h"
 #include "mafw-upnp-source-didl.h"
 #include "mafw-upnp-source-util.h"
+#include "mafw-upnp-source-scratch.h"
+#include "mafw-upnp-source-catalog.h"
+#include "mafw-upnp-source-crawler.h"
+#include "mafw-upnp-source-diff.h"
+#include "mafw-upnp-source-negcache.h"
+#include "mafw-upnp-source-ancestry.h"
+#include "mafw-upnp-source-profile.h"
+#include "mafw-upnp-source-predicate.h"
+#include "mafw-upnp-source-sorter.h"
+#include "mafw-upnp-source-criteria.h"
+#include "mafw-upnp-source-federated.h"
+#include "mafw-upnp-source-textindex.h"
+#include "mafw-upnp-source-jump.h"
 
 #define MAFW_UPNP_SOURCE_PLUGIN_NAME "MAFW-UPnP-Source"
 
 static void mafw_upnp_source_plugin_gupnp_down(void);
 static void mafw_upnp_source_plugin_gupnp_up(void);
+static GList *mafw_upnp_source_plugin_get_servers(void);
 
 G_DEFINE_TYPE(MafwUpnpControlSource, mafw_upnp_control_source, MAFW_TYPE_SOURCE);
 
@@ -60,6 +74,8 @@ static gboolean _shutdown_gssdp(MafwUpnpControlSource *controlsrc)
 			"the network monitoring. You can do this through the " \
 			"\"activate\" boolean variable"
 
+/* Browsing the control source with a filter searches every server found
+   on the network at once, see federated_search_start(). */
 static guint mafw_upnp_control_source_browse(MafwSource *self,
 				const gchar *object_id, gboolean recursive,
 				const MafwFilter *filter,
@@ -68,6 +84,20 @@ static guint mafw_upnp_control_source_browse(MafwSource *self,
 				guint skip_count, guint item_count,
 				MafwSourceBrowseResultCb cb, gpointer user_data)
 {
+	if (cb != NULL && filter != NULL)
+	{
+		GList *servers;
+		guint browse_id;
+
+		servers = mafw_upnp_source_plugin_get_servers();
+		browse_id = federated_search_start(self, servers, filter,
+						   sort_criteria, mdkeys,
+						   skip_count, item_count,
+						   cb, user_data);
+		g_list_free(servers);
+		return browse_id;
+	}
+
 	if (cb != NULL)
 	{
 		GError *error = NULL;
@@ -85,6 +115,9 @@ static guint mafw_upnp_control_source_browse(MafwSource *self,
 static gboolean mafw_upnp_control_source_cancel_browse(MafwSource *self, guint browse_id,
 				  GError **error)
 {
+	if (federated_search_cancel(self, browse_id))
+		return TRUE;
+
 	if (error)
 	{
 		g_set_error(error,
@@ -187,6 +220,24 @@ GObject* mafw_upnp_control_source_new(void)
 #define SYSTEM_UPDATE_ID     "SystemUpdateID"
 #define CONTAINER_UPDATE_IDS "ContainerUpdateIDs"
 
+/** Window in which ContainerUpdateIDs events are merged, in milliseconds */
+#define CONTAINER_CHANGED_DELAY 250
+
+/** DIDL-Lite property carrying the version of a container */
+#define CONTAINER_UPDATE_ID_FILTER "upnp:containerUpdateID"
+#define CONTAINER_UPDATE_ID_NODE   "containerUpdateID"
+
+/** ContentDirectory error codes of objects that do not exist */
+#define CDS_ERROR_NO_SUCH_OBJECT    701
+#define CDS_ERROR_NO_SUCH_CONTAINER 710
+#define CDS_ERROR_UNSUPPORTED_SORT  709
+
+/** Metadata kept of each item in the catalog cache: what lists of items
+    usually show */
+#define CATALOG_KEYS (MUPnPSrc_MKey_URI | MUPnPSrc_MKey_Title | \
+		      MUPnPSrc_MKey_Artist | MUPnPSrc_MKey_Album | \
+		      MUPnPSrc_MKey_MimeType | MUPnPSrc_MKey_Duration)
+
 #define KNOWN_METADATA_KEYS "uri", "mime-type", "title", "duration", \
 	"artist", "album", "genre", "track", "year", "bitrate", "count", \
 	"play-count", "description", "encoding", "added", "thumbnail-uri", \
@@ -215,8 +266,17 @@ static void mafw_upnp_source_deinitialize(GError** error);
 static void mafw_upnp_source_init(MafwUPnPSource* self);
 static void mafw_upnp_source_class_init(MafwUPnPSourceClass* klass);
 static void mafw_upnp_source_dispose(GObject* object);
+static void mafw_upnp_source_open_catalog(MafwUPnPSource *self);
+static void mafw_upnp_source_open_profile(MafwUPnPSource *self);
+static void mafw_upnp_source_crawl(MafwUPnPSource *self,
+				   const gchar *itemid, gboolean refresh);
+typedef struct _ContainerWatch ContainerWatch;
+static void mafw_upnp_source_watch_release(ContainerWatch *watch);
+static void mafw_upnp_source_watch_fetch(ContainerWatch *watch);
 
 /* UPnP service callbacks */
+static void mafw_upnp_source_container_changed(MafwUPnPSource *self,
+					       const gchar *itemid);
 void mafw_upnp_source_notify_callback(GUPnPServiceProxy* service,
 				       const gchar* variable,
 				       GValue* value,
@@ -232,6 +292,38 @@ static void mafw_upnp_source_device_proxy_unavailable(GUPnPControlPoint* cp,
 /* Browse */
 static GUPnPServiceProxyAction* mafw_upnp_source_browse_internal(BrowseArgs*
 								  args);
+static gchar *mafw_upnp_source_browse_filter(guint64 mdata_keys);
+static gboolean mafw_upnp_source_error_is_permanent(const GError *error);
+static guint mafw_upnp_source_browse_start(MafwUPnPSource *self,
+					   const gchar *object_id,
+					   gboolean recursive,
+					   const MafwFilter *filter,
+					   const gchar *sort_criteria,
+					   guint64 mdata_keys,
+					   guint skip_count,
+					   guint item_count,
+					   MafwSourceBrowseResultCb browse_cb,
+					   MafwUPnPSourcePageCb page_cb,
+					   gpointer user_data,
+					   gboolean use_catalog);
+static void mafw_upnp_source_catalog_store(BrowseArgs *args);
+static void mafw_upnp_source_index_item(MafwUPnPSource *self,
+					GUPnPDIDLLiteObject *didlobject,
+					const gchar *objectid);
+static guint mafw_upnp_source_index_browse(MafwUPnPSource *self,
+					   const MafwFilter *filter,
+					   guint64 mdata_keys,
+					   guint skip_count,
+					   guint item_count,
+					   MafwSourceBrowseResultCb browse_cb,
+					   MafwUPnPSourcePageCb page_cb,
+					   gpointer user_data);
+static void mafw_upnp_source_watch_page_cb(MafwUPnPSource *source,
+					   guint browse_id,
+					   ColumnPage *page,
+					   guint remaining_count,
+					   gpointer user_data,
+					   const GError *error);
 static guint mafw_upnp_source_browse(MafwSource *source,
 				     const gchar *object_id,
 				     gboolean recursive,
@@ -256,21 +348,18 @@ static void mafw_upnp_source_get_metadata(MafwSource *source,
 /* Common utilities */
 static GHashTable *mafw_upnp_source_compile_metadata(guint64 keys,
 						     GUPnPDIDLLiteObject* didlobject,
-						     const gchar* didl);
-
-/* Search criteria parsing */
-static gboolean internal_filter_to_search_criteria(GString *upsc,
-						   MafwFilter *maffin,
-						   gboolean negate,
-						   GError **error);
-static gboolean internal_filter_to_search_criteria_complex(
-	GString *upsc, MafwFilter *maffin, gboolean negate,
-	GError **error);
-static gboolean internal_filter_to_search_criteria_simple(
-	GString *upsc, MafwFilter *maffin, gboolean negate,
-	GError **error);
+						     const gchar* didl,
+						     InternPool *pool,
+						     GHashTable *metadata);
+
 static gboolean _cancel_all_browse(gpointer key, BrowseArgs *args,
 					GError *cancel_err);
+static void _cancel_request(MafwUPnPSourcePrivate *priv, BrowseArgs *args,
+			    GError *err);
+static gboolean _cancel_jump_id(MafwUPnPSourcePrivate *priv, guint jump_id,
+				const GError *err);
+static void _cancel_all_jumps(MafwUPnPSourcePrivate *priv,
+			      const GError *err);
 
 /*----------------------------------------------------------------------------
   MAFW Plugin construction
@@ -308,6 +397,7 @@ typedef struct _MafwUPnPSourcePlugin {
 /** THE mafw plugin */
 static MafwUPnPSourcePlugin* _plugin = NULL;
 static MafwSource *control_src;
+static MafwSource *aggregate_src;
 
 static void
 _on_context_available (GUPnPContextManager *context_manager,
@@ -382,6 +472,8 @@ void mafw_upnp_source_plugin_initialize(MafwRegistry* registry)
 	/* Creating the control source */
 	control_src = MAFW_SOURCE(mafw_upnp_control_source_new());
 	mafw_registry_add_extension(registry, MAFW_EXTENSION(control_src));
+	aggregate_src = MAFW_SOURCE(mafw_upnp_aggregate_source_new());
+	mafw_registry_add_extension(registry, MAFW_EXTENSION(aggregate_src));
 	/* Reset next browse id */
 	_plugin->next_browse_id = 0;
 }
@@ -394,6 +486,8 @@ void mafw_upnp_source_plugin_deinitialize(void)
 
 	mafw_registry_remove_extension(_plugin->registry,
 					   MAFW_EXTENSION(control_src));
+	mafw_registry_remove_extension(_plugin->registry,
+				       MAFW_EXTENSION(aggregate_src));
 	g_object_unref(_plugin->registry);
 	_plugin->registry = NULL;
 
@@ -422,6 +516,55 @@ struct _MafwUPnPSourcePrivate {
 
 	/* browse_id => GUPnPServiceProxyAction associations for ->cancel(). */
 	GTree *browses;
+
+	/* Shares repeated metadata strings between the emitted items */
+	InternPool *pool;
+
+	/* Containers browsed earlier, NULL if not bound to a server */
+	Catalog *catalog;
+
+	/* Serve browses from the catalog only */
+	gboolean offline;
+
+	/* SystemUpdateID and containerUpdateIDs seen from the server */
+	UpdateTracker *updates;
+
+	/* Changed containers waiting for ::container-changed: a set of the
+	   UPnP IDs and the same in arrival order */
+	GHashTable *changed_set;
+	GPtrArray *changed;
+	guint changed_id;
+
+	/* Background mirroring of the server into the catalog, NULL when
+	   not enabled */
+	Crawler *crawler;
+	guint crawl_id;
+	gboolean crawl_busy;
+
+	/* Tokens of the items seen, for substring searches, NULL when not
+	   crawling */
+	TextIndex *text_index;
+
+	/* Change feed: UPnP container ID => ContainerWatch */
+	GHashTable *watches;
+	guint next_watch_id;
+
+	/* Actions that recently failed on dead objects */
+	NegCache *negative;
+
+	/* Parents and titles of the containers seen */
+	Ancestry *ancestry;
+
+	/* Offsets of letters in containers sorted by title, and the jumps
+	   going on: ID => JumpArgs */
+	JumpCache *jumps;
+	GHashTable *jump_requests;
+
+	/* Search criteria of the filters used lately */
+	CriteriaCache *criteria;
+
+	/* Capabilities and quirks learned of the server */
+	ServerProfile *profile;
 };
 
 static void mafw_upnp_source_init(MafwUPnPSource *self)
@@ -433,6 +576,21 @@ static void mafw_upnp_source_init(MafwUPnPSource *self)
 	priv->browses = g_tree_new_full(
 		(GCompareDataFunc) util_compare_uint,
 		NULL, NULL, NULL);
+	priv->pool = intern_pool_new(INTERN_POOL_MAX_BYTES);
+	priv->updates = update_tracker_new();
+	priv->changed_set = g_hash_table_new_full(g_str_hash, g_str_equal,
+						  g_free, NULL);
+	priv->changed = g_ptr_array_new();
+	priv->watches = g_hash_table_new_full(
+		g_str_hash, g_str_equal, NULL,
+		(GDestroyNotify)mafw_upnp_source_watch_release);
+	priv->next_watch_id = 1;
+	priv->negative = neg_cache_new(NEG_CACHE_TTL);
+	priv->ancestry = ancestry_new();
+	priv->jumps = jump_cache_new();
+	priv->jump_requests = g_hash_table_new(NULL, NULL);
+	priv->criteria = criteria_cache_new();
+	priv->profile = server_profile_load(NULL);
 }
 
 static void mafw_upnp_source_class_init(MafwUPnPSourceClass *klass)
@@ -479,6 +637,64 @@ static void mafw_upnp_source_dispose(GObject *object)
 	   GUPnP does it for us. */
 	g_tree_destroy(priv->browses);
 
+	catalog_free(priv->catalog);
+	priv->catalog = NULL;
+
+	update_tracker_free(priv->updates);
+	priv->updates = NULL;
+
+	if (priv->crawl_id != 0)
+	{
+		g_source_remove(priv->crawl_id);
+		priv->crawl_id = 0;
+	}
+	crawler_free(priv->crawler);
+	priv->crawler = NULL;
+	text_index_free(priv->text_index);
+	priv->text_index = NULL;
+
+	if (priv->watches != NULL)
+	{
+		g_hash_table_destroy(priv->watches);
+		priv->watches = NULL;
+	}
+
+	neg_cache_free(priv->negative);
+	priv->negative = NULL;
+
+	ancestry_free(priv->ancestry);
+	priv->ancestry = NULL;
+
+	jump_cache_free(priv->jumps);
+	priv->jumps = NULL;
+
+	/* Jumps hold the source, none can be going on */
+	if (priv->jump_requests != NULL)
+	{
+		g_hash_table_destroy(priv->jump_requests);
+		priv->jump_requests = NULL;
+	}
+
+	criteria_cache_free(priv->criteria);
+	priv->criteria = NULL;
+
+	server_profile_free(priv->profile);
+	priv->profile = NULL;
+
+	/* Nobody is interested in the changes anymore */
+	if (priv->changed_id != 0)
+	{
+		g_source_remove(priv->changed_id);
+		priv->changed_id = 0;
+	}
+	if (priv->changed != NULL)
+	{
+		g_ptr_array_free(priv->changed, TRUE);
+		priv->changed = NULL;
+		g_hash_table_destroy(priv->changed_set);
+		priv->changed_set = NULL;
+	}
+
 	if (priv->device != NULL) {
 		g_object_unref(priv->device);
 		priv->device = NULL;
@@ -489,9 +705,48 @@ static void mafw_upnp_source_dispose(GObject *object)
 		priv->service = NULL;
 	}
 
+	intern_pool_free(priv->pool);
+	priv->pool = NULL;
+
 	G_OBJECT_CLASS(parent_class)->dispose(object);
 }
 
+/**
+ * mafw_upnp_source_open_catalog:
+ *
+ * Opens the catalog cache of the server behind @self.
+ */
+static void mafw_upnp_source_open_catalog(MafwUPnPSource *self)
+{
+	gchar *path;
+
+	if (self->priv->catalog != NULL)
+		return;
+
+	path = catalog_get_path(mafw_extension_get_uuid(MAFW_EXTENSION(self)));
+	self->priv->catalog = catalog_open(path);
+	g_free(path);
+}
+
+/**
+ * mafw_upnp_source_open_profile:
+ *
+ * Takes into use what was learned of the server in earlier sessions.
+ */
+static void mafw_upnp_source_open_profile(MafwUPnPSource *self)
+{
+	gchar *path;
+
+	path = server_profile_get_path(
+		mafw_extension_get_uuid(MAFW_EXTENSION(self)));
+	server_profile_free(self->priv->profile);
+	self->priv->profile = server_profile_load(path);
+	g_free(path);
+
+	/* Criteria were ordered for what the server sorted by */
+	criteria_cache_clear(self->priv->criteria);
+}
+
 /*----------------------------------------------------------------------------
   Public API
   ----------------------------------------------------------------------------*/
@@ -505,10 +760,414 @@ GObject *mafw_upnp_source_new(const gchar *name, const gchar *uuid)
 			    NULL);
 }
 
+/**
+ * mafw_upnp_source_new_offline:
+ * @name: Name of the server
+ * @uuid: UUID of the server, as returned by util_udn_to_uuid()
+ *
+ * Creates a source for a server that is not on the network.  It browses
+ * the containers cached from earlier sessions and fails everything else
+ * with %MAFW_SOURCE_ERROR_PEER.
+ *
+ * Returns: A new #MafwUPnPSource.
+ */
+GObject *mafw_upnp_source_new_offline(const gchar *name, const gchar *uuid)
+{
+	GObject *source;
+
+	source = mafw_upnp_source_new(name, uuid);
+	MAFW_UPNP_SOURCE(source)->priv->offline = TRUE;
+	mafw_upnp_source_open_catalog(MAFW_UPNP_SOURCE(source));
+
+	return source;
+}
+
+/**
+ * mafw_upnp_source_set_crawling:
+ * @self:  A #MafwUPnPSource attached to a server
+ * @crawl: Whether to mirror the server in the background
+ *
+ * Enables or disables the background crawler.  It walks every container
+ * of the server into the catalog cache, and afterwards browses again the
+ * containers that the server reports changed.  It runs at low priority,
+ * browses one container per %CRAWLER_INTERVAL and waits while other
+ * browses are active.  The items seen meanwhile are indexed for substring
+ * searches, which are answered locally once the crawl has caught up.
+ */
+void mafw_upnp_source_set_crawling(MafwUPnPSource *self, gboolean crawl)
+{
+	MafwUPnPSourcePrivate *priv;
+
+	g_return_if_fail(MAFW_IS_UPNP_SOURCE(self));
+	priv = self->priv;
+
+	if (!crawl)
+	{
+		if (priv->crawl_id != 0)
+		{
+			g_source_remove(priv->crawl_id);
+			priv->crawl_id = 0;
+		}
+		crawler_free(priv->crawler);
+		priv->crawler = NULL;
+		text_index_free(priv->text_index);
+		priv->text_index = NULL;
+		return;
+	}
+
+	if (priv->crawler != NULL)
+		return;
+	if (priv->catalog == NULL || priv->offline)
+	{
+		g_warning("Crawling [%s] needs a server and a catalog",
+			  mafw_extension_get_name(MAFW_EXTENSION(self)));
+		return;
+	}
+
+	priv->crawler = crawler_new();
+	priv->text_index = text_index_new();
+	mafw_upnp_source_crawl(self, "0", FALSE);
+}
+
+/**
+ * mafw_upnp_source_get_update_stamp:
+ * @self:      A #MafwUPnPSource
+ * @object_id: A container, or %NULL for the server as a whole
+ * @stamp:     Filled with the current version of @object_id
+ *
+ * Records the version of a container as far as the server has told, by
+ * its SystemUpdateID and the upnp:containerUpdateID of the container.
+ * Keep it with data fetched from the container and ask
+ * mafw_upnp_source_changed_since() later whether that is still current.
+ */
+void mafw_upnp_source_get_update_stamp(MafwUPnPSource *self,
+				       const gchar *object_id,
+				       UpdateStamp *stamp)
+{
+	gchar *itemid = NULL;
+
+	g_return_if_fail(MAFW_IS_UPNP_SOURCE(self));
+	g_return_if_fail(stamp != NULL);
+
+	if (object_id != NULL)
+		mafw_source_split_objectid(object_id, NULL, &itemid);
+	update_tracker_get_stamp(self->priv->updates, itemid, stamp);
+	g_free(itemid);
+}
+
+/**
+ * mafw_upnp_source_changed_since:
+ * @self:      A #MafwUPnPSource
+ * @object_id: A container, or %NULL for the server as a whole
+ * @stamp:     An earlier result of mafw_upnp_source_get_update_stamp()
+ *
+ * Returns: %UPDATE_UNCHANGED if @object_id has certainly not changed since
+ * @stamp, %UPDATE_CHANGED if it has or may have, and %UPDATE_UNKNOWN if
+ * the server has not told its versions.
+ */
+UpdateChange mafw_upnp_source_changed_since(MafwUPnPSource *self,
+					    const gchar *object_id,
+					    const UpdateStamp *stamp)
+{
+	UpdateChange change;
+	gchar *itemid = NULL;
+
+	g_return_val_if_fail(MAFW_IS_UPNP_SOURCE(self), UPDATE_UNKNOWN);
+	g_return_val_if_fail(stamp != NULL, UPDATE_UNKNOWN);
+
+	if (object_id != NULL)
+		mafw_source_split_objectid(object_id, NULL, &itemid);
+	change = update_tracker_changed_since(self->priv->updates, itemid,
+					      stamp);
+	g_free(itemid);
+
+	return change;
+}
+
+/**
+ * mafw_upnp_source_get_intern_stats:
+ * @self:  A #MafwUPnPSource
+ * @stats: Filled with the counters of the string interning pool of @self
+ *
+ * Tells how much metadata string storage the source has shared so far.
+ */
+void mafw_upnp_source_get_intern_stats(MafwUPnPSource *self,
+				       InternPoolStats *stats)
+{
+	g_return_if_fail(MAFW_IS_UPNP_SOURCE(self));
+	g_return_if_fail(stats != NULL);
+
+	if (self->priv->pool != NULL)
+		intern_pool_get_stats(self->priv->pool, stats);
+	else
+		memset(stats, 0, sizeof(*stats));
+}
+
 /*----------------------------------------------------------------------------
   UPnP Proxy listeners
   ----------------------------------------------------------------------------*/
 
+/**
+ * mafw_upnp_source_emit_container_changed:
+ *
+ * Emits ::container-changed once for each container changed during the
+ * last %CONTAINER_CHANGED_DELAY milliseconds.
+ */
+static gboolean mafw_upnp_source_emit_container_changed(MafwUPnPSource *self)
+{
+	MafwUPnPSourcePrivate *priv = self->priv;
+	GHashTable *changed_set;
+	GPtrArray *changed;
+	const gchar *uuid;
+	gchar *oid;
+	guint i;
+
+	priv->changed_id = 0;
+
+	/* Handlers may cause new changes, start over with empty ones */
+	changed_set = priv->changed_set;
+	changed = priv->changed;
+	priv->changed_set = g_hash_table_new_full(g_str_hash, g_str_equal,
+						  g_free, NULL);
+	priv->changed = g_ptr_array_new();
+
+	g_object_ref(self);
+	uuid = mafw_extension_get_uuid(MAFW_EXTENSION(self));
+	for (i = 0; i < changed->len; i++)
+	{
+		ContainerWatch *watch;
+
+		oid = g_strdup_printf("%s::%s", uuid,
+				      (const gchar *)g_ptr_array_index(changed,
+								       i));
+		g_signal_emit_by_name(self, "container-changed", oid);
+		g_free(oid);
+
+		/* One refetch for all the watchers */
+		if (priv->watches != NULL)
+		{
+			watch = g_hash_table_lookup(priv->watches,
+				g_ptr_array_index(changed, i));
+			if (watch != NULL)
+				mafw_upnp_source_watch_fetch(watch);
+		}
+	}
+	g_object_unref(self);
+
+	g_ptr_array_free(changed, TRUE);
+	g_hash_table_destroy(changed_set);
+
+	return FALSE;
+}
+
+/**
+ * mafw_upnp_source_container_changed:
+ * @itemid: UPnP ID of the container
+ *
+ * Queues ::container-changed for a container.  Servers rescanning their
+ * library send the same containers over and over, so the changes are
+ * collected for a short while and each container is signalled only once.
+ */
+static void mafw_upnp_source_container_changed(MafwUPnPSource *self,
+					       const gchar *itemid)
+{
+	MafwUPnPSourcePrivate *priv = self->priv;
+	gchar *key;
+
+	/* The dead objects may have come back */
+	if (priv->negative != NULL)
+		neg_cache_clear(priv->negative);
+
+	if (priv->changed == NULL ||
+	    g_hash_table_lookup_extended(priv->changed_set, itemid,
+					 NULL, NULL))
+		return;
+
+	key = g_strdup(itemid);
+	g_hash_table_insert(priv->changed_set, key, NULL);
+	g_ptr_array_add(priv->changed, key);
+
+	if (priv->changed_id == 0)
+		priv->changed_id = g_timeout_add(
+			CONTAINER_CHANGED_DELAY,
+			(GSourceFunc)mafw_upnp_source_emit_container_changed,
+			self);
+}
+
+/**
+ * mafw_upnp_source_set_system_update_id:
+ *
+ * Takes a SystemUpdateID from the server into use.
+ */
+static void mafw_upnp_source_set_system_update_id(MafwUPnPSource *self,
+						  guint32 update_id)
+{
+	MafwUPnPSourcePrivate *priv = self->priv;
+
+	if (update_tracker_set_system(priv->updates, update_id))
+	{
+		g_debug("CDS [%s] SystemUpdateID: %u",
+			mafw_extension_get_name(MAFW_EXTENSION(self)),
+			update_id);
+		if (priv->negative != NULL)
+			neg_cache_clear(priv->negative);
+	}
+
+	/* Validates the catalog cache.  Once it is dropped, the crawler has
+	   to walk the whole server again to fill it back in. */
+	if (priv->catalog != NULL &&
+	    catalog_set_update_id(priv->catalog, update_id) &&
+	    priv->crawler != NULL)
+	{
+		crawler_restart(priv->crawler);
+		text_index_free(priv->text_index);
+		priv->text_index = text_index_new();
+		mafw_upnp_source_crawl(self, "0", FALSE);
+	}
+}
+
+static void mafw_upnp_source_system_update_id_cb(GUPnPServiceProxy* service,
+						 GUPnPServiceProxyAction* action,
+						 gpointer user_data)
+{
+	MafwUPnPSource *self = MAFW_UPNP_SOURCE(user_data);
+	GError *error = NULL;
+	guint update_id = 0;
+
+	if (gupnp_service_proxy_end_action(service, action, &error,
+					   "Id", G_TYPE_UINT, &update_id,
+					   NULL))
+	{
+		mafw_upnp_source_set_system_update_id(self, update_id);
+	}
+	else
+	{
+		g_debug("GetSystemUpdateID failed: %s",
+			error != NULL ? error->message : "no reason");
+		if (error != NULL)
+			g_error_free(error);
+	}
+
+	g_object_unref(self);
+}
+
+static void mafw_upnp_source_sort_caps_cb(GUPnPServiceProxy* service,
+					  GUPnPServiceProxyAction* action,
+					  gpointer user_data)
+{
+	MafwUPnPSource *self = MAFW_UPNP_SOURCE(user_data);
+	GError *error = NULL;
+	gchar *caps = NULL;
+
+	if (gupnp_service_proxy_end_action(service, action, &error,
+					   "SortCaps", G_TYPE_STRING, &caps,
+					   NULL))
+	{
+		g_debug("CDS [%s] SortCaps: %s",
+			mafw_extension_get_name(MAFW_EXTENSION(self)), caps);
+		if (self->priv->profile != NULL)
+		{
+			server_profile_set_sort_caps(self->priv->profile,
+						     caps != NULL ? caps : "");
+			criteria_cache_clear(self->priv->criteria);
+		}
+		g_free(caps);
+	}
+	else
+	{
+		g_debug("GetSortCapabilities failed: %s",
+			error != NULL ? error->message : "no reason");
+		if (error != NULL)
+			g_error_free(error);
+	}
+
+	g_object_unref(self);
+}
+
+static void mafw_upnp_source_search_caps_cb(GUPnPServiceProxy* service,
+					    GUPnPServiceProxyAction* action,
+					    gpointer user_data)
+{
+	MafwUPnPSource *self = MAFW_UPNP_SOURCE(user_data);
+	GError *error = NULL;
+	gchar *caps = NULL;
+
+	if (gupnp_service_proxy_end_action(service, action, &error,
+					   "SearchCaps", G_TYPE_STRING, &caps,
+					   NULL))
+	{
+		g_debug("CDS [%s] SearchCaps: %s",
+			mafw_extension_get_name(MAFW_EXTENSION(self)), caps);
+		if (self->priv->profile != NULL)
+			server_profile_set_search_caps(self->priv->profile,
+						       caps != NULL ? caps : "");
+		g_free(caps);
+	}
+	else
+	{
+		g_debug("GetSearchCapabilities failed: %s",
+			error != NULL ? error->message : "no reason");
+		if (error != NULL)
+			g_error_free(error);
+	}
+
+	g_object_unref(self);
+}
+
+/**
+ * mafw_upnp_source_track_container:
+ *
+ * Remembers the upnp:containerUpdateID of @didlobject if it is a container
+ * that has one, and where the container is.  A new version of a known
+ * container is signalled like one learned from an event.
+ */
+static void mafw_upnp_source_track_container(MafwUPnPSource *self,
+					     GUPnPDIDLLiteObject *didlobject)
+{
+	const gchar *id;
+	const gchar *value;
+	gchar *copy;
+	guint32 update_id;
+	gboolean known;
+	gboolean changed = FALSE;
+
+	if (!GUPNP_IS_DIDL_LITE_CONTAINER(didlobject))
+		return;
+
+	id = gupnp_didl_lite_object_get_id(didlobject);
+	if (id == NULL)
+		return;
+
+	if (self->priv->ancestry != NULL)
+		ancestry_add(self->priv->ancestry, id,
+			     gupnp_didl_lite_object_get_parent_id(didlobject),
+			     gupnp_didl_lite_object_get_title(didlobject));
+
+	value = didl_peek_value(didlobject, NULL, CONTAINER_UPDATE_ID_NODE,
+				&copy);
+	if (value != NULL && util_parse_update_id(value, &update_id))
+	{
+		/* A new version of a container we knew */
+		known = update_tracker_get_container(self->priv->updates, id,
+						     NULL);
+		changed = update_tracker_set_container(self->priv->updates,
+						       id, update_id) && known;
+	}
+	g_free(copy);
+
+	/* A listing may show the new version before the moderated event
+	   does, which is then suppressed as seen: tell the clients now */
+	if (changed)
+	{
+		mafw_upnp_source_container_changed(self, id);
+		if (self->priv->text_index != NULL)
+			text_index_invalidate(self->priv->text_index, id);
+	}
+
+	/* New containers extend the crawl, changed ones are refreshed */
+	mafw_upnp_source_crawl(self, id, changed);
+}
+
 void mafw_upnp_source_notify_callback(GUPnPServiceProxy* service,
 				       const gchar* variable,
 				       GValue* value,
@@ -527,22 +1186,57 @@ void mafw_upnp_source_notify_callback(GUPnPServiceProxy* service,
 
 	if (strcmp(variable, CONTAINER_UPDATE_IDS) == 0)
 	{
+		MafwUPnPSourcePrivate *priv;
 		gchar** ids;
-		gchar* oid;
+		guint32 update_id;
 		int i;
 
-		/* Send a signal for each changed container object ID */
+		/* The value is a list of "container ID,update ID" pairs.
+		   Signal each container whose version we have not seen yet.
+		   A missing or broken update ID just means "changed". */
+		priv = MAFW_UPNP_SOURCE(self)->priv;
 		ids = g_strsplit(g_value_get_string(value), ",", 0);
-		for (i = 0; i < g_strv_length(ids); i++)
+		for (i = 0; ids[i] != NULL; i += 2)
 		{
-			oid = g_strdup_printf("%s::%s",
-				mafw_extension_get_uuid(self), ids[i]);
-			g_signal_emit_by_name(self, "container-changed", oid);
-			g_free(oid);
+			g_strstrip(ids[i]);
+			if (*ids[i] == '\0')
+			{
+				if (ids[i + 1] == NULL)
+					break;
+				continue;
+			}
+
+			if (ids[i + 1] != NULL &&
+			    util_parse_update_id(ids[i + 1], &update_id) &&
+			    !update_tracker_set_container(priv->updates,
+							  ids[i], update_id))
+			{
+				g_debug("Container %s version %u already seen",
+					ids[i], update_id);
+			}
+			else
+			{
+				mafw_upnp_source_container_changed(
+					MAFW_UPNP_SOURCE(self), ids[i]);
+				if (priv->text_index != NULL)
+					text_index_invalidate(priv->text_index,
+							      ids[i]);
+				mafw_upnp_source_crawl(MAFW_UPNP_SOURCE(self),
+						       ids[i], TRUE);
+			}
+
+			if (ids[i + 1] == NULL)
+				break;
 		}
 
 		g_strfreev(ids);
 	}
+	else if (strcmp(variable, SYSTEM_UPDATE_ID) == 0)
+	{
+		/* Sent on subscription and on every change */
+		mafw_upnp_source_set_system_update_id(MAFW_UPNP_SOURCE(self),
+						      g_value_get_uint(value));
+	}
 }
 
 /**
@@ -581,6 +1275,39 @@ static void mafw_upnp_source_attach_proxy(MafwUPnPSource* self,
 			CONTAINER_UPDATE_IDS,
 			mafw_extension_get_name(MAFW_EXTENSION(self)));
 	}
+
+	mafw_upnp_source_open_catalog(self);
+	if (gupnp_service_proxy_add_notify(service,
+					   SYSTEM_UPDATE_ID,
+					   G_TYPE_UINT,
+					   mafw_upnp_source_notify_callback,
+					   self) == FALSE)
+	{
+		g_warning("Subscription of %s for CDS [%s] failed",
+			SYSTEM_UPDATE_ID,
+			mafw_extension_get_name(MAFW_EXTENSION(self)));
+	}
+
+	/* Events come with a delay or not at all, ask right away */
+	if (gupnp_service_proxy_begin_action(
+		    service, "GetSystemUpdateID",
+		    mafw_upnp_source_system_update_id_cb,
+		    g_object_ref(self), NULL) == NULL)
+		g_object_unref(self);
+
+	/* The capabilities known from earlier sessions are used until the
+	   server answers */
+	mafw_upnp_source_open_profile(self);
+	if (gupnp_service_proxy_begin_action(
+		    service, "GetSortCapabilities",
+		    mafw_upnp_source_sort_caps_cb,
+		    g_object_ref(self), NULL) == NULL)
+		g_object_unref(self);
+	if (gupnp_service_proxy_begin_action(
+		    service, "GetSearchCapabilities",
+		    mafw_upnp_source_search_caps_cb,
+		    g_object_ref(self), NULL) == NULL)
+		g_object_unref(self);
 }
 
 static void mafw_upnp_source_device_proxy_available(GUPnPControlPoint* cp,
@@ -678,6 +1405,7 @@ static void mafw_upnp_source_device_proxy_unavailable(
 			 mafw_extension_get_uuid(MAFW_EXTENSION(source)));
 		g_tree_foreach(priv->browses, 
 				(GTraverseFunc)_cancel_all_browse, cancel_err);
+		_cancel_all_jumps(priv, cancel_err);
 		g_error_free(cancel_err);
 		mafw_registry_remove_extension(_plugin->registry,
 					   MAFW_EXTENSION(source));
@@ -686,41 +1414,505 @@ static void mafw_upnp_source_device_proxy_unavailable(
 	g_free(uuid);
 }
 
-/*----------------------------------------------------------------------------
-  Common utilities
-  ----------------------------------------------------------------------------*/
-static void _call_unref(GObject *obj, gpointer udat)
-{
-	g_object_unref(obj);
-}
-
 /**
- * mafw_upnp_source_compile_metadata:
- * @keys:      A list of requested metadata keys (originating from a UI or renderer)
- * @didl_node: Parsed xmlNode structure from a successful browse action,
- *             containing a number of DIDL-Lite item/container nodes.
- * @didl:      Non-parsed raw string-form DIDL-Lite XML document
+ * mafw_upnp_source_plugin_get_servers:
  *
- * Compiles requested metadata keys and their values into a #GHashTable that
- * can be sent back to the requesting UI/Renderer.
- *
- * Returns: A #GHashTable containing key-value pairs. Must be freed after use.
+ * Returns: The sources of the servers on the network, not of those only
+ * remembered from earlier.  Free the list with g_list_free().
  */
-static GHashTable *mafw_upnp_source_compile_metadata(guint64 keys,
-						     GUPnPDIDLLiteObject* didlobject,
-						     const gchar* didl)
+static GList *mafw_upnp_source_plugin_get_servers(void)
 {
-	GHashTable* metadata;
-	const gchar* constval;
-	gchar* value;
+	GList *sources, *servers;
+
+	servers = NULL;
+	for (sources = mafw_registry_get_sources(_plugin->registry);
+	     sources != NULL; sources = sources->next)
+	{
+		if (MAFW_IS_UPNP_SOURCE(sources->data) &&
+		    !MAFW_UPNP_SOURCE(sources->data)->priv->offline)
+			servers = g_list_prepend(servers, sources->data);
+	}
+
+	return g_list_reverse(servers);
+}
+
+/*----------------------------------------------------------------------------
+  Aggregate source
+  ----------------------------------------------------------------------------*/
+
+G_DEFINE_TYPE(MafwUpnpAggregateSource, mafw_upnp_aggregate_source,
+	      MAFW_TYPE_SOURCE);
+
+/* What the aggregate source lists without a filter: the playable items */
+#define AGGREGATE_ITEMS_FILTER "(" MAFW_METADATA_KEY_URI "?)"
+
+typedef struct {
+	MafwSource *aggregate;
+
+	/* Fingerprints of the items given out */
+	GHashTable *seen;
+
+	/* Keys asked of the servers for the fingerprints only, to be left
+	   out of the results, %NULL if none */
+	gchar **strip;
+
+	MafwSourceBrowseResultCb callback;
+	gpointer user_data;
+} AggregateBrowse;
+
+typedef struct {
+	MafwSource *aggregate;
+
+	/* The object ID asked of the aggregate source */
+	gchar *objectid;
+
+	MafwSourceMetadataResultCb callback;
+	gpointer user_data;
+} AggregateMetadata;
+
+/* Servers not measured yet come after every measured one. */
+static guint mafw_upnp_aggregate_source_latency(MafwUPnPSource *server)
+{
+	guint latency;
+
+	latency = server_profile_get_latency(server->priv->profile);
+	return latency > 0 ? latency : G_MAXUINT;
+}
+
+static gint mafw_upnp_aggregate_source_compare(gconstpointer a,
+					       gconstpointer b)
+{
+	guint la, lb;
+
+	la = mafw_upnp_aggregate_source_latency((MafwUPnPSource *)a);
+	lb = mafw_upnp_aggregate_source_latency((MafwUPnPSource *)b);
+	return la < lb ? -1 : la > lb;
+}
+
+static void mafw_upnp_aggregate_browse_free(AggregateBrowse *browse)
+{
+	g_object_unref(browse->aggregate);
+	g_hash_table_destroy(browse->seen);
+	g_strfreev(browse->strip);
+	g_free(browse);
+}
+
+/* The keys to ask the servers for: @mdkeys and those the fingerprints are
+   made of.  @strip is set to the keys added, or %NULL. */
+static gchar **mafw_upnp_aggregate_browse_keys(const gchar *const *mdkeys,
+					       gchar ***strip)
+{
+	const gchar *const *key;
+	GPtrArray *keys, *added;
+	guint i;
+
+	keys = g_ptr_array_new();
+	added = g_ptr_array_new();
+	if (mdkeys != NULL)
+		for (i = 0; mdkeys[i] != NULL; i++)
+			g_ptr_array_add(keys, g_strdup(mdkeys[i]));
+
+	if (keys->len == 0 ||
+	    strcmp(g_ptr_array_index(keys, 0), MAFW_SOURCE_ALL_KEYS[0]) != 0)
+	{
+		for (key = dedup_get_keys(); *key != NULL; key++)
+		{
+			for (i = 0; i < keys->len; i++)
+				if (strcmp(g_ptr_array_index(keys, i),
+					   *key) == 0)
+					break;
+			if (i < keys->len)
+				continue;
+			g_ptr_array_add(keys, g_strdup(*key));
+			g_ptr_array_add(added, g_strdup(*key));
+		}
+	}
+	g_ptr_array_add(keys, NULL);
+
+	if (added->len > 0)
+	{
+		g_ptr_array_add(added, NULL);
+		*strip = (gchar **)g_ptr_array_free(added, FALSE);
+	}
+	else
+	{
+		g_ptr_array_free(added, TRUE);
+		*strip = NULL;
+	}
+
+	return (gchar **)g_ptr_array_free(keys, FALSE);
+}
+
+/* A copy of @metadata without @keys.  The servers may share their
+   results with other browses, so they are left as they are. */
+static GHashTable *mafw_upnp_aggregate_strip(GHashTable *metadata,
+					     gchar **keys)
+{
+	GHashTableIter iter;
+	GHashTable *copy;
+	GValueArray *values;
+	gpointer key, value;
+	guint i;
+
+	copy = mafw_metadata_new();
+	g_hash_table_iter_init(&iter, metadata);
+	while (g_hash_table_iter_next(&iter, &key, &value))
+	{
+		for (i = 0; keys[i] != NULL; i++)
+			if (strcmp(keys[i], key) == 0)
+				break;
+		if (keys[i] != NULL)
+			continue;
+
+		if (!G_VALUE_HOLDS(value, G_TYPE_VALUE_ARRAY))
+		{
+			mafw_metadata_add_val(copy, key, value);
+			continue;
+		}
+		values = g_value_get_boxed(value);
+		for (i = 0; i < values->n_values; i++)
+			mafw_metadata_add_val(
+				copy, key, g_value_array_get_nth(values, i));
+	}
+
+	return copy;
+}
+
+/* Drops the copies of the tracks given out already, keeping the first one
+   merged.  Sorted, that is the copy the first to arrive of those that sort
+   the same, which need not be of the fastest server.  Metadata and
+   playback come from the fastest anyway, see
+   mafw_upnp_aggregate_source_pick(). */
+static gboolean mafw_upnp_aggregate_browse_admit(const gchar *objectid,
+						 GHashTable *metadata,
+						 gpointer user_data)
+{
+	AggregateBrowse *browse = user_data;
+	gchar *fingerprint;
+
+	fingerprint = dedup_fingerprint(metadata);
+	if (fingerprint == NULL)
+		return TRUE;
+
+	dedup_index_add(MAFW_UPNP_AGGREGATE_SOURCE(browse->aggregate)
+			->duplicates, fingerprint, objectid);
+	if (g_hash_table_lookup_extended(browse->seen, fingerprint,
+					 NULL, NULL))
+	{
+		g_free(fingerprint);
+		return FALSE;
+	}
+
+	g_hash_table_insert(browse->seen, fingerprint, NULL);
+	return TRUE;
+}
+
+/* The items are given out as those of the aggregate source, by the object
+   ID of the copy on its server after the UUID of the aggregate source. */
+static void mafw_upnp_aggregate_browse_cb(MafwSource *source,
+					  guint browse_id,
+					  gint remaining_count, guint index,
+					  const gchar *objectid,
+					  GHashTable *metadata,
+					  gpointer user_data,
+					  const GError *error)
+{
+	AggregateBrowse *browse = user_data;
+	GHashTable *stripped;
+	gchar *aggregate_id;
+
+	aggregate_id = NULL;
+	if (objectid != NULL)
+		aggregate_id = g_strconcat(MAFW_UPNP_AGGREGATE_SOURCE_UUID
+					   "::", objectid, NULL);
+
+	stripped = NULL;
+	if (metadata != NULL && browse->strip != NULL)
+		metadata = stripped = mafw_upnp_aggregate_strip(
+			metadata, browse->strip);
+
+	browse->callback(source, browse_id, remaining_count, index,
+			 aggregate_id, metadata, browse->user_data, error);
+	if (stripped != NULL)
+		g_hash_table_unref(stripped);
+	g_free(aggregate_id);
+}
+
+static guint mafw_upnp_aggregate_source_browse(MafwSource *self,
+				const gchar *object_id, gboolean recursive,
+				const MafwFilter *filter,
+				const gchar *sort_criteria,
+				const gchar *const *mdkeys,
+				guint skip_count, guint item_count,
+				MafwSourceBrowseResultCb cb, gpointer user_data)
+{
+	AggregateBrowse *browse;
+	MafwFilter *items;
+	GError *error;
+	GList *servers;
+	gchar *itemid;
+	gchar **keys;
+	guint browse_id;
+
+	g_return_val_if_fail(cb != NULL, MAFW_SOURCE_INVALID_BROWSE_ID);
+
+	/* There is only the library to browse, its items are those of the
+	   servers. */
+	itemid = NULL;
+	mafw_source_split_objectid(object_id, NULL, &itemid);
+	if (itemid == NULL || *itemid != '\0')
+	{
+		error = NULL;
+		g_set_error(&error, MAFW_SOURCE_ERROR,
+			    MAFW_SOURCE_ERROR_INVALID_OBJECT_ID,
+			    "Only the root of the aggregate source can be "
+			    "browsed");
+		cb(self, MAFW_SOURCE_INVALID_BROWSE_ID, 0, 0, NULL, NULL,
+		   user_data, error);
+		g_error_free(error);
+		g_free(itemid);
+		return MAFW_SOURCE_INVALID_BROWSE_ID;
+	}
+	g_free(itemid);
+
+	browse = g_new0(AggregateBrowse, 1);
+	browse->aggregate = g_object_ref(self);
+	browse->seen = g_hash_table_new_full(g_str_hash, g_str_equal,
+					     g_free, NULL);
+	browse->callback = cb;
+	browse->user_data = user_data;
+
+	/* Tracks of the same title are told apart by the rest of their
+	   fingerprints, whatever the client asked for */
+	keys = mafw_upnp_aggregate_browse_keys(mdkeys, &browse->strip);
+
+	items = NULL;
+	if (filter == NULL)
+		filter = items = mafw_filter_parse(AGGREGATE_ITEMS_FILTER);
+
+	servers = g_list_sort(mafw_upnp_source_plugin_get_servers(),
+			      mafw_upnp_aggregate_source_compare);
+	browse_id = federated_search_start(self, servers, filter,
+					   sort_criteria,
+					   (const gchar *const *)keys,
+					   skip_count, item_count,
+					   mafw_upnp_aggregate_browse_cb,
+					   browse);
+	g_list_free(servers);
+	g_strfreev(keys);
+	if (items != NULL)
+		mafw_filter_free(items);
+
+	if (browse_id == MAFW_SOURCE_INVALID_BROWSE_ID)
+	{
+		mafw_upnp_aggregate_browse_free(browse);
+		return MAFW_SOURCE_INVALID_BROWSE_ID;
+	}
+
+	federated_search_set_admit(
+		browse_id, mafw_upnp_aggregate_browse_admit, browse,
+		(GDestroyNotify)mafw_upnp_aggregate_browse_free);
+
+	return browse_id;
+}
+
+static gboolean mafw_upnp_aggregate_source_cancel_browse(MafwSource *self,
+							 guint browse_id,
+							 GError **error)
+{
+	if (federated_search_cancel(self, browse_id))
+		return TRUE;
+
+	g_set_error(error, MAFW_SOURCE_ERROR,
+		    MAFW_SOURCE_ERROR_INVALID_BROWSE_ID,
+		    "Browse ID not found");
+	return FALSE;
+}
+
+/**
+ * mafw_upnp_aggregate_source_pick:
+ * @self:     The aggregate source
+ * @itemid:   Object ID of a copy of a track on its server
+ * @objectid: Set to the object ID of the copy to use
+ *
+ * Picks the fastest of the servers on the network that have a copy of
+ * the track.
+ *
+ * Returns: The source of the server, or %NULL if none is there.
+ */
+static MafwSource *mafw_upnp_aggregate_source_pick(
+	MafwUpnpAggregateSource *self, const gchar *itemid, gchar **objectid)
+{
+	MafwExtension *server;
+	MafwSource *best;
+	GPtrArray *copies;
+	const gchar *copy;
+	gchar *uuid;
+	guint i, n, latency, best_latency;
+
+	copies = dedup_index_lookup(self->duplicates, itemid);
+	n = copies != NULL ? copies->len : 1;
+
+	best = NULL;
+	best_latency = 0;
+	*objectid = NULL;
+	for (i = 0; i < n; i++)
+	{
+		copy = copies != NULL ? g_ptr_array_index(copies, i) : itemid;
+
+		uuid = NULL;
+		mafw_source_split_objectid(copy, &uuid, NULL);
+		server = uuid != NULL ? mafw_registry_get_extension_by_uuid(
+			_plugin->registry, uuid) : NULL;
+		g_free(uuid);
+		if (!MAFW_IS_UPNP_SOURCE(server) ||
+		    MAFW_UPNP_SOURCE(server)->priv->offline)
+			continue;
+
+		latency = mafw_upnp_aggregate_source_latency(
+			MAFW_UPNP_SOURCE(server));
+		if (best == NULL || latency < best_latency)
+		{
+			best = MAFW_SOURCE(server);
+			best_latency = latency;
+			g_free(*objectid);
+			*objectid = g_strdup(copy);
+		}
+	}
+
+	return best;
+}
+
+static void mafw_upnp_aggregate_metadata_cb(MafwSource *server,
+					    const gchar *objectid,
+					    GHashTable *metadata,
+					    gpointer user_data,
+					    const GError *error)
+{
+	AggregateMetadata *request = user_data;
+
+	request->callback(request->aggregate, request->objectid, metadata,
+			  request->user_data, error);
+
+	g_object_unref(request->aggregate);
+	g_free(request->objectid);
+	g_free(request);
+}
+
+/* Metadata of a track comes from the fastest server that has it, which
+   is the one to play it from as well. */
+static void mafw_upnp_aggregate_source_get_metadata(MafwSource *self,
+						    const gchar *object_id,
+						    const gchar *const *mdkeys,
+						    MafwSourceMetadataResultCb cb,
+						    gpointer user_data)
+{
+	AggregateMetadata *request;
+	MafwSource *server;
+	GError *error;
+	gchar *itemid, *objectid;
+
+	g_return_if_fail(cb != NULL);
+
+	itemid = NULL;
+	server = NULL;
+	mafw_source_split_objectid(object_id, NULL, &itemid);
+	if (itemid != NULL && *itemid != '\0')
+		server = mafw_upnp_aggregate_source_pick(
+			MAFW_UPNP_AGGREGATE_SOURCE(self), itemid, &objectid);
+	g_free(itemid);
+
+	if (server == NULL)
+	{
+		error = NULL;
+		g_set_error(&error, MAFW_SOURCE_ERROR,
+			    MAFW_SOURCE_ERROR_OBJECT_ID_NOT_AVAILABLE,
+			    "No server with the item is available");
+		cb(self, object_id, NULL, user_data, error);
+		g_error_free(error);
+		return;
+	}
+
+	request = g_new0(AggregateMetadata, 1);
+	request->aggregate = g_object_ref(self);
+	request->objectid = g_strdup(object_id);
+	request->callback = cb;
+	request->user_data = user_data;
+	mafw_source_get_metadata(server, objectid, mdkeys,
+				 mafw_upnp_aggregate_metadata_cb, request);
+	g_free(objectid);
+}
+
+static void mafw_upnp_aggregate_source_finalize(GObject *object)
+{
+	dedup_index_free(MAFW_UPNP_AGGREGATE_SOURCE(object)->duplicates);
+
+	G_OBJECT_CLASS(mafw_upnp_aggregate_source_parent_class)->finalize(
+		object);
+}
+
+static void mafw_upnp_aggregate_source_class_init(
+	MafwUpnpAggregateSourceClass *klass)
+{
+	G_OBJECT_CLASS(klass)->finalize = mafw_upnp_aggregate_source_finalize;
+	MAFW_SOURCE_CLASS(klass)->browse = mafw_upnp_aggregate_source_browse;
+	MAFW_SOURCE_CLASS(klass)->cancel_browse =
+		mafw_upnp_aggregate_source_cancel_browse;
+	MAFW_SOURCE_CLASS(klass)->get_metadata =
+		mafw_upnp_aggregate_source_get_metadata;
+}
+
+static void mafw_upnp_aggregate_source_init(MafwUpnpAggregateSource *source)
+{
+	source->duplicates = dedup_index_new();
+}
+
+GObject* mafw_upnp_aggregate_source_new(void)
+{
+	return g_object_new(mafw_upnp_aggregate_source_get_type(),
+			    "plugin", MAFW_UPNP_SOURCE_PLUGIN_NAME,
+			    "uuid", MAFW_UPNP_AGGREGATE_SOURCE_UUID,
+			    "name", "MAFW-UPnP-Aggregate-Source",
+			    NULL);
+}
+
+/*----------------------------------------------------------------------------
+  Common utilities
+  ----------------------------------------------------------------------------*/
+static void _call_unref(GObject *obj, gpointer udat)
+{
+	g_object_unref(obj);
+}
+
+/**
+ * mafw_upnp_source_compile_metadata:
+ * @keys:      A list of requested metadata keys (originating from a UI or renderer)
+ * @didl_node: Parsed xmlNode structure from a successful browse action,
+ *             containing a number of DIDL-Lite item/container nodes.
+ * @didl:      Non-parsed raw string-form DIDL-Lite XML document
+ * @pool:      Pool sharing repeated string values, or %NULL
+ * @metadata:  An empty metadata table to fill, or %NULL for a new one
+ *
+ * Compiles requested metadata keys and their values into a #GHashTable that
+ * can be sent back to the requesting UI/Renderer.
+ *
+ * Returns: A #GHashTable containing key-value pairs. Must be freed after use.
+ */
+static GHashTable *mafw_upnp_source_compile_metadata(guint64 keys,
+						     GUPnPDIDLLiteObject* didlobject,
+						     const gchar* didl,
+						     InternPool *pool,
+						     GHashTable *metadata)
+{
+	const gchar* constval;
 	gint number;
 	GList *resources;
-	gint type = G_TYPE_INVALID;
 	gboolean is_audio = FALSE, is_supported = TRUE, is_container;
 	GUPnPDIDLLiteResource* first_res = NULL;
 
 	/* Requested metadata keys */
-	metadata = mafw_metadata_new();
+	if (metadata == NULL)
+		metadata = mafw_metadata_new();
 
 	if ((keys & MUPnPSrc_MKey_Title) ==  MUPnPSrc_MKey_Title)
 	{
@@ -779,14 +1971,16 @@ static GHashTable *mafw_upnp_source_compile_metadata(guint64 keys,
 			((keys & MUPnPSrc_MKey_MimeType)
 				== MUPnPSrc_MKey_MimeType))
 	{
-		didl_get_mimetype(metadata, is_container, is_audio, resources);
+		didl_get_mimetype(metadata, pool, is_container, is_audio,
+				  resources);
 	}
 	keys &= ~MUPnPSrc_MKey_MimeType;
 	
 	if (first_res && (keys & MUPnPSrc_MKey_Duration) == MUPnPSrc_MKey_Duration)
 	{
-		number = (gint)gupnp_didl_lite_resource_get_duration(first_res);
-		if (number >= 0)
+		if (didl_parse_duration(didl_res_peek(first_res,
+						      DIDL_RES_DURATION),
+					&number))
 			mafw_metadata_add_int(metadata,
 						MAFW_METADATA_KEY_DURATION,
 						number);
@@ -796,19 +1990,16 @@ static GHashTable *mafw_upnp_source_compile_metadata(guint64 keys,
 	if (first_res && !resources->next &&
 		(keys & MUPnPSrc_MKey_FileSize) == MUPnPSrc_MKey_FileSize)
 	{
-		number = (gint)gupnp_didl_lite_resource_get_size(first_res);
-		if (number >= 0)
-			mafw_metadata_add_int(metadata,
-						MAFW_METADATA_KEY_FILESIZE,
-						number);
+		didl_decode_size(metadata, NULL, MAFW_METADATA_KEY_FILESIZE,
+				 didl_res_peek(first_res, DIDL_RES_SIZE));
 	}
 	keys &= ~MUPnPSrc_MKey_FileSize;
 
 	if (first_res && !resources->next &&
 		(keys & MUPnPSrc_MKey_Bitrate) == MUPnPSrc_MKey_Bitrate)
 	{
-		number = (gint)gupnp_didl_lite_resource_get_bitrate(first_res);
-		if (number > 0)
+		if (didl_parse_int(didl_res_peek(first_res, DIDL_RES_BITRATE),
+				   &number) && number > 0)
 			mafw_metadata_add_int(metadata,
 						MAFW_METADATA_KEY_BITRATE,
 						number);
@@ -818,8 +2009,11 @@ static GHashTable *mafw_upnp_source_compile_metadata(guint64 keys,
 	if (first_res && !resources->next &&
 		(keys & MUPnPSrc_MKey_Res_X) == MUPnPSrc_MKey_Res_X)
 	{
-		number = (gint)gupnp_didl_lite_resource_get_width(first_res);
-		if (number > 0)
+		gint height;
+
+		if (didl_parse_resolution(didl_res_peek(first_res,
+							DIDL_RES_RESOLUTION),
+					  &number, &height))
 			mafw_metadata_add_int(metadata,
 						MAFW_METADATA_KEY_RES_X,
 						number);
@@ -829,8 +2023,11 @@ static GHashTable *mafw_upnp_source_compile_metadata(guint64 keys,
 	if (first_res && !resources->next &&
 		(keys & MUPnPSrc_MKey_Res_Y) == MUPnPSrc_MKey_Res_Y)
 	{
-		number = (gint)gupnp_didl_lite_resource_get_height(first_res);
-		if (number > 0)
+		gint width;
+
+		if (didl_parse_resolution(didl_res_peek(first_res,
+							DIDL_RES_RESOLUTION),
+					  &width, &number))
 			mafw_metadata_add_int(metadata,
 						MAFW_METADATA_KEY_RES_Y,
 						number);
@@ -847,76 +2044,40 @@ static GHashTable *mafw_upnp_source_compile_metadata(guint64 keys,
 		((keys & MUPnPSrc_MKey_Is_Seekable) ==
 			MUPnPSrc_MKey_Is_Seekable))
 	{
-		if (gupnp_protocol_info_get_dlna_operation(
-			gupnp_didl_lite_resource_get_protocol_info(first_res))
-				!= GUPNP_DLNA_OPERATION_NONE)
+		const DidlProtocolInfo *info;
+
+		info = didl_resource_get_info(first_res);
+		if (info && info->dlna_operation != GUPNP_DLNA_OPERATION_NONE)
 		{
 			mafw_metadata_add_boolean(metadata, MAFW_METADATA_KEY_IS_SEEKABLE,
 						  	TRUE);
 		}
-		else
+		else if (info)
 		{
-			value = didl_fallback(didlobject, first_res,
-					8, &type);
-			
-			if (value)
+			if (info->has_dlna)
+				mafw_metadata_add_boolean(metadata,
+					MAFW_METADATA_KEY_IS_SEEKABLE,
+					FALSE);
+			if ((keys & MUPnPSrc_MKey_Protocol_Info) ==
+				MUPnPSrc_MKey_Protocol_Info)
 			{
-				gchar** array;
-				/* Split the protocol info field into 4 fields:
-	   			0:protocol, 1:network, 2:mime-type and 3:additional info. */
-				array = g_strsplit(value, ":", 4);
-				
-				if (strstr(array[3], "DLNA.") != NULL)
-					mafw_metadata_add_boolean(metadata, 
-						MAFW_METADATA_KEY_IS_SEEKABLE,
-						  	FALSE);
-				g_strfreev(array);
-				if ((keys & MUPnPSrc_MKey_Protocol_Info) ==
-					MUPnPSrc_MKey_Protocol_Info)
-				{
-					mafw_metadata_add_str(metadata, 
-						MAFW_METADATA_KEY_PROTOCOL_INFO,
-							      value);
-					keys &= ~MUPnPSrc_MKey_Protocol_Info;
-				}
-				g_free(value);
+				intern_pool_add_str(pool, metadata,
+					MAFW_METADATA_KEY_PROTOCOL_INFO,
+					info->raw);
+				keys &= ~MUPnPSrc_MKey_Protocol_Info;
 			}
-			
 		}
 	}
 	keys &= ~MUPnPSrc_MKey_Is_Seekable;
 
 	gint id = 0;
-	/* the rest */
+	/* the rest, decoded straight from the XML tree by the typed decoder
+	   of each key */
 	while (keys)
 	{
 		if ((keys & 1) == 1)
-		{			
-			value = didl_fallback(didlobject, first_res,
-					id, &type);
-			if (value != NULL && value[0] != '\0')
-			{
-				constval = util_get_metadatakey_from_id(id);
-				if (!constval)
-				{
-					g_free(value);
-					keys >>= 1;
-					id++;
-					continue;
-				}
-				if (type == G_TYPE_INT)
-				{
-					mafw_metadata_add_int(metadata, constval,
-							      atoi(value));
-				}
-				else if (type == G_TYPE_STRING)
-				{
-					mafw_metadata_add_str(metadata, constval,
-							      value);
-				}
-				g_free(value);
-			}
-		}
+			didl_decode_fallback(metadata, pool, didlobject,
+					     first_res, id);
 		keys >>= 1;
 		id++;
 	}
@@ -931,476 +2092,2606 @@ static GHashTable *mafw_upnp_source_compile_metadata(guint64 keys,
   Search criteria parsing
   ----------------------------------------------------------------------------*/
 
-static gboolean internal_filter_to_search_criteria_simple(
-	GString *upsc, MafwFilter *maffin, gboolean negate,
-	GError **error)
+/**
+ * mafw_upnp_source_filter_to_search_criteria:
+ * @self:   A #MafwUPnPSource
+ * @filter: The MAFW filter to convert
+ * @error:  An error pointer
+ *
+ * Converts a MAFW browse filter to a UPnP SearchCriteriaString, optimised
+ * for the server by criteria_optimize().  The filters used lately are
+ * converted only once.
+ *
+ * Returns: A converted UPnP-style search criteria string or NULL if
+ *          parsing fails.
+ */
+static gchar *mafw_upnp_source_filter_to_search_criteria(
+	MafwUPnPSource *self, const MafwFilter *filter, GError **error)
 {
-	const gchar* didl_key;
-
-	g_assert(upsc != NULL);
-
-	didl_key = util_mafwkey_to_upnp_filter(maffin->key);
-	g_string_append(upsc, didl_key);
-
-	/* Since protocolInfo contains sub-strings like MIME type and protocol,
-	   we must change the exact match to approximate match. UPnP doesn't
-	   seem to support wildcards in protocolInfo fields during searching. */
-	if (strcmp(didl_key, DIDL_RES "@" DIDL_RES_PROTOCOL_INFO) == 0)
+	if (filter == NULL)
 	{
-		if (maffin->type == mafw_f_eq)
-			maffin->type = mafw_f_approx;
+		return NULL;
 	}
 
-	/* Convert the MAFW filter type into a UPnP type. */
-	if (maffin->type == mafw_f_eq)
-	{
-		if (negate == TRUE)
-			g_string_append(upsc, " != ");
-		else
-			g_string_append(upsc, " = ");
-	}
-	else if (maffin->type == mafw_f_lt)
-	{
-		if (negate == TRUE)
-			g_string_append(upsc, " >= ");
-		else
-			g_string_append(upsc, " < ");
-	}
-	else if (maffin->type == mafw_f_gt)
-	{
-		if (negate == TRUE)
-			g_string_append(upsc, " <= ");
-		else
-			g_string_append(upsc, " > ");
-	}
-	else if (maffin->type == mafw_f_approx)
-	{
-		if (negate == TRUE)
-			g_string_append(upsc, " doesNotContain ");
-		else
-			g_string_append(upsc, " contains ");
-	}
-	else if (maffin->type == mafw_f_exists)
-	{
-		if (negate == TRUE)
-			g_string_append(upsc, " exists false");
-		else
-			g_string_append(upsc, " exists true");
-	}
-	else
-	{
-		g_assert_not_reached();
-	}
+	return criteria_cache_translate(self->priv->criteria, filter,
+					self->priv->profile, error);
+}
 
-	/* If this is binary operation then append the right value */
-	if (maffin->type != mafw_f_exists)
+/**
+ * mafw_upnp_source_can_search_filter:
+ * @profile: Profile of the server
+ * @filter:  A MAFW filter
+ *
+ * Tells whether the server can be asked to Search with @filter, or the
+ * filter is to be evaluated locally on the children of the browsed
+ * container.
+ *
+ * Returns: %FALSE if the server is known not to search by some property
+ * @filter looks at.
+ */
+static gboolean mafw_upnp_source_can_search_filter(
+	const ServerProfile *profile, const MafwFilter *filter)
+{
+	MafwFilter *const *part;
+	GPtrArray *stack;
+	gboolean can;
+
+	/* Generated filters may nest deeper than the stack would take */
+	can = TRUE;
+	stack = g_ptr_array_new();
+	g_ptr_array_add(stack, (gpointer)filter);
+	while (can && stack->len > 0)
 	{
-		const gchar *str;
-
-		g_assert(maffin->value != NULL);
-
-		g_string_append_c(upsc, '"');
-		str = maffin->value;
-		while (*str)
+		filter = g_ptr_array_remove_index(stack, stack->len - 1);
+		if (!MAFW_FILTER_IS_SIMPLE(filter))
 		{
-			gchar c;
-
-			/*
-			 * UPnP can search for a substring, but not
-			 * for multiple substrings like "alpha*beta"
-			 * in a property value.  Therefore reject the
-			 * wildcard in the middle if we're matching
-			 * approximately.
-			 */
-			if (maffin->type == mafw_f_approx && *str == '*')
-			{
-				if (str == maffin->value || *(str+1) == '\0')
-				{
-					str++;
-					continue;
-				}
-				else
-				{
-					g_set_error(error,
-						    MAFW_SOURCE_ERROR,
-						    MAFW_SOURCE_ERROR_INVALID_SEARCH_STRING,
-						    "Wildcards in the middle "
-						    "of approximated property "
-						    "values are not supported");
-					return FALSE;
-				}
-			}
-
-			/* mafw_filter_unquote_char() only returns NULL
-			 * if $maffin->value is syntactically incorrect. */
-			str = mafw_filter_unquote_char(str, &c);
-			if (str == NULL)
-			{
-				g_set_error(error,
-					    MAFW_SOURCE_ERROR,
-				    MAFW_SOURCE_ERROR_INVALID_SEARCH_STRING,
-					    "Invalid escape sequence");
-				return FALSE;
-			}
-
-			/* We can't do anything about NILs for they
-			 * are interpreted as terminators by gupnp
-			 * and there is no way to quote them. */
-			if (c == '\0')
-			{
-				g_set_error(error,
-					    MAFW_SOURCE_ERROR,
-				    MAFW_SOURCE_ERROR_INVALID_SEARCH_STRING,
-					    "NIL in property value");
-				return FALSE;
-			}
-
-			if (c == '\\' || c == '"')
-				g_string_append_c(upsc, '\\');
-			g_string_append_c(upsc, c);
+			for (part = filter->parts; *part != NULL; part++)
+				g_ptr_array_add(stack, *part);
+			continue;
 		}
 
-		g_string_append_c(upsc, '"');
+		can = server_profile_can_search_by(
+			profile, util_mafwkey_to_upnp_filter(filter->key));
 	}
+	g_ptr_array_free(stack, TRUE);
 
-	return TRUE;
+	return can;
 }
 
-static gboolean internal_filter_to_search_criteria_complex(
-	GString *upsc, MafwFilter *maffin, gboolean negate,
-	GError **error)
+/*---------------------------------------------------------------------------
+  Browse Arguments
+  ---------------------------------------------------------------------------*/
+
+/** Struct that holds all necessary information for a single browse action */
+struct _BrowseArgs
 {
-	const gchar *op;
-	MafwFilter *const *sexp;
+	/*-------------------------------------------------------------------
+	  Static parameters passed in mafw_source_browse() call
+	  -------------------------------------------------------------------*/
 
-	g_assert(maffin != NULL);
+	/** The particular UPnP server instance that is being browsed */
+	MafwUPnPSource* source;
 
-	if (maffin->type == mafw_f_not)
-	{
-		/* There is no NOT operator in UPnP search strings,
-		 * so we need to negate all individual terms. */
-		negate = !negate;
-		op = NULL;
-	}
-	else if (maffin->type == mafw_f_and)
+	/** The UPnP CDS Item ID that is being browsed */
+	gchar* itemid;
+
+	/** Filter string converted to a UPnP search criteria */
+	gchar* search_criteria;
+
+	/** Copied sort criteria string */
+	gchar* sort_criteria;
+
+	/** Requested metadata keys (copied) */
+	guint64 mdata_keys;
+
+	/** Requested metadata keys in a comma-separated string */
+	gchar* meta_keys_csv;
+
+	/** Original skip count */
+	guint skip_count;
+
+	/** Original item count (total number of items the user wants) */
+	guint item_count;
+
+	/** Original requested count (number of items requested at a time) */
+	guint requested_count;
+
+	/** User callback function & its user data */
+	MafwSourceBrowseResultCb callback;
+	gpointer user_data;
+
+	/*-------------------------------------------------------------------
+	  Run-time parameters
+	  -------------------------------------------------------------------*/
+
+	/** The browse/search action associated with these args */
+	GUPnPServiceProxyAction* action;
+
+	/** ID of the current browse operation */
+	guint browse_id;
+
+	/** Number of items remaining to be fetched. */
+	guint remaining_count;
+
+	/** Number of items returned by the CDS in response to the request. */
+	guint number_returned;
+
+	/** Total number of items in the container currently browsed. */
+	guint total_matches;
+
+	/** Index of the next emitted item */
+	guint current;
+
+	/** Buffers reused from page to page */
+	PageScratch *scratch;
+
+	/** Columnar mode: the page being filled and its consumer. In this
+	    mode @callback only reports the end of the browse. */
+	ColumnPage *page;
+	MafwUPnPSourcePageCb page_cb;
+	gpointer page_user_data;
+
+	/** Every item of the container, for the catalog cache */
+	ColumnPage *record;
+
+	/** Pending emission of results from the catalog cache */
+	guint idle_id;
+
+	/** When the pending request was sent, monotonic time */
+	gint64 sent_at;
+
+	/** The previous page was shorter than asked: its size and what was
+	    asked, for the server profile */
+	guint short_page;
+	guint short_requested;
+
+	/** Shared fetch: the browse whose results this one gets, or the
+	    identical browses that get the results of this one */
+	BrowseArgs *leader;
+	GList *followers;
+
+	/** An identical browse may still join this one */
+	gboolean joinable;
+
+	/** The client cancelled but followers still need the results */
+	gboolean detached;
+
+	/** Results are filtered or sorted here, the server is browsed
+	    from the start and the skip and item counts of the client
+	    apply to the items that pass @predicate, after @sorter */
+	gboolean local;
+	guint local_skip;
+	guint local_count;
+
+	/** Filter evaluated here because the server cannot search by it */
+	Predicate *predicate;
+
+	/** Sort done here because the server cannot sort, and the sort
+	    criteria of the client in case the server refuses or
+	    ignores them */
+	Sorter *sorter;
+	gchar *mafw_sort_criteria;
+
+	/** Metadata keys compiled only for @predicate, @sorter and the
+	    check of the order of the server */
+	guint64 local_keys;
+
+	/** Substring search answered from the text index */
+	MafwFilter *index_filter;
+
+	/** Number of items that passed @predicate, or read from @sorter */
+	guint matched;
+
+	/** Reference count */
+	guint refcount;
+};
+
+/**
+ * Increase BrowseArgs* reference count. Reference counting is needed because
+ * this source sends results back to the user in multiple idle callbacks.
+ */
+static BrowseArgs* browse_args_ref(BrowseArgs* args)
+{
+	g_assert(args != NULL);
+
+	if (++args->refcount == 1)
+	{
+		/* Take only one reference to the source object */
+		g_object_ref(args->source);
+	}
+
+	return args;
+}
+
+static void mafw_upnp_source_browse_emit(BrowseArgs *args,
+					 guint remaining_count,
+					 guint index,
+					 const gchar *objectid,
+					 GHashTable *metadata,
+					 const GError *error);
+static void mafw_upnp_source_browse_release(BrowseArgs *args);
+
+/**
+ * Decrease BrowseArgs* reference count. See browse_args_ref() for reasons.
+ */
+static void browse_args_unref(BrowseArgs* args, GError *err)
+{
+	g_assert(args != NULL && args->refcount > 0);
+
+	if (--args->refcount == 0)
+	{
+		/* Remove the browse ID and this args struct from our list
+		   of cancellable browse operations */
+		if (g_tree_remove(args->source->priv->browses,
+				  GUINT_TO_POINTER(args->browse_id)) == FALSE)
+		{
+			g_assert_not_reached();
+		}
+
+		/* If remaining count > 0, then the action was probably
+		   cancelled, so we must send the final result indicating EOF.
+		*/
+		if (args->remaining_count > 0)
+		{
+			mafw_upnp_source_browse_emit(args, 0, 0, NULL, NULL,
+						     err);
+		}
+		mafw_upnp_source_browse_release(args);
+
+		g_object_unref(args->source);
+		page_scratch_free(args->scratch);
+		column_page_free(args->page);
+		column_page_free(args->record);
+		predicate_free(args->predicate);
+		sorter_free(args->sorter);
+		if (args->index_filter != NULL)
+			mafw_filter_free(args->index_filter);
+		g_free(args->mafw_sort_criteria);
+		g_free(args->itemid);
+		g_free(args->search_criteria);
+		g_free(args->sort_criteria);
+		g_free(args->meta_keys_csv);
+		g_free(args);
+	}
+}
+
+/*----------------------------------------------------------------------------
+  Shared browses
+  ----------------------------------------------------------------------------*/
+
+/**
+ * mafw_upnp_source_browse_emit:
+ *
+ * Gives a browse result to the client of @args and to the clients of the
+ * identical browses following it.  With a @remaining_count of 0 the
+ * followers are done.
+ */
+static void mafw_upnp_source_browse_emit(BrowseArgs *args,
+					 guint remaining_count,
+					 guint index,
+					 const gchar *objectid,
+					 GHashTable *metadata,
+					 const GError *error)
+{
+	GList *followers, *node;
+	BrowseArgs *follower;
+
+	if (!args->detached)
+		args->callback(MAFW_SOURCE(args->source), args->browse_id,
+			       remaining_count, index, objectid, metadata,
+			       args->user_data, error);
+	if (args->followers == NULL)
+		return;
+
+	/* The callbacks may cancel any of them */
+	followers = g_list_copy(args->followers);
+	g_list_foreach(followers, (GFunc)browse_args_ref, NULL);
+	for (node = followers; node != NULL; node = node->next)
+	{
+		follower = node->data;
+		if (follower->leader != args)
+			continue;
+
+		follower->remaining_count = remaining_count;
+		follower->callback(MAFW_SOURCE(follower->source),
+				   follower->browse_id, remaining_count,
+				   index, objectid, metadata,
+				   follower->user_data, error);
+	}
+	for (node = followers; node != NULL; node = node->next)
+		browse_args_unref(node->data, NULL);
+	g_list_free(followers);
+
+	if (remaining_count == 0)
+		mafw_upnp_source_browse_release(args);
+}
+
+/**
+ * mafw_upnp_source_browse_release:
+ *
+ * Ends the browses following @args.  They have got all the results the
+ * client of @args has.
+ */
+static void mafw_upnp_source_browse_release(BrowseArgs *args)
+{
+	BrowseArgs *follower;
+
+	while (args->followers != NULL)
+	{
+		follower = args->followers->data;
+		args->followers = g_list_delete_link(args->followers,
+						     args->followers);
+		follower->leader = NULL;
+		follower->remaining_count = 0;
+		browse_args_unref(follower, NULL);
+	}
+}
+
+static gboolean mafw_upnp_source_find_leader(gpointer key,
+					     BrowseArgs *args,
+					     BrowseArgs **match)
+{
+	BrowseArgs *wanted = *match;
+
+	if (args == NULL || args == wanted || !args->joinable ||
+	    args->page != NULL ||
+	    args->local || wanted->local ||
+	    args->mdata_keys != wanted->mdata_keys ||
+	    args->skip_count != wanted->skip_count ||
+	    args->item_count != wanted->item_count ||
+	    strcmp(args->itemid, wanted->itemid) != 0 ||
+	    g_strcmp0(args->search_criteria, wanted->search_criteria) != 0 ||
+	    g_strcmp0(args->sort_criteria, wanted->sort_criteria) != 0)
+		return FALSE;
+
+	*match = args;
+	return TRUE;
+}
+
+/**
+ * mafw_upnp_source_browse_join:
+ * @args: A browse about to be started
+ *
+ * Makes @args follow an identical browse that has not got any results
+ * yet, instead of fetching the same results again.
+ *
+ * Returns: %TRUE if @args joined another browse.
+ */
+static gboolean mafw_upnp_source_browse_join(BrowseArgs *args)
+{
+	BrowseArgs *leader = args;
+
+	g_tree_foreach(args->source->priv->browses,
+		       (GTraverseFunc)mafw_upnp_source_find_leader, &leader);
+	if (leader == args)
+		return FALSE;
+
+	g_debug("Browse %u shares the results of browse %u",
+		args->browse_id, leader->browse_id);
+	args->leader = leader;
+	leader->followers = g_list_append(leader->followers, args);
+
+	return TRUE;
+}
+
+/**
+ * mafw_upnp_source_browse_leave:
+ * @args: A cancelled browse following another one
+ *
+ * Stops the shared fetch when the last interested client has gone.
+ */
+static void mafw_upnp_source_browse_leave(BrowseArgs *args, GError *err)
+{
+	BrowseArgs *leader = args->leader;
+
+	leader->followers = g_list_remove(leader->followers, args);
+	args->leader = NULL;
+	browse_args_unref(args, err);
+
+	if (leader->detached && leader->followers == NULL)
+		_cancel_request(leader->source->priv, leader, err);
+}
+
+/*----------------------------------------------------------------------------
+  Browse
+  ----------------------------------------------------------------------------*/
+
+/**
+ * mafw_upnp_source_browse_index:
+ *
+ * Returns: The index the client of @args gets with the next item.
+ */
+static guint mafw_upnp_source_browse_index(const BrowseArgs *args)
+{
+	if (args->predicate == NULL || args->sorter != NULL)
+		return args->current;
+
+	return args->matched - MIN(args->matched, args->local_skip);
+}
+
+/**
+ * mafw_upnp_source_browse_match:
+ * @args:     #BrowseArgs* of the browse
+ * @metadata: Metadata of the latest item of the server
+ *
+ * Applies the local filter of @args, if any, to an item, and the skip and
+ * item counts of the client to the items passing it.  The browse ends with
+ * the last item the client wants.  Sorted browses count the items once
+ * they are sorted.
+ *
+ * Returns: Whether the client, or the sorter, gets the item.
+ */
+static gboolean mafw_upnp_source_browse_match(BrowseArgs *args,
+					      GHashTable *metadata)
+{
+	if (args->predicate != NULL &&
+	    !predicate_match(args->predicate, metadata))
+		return FALSE;
+	if (!args->local || args->sorter != NULL)
+		return TRUE;
+
+	if (args->matched++ < args->local_skip)
+		return FALSE;
+
+	if (args->local_count != 0 &&
+	    args->matched - args->local_skip == args->local_count)
+		args->remaining_count = 0;
+
+	return TRUE;
+}
+
+/* Drops from @metadata the @keys compiled only for the local filter. */
+static void mafw_upnp_source_strip_keys(GHashTable *metadata, guint64 keys)
+{
+	gint id;
+
+	for (id = 0; keys != 0; id++, keys >>= 1)
+		if ((keys & 1) == 1)
+			g_hash_table_remove(metadata,
+					    util_get_metadatakey_from_id(id));
+}
+
+/**
+ * mafw_upnp_source_sort_locally:
+ * @args:          #BrowseArgs* of a browse that has not got any results
+ * @sort_criteria: MAFW sort criteria of the client
+ *
+ * Makes @args fetch the whole container, unsorted, and sort it here
+ * before delivering anything.
+ *
+ * Returns: %FALSE if @sort_criteria is malformed.
+ */
+static gboolean mafw_upnp_source_sort_locally(BrowseArgs *args,
+					      const gchar *sort_criteria)
+{
+	GError *error = NULL;
+
+	args->sorter = sorter_new(sort_criteria, SORTER_RUN_SIZE, &error);
+	if (args->sorter == NULL)
+	{
+		g_debug("Not sorting: %s", error->message);
+		g_error_free(error);
+		return FALSE;
+	}
+
+	g_debug("Server cannot sort by %s, sorting locally", sort_criteria);
+	if (!args->local)
+	{
+		args->local = TRUE;
+		args->local_skip = args->skip_count;
+		args->local_count = args->item_count;
+		args->skip_count = 0;
+		args->item_count = 0;
+	}
+	args->local_keys |= sorter_get_keys(args->sorter) & ~args->mdata_keys;
+	g_free(args->sort_criteria);
+	args->sort_criteria = g_strdup("");
+
+	return TRUE;
+}
+
+/* Gives an item to the sorter of @args, or ends the browse if that
+   fails. */
+static void mafw_upnp_source_sort_add(BrowseArgs *args,
+				      const gchar *objectid,
+				      GHashTable *metadata)
+{
+	GError *error = NULL;
+
+	if (sorter_add(args->sorter, objectid, metadata, &error))
+		return;
+
+	g_warning("Sorting browse %u failed: %s", args->browse_id,
+		  error->message);
+	sorter_free(args->sorter);
+	args->sorter = NULL;
+	args->remaining_count = 0;
+	mafw_upnp_source_browse_emit(args, 0, 0, NULL, NULL, error);
+	g_error_free(error);
+}
+
+/**
+ * mafw_upnp_source_browse_result:
+ * @parser:    The DIDL-Lite parser object that is parsing browse results
+ * @didl_node: A single DIDL-Lite object (item/container) node
+ * @user_data: #BrowseArgs*
+ *
+ * Parses each item/container from a successful browse action, one by one
+ * (decided by the #GUPnPDIDLLiteParser). Then, returns the results for the
+ * whole set in one go using the user-given callback function.
+ */
+static void mafw_upnp_source_browse_result(GUPnPDIDLLiteParser* parser,
+					   GUPnPDIDLLiteObject* didlobject,
+					   BrowseArgs* args)
+{
+	GHashTable* metadata;
+	const gchar* objectid;
+	gint current;
+
+	g_assert(args != NULL);
+	g_assert(args->callback != NULL);
+
+	/* A locally filtered browse may have got all the client wanted
+	   in the middle of a page, or failed to sort */
+	if (args->local && args->remaining_count == 0)
+		return;
+	g_return_if_fail(args->remaining_count > 0);
+
+	/* Create a MAFW-style object ID for this item node. If an
+	   ID cannot be found, this node might be a <desc> node, which
+	   can be skipped with good conscience. The ID is built into a
+	   reused buffer, callbacks only get to borrow it. */
+	objectid = page_scratch_objectid(args->scratch, didlobject);
+
+	/* If there was no object ID, this node might be a <desc> node
+	   which must not be exposed to the user and thus not counted
+	   in skip_count, either. */
+	if (objectid == NULL)
+	{
+		return;
+	}
+
+	mafw_upnp_source_track_container(args->source, didlobject);
+	if (args->source->priv->text_index != NULL &&
+	    GUPNP_IS_DIDL_LITE_ITEM(didlobject))
+		mafw_upnp_source_index_item(args->source, didlobject,
+					    objectid);
+
+	if (args->sorter != NULL)
+	{
+		/* Kept until the whole container is sorted */
+		metadata = mafw_upnp_source_compile_metadata(
+			args->mdata_keys | args->local_keys, didlobject,
+			NULL, args->source->priv->pool, NULL);
+		args->current++;
+		args->remaining_count--;
+		if (mafw_upnp_source_browse_match(args, metadata))
+			mafw_upnp_source_sort_add(args, objectid, metadata);
+		g_hash_table_unref(metadata);
+		return;
+	}
+
+	if (args->page != NULL)
+	{
+		/* Columnar mode, the metadata table never leaves the source
+		   so it can be recycled. Strings are copied into the page,
+		   no point in pinning them. */
+		metadata = mafw_upnp_source_compile_metadata(
+			args->mdata_keys | args->local_keys, didlobject,
+			NULL, NULL, page_scratch_take_metadata(args->scratch));
+		if (args->record != NULL)
+			column_page_append(args->record, objectid, metadata);
+
+		args->current++;
+		args->remaining_count--;
+		if (mafw_upnp_source_browse_match(args, metadata))
+			column_page_append(args->page, objectid, metadata);
+		page_scratch_recycle_metadata(args->scratch, metadata);
+		return;
+	}
+
+	/* Gather requested metadata information from DIDL-Lite */
+	metadata = mafw_upnp_source_compile_metadata(args->mdata_keys |
+						     args->local_keys,
+						     didlobject,
+						     NULL,
+						     args->source->priv->pool,
+						     NULL);
+	if (args->record != NULL)
+		column_page_append(args->record, objectid, metadata);
+
+	/* Calculate remaining count and current item's index. */
+	current = mafw_upnp_source_browse_index(args);
+	args->current++;
+	args->remaining_count--;
+	if (!mafw_upnp_source_browse_match(args, metadata))
+	{
+		/* Filtered out, but the end is due if it was the last */
+		if (args->remaining_count == 0)
+			mafw_upnp_source_browse_emit(args, 0, 0, NULL, NULL,
+						     NULL);
+		g_hash_table_unref(metadata);
+		return;
+	}
+	mafw_upnp_source_strip_keys(metadata, args->local_keys);
+
+	/* Emit results */
+	mafw_upnp_source_browse_emit(args, args->remaining_count, current,
+				     objectid, metadata, NULL);
+	
+	/* Free the compiled metadata, the callback may have kept a
+	   reference */
+	g_hash_table_unref(metadata);
+}
+
+/**
+ * mafw_upnp_source_emit_page:
+ * @args: #BrowseArgs* of a columnar browse
+ *
+ * Hands the page filled from the latest browse increment over to the page
+ * callback and starts a new one.
+ */
+static void mafw_upnp_source_emit_page(BrowseArgs *args)
+{
+	ColumnPage *page;
+
+	page = args->page;
+	args->page = column_page_new(mafw_upnp_source_browse_index(args));
+
+	/* Only <desc> nodes or nothing at all, the end of the browse is
+	   reported separately.  Unless the local filter took all of the
+	   last page. */
+	if (column_page_get_n_rows(page) == 0)
+	{
+		column_page_free(page);
+		if (args->predicate != NULL && args->sorter == NULL &&
+		    args->remaining_count == 0)
+			mafw_upnp_source_browse_emit(args, 0, 0, NULL, NULL,
+						     NULL);
+		return;
+	}
+
+	column_page_seal(page);
+	args->page_cb(args->source, args->browse_id, page,
+		      args->remaining_count, args->page_user_data, NULL);
+}
+
+/**
+ * mafw_upnp_source_page_end_cb:
+ *
+ * #MafwSourceBrowseResultCb of columnar browses.  Item results never come
+ * here, so this only relays the end of the browse and errors.
+ */
+static void mafw_upnp_source_page_end_cb(MafwSource *source,
+					 guint browse_id,
+					 gint remaining_count,
+					 guint index,
+					 const gchar *objectid,
+					 GHashTable *metadata,
+					 gpointer user_data,
+					 const GError *error)
+{
+	BrowseArgs *args = user_data;
+
+	args->page_cb(MAFW_UPNP_SOURCE(source), browse_id, NULL, 0,
+		      args->page_user_data, error);
+}
+
+/**
+ * mafw_upnp_source_sort_idle:
+ * @args: #BrowseArgs* of a sorted browse
+ *
+ * Delivers the next DEFAULT_REQUESTED_COUNT sorted results, like a page
+ * from the server would come.
+ */
+static gboolean mafw_upnp_source_sort_idle(BrowseArgs *args)
+{
+	GHashTable *metadata;
+	GError *error = NULL;
+	gchar *objectid;
+	guint n;
+
+	/* The next batch comes in the next idle, which takes over the
+	   reference of this one.  Cancelling removes it and thus stops
+	   this batch, too. */
+	args->idle_id = g_idle_add((GSourceFunc)mafw_upnp_source_sort_idle,
+				   args);
+	browse_args_ref(args);
+
+	for (n = 0; n < DEFAULT_REQUESTED_COUNT &&
+		     args->remaining_count > 0 && args->idle_id != 0;)
+	{
+		if (!sorter_next(args->sorter, &objectid, &metadata, &error))
+		{
+			/* The temporary files are gone bad */
+			if (error != NULL)
+				g_warning("Sorting browse %u failed: %s",
+					  args->browse_id, error->message);
+			args->remaining_count = 0;
+			mafw_upnp_source_browse_emit(args, 0, 0, NULL, NULL,
+						     error);
+			g_clear_error(&error);
+			break;
+		}
+
+		if (args->matched++ >= args->local_skip)
+		{
+			n++;
+			args->remaining_count--;
+			if (args->page != NULL)
+			{
+				column_page_append(args->page, objectid,
+						   metadata);
+			}
+			else
+			{
+				mafw_upnp_source_strip_keys(metadata,
+							    args->local_keys);
+				mafw_upnp_source_browse_emit(
+					args, args->remaining_count,
+					args->current, objectid, metadata,
+					NULL);
+			}
+			args->current++;
+		}
+		g_free(objectid);
+		g_hash_table_unref(metadata);
+	}
+	if (args->page != NULL && args->idle_id != 0)
+		mafw_upnp_source_emit_page(args);
+
+	if (args->remaining_count == 0 && args->idle_id != 0)
+	{
+		/* Everything delivered */
+		g_source_remove(args->idle_id);
+		args->idle_id = 0;
+		browse_args_unref(args, NULL);
+	}
+	browse_args_unref(args, NULL);
+
+	return FALSE;
+}
+
+/**
+ * mafw_upnp_source_sort_start:
+ * @args: #BrowseArgs* of a sorted browse that got the whole container
+ *
+ * Sorts the container and starts delivering it.
+ */
+static void mafw_upnp_source_sort_start(BrowseArgs *args)
+{
+	GError *error = NULL;
+	guint n;
+
+	if (!sorter_finish(args->sorter, &error))
+	{
+		g_warning("Sorting browse %u failed: %s", args->browse_id,
+			  error->message);
+		args->remaining_count = 0;
+		mafw_upnp_source_browse_emit(args, 0, 0, NULL, NULL, error);
+		g_error_free(error);
+		return;
+	}
+
+	n = sorter_get_n_items(args->sorter);
+	n = n > args->local_skip ? n - args->local_skip : 0;
+	if (args->local_count != 0)
+		n = MIN(n, args->local_count);
+
+	args->remaining_count = n;
+	args->current = 0;
+	if (args->page != NULL)
+	{
+		column_page_free(args->page);
+		args->page = column_page_new(0);
+	}
+	if (n == 0)
+	{
+		mafw_upnp_source_browse_emit(args, 0, 0, NULL, NULL, NULL);
+		return;
+	}
+
+	browse_args_ref(args);
+	args->idle_id = g_idle_add((GSourceFunc)mafw_upnp_source_sort_idle,
+				   args);
+}
+
+/*----------------------------------------------------------------------------
+  Catalog cache
+  ----------------------------------------------------------------------------*/
+
+/**
+ * mafw_upnp_source_catalog_store:
+ * @args: #BrowseArgs* of a browse that has seen all children of its
+ *        container
+ *
+ * Caches the container in the catalog and tells the clients if it differs
+ * from the copy cached earlier, which they may have been shown.
+ */
+static void mafw_upnp_source_catalog_store(BrowseArgs *args)
+{
+	Catalog *catalog;
+
+	catalog = args->source->priv->catalog;
+	if (catalog_store(catalog, args->itemid, args->record) &&
+	    args->page_cb != mafw_upnp_source_watch_page_cb)
+		mafw_upnp_source_container_changed(args->source,
+						   args->itemid);
+	args->record = NULL;
+	catalog_set_validated(catalog, args->itemid);
+}
+
+/**
+ * mafw_upnp_source_revalidate_cb:
+ *
+ * #MafwSourceBrowseResultCb of revalidation browses, whose results only
+ * go to the catalog.
+ */
+static void mafw_upnp_source_revalidate_cb(MafwSource *source,
+					   guint browse_id,
+					   gint remaining_count,
+					   guint index,
+					   const gchar *objectid,
+					   GHashTable *metadata,
+					   gpointer user_data,
+					   const GError *error)
+{
+	if (error != NULL)
+		g_debug("Revalidation browse failed: %s", error->message);
+}
+
+/**
+ * mafw_upnp_source_catalog_current:
+ *
+ * Returns: %TRUE if the server has confirmed that nothing has changed since
+ * the catalog was built, so that its containers need no revalidation.
+ */
+static gboolean mafw_upnp_source_catalog_current(MafwUPnPSourcePrivate *priv)
+{
+	guint32 server_id, catalog_id;
+
+	return update_tracker_get_system(priv->updates, &server_id) &&
+		catalog_get_update_id(priv->catalog, &catalog_id) &&
+		server_id == catalog_id;
+}
+
+/**
+ * mafw_upnp_source_catalog_idle:
+ * @args: #BrowseArgs* of a browse served from the catalog
+ *
+ * Emits the requested part of a cached container, then checks the
+ * container against the server in the background unless that was done
+ * already in this session.
+ */
+static gboolean mafw_upnp_source_catalog_idle(BrowseArgs *args)
+{
+	MafwUPnPSourcePrivate *priv;
+	CatalogEntry entry;
+	ColumnPage *page;
+	GHashTable *metadata;
+	const gchar *str;
+	gchar *oid;
+	gint duration;
+	guint row;
+
+	priv = args->source->priv;
+	args->idle_id = 0;
+
+	if (!catalog_lookup(priv->catalog, args->itemid, &entry))
+	{
+		/* Invalidated by a SystemUpdateID change in the meantime,
+		   cache it again from the server */
+		if (!priv->offline)
+		{
+			if (args->skip_count == 0 && args->item_count == 0 &&
+			    (args->mdata_keys & CATALOG_KEYS) == CATALOG_KEYS)
+				args->record = column_page_new(0);
+			args->action = mafw_upnp_source_browse_internal(args);
+			if (args->action != NULL)
+			{
+				browse_args_unref(args, NULL);
+				return FALSE;
+			}
+		}
+		entry.n_rows = 0;
+	}
+
+	/* Copy the rows, the callbacks may well modify the catalog */
+	page = catalog_entry_to_page(&entry, args->skip_count,
+				     args->item_count);
+	args->remaining_count = column_page_get_n_rows(page);
+
+	if (args->page_cb != NULL)
+	{
+		args->current = args->remaining_count;
+		args->remaining_count = 0;
+		if (args->current == 0)
+		{
+			column_page_free(page);
+			page = NULL;
+		}
+		args->page_cb(args->source, args->browse_id, page, 0,
+			      args->page_user_data, NULL);
+		page = NULL;
+	}
+	else if (args->remaining_count == 0)
+	{
+		args->callback(MAFW_SOURCE(args->source), args->browse_id,
+			       0, 0, NULL, NULL, args->user_data, NULL);
+	}
+	else
+	{
+		for (row = 0; row < column_page_get_n_rows(page); row++)
+		{
+			metadata = mafw_metadata_new();
+			str = column_page_get_string(page, row,
+						     COLUMN_PAGE_TITLE);
+			if (str != NULL &&
+			    args->mdata_keys & MUPnPSrc_MKey_Title)
+				mafw_metadata_add_str(metadata,
+					MAFW_METADATA_KEY_TITLE, str);
+			str = column_page_get_string(page, row,
+						     COLUMN_PAGE_ARTIST);
+			if (str != NULL &&
+			    args->mdata_keys & MUPnPSrc_MKey_Artist)
+				mafw_metadata_add_str(metadata,
+					MAFW_METADATA_KEY_ARTIST, str);
+			str = column_page_get_string(page, row,
+						     COLUMN_PAGE_ALBUM);
+			if (str != NULL &&
+			    args->mdata_keys & MUPnPSrc_MKey_Album)
+				mafw_metadata_add_str(metadata,
+					MAFW_METADATA_KEY_ALBUM, str);
+			str = column_page_get_string(page, row,
+						     COLUMN_PAGE_URI);
+			if (str != NULL && args->mdata_keys & MUPnPSrc_MKey_URI)
+				mafw_metadata_add_str(metadata,
+					MAFW_METADATA_KEY_URI, str);
+			str = column_page_get_string(page, row,
+						     COLUMN_PAGE_MIME);
+			if (str != NULL &&
+			    args->mdata_keys & MUPnPSrc_MKey_MimeType)
+				mafw_metadata_add_str(metadata,
+					MAFW_METADATA_KEY_MIME, str);
+			duration = column_page_get_duration(page, row);
+			if (duration != COLUMN_PAGE_NO_DURATION &&
+			    args->mdata_keys & MUPnPSrc_MKey_Duration)
+				mafw_metadata_add_int(metadata,
+					MAFW_METADATA_KEY_DURATION, duration);
+
+			args->remaining_count--;
+			args->callback(MAFW_SOURCE(args->source),
+				       args->browse_id,
+				       args->remaining_count,
+				       args->current++,
+				       column_page_get_string(page, row,
+						COLUMN_PAGE_OBJECT_ID),
+				       metadata,
+				       args->user_data,
+				       NULL);
+			g_hash_table_unref(metadata);
+		}
+	}
+	column_page_free(page);
+
+	if (!priv->offline &&
+	    !catalog_is_validated(priv->catalog, args->itemid) &&
+	    !mafw_upnp_source_catalog_current(priv))
+	{
+		/* One check per container and session is enough, the
+		   SystemUpdateID covers the rest */
+		catalog_set_validated(priv->catalog, args->itemid);
+		oid = g_strdup_printf("%s::%s",
+			mafw_extension_get_uuid(MAFW_EXTENSION(args->source)),
+			args->itemid);
+		mafw_upnp_source_browse_start(args->source, oid, FALSE,
+					      NULL, NULL, CATALOG_KEYS, 0, 0,
+					      mafw_upnp_source_revalidate_cb,
+					      NULL, NULL, FALSE);
+		g_free(oid);
+	}
+
+	browse_args_unref(args, NULL);
+	return FALSE;
+}
+
+/*----------------------------------------------------------------------------
+  Change feed
+  ----------------------------------------------------------------------------*/
+
+typedef struct {
+	guint id;
+	MafwUPnPSourceChangeCb callback;
+	gpointer user_data;
+} ContainerWatcher;
+
+/* A watched container.  All its watchers share one snapshot and one
+   refetch per change. */
+struct _ContainerWatch {
+	MafwUPnPSource *source;
+	gchar *itemid;
+	gchar *object_id;
+
+	/* ContainerWatcher*s */
+	GList *watchers;
+
+	/* The container as last fetched, NULL before the first fetch */
+	ColumnPage *snapshot;
+
+	/* The fetch in progress */
+	ColumnPage *incoming;
+	gboolean fetching;
+	/* Changed again during the fetch */
+	gboolean refetch;
+
+	/* Delivering a diff */
+	gboolean delivering;
+	/* Unwatched while fetching or delivering, free when done */
+	gboolean orphan;
+};
+
+static void mafw_upnp_source_watch_free(ContainerWatch *watch)
+{
+	g_list_foreach(watch->watchers, (GFunc)g_free, NULL);
+	g_list_free(watch->watchers);
+	column_page_free(watch->snapshot);
+	column_page_free(watch->incoming);
+	g_free(watch->itemid);
+	g_free(watch->object_id);
+	g_free(watch);
+}
+
+/**
+ * mafw_upnp_source_watch_release:
+ *
+ * Destroy function of the watch table.  A watch still waiting for its
+ * fetch or delivering is freed when done.
+ */
+static void mafw_upnp_source_watch_release(ContainerWatch *watch)
+{
+	if (watch->fetching || watch->delivering)
+		watch->orphan = TRUE;
+	else
+		mafw_upnp_source_watch_free(watch);
+}
+
+static void mafw_upnp_source_watch_deliver(ContainerWatch *watch,
+					   const ContainerDiff *diff)
+{
+	GList *watchers, *node;
+	ContainerWatcher *watcher;
+
+	/* Callbacks may unwatch */
+	watch->delivering = TRUE;
+	watchers = g_list_copy(watch->watchers);
+	for (node = watchers; node != NULL; node = node->next)
+	{
+		if (watch->orphan ||
+		    g_list_find(watch->watchers, node->data) == NULL)
+			continue;
+
+		watcher = node->data;
+		watcher->callback(watch->source, watch->object_id, diff,
+				  watcher->user_data);
+	}
+	g_list_free(watchers);
+	watch->delivering = FALSE;
+}
+
+/**
+ * mafw_upnp_source_watch_page_cb:
+ *
+ * Collects the fetched container.  At the end diffs it against the
+ * snapshot and hands the changes to the watchers.
+ */
+static void mafw_upnp_source_watch_page_cb(MafwUPnPSource *source,
+					   guint browse_id,
+					   ColumnPage *page,
+					   guint remaining_count,
+					   gpointer user_data,
+					   const GError *error)
+{
+	ContainerWatch *watch = user_data;
+	ContainerDiff *diff;
+	guint row;
+
+	if (page != NULL)
+	{
+		for (row = 0; row < column_page_get_n_rows(page); row++)
+			column_page_append_copy(watch->incoming, page, row);
+		column_page_free(page);
+	}
+	if (remaining_count > 0 && error == NULL)
+		return;
+
+	watch->fetching = FALSE;
+	if (error != NULL)
+	{
+		g_debug("Change feed fetch of %s failed: %s",
+			watch->object_id, error->message);
+		column_page_free(watch->incoming);
+	}
+	else if (watch->snapshot == NULL)
+	{
+		/* The baseline */
+		column_page_seal(watch->incoming);
+		watch->snapshot = watch->incoming;
+	}
+	else
+	{
+		column_page_seal(watch->incoming);
+		diff = container_diff_new(watch->snapshot, watch->incoming);
+		column_page_free(watch->snapshot);
+		watch->snapshot = watch->incoming;
+		if (!watch->orphan && !container_diff_is_empty(diff))
+			mafw_upnp_source_watch_deliver(watch, diff);
+		container_diff_free(diff);
+	}
+	watch->incoming = NULL;
+
+	if (watch->orphan)
+		mafw_upnp_source_watch_free(watch);
+	else if (watch->refetch)
+		mafw_upnp_source_watch_fetch(watch);
+}
+
+/**
+ * mafw_upnp_source_watch_fetch:
+ *
+ * Fetches the watched container, or makes the fetch in progress go again
+ * when it is done.
+ */
+static void mafw_upnp_source_watch_fetch(ContainerWatch *watch)
+{
+	if (watch->fetching)
+	{
+		watch->refetch = TRUE;
+		return;
+	}
+
+	watch->refetch = FALSE;
+	watch->fetching = TRUE;
+	watch->incoming = column_page_new(0);
+	mafw_upnp_source_browse_start(watch->source, watch->object_id,
+				      FALSE, NULL, NULL, CATALOG_KEYS, 0, 0,
+				      NULL, mafw_upnp_source_watch_page_cb,
+				      watch, FALSE);
+}
+
+/**
+ * mafw_upnp_source_watch_container:
+ * @self:      A #MafwUPnPSource
+ * @object_id: The container to watch
+ * @callback:  Receives the changes of the container
+ * @user_data: Data for @callback
+ *
+ * Subscribes to the item level changes of a container.  Whenever the
+ * server reports the container changed, the source fetches it once for
+ * all its watchers and gives them what was added, removed and modified
+ * since the previous fetch, instead of each client browsing the whole
+ * container again.  The first snapshot comes from the catalog cache if
+ * possible, otherwise it is fetched right away.
+ *
+ * Returns: ID for mafw_upnp_source_unwatch_container(), or 0.
+ */
+guint mafw_upnp_source_watch_container(MafwUPnPSource *self,
+				       const gchar *object_id,
+				       MafwUPnPSourceChangeCb callback,
+				       gpointer user_data)
+{
+	MafwUPnPSourcePrivate *priv;
+	ContainerWatch *watch;
+	ContainerWatcher *watcher;
+	CatalogEntry entry;
+	gchar *itemid = NULL;
+
+	g_return_val_if_fail(MAFW_IS_UPNP_SOURCE(self), 0);
+	g_return_val_if_fail(object_id != NULL, 0);
+	g_return_val_if_fail(callback != NULL, 0);
+
+	priv = self->priv;
+	mafw_source_split_objectid(object_id, NULL, &itemid);
+	if (itemid == NULL || *itemid == '\0')
+	{
+		g_free(itemid);
+		itemid = g_strdup("0");
+	}
+
+	watcher = g_new0(ContainerWatcher, 1);
+	watcher->id = priv->next_watch_id++;
+	watcher->callback = callback;
+	watcher->user_data = user_data;
+
+	watch = g_hash_table_lookup(priv->watches, itemid);
+	if (watch != NULL)
+	{
+		watch->watchers = g_list_append(watch->watchers, watcher);
+		g_free(itemid);
+		return watcher->id;
+	}
+
+	watch = g_new0(ContainerWatch, 1);
+	watch->source = self;
+	watch->itemid = itemid;
+	watch->object_id = g_strdup_printf("%s::%s",
+		mafw_extension_get_uuid(MAFW_EXTENSION(self)), itemid);
+	watch->watchers = g_list_append(NULL, watcher);
+	g_hash_table_insert(priv->watches, watch->itemid, watch);
+
+	if (priv->catalog != NULL &&
+	    catalog_lookup(priv->catalog, itemid, &entry))
+		watch->snapshot = catalog_entry_to_page(&entry, 0, 0);
+	else if (!priv->offline)
+		mafw_upnp_source_watch_fetch(watch);
+
+	return watcher->id;
+}
+
+static gboolean mafw_upnp_source_unwatch(gpointer key, ContainerWatch *watch,
+					 guint *watch_id)
+{
+	GList *node;
+
+	for (node = watch->watchers; node != NULL; node = node->next)
+	{
+		if (((ContainerWatcher *)node->data)->id != *watch_id)
+			continue;
+
+		g_free(node->data);
+		watch->watchers = g_list_delete_link(watch->watchers, node);
+		*watch_id = 0;
+		return watch->watchers == NULL;
+	}
+
+	return FALSE;
+}
+
+/**
+ * mafw_upnp_source_unwatch_container:
+ * @self:     A #MafwUPnPSource
+ * @watch_id: A watch ID from mafw_upnp_source_watch_container()
+ *
+ * Stops the change feed of a watch.
+ */
+void mafw_upnp_source_unwatch_container(MafwUPnPSource *self, guint watch_id)
+{
+	g_return_if_fail(MAFW_IS_UPNP_SOURCE(self));
+
+	g_hash_table_foreach_remove(self->priv->watches,
+				    (GHRFunc)mafw_upnp_source_unwatch,
+				    &watch_id);
+	if (watch_id != 0)
+		g_warning("No container watch %u", watch_id);
+}
+
+/*----------------------------------------------------------------------------
+  Jump to letter
+  ----------------------------------------------------------------------------*/
+
+/** The order the offsets of letters are in */
+#define JUMP_SORT_CRITERIA "+dc:title"
+
+typedef struct {
+	MafwUPnPSource *source;
+	guint jump_id;
+	gchar *object_id;
+	gchar *itemid;
+	gchar *letter;
+	MafwUPnPSourceOffsetCb callback;
+	gpointer user_data;
+
+	/* The action or the idle pending, for cancelling */
+	GUPnPServiceProxyAction *action;
+	guint idle_id;
+
+	/* What the pending action is for */
+	enum {
+		JUMP_STEP_PROBE,
+		JUMP_STEP_FLAT,
+		JUMP_STEP_COUNT
+	} step;
+
+	/* Offset of the first child the pending probe asked for */
+	guint start;
+
+	/* The children were counted by a Search already */
+	gboolean counted;
+
+	/* Titles of the children the last action returned */
+	GPtrArray *titles;
+} JumpArgs;
+
+static void mafw_upnp_source_jump_next(JumpArgs *args);
+static void mafw_upnp_source_jump_probe(JumpArgs *args, guint count);
+
+static void mafw_upnp_source_jump_free(JumpArgs *args)
+{
+	g_hash_table_remove(args->source->priv->jump_requests,
+			    GUINT_TO_POINTER(args->jump_id));
+	g_object_unref(args->source);
+	g_ptr_array_foreach(args->titles, (GFunc)g_free, NULL);
+	g_ptr_array_free(args->titles, TRUE);
+	g_free(args->object_id);
+	g_free(args->itemid);
+	g_free(args->letter);
+	g_free(args);
+}
+
+static void mafw_upnp_source_jump_finish(JumpArgs *args, guint offset,
+					 const GError *error)
+{
+	args->callback(args->source, args->object_id, args->letter, offset,
+		       args->user_data, error);
+	mafw_upnp_source_jump_free(args);
+}
+
+/* Fails the jump if its action could not be sent. */
+static void mafw_upnp_source_jump_sent(JumpArgs *args)
+{
+	GError *error = NULL;
+
+	if (args->action != NULL)
+		return;
+
+	g_set_error(&error, MAFW_SOURCE_ERROR,
+		    MAFW_SOURCE_ERROR_BROWSE_RESULT_FAILED,
+		    "Unable to send action to %s",
+		    mafw_extension_get_name(MAFW_EXTENSION(args->source)));
+	mafw_upnp_source_jump_finish(args, 0, error);
+	g_error_free(error);
+}
+
+/**
+ * _cancel_jump:
+ *
+ * Stops a jump to a letter, with the action or the idle it waits for.
+ * @callback hears of it only if @err is set.
+ */
+static void _cancel_jump(MafwUPnPSourcePrivate *priv, JumpArgs *args,
+			 const GError *err)
+{
+	if (args->action != NULL)
+	{
+		gupnp_service_proxy_cancel_action(priv->service,
+						  args->action);
+		args->action = NULL;
+	}
+	if (args->idle_id != 0)
+	{
+		g_source_remove(args->idle_id);
+		args->idle_id = 0;
+	}
+
+	if (err != NULL)
+		mafw_upnp_source_jump_finish(args, 0, err);
+	else
+		mafw_upnp_source_jump_free(args);
+}
+
+static gboolean _cancel_jump_id(MafwUPnPSourcePrivate *priv, guint jump_id,
+				const GError *err)
+{
+	JumpArgs *args;
+
+	args = g_hash_table_lookup(priv->jump_requests,
+				   GUINT_TO_POINTER(jump_id));
+	if (args == NULL)
+		return FALSE;
+
+	_cancel_jump(priv, args, err);
+	return TRUE;
+}
+
+static void _cancel_all_jumps(MafwUPnPSourcePrivate *priv,
+			      const GError *err)
+{
+	GList *jumps, *node;
+
+	/* Cancelling removes them from the table */
+	jumps = g_hash_table_get_values(priv->jump_requests);
+	for (node = jumps; node != NULL; node = node->next)
+		_cancel_jump(priv, node->data, err);
+	g_list_free(jumps);
+}
+
+static gboolean mafw_upnp_source_jump_idle(JumpArgs *args)
+{
+	args->idle_id = 0;
+	mafw_upnp_source_jump_next(args);
+	return FALSE;
+}
+
+static void mafw_upnp_source_jump_result(GUPnPDIDLLiteParser *parser,
+					 GUPnPDIDLLiteObject *didlobject,
+					 JumpArgs *args)
+{
+	g_ptr_array_add(args->titles,
+			g_strdup(gupnp_didl_lite_object_get_title(
+					 didlobject)));
+}
+
+/**
+ * mafw_upnp_source_jump_cb:
+ *
+ * Completes an action of a jump: learns the number of children from a
+ * probe at offset 0, whether a Search counts the children right, how many
+ * sort before the letter, or the titles at some offsets.
+ */
+static void mafw_upnp_source_jump_cb(GUPnPServiceProxy *service,
+				     GUPnPServiceProxyAction *action,
+				     gpointer user_data)
+{
+	JumpArgs *args = user_data;
+	MafwUPnPSourcePrivate *priv = args->source->priv;
+	GError *gupnp_error = NULL;
+	GError *error = NULL;
+	JumpTable *table;
+	gchar *didl = NULL;
+	guint number_returned = 0, total_matches = 0;
+	guint total, i;
+
+	args->action = NULL;
+	table = jump_cache_get(priv->jumps, args->itemid, priv->updates);
+	if (!gupnp_service_proxy_end_action(
+		    service, action, &gupnp_error,
+		    "Result",         G_TYPE_STRING, &didl,
+		    "NumberReturned", G_TYPE_UINT,   &number_returned,
+		    "TotalMatches",   G_TYPE_UINT,   &total_matches,
+		    NULL))
+	{
+		if (args->step != JUMP_STEP_PROBE)
+		{
+			/* Without Search, probes will do */
+			g_debug("Jump search failed: %s",
+				gupnp_error->message);
+			jump_table_set_search(table, JUMP_SEARCH_UNUSABLE);
+			g_error_free(gupnp_error);
+			mafw_upnp_source_jump_next(args);
+			return;
+		}
+
+		g_set_error(&error, MAFW_SOURCE_ERROR,
+			    MAFW_SOURCE_ERROR_BROWSE_RESULT_FAILED,
+			    "Action failed: %s", gupnp_error->message);
+		g_error_free(gupnp_error);
+		mafw_upnp_source_jump_finish(args, 0, error);
+		g_error_free(error);
+		return;
+	}
+
+	switch (args->step)
 	{
-		if (negate == TRUE)
-			op = " or ";
-		else
-			op = " and ";
+	case JUMP_STEP_FLAT:
+		/* The Search finds descendants, and only the children
+		   when there are as many */
+		jump_table_get_total(table, &total);
+		jump_table_set_search(table, total_matches == total
+				      ? JUMP_SEARCH_USABLE
+				      : JUMP_SEARCH_UNUSABLE);
+		break;
+	case JUMP_STEP_COUNT:
+		/* Check the children at the boundary, the server may well
+		   compare otherwise than it sorts */
+		args->counted = TRUE;
+		args->step = JUMP_STEP_PROBE;
+		args->start = total_matches > 0 ? total_matches - 1 : 0;
+		mafw_upnp_source_jump_probe(args, 2);
+		g_free(didl);
+		return;
+	case JUMP_STEP_PROBE:
+		if (!jump_table_get_total(table, &total))
+		{
+			if (total_matches == 0 && number_returned > 0)
+			{
+				g_set_error(&error, MAFW_SOURCE_ERROR,
+					MAFW_SOURCE_ERROR_BROWSE_RESULT_FAILED,
+					"Server does not tell the number of "
+					"children of %s", args->object_id);
+				mafw_upnp_source_jump_finish(args, 0, error);
+				g_error_free(error);
+				g_free(didl);
+				return;
+			}
+			jump_table_set_total(table, total_matches);
+		}
+
+		g_ptr_array_foreach(args->titles, (GFunc)g_free, NULL);
+		g_ptr_array_set_size(args->titles, 0);
+		if (didl != NULL)
+		{
+			gulong id;
+
+			id = g_signal_connect(
+				parser, "object-available",
+				(GCallback)mafw_upnp_source_jump_result,
+				args);
+			gupnp_didl_lite_parser_parse_didl(parser, didl,
+							  NULL);
+			g_signal_handler_disconnect(parser, id);
+		}
+		for (i = 0; i < args->titles->len; i++)
+			jump_table_add_probe(table, args->start + i,
+					     g_ptr_array_index(args->titles,
+							       i));
+		break;
 	}
-	else if (maffin->type == mafw_f_or)
+	g_free(didl);
+
+	mafw_upnp_source_jump_next(args);
+}
+
+/* Browses @count children sorted by title from args->start. */
+static void mafw_upnp_source_jump_probe(JumpArgs *args, guint count)
+{
+	args->action = gupnp_service_proxy_begin_action(
+		args->source->priv->service,
+		"Browse",         mafw_upnp_source_jump_cb, args,
+		"ObjectID",       G_TYPE_STRING, args->itemid,
+		"BrowseFlag",     G_TYPE_STRING, "BrowseDirectChildren",
+		"Filter",         G_TYPE_STRING, "dc:title",
+		"StartingIndex",  G_TYPE_UINT,   args->start,
+		"RequestedCount", G_TYPE_UINT,   count,
+		"SortCriteria",   G_TYPE_STRING, JUMP_SORT_CRITERIA,
+		NULL);
+	mafw_upnp_source_jump_sent(args);
+}
+
+/* Counts the descendants of the container matching @criteria. */
+static void mafw_upnp_source_jump_search(JumpArgs *args,
+					 const gchar *criteria)
+{
+	args->action = gupnp_service_proxy_begin_action(
+		args->source->priv->service,
+		"Search",         mafw_upnp_source_jump_cb, args,
+		"ContainerID",    G_TYPE_STRING, args->itemid,
+		"SearchCriteria", G_TYPE_STRING, criteria,
+		"Filter",         G_TYPE_STRING, "dc:title",
+		"StartingIndex",  G_TYPE_UINT,   0,
+		"RequestedCount", G_TYPE_UINT,   1,
+		"SortCriteria",   G_TYPE_STRING, "",
+		NULL);
+	mafw_upnp_source_jump_sent(args);
+}
+
+/* Appends @str to @upsc as a quoted search criteria string. */
+static void mafw_upnp_source_jump_quote(GString *upsc, const gchar *str)
+{
+	g_string_append_c(upsc, '"');
+	for (; *str != '\0'; str++)
 	{
-		if (negate == TRUE)
-			op = " and ";
-		else
-			op = " or ";
+		if (*str == '\\' || *str == '"')
+			g_string_append_c(upsc, '\\');
+		g_string_append_c(upsc, *str);
 	}
-	else
+	g_string_append_c(upsc, '"');
+}
+
+/**
+ * mafw_upnp_source_jump_next:
+ *
+ * Takes the next step towards the offset of the letter: finds the number
+ * of children first, then counts the children before the letter by a
+ * Search if it can be trusted to find only them, and bisects between the
+ * children seen otherwise.
+ */
+static void mafw_upnp_source_jump_next(JumpArgs *args)
+{
+	MafwUPnPSourcePrivate *priv = args->source->priv;
+	JumpTable *table;
+	GString *upsc;
+	gchar *upper, *lower;
+	guint offset, low, high;
+
+	table = jump_cache_get(priv->jumps, args->itemid, priv->updates);
+	if (jump_table_lookup(table, args->letter, &offset))
 	{
-		g_assert_not_reached();
+		mafw_upnp_source_jump_finish(args, offset, NULL);
+		return;
+	}
+
+	if (!jump_table_get_total(table, &high))
+	{
+		args->step = JUMP_STEP_PROBE;
+		args->start = 0;
+		mafw_upnp_source_jump_probe(args, 1);
+		return;
 	}
 
-	g_assert(maffin->parts != NULL && maffin->parts[0] != NULL);
+	if (jump_table_bounds(table, args->letter, &low, &high))
+	{
+		mafw_upnp_source_jump_finish(args, low, NULL);
+		return;
+	}
 
-	if (maffin->parts[1] != NULL)
+	if (jump_table_get_search(table) == JUMP_SEARCH_UNKNOWN)
 	{
-		/* Has more than one subexpressions. */
-		for (sexp = maffin->parts; *sexp; sexp++)
+		if (server_profile_can_search_by(priv->profile, "dc:title") &&
+		    server_profile_total_matches_reliable(priv->profile) !=
+		    PROFILE_NO)
 		{
-			g_string_append_c(upsc, '(');
+			args->step = JUMP_STEP_FLAT;
+			mafw_upnp_source_jump_search(args,
+						     "dc:title exists true");
+			return;
+		}
+		jump_table_set_search(table, JUMP_SEARCH_UNUSABLE);
+	}
 
-			if (internal_filter_to_search_criteria(
-				    upsc, *sexp, negate, error) == FALSE)
-			{
-				return FALSE;
-			}
+	if (jump_table_get_search(table) == JUMP_SEARCH_USABLE &&
+	    !args->counted)
+	{
+		/* Titles before the letter in either case, for servers
+		   comparing case-sensitively */
+		upper = g_utf8_strup(args->letter, -1);
+		lower = g_utf8_strdown(args->letter, -1);
+		upsc = g_string_new("dc:title < ");
+		mafw_upnp_source_jump_quote(upsc, upper);
+		g_string_append(upsc, " or (dc:title >= \"a\" and "
+				"dc:title < ");
+		mafw_upnp_source_jump_quote(upsc, lower);
+		g_string_append_c(upsc, ')');
+		g_free(upper);
+		g_free(lower);
+
+		args->step = JUMP_STEP_COUNT;
+		mafw_upnp_source_jump_search(args, upsc->str);
+		g_string_free(upsc, TRUE);
+		return;
+	}
+
+	args->step = JUMP_STEP_PROBE;
+	args->start = low + (high - low) / 2;
+	mafw_upnp_source_jump_probe(args, 1);
+}
+
+/**
+ * mafw_upnp_source_find_letter:
+ * @self:      A #MafwUPnPSource attached to a server
+ * @object_id: A container
+ * @letter:    A letter, or any prefix of titles
+ * @callback:  Called with the offset
+ * @user_data: Passed to @callback
+ *
+ * Finds the offset of the first child of @object_id, sorted by "+title",
+ * whose title does not sort before @letter regardless of case; the
+ * number of children if there is none.  A Search counting the children
+ * before @letter finds it in two requests, probes of one child at a time
+ * bisect the container otherwise.  The offsets found and the children
+ * seen are remembered until the container changes, so the next letters
+ * of a container are cheaper.
+ *
+ * The jump is cancelled like a browse, by mafw_source_cancel_browse()
+ * with the ID returned; @callback is not called then.
+ *
+ * Returns: The ID of the jump, or %MAFW_SOURCE_INVALID_BROWSE_ID if it
+ * failed at once.
+ */
+guint mafw_upnp_source_find_letter(MafwUPnPSource *self,
+				   const gchar *object_id,
+				   const gchar *letter,
+				   MafwUPnPSourceOffsetCb callback,
+				   gpointer user_data)
+{
+	JumpArgs *args;
+	gchar *itemid = NULL;
+	GError *error = NULL;
+
+	g_return_val_if_fail(MAFW_IS_UPNP_SOURCE(self),
+			     MAFW_SOURCE_INVALID_BROWSE_ID);
+	g_return_val_if_fail(object_id != NULL && letter != NULL,
+			     MAFW_SOURCE_INVALID_BROWSE_ID);
+	g_return_val_if_fail(callback != NULL, MAFW_SOURCE_INVALID_BROWSE_ID);
+
+	mafw_source_split_objectid(object_id, NULL, &itemid);
+	if (itemid == NULL || *itemid == '\0')
+	{
+		g_free(itemid);
+		itemid = g_strdup("0");
+	}
+
+	if (self->priv->offline || self->priv->service == NULL ||
+	    !server_profile_can_sort(self->priv->profile,
+				     JUMP_SORT_CRITERIA))
+	{
+		g_set_error(&error, MAFW_SOURCE_ERROR, MAFW_SOURCE_ERROR_PEER,
+			    "Server cannot list %s by title", object_id);
+		callback(self, object_id, letter, 0, user_data, error);
+		g_error_free(error);
+		g_free(itemid);
+		return MAFW_SOURCE_INVALID_BROWSE_ID;
+	}
+
+	args = g_new0(JumpArgs, 1);
+	args->source = g_object_ref(self);
+	args->jump_id = _plugin->next_browse_id++;
+	args->object_id = g_strdup(object_id);
+	args->itemid = itemid;
+	args->letter = g_strdup(letter);
+	args->callback = callback;
+	args->user_data = user_data;
+	args->titles = g_ptr_array_new();
+
+	/* Asynchronously even if known, like from the server */
+	args->idle_id = g_idle_add((GSourceFunc)mafw_upnp_source_jump_idle,
+				   args);
+	g_hash_table_insert(self->priv->jump_requests,
+			    GUINT_TO_POINTER(args->jump_id), args);
+
+	return args->jump_id;
+}
+
+/*----------------------------------------------------------------------------
+  Type-ahead search
+  ----------------------------------------------------------------------------*/
+
+/**
+ * mafw_upnp_source_type_ahead:
+ * @self:          A #MafwUPnPSource
+ * @object_id:     The container to search recursively
+ * @metadata_keys: Metadata keys of the results
+ * @callback:      Called with the results
+ * @user_data:     Passed to @callback
+ *
+ * Prepares to search @object_id for the titles containing the text typed,
+ * given with type_ahead_set_text().  The text is searched for once the
+ * typing pauses for %TYPE_AHEAD_DELAY, and longer text is looked for among
+ * the results already at hand instead of asking the server again.
+ *
+ * Returns: The search, to be freed with type_ahead_free().
+ */
+TypeAhead *mafw_upnp_source_type_ahead(MafwUPnPSource *self,
+				       const gchar *object_id,
+				       const gchar *const *metadata_keys,
+				       TypeAheadResultCb callback,
+				       gpointer user_data)
+{
+	g_return_val_if_fail(MAFW_IS_UPNP_SOURCE(self), NULL);
+	g_return_val_if_fail(object_id != NULL && callback != NULL, NULL);
+
+	return type_ahead_new(MAFW_SOURCE(self), object_id,
+			      MAFW_METADATA_KEY_TITLE, metadata_keys,
+			      TYPE_AHEAD_DELAY, callback, user_data);
+}
+
+/*----------------------------------------------------------------------------
+  Catalog crawler
+  ----------------------------------------------------------------------------*/
+
+/**
+ * mafw_upnp_source_crawl_cb:
+ *
+ * #MafwSourceBrowseResultCb of crawler browses.  The items go to the
+ * catalog and the child containers to the crawler by the normal browse
+ * path, so this only notices the end of the browse.
+ */
+static void mafw_upnp_source_crawl_cb(MafwSource *source,
+				      guint browse_id,
+				      gint remaining_count,
+				      guint index,
+				      const gchar *objectid,
+				      GHashTable *metadata,
+				      gpointer user_data,
+				      const GError *error)
+{
+	MafwUPnPSourcePrivate *priv = MAFW_UPNP_SOURCE(source)->priv;
+
+	if (remaining_count > 0 && error == NULL)
+		return;
+
+	/* Whatever the container holds is missing from the index */
+	if (error != NULL)
+	{
+		g_debug("Crawler browse failed: %s", error->message);
+		if (priv->crawler != NULL)
+			crawler_fail(priv->crawler);
+	}
+	priv->crawl_busy = FALSE;
+}
+
+/**
+ * mafw_upnp_source_crawl_tick:
+ *
+ * Browses the next container of the crawl, at most one at a time and one
+ * per %CRAWLER_INTERVAL.  Waits while other browses are active so that the
+ * crawler never competes with the user.
+ */
+static gboolean mafw_upnp_source_crawl_tick(MafwUPnPSource *self)
+{
+	MafwUPnPSourcePrivate *priv = self->priv;
+	gchar *itemid;
+	gchar *oid;
+
+	if (priv->crawl_busy || g_tree_nnodes(priv->browses) > 0)
+		return TRUE;
+
+	itemid = crawler_next(priv->crawler);
+	if (itemid == NULL)
+	{
+		/* Caught up, mafw_upnp_source_crawl() wakes us up */
+		g_debug("Crawler of [%s] idle, %u containers visited, "
+			"%u items indexed",
+			mafw_extension_get_name(MAFW_EXTENSION(self)),
+			crawler_get_visited(priv->crawler),
+			text_index_get_size(priv->text_index));
+
+		/* Substring searches keep going to the server unless the
+		   walk saw everything */
+		text_index_set_complete(priv->text_index,
+					crawler_is_complete(priv->crawler));
+		priv->crawl_id = 0;
+		return FALSE;
+	}
+
+	oid = g_strdup_printf("%s::%s",
+			      mafw_extension_get_uuid(MAFW_EXTENSION(self)),
+			      itemid);
+	priv->crawl_busy = TRUE;
+	if (mafw_upnp_source_browse_start(self, oid, FALSE, NULL, NULL,
+					  CATALOG_KEYS | TEXT_INDEX_KEYS,
+					  0, 0, mafw_upnp_source_crawl_cb,
+					  NULL, NULL, FALSE) ==
+	    MAFW_SOURCE_INVALID_BROWSE_ID)
+	{
+		priv->crawl_busy = FALSE;
+		crawler_fail(priv->crawler);
+	}
+	g_free(oid);
+	g_free(itemid);
+
+	return TRUE;
+}
+
+/**
+ * mafw_upnp_source_crawl:
+ * @itemid:  UPnP ID of a container
+ * @refresh: %TRUE if the container has changed
+ *
+ * Hands a container to the crawler, if crawling is enabled.
+ */
+static void mafw_upnp_source_crawl(MafwUPnPSource *self,
+				   const gchar *itemid, gboolean refresh)
+{
+	MafwUPnPSourcePrivate *priv = self->priv;
+
+	if (priv->crawler == NULL ||
+	    !crawler_enqueue(priv->crawler, itemid, refresh))
+		return;
+
+	if (priv->crawl_id == 0)
+		priv->crawl_id = g_timeout_add_full(
+			G_PRIORITY_LOW, CRAWLER_INTERVAL,
+			(GSourceFunc)mafw_upnp_source_crawl_tick, self, NULL);
+}
+
+/*----------------------------------------------------------------------------
+  Text index
+  ----------------------------------------------------------------------------*/
+
+/**
+ * mafw_upnp_source_index_item:
+ * @objectid: MAFW object ID of @didlobject
+ *
+ * Adds an item that came in a browse to the text index.
+ */
+static void mafw_upnp_source_index_item(MafwUPnPSource *self,
+					GUPnPDIDLLiteObject *didlobject,
+					const gchar *objectid)
+{
+	GHashTable *metadata;
+	const gchar *parentid;
+
+	parentid = gupnp_didl_lite_object_get_parent_id(didlobject);
+	if (parentid == NULL)
+		return;
+
+	metadata = mafw_upnp_source_compile_metadata(TEXT_INDEX_KEYS,
+						     didlobject, NULL,
+						     self->priv->pool, NULL);
+	text_index_add(self->priv->text_index, objectid, parentid, metadata);
+	g_hash_table_unref(metadata);
+}
 
-			g_string_append_c(upsc, ')');
+/**
+ * mafw_upnp_source_local_emit:
+ * @args: #BrowseArgs* of a browse answered here
+ * @hits: The #TextIndexHit<!-- -->s to give out, freed
+ *
+ * Emits the results of a browse that needs no server, all at once.
+ */
+static void mafw_upnp_source_local_emit(BrowseArgs *args, GPtrArray *hits)
+{
+	TextIndexHit *hit;
+	ColumnPage *page;
+	guint i;
 
-			if (*(sexp + 1))
+	args->remaining_count = hits->len;
+	if (args->page_cb != NULL)
+	{
+		page = NULL;
+		if (hits->len > 0)
+		{
+			page = column_page_new(0);
+			for (i = 0; i < hits->len; i++)
 			{
-				/* mafw_f_not expressions are not
-				 * supposed to have multiple parts. */
-				g_assert(op != NULL);
-				g_string_append(upsc, op);
+				hit = g_ptr_array_index(hits, i);
+				column_page_append(page, hit->objectid,
+						   hit->metadata);
 			}
+			column_page_seal(page);
+		}
+		args->current = args->remaining_count;
+		args->remaining_count = 0;
+		args->page_cb(args->source, args->browse_id, page, 0,
+			      args->page_user_data, NULL);
+	}
+	else if (args->remaining_count == 0)
+	{
+		args->callback(MAFW_SOURCE(args->source), args->browse_id,
+			       0, 0, NULL, NULL, args->user_data, NULL);
+	}
+	else
+	{
+		for (i = 0; i < hits->len; i++)
+		{
+			hit = g_ptr_array_index(hits, i);
+			args->remaining_count--;
+			args->callback(MAFW_SOURCE(args->source),
+				       args->browse_id,
+				       args->remaining_count,
+				       args->current++,
+				       hit->objectid,
+				       hit->metadata,
+				       args->user_data,
+				       NULL);
 		}
 	}
-	else if (internal_filter_to_search_criteria(upsc, maffin->parts[0],
-						    negate, error) == FALSE)
+	text_index_hits_free(hits);
+}
+
+/**
+ * mafw_upnp_source_local_start:
+ * @itemid: UPnP ID of the browsed object, taken
+ * @idle:   Emits the results of the browse and releases @args
+ *
+ * Starts a browse answered without the server, see
+ * mafw_upnp_source_browse_start() for the other parameters.  The results
+ * come asynchronously, like from the server.
+ *
+ * Returns: The #BrowseArgs of the browse, to be set up further before
+ * @idle runs.
+ */
+static BrowseArgs *mafw_upnp_source_local_start(
+	MafwUPnPSource *self, gchar *itemid, guint64 mdata_keys,
+	guint skip_count, guint item_count,
+	MafwSourceBrowseResultCb browse_cb, MafwUPnPSourcePageCb page_cb,
+	gpointer user_data, GSourceFunc idle)
+{
+	BrowseArgs *args;
+
+	args = g_new0(BrowseArgs, 1);
+	args->source = self;
+	args->itemid = itemid;
+	args->mdata_keys = mdata_keys;
+	args->skip_count = skip_count;
+	args->item_count = item_count;
+	if (page_cb != NULL)
+	{
+		args->page_cb = page_cb;
+		args->page_user_data = user_data;
+		args->callback = mafw_upnp_source_page_end_cb;
+		args->user_data = args;
+	}
+	else
+	{
+		args->callback = browse_cb;
+		args->user_data = user_data;
+	}
+	args->browse_id = _plugin->next_browse_id++;
+	args->remaining_count = UINT_MAX;
+
+	browse_args_ref(args);
+	args->idle_id = g_idle_add(idle, args);
+	g_tree_insert(self->priv->browses,
+		      GUINT_TO_POINTER(args->browse_id), args);
+
+	return args;
+}
+
+/**
+ * mafw_upnp_source_index_idle:
+ * @args: #BrowseArgs* of a search answered from the text index
+ *
+ * Emits the requested part of the matching items.
+ */
+static gboolean mafw_upnp_source_index_idle(BrowseArgs *args)
+{
+	GPtrArray *hits;
+	GError *error = NULL;
+
+	args->idle_id = 0;
+	hits = text_index_search(args->source->priv->text_index,
+				 args->index_filter, args->mdata_keys,
+				 args->skip_count, args->item_count, &error);
+	if (hits == NULL)
 	{
+		args->remaining_count = 0;
+		mafw_upnp_source_browse_emit(args, 0, 0, NULL, NULL, error);
+		g_error_free(error);
+	}
+	else
+		mafw_upnp_source_local_emit(args, hits);
+
+	browse_args_unref(args, NULL);
+	return FALSE;
+}
+
+/**
+ * mafw_upnp_source_index_browse:
+ *
+ * Starts a search of the whole server answered from the text index, see
+ * mafw_upnp_source_browse_start() for the parameters.
+ */
+static guint mafw_upnp_source_index_browse(MafwUPnPSource *self,
+					   const MafwFilter *filter,
+					   guint64 mdata_keys,
+					   guint skip_count,
+					   guint item_count,
+					   MafwSourceBrowseResultCb browse_cb,
+					   MafwUPnPSourcePageCb page_cb,
+					   gpointer user_data)
+{
+	BrowseArgs *args;
+
+	args = mafw_upnp_source_local_start(
+		self, g_strdup("0"), mdata_keys, skip_count, item_count,
+		browse_cb, page_cb, user_data,
+		(GSourceFunc)mafw_upnp_source_index_idle);
+	args->index_filter = mafw_filter_copy(filter);
+	g_debug("Browse %u searched from the text index", args->browse_id);
+
+	return args->browse_id;
+}
+
+/*----------------------------------------------------------------------------
+  Library views
+  ----------------------------------------------------------------------------*/
+
+/* The views under MAFW_UPNP_SOURCE_VIEWS, by TextIndexGrouping */
+static const gchar *const mafw_upnp_source_views[TEXT_INDEX_N_GROUPINGS] = {
+	"artist",
+	"album",
+	"genre",
+	"year"
+};
+
+/**
+ * mafw_upnp_source_parse_view:
+ * @itemid:   UPnP part of an object ID
+ * @grouping: Set to the view, or %TEXT_INDEX_N_GROUPINGS for the list of
+ *            views
+ * @label:    Set to the group within the view, pointing into @itemid, or
+ *            %NULL for the list of groups
+ *
+ * The views are "mafw-views", "mafw-views/artist" and
+ * "mafw-views/artist/<artist>", and so on with the other groupings.  The
+ * label is the rest of the ID, slashes and all.
+ *
+ * Returns: Whether @itemid is that of a view.
+ */
+static gboolean mafw_upnp_source_parse_view(const gchar *itemid,
+					    TextIndexGrouping *grouping,
+					    const gchar **label)
+{
+	const gchar *p;
+	gsize len;
+	guint i;
+
+	if (!g_str_has_prefix(itemid, MAFW_UPNP_SOURCE_VIEWS))
+		return FALSE;
+
+	*grouping = TEXT_INDEX_N_GROUPINGS;
+	*label = NULL;
+	p = itemid + strlen(MAFW_UPNP_SOURCE_VIEWS);
+	if (*p == '\0')
+		return TRUE;
+	if (*p++ != '/')
 		return FALSE;
+
+	for (i = 0; i < TEXT_INDEX_N_GROUPINGS; i++)
+	{
+		len = strlen(mafw_upnp_source_views[i]);
+		if (strncmp(p, mafw_upnp_source_views[i], len) != 0 ||
+		    (p[len] != '\0' && p[len] != '/'))
+			continue;
+
+		*grouping = i;
+		if (p[len] == '/')
+			*label = p + len + 1;
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+/* A container of the views, with the requested metadata of @keys. */
+static TextIndexHit *mafw_upnp_source_view_container(MafwUPnPSource *self,
+						     const gchar *itemid,
+						     const gchar *title,
+						     gint childcount,
+						     guint64 keys)
+{
+	TextIndexHit *hit;
+
+	hit = g_new(TextIndexHit, 1);
+	hit->objectid = g_strdup_printf("%s::%s",
+		mafw_extension_get_uuid(MAFW_EXTENSION(self)), itemid);
+	hit->metadata = mafw_metadata_new();
+	if (keys & MUPnPSrc_MKey_Title)
+		mafw_metadata_add_str(hit->metadata, MAFW_METADATA_KEY_TITLE,
+				      title);
+	if (keys & MUPnPSrc_MKey_MimeType)
+		mafw_metadata_add_str(hit->metadata, MAFW_METADATA_KEY_MIME,
+				      MAFW_METADATA_VALUE_MIME_CONTAINER);
+	if (keys & MUPnPSrc_MKey_Childcount)
+		mafw_metadata_add_int(hit->metadata,
+				      MAFW_METADATA_KEY_CHILDCOUNT_1,
+				      childcount);
+
+	return hit;
+}
+
+/**
+ * mafw_upnp_source_view_contents:
+ * @keys: The metadata to give, MUPnPSrc_MKey_*
+ *
+ * Returns: The children of the view @itemid, as #TextIndexHit<!-- -->s.
+ */
+static GPtrArray *mafw_upnp_source_view_contents(MafwUPnPSource *self,
+						 const gchar *itemid,
+						 guint64 keys)
+{
+	TextIndex *index = self->priv->text_index;
+	TextIndexGrouping grouping;
+	TextIndexGroup *group;
+	GPtrArray *groups, *hits;
+	const gchar *label;
+	gchar *childid;
+	guint i;
+
+	if (!mafw_upnp_source_parse_view(itemid, &grouping, &label))
+		g_assert_not_reached();
+	if (label != NULL)
+		return text_index_get_group(index, grouping, label, keys, 0, 0);
+
+	hits = g_ptr_array_new();
+	if (grouping == TEXT_INDEX_N_GROUPINGS)
+	{
+		for (i = 0; i < TEXT_INDEX_N_GROUPINGS; i++)
+		{
+			groups = text_index_get_groups(index, i);
+			childid = g_strconcat(MAFW_UPNP_SOURCE_VIEWS "/",
+					      mafw_upnp_source_views[i],
+					      NULL);
+			g_ptr_array_add(hits, mafw_upnp_source_view_container(
+						self, childid,
+						mafw_upnp_source_views[i],
+						groups->len, keys));
+			g_free(childid);
+			text_index_groups_free(groups);
+		}
+		return hits;
+	}
+
+	groups = text_index_get_groups(index, grouping);
+	for (i = 0; i < groups->len; i++)
+	{
+		group = g_ptr_array_index(groups, i);
+		childid = g_strconcat(MAFW_UPNP_SOURCE_VIEWS "/",
+				      mafw_upnp_source_views[grouping], "/",
+				      group->label, NULL);
+		g_ptr_array_add(hits, mafw_upnp_source_view_container(
+					self, childid, group->label,
+					group->count, keys));
+		g_free(childid);
+	}
+	text_index_groups_free(groups);
+
+	return hits;
+}
+
+/**
+ * mafw_upnp_source_view_idle:
+ * @args: #BrowseArgs* of a browse of a view
+ *
+ * Emits the requested part of the view, filtered if asked.
+ */
+static gboolean mafw_upnp_source_view_idle(BrowseArgs *args)
+{
+	GPtrArray *hits, *window;
+	TextIndexHit *hit;
+	guint i;
+
+	args->idle_id = 0;
+	hits = mafw_upnp_source_view_contents(args->source, args->itemid,
+					      args->mdata_keys |
+					      args->local_keys);
+
+	window = g_ptr_array_new();
+	for (i = 0; i < hits->len; i++)
+	{
+		hit = g_ptr_array_index(hits, i);
+		if ((args->predicate != NULL &&
+		     !predicate_match(args->predicate, hit->metadata)) ||
+		    (args->item_count > 0 &&
+		     window->len == args->item_count))
+		{
+			g_free(hit->objectid);
+			g_hash_table_unref(hit->metadata);
+			g_free(hit);
+			continue;
+		}
+		if (args->skip_count > 0)
+		{
+			args->skip_count--;
+			g_free(hit->objectid);
+			g_hash_table_unref(hit->metadata);
+			g_free(hit);
+			continue;
+		}
+
+		mafw_upnp_source_strip_keys(hit->metadata, args->local_keys);
+		g_ptr_array_add(window, hit);
 	}
+	g_ptr_array_free(hits, TRUE);
 
-	return TRUE;
+	mafw_upnp_source_local_emit(args, window);
+	browse_args_unref(args, NULL);
+	return FALSE;
 }
 
 /**
- * mafw_upnp_source_filter_to_search_criteria:
- * @upsc:   UPnP-style search criteria
- * @maffin: MAFW-style browse filter string
- * @negate: Switch the whole expression into a NOT operation
- * @error:  An error pointer that is set if errors occur
- *
- * Parses a MafwFilter and writes the translated expressions to @upsc.
- * @negate tells it to negate all (sub)expressions, which is used to
- * emulate the NOT operator of LDAP that is not present in UPnP.
+ * mafw_upnp_source_view_metadata:
+ * @itemid: UPnP ID of a view
  *
- * NOTE: Remember to free @upsc.
- *
- * Returns: %TRUE if successful; otherwise %FALSE
+ * Gives the metadata of a view right away, like that of its entry in the
+ * view above it.
  */
-static gboolean internal_filter_to_search_criteria(GString *upsc,
-						   MafwFilter *maffin,
-						   gboolean negate,
-						   GError **error)
+static void mafw_upnp_source_view_metadata(MafwUPnPSource *self,
+					   const gchar *object_id,
+					   const gchar *itemid,
+					   const gchar *const *metadata_keys,
+					   MafwSourceMetadataResultCb cb,
+					   gpointer user_data)
 {
-	if (MAFW_FILTER_IS_SIMPLE(maffin))
-	{
-		return internal_filter_to_search_criteria_simple(upsc,
-								 maffin,
-								 negate,
-								 error);
-	}
-	else
+	TextIndexGrouping grouping;
+	TextIndexHit *hit;
+	GPtrArray *children;
+	const gchar *label;
+	GError *error = NULL;
+
+	if (self->priv->text_index == NULL)
 	{
-		return internal_filter_to_search_criteria_complex(upsc,
-								  maffin,
-								  negate,
-								  error);
+		g_set_error(&error, MAFW_SOURCE_ERROR,
+			    MAFW_SOURCE_ERROR_OBJECT_ID_NOT_AVAILABLE,
+			    "Views need crawling to be enabled");
+		cb(MAFW_SOURCE(self), object_id, NULL, user_data, error);
+		g_error_free(error);
+		return;
 	}
+
+	mafw_upnp_source_parse_view(itemid, &grouping, &label);
+	if (label == NULL)
+		label = grouping < TEXT_INDEX_N_GROUPINGS
+			? mafw_upnp_source_views[grouping]
+			: MAFW_UPNP_SOURCE_VIEWS;
+
+	children = mafw_upnp_source_view_contents(self, itemid, 0);
+	hit = mafw_upnp_source_view_container(
+		self, itemid, label, children->len,
+		util_compile_mdata_keys(metadata_keys));
+	text_index_hits_free(children);
+
+	cb(MAFW_SOURCE(self), object_id, hit->metadata, user_data, NULL);
+	g_hash_table_unref(hit->metadata);
+	g_free(hit->objectid);
+	g_free(hit);
 }
 
 /**
- * mafw_upnp_source_filter_to_search_criteria:
- * @mafw_filter: The MAFW-style filter string to convert
- * @error:       An error pointer
+ * mafw_upnp_source_view_browse:
+ * @itemid: UPnP ID of a view, taken
  *
- * Converts a MAFW browse filter string to a UPnP SearchCriteriaString.
+ * Starts a browse of a view, made of the items the crawl has seen so
+ * far.  Filters are evaluated here, on the metadata the text index keeps;
+ * the sort criteria are not heeded.  See mafw_upnp_source_browse_start()
+ * for the other parameters.
  *
- * Returns: A converted UPnP-style search criteria string or NULL if
- *          parsing fails.
+ * Returns: The browse ID, or %MAFW_SOURCE_INVALID_BROWSE_ID if crawling
+ * is not enabled or @filter is not valid.
  */
-static gchar *mafw_upnp_source_filter_to_search_criteria(
-	const MafwFilter *filter, GError **error)
+static guint mafw_upnp_source_view_browse(MafwUPnPSource *self,
+					  gchar *itemid,
+					  const MafwFilter *filter,
+					  guint64 mdata_keys,
+					  guint skip_count,
+					  guint item_count,
+					  MafwSourceBrowseResultCb browse_cb,
+					  MafwUPnPSourcePageCb page_cb,
+					  gpointer user_data,
+					  GError **error)
 {
-	GString *search_criteria;
-	MafwFilter *maffin;
-	gchar* str;
+	BrowseArgs *args;
+	Predicate *pred;
 
-	if (filter == NULL)
+	if (self->priv->text_index == NULL)
 	{
-		return NULL;
+		g_set_error(error, MAFW_SOURCE_ERROR,
+			    MAFW_SOURCE_ERROR_OBJECT_ID_NOT_AVAILABLE,
+			    "Views need crawling to be enabled");
+		g_free(itemid);
+		return MAFW_SOURCE_INVALID_BROWSE_ID;
 	}
 
-	/* Convert the internal filter representation to UPnP. */
-	search_criteria = g_string_new(NULL);
-	maffin = mafw_filter_copy(filter);
-	if (internal_filter_to_search_criteria(search_criteria,
-					       maffin,
-					       FALSE,
-					       error) == TRUE)
+	pred = NULL;
+	if (filter != NULL)
 	{
-		str = search_criteria->str;
-
-		/* Don't free the GString's gchar* array -> FALSE */
-		g_string_free(search_criteria, FALSE);
+		pred = predicate_compile(filter, error);
+		if (pred == NULL)
+		{
+			g_free(itemid);
+			return MAFW_SOURCE_INVALID_BROWSE_ID;
+		}
 	}
-	else
-	{
-		str = NULL;
 
-		/* Free also the GString's gchar* array, if any -> TRUE */
-		g_string_free(search_criteria, TRUE);
+	args = mafw_upnp_source_local_start(
+		self, itemid, mdata_keys, skip_count, item_count, browse_cb,
+		page_cb, user_data, (GSourceFunc)mafw_upnp_source_view_idle);
+	if (pred != NULL)
+	{
+		args->predicate = pred;
+		args->local_keys = predicate_get_keys(pred) & ~mdata_keys;
 	}
+	g_debug("Browse %u of view %s", args->browse_id, itemid);
 
-	mafw_filter_free(maffin);
-
-	return str;
+	return args->browse_id;
 }
 
-/*---------------------------------------------------------------------------
-  Browse Arguments
-  ---------------------------------------------------------------------------*/
-
-/** Struct that holds all necessary information for a single browse action */
-struct _BrowseArgs
+/* Metadata keys of MAFW @sort_criteria, 0 if they are malformed. */
+static guint64 mafw_upnp_source_sort_keys(const gchar *sort_criteria)
 {
-	/*-------------------------------------------------------------------
-	  Static parameters passed in mafw_source_browse() call
-	  -------------------------------------------------------------------*/
-
-	/** The particular UPnP server instance that is being browsed */
-	MafwUPnPSource* source;
-
-	/** The UPnP CDS Item ID that is being browsed */
-	gchar* itemid;
-
-	/** Filter string converted to a UPnP search criteria */
-	gchar* search_criteria;
-
-	/** Copied sort criteria string */
-	gchar* sort_criteria;
-
-	/** Requested metadata keys (copied) */
-	guint64 mdata_keys;
-
-	/** Requested metadata keys in a comma-separated string */
-	gchar* meta_keys_csv;
-
-	/** Original skip count */
-	guint skip_count;
-
-	/** Original item count (total number of items the user wants) */
-	guint item_count;
-
-	/** Original requested count (number of items requested at a time) */
-	guint requested_count;
-
-	/** User callback function & its user data */
-	MafwSourceBrowseResultCb callback;
-	gpointer user_data;
+	Sorter *sorter;
+	guint64 keys;
 
-	/*-------------------------------------------------------------------
-	  Run-time parameters
-	  -------------------------------------------------------------------*/
+	sorter = sorter_new(sort_criteria, 1, NULL);
+	if (sorter == NULL)
+		return 0;
 
-	/** The browse/search action associated with these args */
-	GUPnPServiceProxyAction* action;
+	keys = sorter_get_keys(sorter);
+	sorter_free(sorter);
 
-	/** ID of the current browse operation */
-	guint browse_id;
+	return keys;
+}
 
-	/** Number of items remaining to be fetched. */
-	guint remaining_count;
+/* Orders a server may sort strings in: the collation of the locale,
+   plain bytes and bytes of the case folded strings */
+#define SORT_CHECK_ORDERS 3
+
+/* The first sort key of an item of the page */
+typedef struct {
+	gboolean is_number;
+	gint64 number;
+	gchar *strings[SORT_CHECK_ORDERS];
+} SortCheckItem;
+
+/* The items of a page that have a value for the first sort key */
+typedef struct {
+	guint64 keys;
+	const gchar *key;
+	GArray *items;
+} SortCheck;
+
+static void mafw_upnp_source_sort_check_item(GUPnPDIDLLiteParser *parser,
+					     GUPnPDIDLLiteObject *didlobject,
+					     SortCheck *check)
+{
+	GHashTable *metadata;
+	const GValue *value;
+	const gchar *text;
+	SortCheckItem item = { 0 };
+
+	/* Like in mafw_upnp_source_browse_result(), <desc> nodes are no
+	   items */
+	if (gupnp_didl_lite_object_get_id(didlobject) == NULL)
+		return;
 
-	/** Number of items returned by the CDS in response to the request. */
-	guint number_returned;
+	metadata = mafw_upnp_source_compile_metadata(
+		check->keys, didlobject, NULL, NULL, NULL);
+	value = mafw_metadata_first(metadata, check->key);
+	if (value == NULL)
+	{
+		/* Servers put the items without one anywhere */
+	}
+	else if (G_VALUE_HOLDS_STRING(value))
+	{
+		text = g_value_get_string(value);
+		if (text != NULL && *text != '\0')
+		{
+			item.strings[0] = g_utf8_collate_key(text, -1);
+			item.strings[1] = g_strdup(text);
+			item.strings[2] = g_utf8_casefold(text, -1);
+			g_array_append_val(check->items, item);
+		}
+	}
+	else if (G_VALUE_HOLDS_INT(value) || G_VALUE_HOLDS_LONG(value) ||
+		 G_VALUE_HOLDS_INT64(value))
+	{
+		item.is_number = TRUE;
+		item.number = G_VALUE_HOLDS_INT(value)
+			? g_value_get_int(value)
+			: G_VALUE_HOLDS_LONG(value)
+			? g_value_get_long(value)
+			: g_value_get_int64(value);
+		g_array_append_val(check->items, item);
+	}
+	g_hash_table_unref(metadata);
+}
 
-	/** Total number of items in the container currently browsed. */
-	guint total_matches;
+/* Returns: %TRUE if @items are in the @order of strings, ascending if
+   @direction is 1 or descending if it is -1. */
+static gboolean mafw_upnp_source_sort_check_order(GArray *items, guint order,
+						  gint direction)
+{
+	SortCheckItem *a, *b;
+	gint cmp;
+	guint i;
 
-	/** Index of the next emitted item */
-	guint current;
+	for (i = 1; i < items->len; i++)
+	{
+		a = &g_array_index(items, SortCheckItem, i - 1);
+		b = &g_array_index(items, SortCheckItem, i);
+		if (a->is_number != b->is_number)
+			continue;
+		if (a->is_number)
+			cmp = a->number < b->number ? -1
+				: a->number > b->number;
+		else
+			cmp = strcmp(a->strings[order], b->strings[order]);
+		if (cmp * direction > 0)
+			return FALSE;
+	}
 
-	/** Reference count */
-	guint refcount;
-};
+	return TRUE;
+}
 
 /**
- * Increase BrowseArgs* reference count. Reference counting is needed because
- * this source sends results back to the user in multiple idle callbacks.
+ * mafw_upnp_source_sort_check:
+ * @args: #BrowseArgs* of a browse sorted by the server
+ * @didl: A page of its results
+ *
+ * Each server sorts with a collation of its own, and puts the items
+ * without a value where it likes.  Only a page that is in no order of
+ * the first sort key, ascending or descending, by any of the usual
+ * collations was clearly not sorted.
+ *
+ * Returns: %FALSE if @didl was clearly not sorted.
  */
-static BrowseArgs* browse_args_ref(BrowseArgs* args)
+static gboolean mafw_upnp_source_sort_check(BrowseArgs *args,
+					    const gchar *didl)
 {
-	g_assert(args != NULL);
+	SortCheck check;
+	Sorter *sorter;
+	gboolean sorted = FALSE;
+	guint order, i;
+	gulong id;
+
+	sorter = sorter_new(args->mafw_sort_criteria, 1, NULL);
+	if (sorter == NULL)
+		return TRUE;
+	check.keys = sorter_get_keys(sorter);
+	check.key = sorter_get_sort_keys(sorter)[0];
+	check.items = g_array_new(FALSE, FALSE, sizeof(SortCheckItem));
+
+	id = g_signal_connect(parser, "object-available",
+			      (GCallback)mafw_upnp_source_sort_check_item,
+			      &check);
+	gupnp_didl_lite_parser_parse_didl(parser, didl, NULL);
+	g_signal_handler_disconnect(parser, id);
+
+	for (order = 0; order < SORT_CHECK_ORDERS && !sorted; order++)
+		sorted = mafw_upnp_source_sort_check_order(check.items,
+							   order, 1) ||
+			mafw_upnp_source_sort_check_order(check.items,
+							  order, -1);
+
+	for (i = 0; i < check.items->len; i++)
+		for (order = 0; order < SORT_CHECK_ORDERS; order++)
+			g_free(g_array_index(check.items, SortCheckItem,
+					     i).strings[order]);
+	g_array_free(check.items, TRUE);
+	sorter_free(sorter);
+
+	return sorted;
+}
 
-	if (++args->refcount == 1)
+/* Browses @args again from the start, to be sorted here. */
+static gboolean mafw_upnp_source_sort_restart(BrowseArgs *args)
+{
+	if (!mafw_upnp_source_sort_locally(args, args->mafw_sort_criteria))
+		return FALSE;
+
+	g_free(args->meta_keys_csv);
+	args->meta_keys_csv = mafw_upnp_source_browse_filter(
+		args->mdata_keys | args->local_keys);
+	args->remaining_count = UINT_MAX;
+	args->action = mafw_upnp_source_browse_internal(args);
+	if (args->action == NULL)
 	{
-		/* Take only one reference to the source object */
-		g_object_ref(args->source);
+		browse_args_unref(args, NULL);
+		return FALSE;
 	}
 
-	return args;
+	return TRUE;
 }
 
 /**
- * Decrease BrowseArgs* reference count. See browse_args_ref() for reasons.
+ * mafw_upnp_source_sort_retry:
+ * @args:  #BrowseArgs* of a browse that failed
+ * @error: Why it failed
+ *
+ * Browses again to sort here if the server refused the sort criteria
+ * before any results.
+ *
+ * Returns: %TRUE if @args goes on.
  */
-static void browse_args_unref(BrowseArgs* args, GError *err)
+static gboolean mafw_upnp_source_sort_retry(BrowseArgs *args,
+					    const GError *error)
 {
-	g_assert(args != NULL && args->refcount > 0);
-
-	if (--args->refcount == 0)
-	{
-		/* Remove the browse ID and this args struct from our list
-		   of cancellable browse operations */
-		if (g_tree_remove(args->source->priv->browses,
-				  GUINT_TO_POINTER(args->browse_id)) == FALSE)
-		{
-			g_assert_not_reached();
-		}
-
-		/* If remaining count > 0, then the action was probably
-		   cancelled, so we must send the final result indicating EOF.
-		*/
-		if (args->remaining_count > 0)
-		{
-			args->callback(MAFW_SOURCE(args->source),
-				       args->browse_id, 0, 0, NULL, NULL,
-				       args->user_data, err);
-		}
+	if (error == NULL || error->domain != GUPNP_CONTROL_ERROR ||
+	    error->code != CDS_ERROR_UNSUPPORTED_SORT ||
+	    args->current != 0 || args->sorter != NULL ||
+	    args->mafw_sort_criteria == NULL)
+		return FALSE;
 
-		g_object_unref(args->source);
-		g_free(args->itemid);
-		g_free(args->search_criteria);
-		g_free(args->sort_criteria);
-		g_free(args->meta_keys_csv);
-		g_free(args);
-	}
+	return mafw_upnp_source_sort_restart(args);
 }
 
-/*----------------------------------------------------------------------------
-  Browse
-  ----------------------------------------------------------------------------*/
-
 /**
- * mafw_upnp_source_browse_result:
- * @parser:    The DIDL-Lite parser object that is parsing browse results
- * @didl_node: A single DIDL-Lite object (item/container) node
- * @user_data: #BrowseArgs*
+ * mafw_upnp_source_sort_ignored:
+ * @args: #BrowseArgs* of a browse that got its first page
+ * @didl: The page
  *
- * Parses each item/container from a successful browse action, one by one
- * (decided by the #GUPnPDIDLLiteParser). Then, returns the results for the
- * whole set in one go using the user-given callback function.
+ * Some servers take sort criteria they cannot sort by and return the items
+ * in their own order.  Browses again to sort here if the first page the
+ * server was to sort is out of order.
+ *
+ * Returns: %TRUE if @didl was dropped for the browse again.
  */
-static void mafw_upnp_source_browse_result(GUPnPDIDLLiteParser* parser,
-					   GUPnPDIDLLiteObject* didlobject,
-					   BrowseArgs* args)
+static gboolean mafw_upnp_source_sort_ignored(BrowseArgs *args,
+					      const gchar *didl)
 {
-	GHashTable* metadata;
-	gchar* objectid;
-	gint current;
+	GError *error = NULL;
 
-	g_assert(args != NULL);
-	g_assert(args->callback != NULL);
-	g_return_if_fail(args->remaining_count > 0);
+	if (args->current != 0 || args->sorter != NULL ||
+	    args->mafw_sort_criteria == NULL || args->number_returned < 2 ||
+	    mafw_upnp_source_sort_check(args, didl))
+		return FALSE;
 
-	/* Create a MAFW-style object ID for this item node. If an
-	   ID cannot be found, this node might be a <desc> node, which
-	   can be skipped with good conscience. */
-	objectid = util_create_objectid(args->source, didlobject);
+	g_debug("Server ignored the sort criteria of browse %u",
+		args->browse_id);
+	if (mafw_upnp_source_sort_restart(args))
+		return TRUE;
 
-	/* If there was no object ID, this node might be a <desc> node
-	   which must not be exposed to the user and thus not counted
-	   in skip_count, either. */
-	if (objectid == NULL)
+	/* Half way to sorting here, the page cannot be used as it is */
+	g_set_error(&error, MAFW_SOURCE_ERROR, MAFW_SOURCE_ERROR_PEER,
+		    "Unable to initiate browse.");
+	if (args->remaining_count > 0)
 	{
-		return;
+		mafw_upnp_source_browse_emit(args, 0, 0, NULL, NULL, error);
+		args->remaining_count = 0;
 	}
+	g_error_free(error);
 
-	/* Gather requested metadata information from DIDL-Lite */
-	metadata = mafw_upnp_source_compile_metadata(args->mdata_keys,
-						     didlobject,
-						     NULL);
-
-	/* Calculate remaining count and current item's index. */
-	current = args->current++;
-	args->remaining_count--;
-	/* Emit results */
-	args->callback(MAFW_SOURCE(args->source),
-		       args->browse_id,
-		       args->remaining_count,
-		       current,
-		       objectid,
-		       metadata,
-		       args->user_data,
-		       NULL);
-	
-	/* Free the compiled metadata and MAFW-style object ID */
-	g_hash_table_unref(metadata);
-	g_free(objectid);
+	return TRUE;
 }
 
 /**
@@ -1421,13 +4712,17 @@ static void mafw_upnp_source_browse_cb(GUPnPServiceProxy* service,
 	GError* gupnp_error = NULL;
 	gboolean result = FALSE;
 	gchar* didl = NULL;
+	ServerProfile *profile;
 
 	g_assert(args != NULL);
+	profile = args->source->priv->profile;
 
 	/* This action was completed, remove it from args because it cannot be
 	   cancelled anymore, since this function runs all the way thru the
-	   returned set of results and returns to main loop after it's done. */
+	   returned set of results and returns to main loop after it's done.
+	   Late comers would miss the results, they cannot join anymore. */
 	args->action = NULL;
+	args->joinable = FALSE;
 
 	/* Parse the action result and number of items returned in this set */
 	result = gupnp_service_proxy_end_action(
@@ -1436,6 +4731,10 @@ static void mafw_upnp_source_browse_cb(GUPnPServiceProxy* service,
 		"NumberReturned", G_TYPE_UINT,   &args->number_returned,
 		"TotalMatches",   G_TYPE_UINT,   &args->total_matches,
 		NULL);
+	if (result)
+		server_profile_add_latency(
+			profile,
+			(g_get_monotonic_time() - args->sent_at) / 1000);
 
 	g_debug("CDS server with UUID [%s] browse result consists of:"
 		"\tNumberReturned: %d\n"
@@ -1453,7 +4752,17 @@ static void mafw_upnp_source_browse_cb(GUPnPServiceProxy* service,
 			args->remaining_count =	args->item_count;
 		}
 	}
-	if (result == FALSE || didl == NULL || args->total_matches == 0)
+	if (!result && mafw_upnp_source_sort_retry(args, gupnp_error))
+	{
+		/* Refused to sort, going on unsorted */
+		g_error_free(gupnp_error);
+	}
+	else if (result && didl != NULL &&
+		 mafw_upnp_source_sort_ignored(args, didl))
+	{
+		/* Did not sort either, going on unsorted */
+	}
+	else if (result == FALSE || didl == NULL || args->total_matches == 0)
 	{
 		/* Action failed completely, no results. */
 		GError* error = NULL;
@@ -1468,17 +4777,26 @@ static void mafw_upnp_source_browse_cb(GUPnPServiceProxy* service,
 				    MAFW_SOURCE_ERROR,
 				    MAFW_SOURCE_ERROR_BROWSE_RESULT_FAILED,
 				    "Action failed: %s", gupnp_error->message);
+			if (mafw_upnp_source_error_is_permanent(gupnp_error))
+				neg_cache_add(args->source->priv->negative,
+					      args->search_criteria != NULL ?
+					      "Search" : "BrowseDirectChildren",
+					      args->itemid, error);
 			g_error_free(gupnp_error);
 		}
 
+		/* An empty container is worth caching, too */
+		if (result && error == NULL && didl != NULL &&
+		    args->record != NULL)
+			mafw_upnp_source_catalog_store(args);
+
 		/* Call the callback function with invalid values and an error.
 		 * Zero out remaining_count, otherwise browse_args_unref()
 		 * will try to terminate the session again. */
 		if (args->remaining_count > 0)
 		{
-			args->callback(MAFW_SOURCE(args->source),
-				       args->browse_id, 0, 0, NULL, NULL,
-				       args->user_data, error);
+			mafw_upnp_source_browse_emit(args, 0, 0, NULL, NULL,
+						     error);
 			args->remaining_count = 0;
 		}
 
@@ -1491,6 +4809,11 @@ static void mafw_upnp_source_browse_cb(GUPnPServiceProxy* service,
 		gboolean parser_return;
 		guint object_signal_id;
 		
+		if (args->scratch == NULL)
+			args->scratch = page_scratch_new(
+				mafw_extension_get_uuid(
+					MAFW_EXTENSION(args->source)));
+
 		object_signal_id = g_signal_connect(parser, "object-available",
 					(GCallback)mafw_upnp_source_browse_result,
 					args);
@@ -1501,6 +4824,17 @@ static void mafw_upnp_source_browse_cb(GUPnPServiceProxy* service,
 			didl,
 			&gupnp_error);
 		g_signal_handler_disconnect(parser, object_signal_id);
+		page_scratch_reset(args->scratch);
+		if (args->page != NULL && parser_return && gupnp_error == NULL)
+			mafw_upnp_source_emit_page(args);
+		if (args->short_page != 0)
+		{
+			server_profile_short_page(profile,
+						  args->short_requested,
+						  args->short_page,
+						  args->number_returned == 0);
+			args->short_page = 0;
+		}
 		if (!parser_return || gupnp_error != NULL)
 		{
 			/* DIDL-Lite parsing failed */
@@ -1528,9 +4862,8 @@ static void mafw_upnp_source_browse_cb(GUPnPServiceProxy* service,
 					g_warning("DIDL-Lite parsing failed."
 					  "Terminating browse session.");
 
-				args->callback(MAFW_SOURCE(args->source),
-					       args->browse_id, 0, 0, NULL, NULL,
-					       args->user_data, error);
+				mafw_upnp_source_browse_emit(args, 0, 0, NULL,
+							     NULL, error);
 				args->remaining_count = 0;
 			}
 
@@ -1540,13 +4873,25 @@ static void mafw_upnp_source_browse_cb(GUPnPServiceProxy* service,
 		}
 		/* Continue incremental browse only, if:
 		 * 1. There are items left in the server to browse
-		 * (2. The server returned at least requested_count items)
+		 * 2. The server returned at least requested_count items, or
+		 *    is not known to end with a short page
 		 * 3. All items were requested, or
 		 * 4. the next skip_count won't go beyond the requested count
 		 */
 		else if (args->remaining_count == 0)
 		{
 			/* There are no more items left to browse. Stop. */
+			if (args->record != NULL)
+				mafw_upnp_source_catalog_store(args);
+			/* Only a short page ending where TotalMatches said
+			   shows the server ran out there, a full one may as
+			   well have been cut by the client's count */
+			if (args->number_returned < args->requested_count &&
+			    args->skip_count + args->current ==
+			    args->total_matches)
+				server_profile_total_matches(profile, TRUE);
+			if (args->sorter != NULL)
+				mafw_upnp_source_sort_start(args);
 		}
 		/* This happens when no result was obtained in the browse operation.
 		   In  this case, mafw_upnp_source_browse_result is not invoked,
@@ -1554,20 +4899,34 @@ static void mafw_upnp_source_browse_cb(GUPnPServiceProxy* service,
 		   INT_MAX) and the user callback was never invoked */
 		else if (args->number_returned == 0)
 		{
-			args->callback(MAFW_SOURCE(args->source),
-				       args->browse_id, 0, 0, NULL, NULL,
-				       args->user_data, NULL);
+			/* TotalMatches promised more */
+			server_profile_total_matches(profile, FALSE);
+			if (args->sorter != NULL)
+				mafw_upnp_source_sort_start(args);
+			else
+				mafw_upnp_source_browse_emit(args, 0, 0, NULL,
+							     NULL, NULL);
 		}
-#if 0
-		/* Uncommenting this makes DLNA CTT 7.3.64.10 fail, but this
-		   commented version might produce other problems... */
-		else if (args->number_returned < args->requested_count)
+		/* Stopping at every short page makes DLNA CTT 7.3.64.10 fail,
+		   so only with the servers known to end with one, and not at
+		   a page the server may have capped. */
+		else if (args->number_returned < args->requested_count &&
+			 server_profile_total_matches_reliable(profile) !=
+			 PROFILE_YES &&
+			 server_profile_short_page_is_end(
+				 profile, args->number_returned))
 		{
 			/* The latest browse returned less items than what
-			   was requested. It is quite likely that we got all
-			   of them. Stop. */
+			   was requested, and TotalMatches cannot be trusted
+			   to tell the end.  Stop without asking for an
+			   empty page. */
+			args->remaining_count = 0;
+			if (args->sorter != NULL)
+				mafw_upnp_source_sort_start(args);
+			else
+				mafw_upnp_source_browse_emit(args, 0, 0, NULL,
+							     NULL, NULL);
 		}
-#endif
 		else if (args->item_count != 0 &&
 			 args->current >= (args->item_count - 1))
 		{
@@ -1576,9 +4935,16 @@ static void mafw_upnp_source_browse_cb(GUPnPServiceProxy* service,
 		}
 		else
 		{
-			/* Browse the next increment. */
+			/* Browse the next increment, and learn from it
+			   whether this page was capped or the last one. */
+			if (args->number_returned < args->requested_count)
+			{
+				args->short_page = args->number_returned;
+				args->short_requested = args->requested_count;
+			}
 			args->action = mafw_upnp_source_browse_internal(args);
 		}
+		server_profile_page(profile, args->number_returned);
 	}
 
 	g_free(didl);
@@ -1590,6 +4956,7 @@ static GUPnPServiceProxyAction* mafw_upnp_source_browse_internal(
 {
 	GUPnPServiceProxyAction *action;
 	gint skip_count;
+	guint page_size;
 
 	g_assert(args != NULL);
 
@@ -1597,18 +4964,21 @@ static GUPnPServiceProxyAction* mafw_upnp_source_browse_internal(
 
 	skip_count = args->skip_count + args->current;
 
+	/* Pages no bigger than the server gives at a time */
+	page_size = server_profile_get_page_size(args->source->priv->profile,
+						 DEFAULT_REQUESTED_COUNT);
 	if (args->item_count == 0)
 	{
 		/* All items were requested by the user. Get default amount. */
-		args->requested_count = DEFAULT_REQUESTED_COUNT;
+		args->requested_count = page_size;
 	}
 	else
 	{
 		/* A specific number of items was requested by the user.
 		   Choose the smaller value between DEFAULT and items left. */
-		args->requested_count = MIN(DEFAULT_REQUESTED_COUNT,
-					    args->item_count);
+		args->requested_count = MIN(page_size, args->item_count);
 	}
+	args->sent_at = g_get_monotonic_time();
 
 	g_debug("Browse increment: %s\n\tSkip: %d -- Count: %d\n",
 		args->itemid, skip_count, args->requested_count);
@@ -1699,32 +5069,105 @@ static gchar* mafw_sort_criteria_to_upnp(const gchar* mafw_sc)
 }
 
 /**
- * See mafw_source_browse() for more information.
+ * mafw_upnp_source_browse_filter:
+ *
+ * Returns: The UPnP filter for a browse of @mdata_keys.  The update IDs of
+ * the child containers are always asked, for the update tracking.
  */
-static guint mafw_upnp_source_browse(MafwSource *source,
-				      const gchar *object_id,
-				      gboolean recursive,
-				      const MafwFilter *filter,
-				      const gchar *sort_criteria,
-				      const gchar *const *metadata_keys,
-				      guint skip_count,
-				      guint item_count,
-				      MafwSourceBrowseResultCb browse_cb,
-				      gpointer user_data)
+static gchar *mafw_upnp_source_browse_filter(guint64 mdata_keys)
+{
+	gchar *filter;
+	gchar *with_ids;
+
+	filter = util_mafwkey_array_to_upnp_filter(mdata_keys);
+	if (strcmp(filter, "*") == 0)
+		return filter;
+
+	with_ids = g_strconcat(filter, *filter != '\0' ? "," : "",
+			       CONTAINER_UPDATE_ID_FILTER, NULL);
+	g_free(filter);
+
+	return with_ids;
+}
+
+/**
+ * mafw_upnp_source_browse_report:
+ *
+ * Reports an error of a browse that could not be started to whichever
+ * callback was given.
+ */
+static void mafw_upnp_source_browse_report(MafwUPnPSource *self,
+					   MafwSourceBrowseResultCb browse_cb,
+					   MafwUPnPSourcePageCb page_cb,
+					   gpointer user_data,
+					   const GError *error)
+{
+	if (page_cb != NULL)
+		page_cb(self, MAFW_SOURCE_INVALID_BROWSE_ID, NULL, 0,
+			user_data, error);
+	else if (browse_cb != NULL)
+		browse_cb(MAFW_SOURCE(self), MAFW_SOURCE_INVALID_BROWSE_ID,
+			  0, 0, NULL, NULL, user_data, error);
+}
+
+/**
+ * mafw_upnp_source_error_is_permanent:
+ * @error: Error from a CDS action
+ *
+ * Tells the failures that will not go away by asking again until the
+ * content of the server changes, those worth remembering in the negative
+ * result cache.
+ *
+ * Returns: %TRUE if @error says the object does not exist.
+ */
+static gboolean mafw_upnp_source_error_is_permanent(const GError *error)
+{
+	return error->domain == GUPNP_CONTROL_ERROR &&
+		(error->code == CDS_ERROR_NO_SUCH_OBJECT ||
+		 error->code == CDS_ERROR_NO_SUCH_CONTAINER);
+}
+
+/**
+ * mafw_upnp_source_browse_start:
+ * @recursive: Whether a filter is to reach below the direct children.
+ *             Servers that cannot search by the filter fail such a browse.
+ * @page_cb: If not %NULL, results are delivered as #ColumnPage<!-- -->s to
+ *           @page_cb instead of item by item to @browse_cb.
+ * @use_catalog: Whether the results may come from the catalog cache.
+ *
+ * Common part of mafw_upnp_source_browse() and
+ * mafw_upnp_source_browse_pages().
+ */
+static guint mafw_upnp_source_browse_start(MafwUPnPSource *self,
+					   const gchar *object_id,
+					   gboolean recursive,
+					   const MafwFilter *filter,
+					   const gchar *sort_criteria,
+					   guint64 mdata_keys,
+					   guint skip_count,
+					   guint item_count,
+					   MafwSourceBrowseResultCb browse_cb,
+					   MafwUPnPSourcePageCb page_cb,
+					   gpointer user_data,
+					   gboolean use_catalog)
 {
 	GUPnPServiceProxyAction* action;
-	MafwUPnPSource* self;
 	BrowseArgs* args;
 	gchar* upsc;
+	Predicate *pred;
 	gchar* upnp_sort_criteria;
-	/* const gchar* const* meta_keys; */
 	gchar* itemid;
 	GError *error = NULL;
+	Catalog *catalog;
+	CatalogEntry entry;
+	gboolean cached;
+	gboolean sort_locally;
+	TextIndexGrouping grouping;
+	const gchar *label;
+	guint browse_id;
 
-	self = MAFW_UPNP_SOURCE(source);
 	g_assert(self != NULL);
-	g_assert(browse_cb != NULL);
-
+	g_assert(browse_cb != NULL || page_cb != NULL);
 
 	/* Split the object ID to get the item part, after "::" */
 	itemid = NULL;
@@ -1732,28 +5175,90 @@ static guint mafw_upnp_source_browse(MafwSource *source,
 	if (itemid == NULL || strlen(itemid) == 0)
 		itemid = g_strdup("0");
 
-	/* Construct the UPnP SearchCriteria if $filter is specified. */
-	if (filter == NULL)
+	/* The views are made here of what the crawl has seen */
+	if (mafw_upnp_source_parse_view(itemid, &grouping, &label))
 	{
-		upsc = NULL;
-	}
-	else
-	{
-		upsc = mafw_upnp_source_filter_to_search_criteria(filter,
-								   &error);
-		if (upsc == NULL)
+		browse_id = mafw_upnp_source_view_browse(self, itemid, filter,
+							 mdata_keys,
+							 skip_count,
+							 item_count,
+							 browse_cb, page_cb,
+							 user_data, &error);
+		if (error != NULL)
 		{
-			g_debug("Wrong filter");
-			if (browse_cb)
-			{
-				browse_cb(source, MAFW_SOURCE_INVALID_BROWSE_ID,
-						0, 0, NULL,
-						NULL, user_data, error);
-			}
+			mafw_upnp_source_browse_report(self, browse_cb,
+						       page_cb, user_data,
+						       error);
 			g_error_free(error);
-			g_free(itemid);
-			return MAFW_SOURCE_INVALID_BROWSE_ID;
 		}
+		return browse_id;
+	}
+
+	/* Substring searches of the whole server need not bother it once
+	   every item is indexed */
+	if (use_catalog && filter != NULL && strcmp(itemid, "0") == 0 &&
+	    (sort_criteria == NULL || *sort_criteria == '\0') &&
+	    (mdata_keys & ~TEXT_INDEX_KEYS) == 0 &&
+	    self->priv->text_index != NULL &&
+	    text_index_is_complete(self->priv->text_index) &&
+	    text_index_can_search(filter))
+	{
+		g_free(itemid);
+		return mafw_upnp_source_index_browse(self, filter, mdata_keys,
+						     skip_count, item_count,
+						     browse_cb, page_cb,
+						     user_data);
+	}
+
+	/* Construct the UPnP SearchCriteria if $filter is specified.
+	   A filter the server cannot search by is evaluated here instead,
+	   on the direct children of the container. */
+	upsc = NULL;
+	pred = NULL;
+	if (filter != NULL &&
+	    mafw_upnp_source_can_search_filter(self->priv->profile, filter))
+	{
+		upsc = mafw_upnp_source_filter_to_search_criteria(
+			self, filter, &error);
+	}
+	else if (filter != NULL && recursive)
+	{
+		/* Filtering the direct children here would come up short
+		   without saying so */
+		g_set_error(&error, MAFW_SOURCE_ERROR,
+			    MAFW_SOURCE_ERROR_INVALID_SEARCH_STRING,
+			    "Server cannot search by the filter");
+	}
+	else if (filter != NULL)
+	{
+		g_debug("Server cannot search by the filter, filtering "
+			"locally");
+		pred = predicate_compile(filter, &error);
+	}
+	if (error != NULL)
+	{
+		g_debug("Wrong filter");
+		mafw_upnp_source_browse_report(self, browse_cb, page_cb,
+					       user_data, error);
+		g_error_free(error);
+		g_free(itemid);
+		return MAFW_SOURCE_INVALID_BROWSE_ID;
+	}
+
+	/* Do not ask again about a container that was just found missing */
+	if (neg_cache_lookup(self->priv->negative,
+			     upsc != NULL ? "Search" : "BrowseDirectChildren",
+			     itemid, &error))
+	{
+		g_debug("Browse of %s failed recently: %s", object_id,
+			error->message);
+		mafw_upnp_source_browse_report(self, browse_cb, page_cb,
+					       user_data, error);
+		g_error_free(error);
+		g_free(upsc);
+		predicate_free(pred);
+		g_free(itemid);
+		return MAFW_SOURCE_INVALID_BROWSE_ID;
 	}
 
 	/* Convert Mafw sort criteria to UPnP style. If there is no sort
@@ -1763,6 +5268,37 @@ static guint mafw_upnp_source_browse(MafwSource *source,
 	if (upnp_sort_criteria == NULL)
 		upnp_sort_criteria = g_strdup("");
 
+	/* Do not push down what the server is known not to do, sort
+	   here instead */
+	sort_locally = *upnp_sort_criteria != '\0' &&
+		!server_profile_can_sort(self->priv->profile,
+					 upnp_sort_criteria);
+
+	/* Only plain browses in server order are cached, and only with the
+	   metadata keys the catalog keeps */
+	catalog = self->priv->catalog;
+	if (catalog != NULL &&
+	    (upsc != NULL || pred != NULL || *upnp_sort_criteria != '\0'))
+		catalog = NULL;
+	cached = catalog != NULL && use_catalog &&
+		(mdata_keys & ~CATALOG_KEYS) == 0 &&
+		catalog_lookup(catalog, itemid, &entry);
+	if (!cached && self->priv->offline)
+	{
+		g_set_error(&error, MAFW_SOURCE_ERROR,
+			    MAFW_SOURCE_ERROR_PEER,
+			    "Server is offline and %s is not cached",
+			    object_id);
+		mafw_upnp_source_browse_report(self, browse_cb, page_cb,
+					       user_data, error);
+		g_error_free(error);
+		g_free(upsc);
+		predicate_free(pred);
+		g_free(upnp_sort_criteria);
+		g_free(itemid);
+		return MAFW_SOURCE_INVALID_BROWSE_ID;
+	}
+
 	/*
 	 * Register the current browseid now.  This is necessary because
 	 * gupnp_service_proxy_begin_action() may smartly call the callback
@@ -1782,33 +5318,54 @@ static guint mafw_upnp_source_browse(MafwSource *source,
 	args->itemid = itemid; /* Already strdupped */
 	args->search_criteria = upsc;
 	args->sort_criteria = upnp_sort_criteria;
-
-	if (metadata_keys == NULL)
+	args->mdata_keys = mdata_keys;
+	args->skip_count = skip_count;
+	args->item_count = item_count;
+	if (pred != NULL)
 	{
-		metadata_keys = MAFW_SOURCE_NO_KEYS;
+		/* The client counts the items passing the filter, only the
+		   whole container can tell which ones they are */
+		args->predicate = pred;
+		args->local = TRUE;
+		args->local_keys = predicate_get_keys(pred) &
+			~args->mdata_keys;
+		args->local_skip = skip_count;
+		args->local_count = item_count;
+		args->skip_count = 0;
+		args->item_count = 0;
 	}
-
-	/* If metadata_keys is empty (but not NULL), or it contains an asterisk,
-	   it means that ALL metadata keys are being requested */
-	if (metadata_keys != NULL && metadata_keys[0] != NULL &&
-	    strcmp(MAFW_SOURCE_ALL_KEYS[0], metadata_keys[0]) == 0)
+	if (*upnp_sort_criteria != '\0')
+	{
+		if (!sort_locally)
+		{
+			/* The sort keys come along to check the order */
+			args->mafw_sort_criteria = g_strdup(sort_criteria);
+			args->local_keys |= mafw_upnp_source_sort_keys(
+				sort_criteria) & ~args->mdata_keys;
+		}
+		else if (!mafw_upnp_source_sort_locally(args, sort_criteria))
+			args->sort_criteria[0] = '\0';
+	}
+	args->meta_keys_csv = mafw_upnp_source_browse_filter(
+		args->mdata_keys | args->local_keys);
+	if (page_cb != NULL)
 	{
-		args->mdata_keys = G_MAXUINT64;
-		/* meta_keys = MAFW_SOURCE_LIST(KNOWN_METADATA_KEYS); */
+		args->page = column_page_new(0);
+		args->page_cb = page_cb;
+		args->page_user_data = user_data;
+		args->callback = mafw_upnp_source_page_end_cb;
+		args->user_data = args;
 	}
 	else
 	{
-		args->mdata_keys = util_compile_mdata_keys(metadata_keys);
-		/* meta_keys = metadata_keys; */
+		args->callback = browse_cb;
+		args->user_data = user_data;
 	}
-
-	args->meta_keys_csv = util_mafwkey_array_to_upnp_filter(args->mdata_keys);
-	args->skip_count = skip_count;
-	args->item_count = item_count;
-	args->callback = browse_cb;
-	args->user_data = user_data;
 	args->browse_id = _plugin->next_browse_id;
 	args->remaining_count = UINT_MAX;
+	if (catalog != NULL && skip_count == 0 && item_count == 0 &&
+	    (mdata_keys & CATALOG_KEYS) == CATALOG_KEYS)
+		args->record = column_page_new(0);
 
 	g_debug("Browse: %s\n"
 		"\tID: %u\n"
@@ -1818,21 +5375,45 @@ static guint mafw_upnp_source_browse(MafwSource *source,
 		object_id, args->browse_id, args->meta_keys_csv,
 		args->sort_criteria, args->search_criteria);
 
-	/* Invoke the browse action on the given object (container) id */
+	if (!cached && page_cb == NULL && mafw_upnp_source_browse_join(args))
+	{
+		/* Results come with those of an identical browse */
+		column_page_free(args->record);
+		args->record = NULL;
+		browse_args_ref(args);
+		g_tree_insert(self->priv->browses,
+			      GUINT_TO_POINTER(_plugin->next_browse_id), args);
+		return _plugin->next_browse_id++;
+	}
+
+	if (cached)
+	{
+		/* Answer from the catalog, but asynchronously like the
+		   server would */
+		g_debug("Browse %u served from the catalog", args->browse_id);
+		column_page_free(args->record);
+		args->record = NULL;
+		browse_args_ref(args);
+		args->idle_id = g_idle_add(
+			(GSourceFunc)mafw_upnp_source_catalog_idle, args);
+		g_tree_insert(self->priv->browses,
+			      GUINT_TO_POINTER(_plugin->next_browse_id), args);
+		return _plugin->next_browse_id++;
+	}
+
+	/* Invoke the browse action on the given object (container) id.
+	   Identical browses may join until the first results come. */
+	args->joinable = page_cb == NULL;
 	action = mafw_upnp_source_browse_internal(args);
 	if (action == NULL)
 	{
 		g_warning("Unable to initiate browse. Terminating session.");
-		if (browse_cb)
-		{
-			g_set_error(&error, MAFW_SOURCE_ERROR,
-				MAFW_SOURCE_ERROR_PEER,
-				"Unable to initiate browse.");
-			browse_cb(source, MAFW_SOURCE_INVALID_BROWSE_ID,
-					0, 0, NULL,
-					NULL, user_data, error);
-			g_error_free(error);
-		}
+		g_set_error(&error, MAFW_SOURCE_ERROR,
+			MAFW_SOURCE_ERROR_PEER,
+			"Unable to initiate browse.");
+		mafw_upnp_source_browse_report(self, browse_cb, page_cb,
+					       user_data, error);
+		g_error_free(error);
 
 		/* Action invocation failed before it even begun */
 		browse_args_unref(args, NULL);
@@ -1852,11 +5433,108 @@ static guint mafw_upnp_source_browse(MafwSource *source,
 	}
 }
 
+/**
+ * See mafw_source_browse() for more information.
+ */
+static guint mafw_upnp_source_browse(MafwSource *source,
+				      const gchar *object_id,
+				      gboolean recursive,
+				      const MafwFilter *filter,
+				      const gchar *sort_criteria,
+				      const gchar *const *metadata_keys,
+				      guint skip_count,
+				      guint item_count,
+				      MafwSourceBrowseResultCb browse_cb,
+				      gpointer user_data)
+{
+	guint64 mdata_keys;
+
+	g_assert(browse_cb != NULL);
+
+	if (metadata_keys == NULL)
+	{
+		metadata_keys = MAFW_SOURCE_NO_KEYS;
+	}
+
+	/* If metadata_keys is empty (but not NULL), or it contains an asterisk,
+	   it means that ALL metadata keys are being requested */
+	if (metadata_keys != NULL && metadata_keys[0] != NULL &&
+	    strcmp(MAFW_SOURCE_ALL_KEYS[0], metadata_keys[0]) == 0)
+	{
+		mdata_keys = G_MAXUINT64;
+	}
+	else
+	{
+		mdata_keys = util_compile_mdata_keys(metadata_keys);
+	}
+
+	return mafw_upnp_source_browse_start(MAFW_UPNP_SOURCE(source),
+					     object_id, recursive, filter,
+					     sort_criteria, mdata_keys,
+					     skip_count, item_count,
+					     browse_cb, NULL, user_data, TRUE);
+}
+
+/**
+ * mafw_upnp_source_browse_pages:
+ * @self:          A #MafwUPnPSource
+ * @object_id:     The container to browse
+ * @filter:        Optional filter, as for mafw_source_browse()
+ * @sort_criteria: Optional sort criteria, as for mafw_source_browse()
+ * @skip_count:    Number of items to skip
+ * @item_count:    Number of items wanted, 0 for all
+ * @page_cb:       Receives the results one #ColumnPage at a time
+ * @user_data:     Data for @page_cb
+ *
+ * Like mafw_source_browse(), but for bulk consumers: results come in
+ * column-oriented pages holding the object ID, title, artist, album, URI,
+ * MIME type and duration of each item, without a metadata hash table per
+ * item.  @page_cb owns the pages it gets and frees them with
+ * column_page_free().  The last call has a remaining count of 0; it has no
+ * page if the browse ended early or failed.  Browses are cancelled with mafw_source_cancel_browse().
+ *
+ * Returns: The browse ID, or %MAFW_SOURCE_INVALID_BROWSE_ID.
+ */
+guint mafw_upnp_source_browse_pages(MafwUPnPSource *self,
+				    const gchar *object_id,
+				    const MafwFilter *filter,
+				    const gchar *sort_criteria,
+				    guint skip_count,
+				    guint item_count,
+				    MafwUPnPSourcePageCb page_cb,
+				    gpointer user_data)
+{
+	g_return_val_if_fail(MAFW_IS_UPNP_SOURCE(self),
+			     MAFW_SOURCE_INVALID_BROWSE_ID);
+	g_return_val_if_fail(page_cb != NULL, MAFW_SOURCE_INVALID_BROWSE_ID);
+
+	return mafw_upnp_source_browse_start(self, object_id, FALSE, filter,
+					     sort_criteria, CATALOG_KEYS,
+					     skip_count, item_count,
+					     NULL, page_cb, user_data, TRUE);
+}
+
 static void _cancel_request(MafwUPnPSourcePrivate *priv, BrowseArgs *args, GError *err)
 {
 	g_assert(args != NULL);
 
-	if (args->action != NULL)
+	if (args->leader != NULL)
+	{
+		/* Following an identical browse */
+		mafw_upnp_source_browse_leave(args, err);
+	}
+	else if (args->followers != NULL)
+	{
+		/* Others still want the results, only this client goes */
+		if (!args->detached)
+		{
+			args->detached = TRUE;
+			args->callback(MAFW_SOURCE(args->source),
+				       args->browse_id, 0, 0, NULL, NULL,
+				       args->user_data, err);
+		}
+	}
+	else if (args->action != NULL)
 	{
 		/* Cancel the action related to the given browse ID */
 		gupnp_service_proxy_cancel_action(priv->service,
@@ -1868,6 +5546,13 @@ static void _cancel_request(MafwUPnPSourcePrivate *priv, BrowseArgs *args, GErro
 		   as sending the last EOF msg to the user callback. */
 		browse_args_unref(args, err);
 	}
+	else if (args->idle_id != 0)
+	{
+		/* Results from the catalog were not emitted yet */
+		g_source_remove(args->idle_id);
+		args->idle_id = 0;
+		browse_args_unref(args, err);
+	}
 	else
 	{
 		/* The UPnP action was completed and it cannot be
@@ -1897,11 +5582,15 @@ static gboolean mafw_upnp_source_cancel_browse(MafwSource *source,
 	BrowseArgs* args = NULL;
 
 	g_assert(priv != NULL);
-	g_assert(priv->service != NULL);
+	g_assert(priv->service != NULL || priv->offline);
 
 	if (g_tree_lookup_extended(priv->browses, GUINT_TO_POINTER(browse_id),
 				   NULL, (gpointer) &args) == FALSE)
 	{
+		/* Jumps to letters have their IDs from the same series */
+		if (_cancel_jump_id(priv, browse_id, NULL))
+			return TRUE;
+
 		g_warning("Unable to cancel browse with ID: %u", browse_id);
 		g_set_error(error,
 			    MAFW_SOURCE_ERROR,
@@ -1919,6 +5608,249 @@ static gboolean mafw_upnp_source_cancel_browse(MafwSource *source,
 	}
 }
 
+/*----------------------------------------------------------------------------
+  Ancestors
+  ----------------------------------------------------------------------------*/
+
+typedef struct {
+	MafwUPnPSource *source;
+	gchar *itemid;
+
+	/* The object asked from the server last */
+	gchar *fetched;
+
+	MafwUPnPSourceAncestorsCb callback;
+	gpointer user_data;
+} AncestorsArgs;
+
+static void mafw_upnp_source_ancestors_step(AncestorsArgs *args);
+
+static void mafw_upnp_source_ancestors_free(AncestorsArgs *args)
+{
+	g_object_unref(args->source);
+	g_free(args->itemid);
+	g_free(args->fetched);
+	g_free(args);
+}
+
+static void mafw_upnp_source_ancestors_fail(AncestorsArgs *args,
+					    const GError *error)
+{
+	gchar *oid;
+
+	oid = g_strdup_printf("%s::%s",
+		mafw_extension_get_uuid(MAFW_EXTENSION(args->source)),
+		args->itemid);
+	args->callback(args->source, oid, NULL, NULL, args->user_data, error);
+	g_free(oid);
+	mafw_upnp_source_ancestors_free(args);
+}
+
+/**
+ * mafw_upnp_source_ancestors_result:
+ *
+ * Remembers where the fetched object is, be it an item or a container.
+ */
+static void mafw_upnp_source_ancestors_result(GUPnPDIDLLiteParser* parser,
+					      GUPnPDIDLLiteObject* didlobject,
+					      gpointer user_data)
+{
+	AncestorsArgs *args = user_data;
+	const gchar *id;
+
+	id = gupnp_didl_lite_object_get_id(didlobject);
+	if (id == NULL)
+		return;
+
+	ancestry_add(args->source->priv->ancestry, id,
+		     gupnp_didl_lite_object_get_parent_id(didlobject),
+		     gupnp_didl_lite_object_get_title(didlobject));
+}
+
+static void mafw_upnp_source_ancestors_cb(GUPnPServiceProxy* service,
+					  GUPnPServiceProxyAction* action,
+					  gpointer user_data)
+{
+	AncestorsArgs *args = user_data;
+	GError *gupnp_error = NULL;
+	GError *error = NULL;
+	gchar *didl = NULL;
+	guint object_signal_id;
+
+	if (gupnp_service_proxy_end_action(service, action, &gupnp_error,
+					   "Result", G_TYPE_STRING, &didl,
+					   NULL) && didl != NULL)
+	{
+		object_signal_id = g_signal_connect(parser, "object-available",
+			(GCallback)mafw_upnp_source_ancestors_result, args);
+		gupnp_didl_lite_parser_parse_didl(parser, didl, &gupnp_error);
+		g_signal_handler_disconnect(parser, object_signal_id);
+	}
+	g_free(didl);
+
+	if (gupnp_error != NULL)
+	{
+		g_set_error(&error, MAFW_SOURCE_ERROR,
+			    MAFW_SOURCE_ERROR_GET_METADATA_RESULT_FAILED,
+			    "Metadata result error: %s", gupnp_error->message);
+		if (mafw_upnp_source_error_is_permanent(gupnp_error))
+			neg_cache_add(args->source->priv->negative,
+				      "BrowseMetadata", args->fetched, error);
+		mafw_upnp_source_ancestors_fail(args, error);
+		g_error_free(gupnp_error);
+		g_error_free(error);
+		return;
+	}
+
+	mafw_upnp_source_ancestors_step(args);
+}
+
+/**
+ * mafw_upnp_source_ancestors_step:
+ *
+ * Walks up from the object as far as the cache knows.  Either delivers the
+ * chain, or fetches the first object missing from it and comes back.
+ */
+static void mafw_upnp_source_ancestors_step(AncestorsArgs *args)
+{
+	MafwUPnPSourcePrivate *priv = args->source->priv;
+	const gchar *uuid;
+	const gchar *missing;
+	const gchar *title;
+	GPtrArray *chain;
+	GError *error = NULL;
+	gchar **ids, **titles;
+	guint i, n;
+
+	chain = ancestry_walk(priv->ancestry, args->itemid, &missing,
+			      &error);
+	if (chain == NULL)
+	{
+		mafw_upnp_source_ancestors_fail(args, error);
+		g_error_free(error);
+		return;
+	}
+	if (missing == NULL)
+	{
+		/* From the root down to the object */
+		uuid = mafw_extension_get_uuid(MAFW_EXTENSION(args->source));
+		n = chain->len;
+		ids = g_new0(gchar *, n + 1);
+		titles = g_new0(gchar *, n + 1);
+		for (i = 0; i < n; i++)
+		{
+			ancestry_lookup(priv->ancestry,
+					g_ptr_array_index(chain, n - 1 - i),
+					NULL, &title);
+			ids[i] = g_strdup_printf("%s::%s", uuid,
+				(const gchar *)g_ptr_array_index(chain,
+								 n - 1 - i));
+			titles[i] = g_strdup(title != NULL ? title : "");
+		}
+		g_ptr_array_free(chain, TRUE);
+
+		args->callback(args->source, ids[n - 1],
+			       (const gchar *const *)ids,
+			       (const gchar *const *)titles,
+			       args->user_data, NULL);
+		g_strfreev(ids);
+		g_strfreev(titles);
+		mafw_upnp_source_ancestors_free(args);
+		return;
+	}
+	g_ptr_array_free(chain, TRUE);
+
+	if (g_strcmp0(args->fetched, missing) == 0)
+	{
+		/* The server did not give what it was asked */
+		g_set_error(&error, MAFW_SOURCE_ERROR,
+			    MAFW_SOURCE_ERROR_GET_METADATA_RESULT_FAILED,
+			    "No metadata for %s", missing);
+	}
+	else if (priv->offline)
+	{
+		g_set_error(&error, MAFW_SOURCE_ERROR,
+			    MAFW_SOURCE_ERROR_PEER,
+			    "Server is offline");
+	}
+	else
+	{
+		neg_cache_lookup(priv->negative, "BrowseMetadata", missing,
+				 &error);
+	}
+	if (error != NULL)
+	{
+		mafw_upnp_source_ancestors_fail(args, error);
+		g_error_free(error);
+		return;
+	}
+
+	g_debug("Fetching %s for the parent chain of %s", missing,
+		args->itemid);
+	g_free(args->fetched);
+	args->fetched = g_strdup(missing);
+	gupnp_service_proxy_begin_action(
+		priv->service, "Browse", mafw_upnp_source_ancestors_cb, args,
+		"ObjectID",       G_TYPE_STRING, args->fetched,
+		"BrowseFlag",     G_TYPE_STRING, "BrowseMetadata",
+		"Filter",         G_TYPE_STRING, "dc:title",
+		"StartingIndex",  G_TYPE_UINT,   0,
+		"RequestedCount", G_TYPE_UINT,   0,
+		"SortCriteria",   G_TYPE_STRING, "",
+		NULL);
+}
+
+static gboolean mafw_upnp_source_ancestors_idle(AncestorsArgs *args)
+{
+	mafw_upnp_source_ancestors_step(args);
+	return FALSE;
+}
+
+/**
+ * mafw_upnp_source_get_ancestors:
+ * @self:      A #MafwUPnPSource
+ * @object_id: The object whose place is wanted
+ * @callback:  Receives the chain of containers
+ * @user_data: Data for @callback
+ *
+ * Tells the path from the root container down to @object_id, for
+ * breadcrumbs or to go from a track to its album.  The parents and titles
+ * of the containers seen in browse and metadata results are remembered,
+ * so usually the path is known without asking the server, or with one
+ * BrowseMetadata for the object itself.  Only the missing levels are
+ * fetched, one at a time.
+ *
+ * @callback gets the object IDs and titles from the root down to and
+ * including @object_id, or an error.  It is always called from the main
+ * loop.
+ */
+void mafw_upnp_source_get_ancestors(MafwUPnPSource *self,
+				    const gchar *object_id,
+				    MafwUPnPSourceAncestorsCb callback,
+				    gpointer user_data)
+{
+	AncestorsArgs *args;
+	gchar *itemid = NULL;
+
+	g_return_if_fail(MAFW_IS_UPNP_SOURCE(self));
+	g_return_if_fail(object_id != NULL);
+	g_return_if_fail(callback != NULL);
+
+	mafw_source_split_objectid(object_id, NULL, &itemid);
+	if (itemid == NULL || *itemid == '\0')
+	{
+		g_free(itemid);
+		itemid = g_strdup("0");
+	}
+
+	args = g_new0(AncestorsArgs, 1);
+	args->source = g_object_ref(self);
+	args->itemid = itemid;
+	args->callback = callback;
+	args->user_data = user_data;
+	g_idle_add((GSourceFunc)mafw_upnp_source_ancestors_idle, args);
+}
+
 /*----------------------------------------------------------------------------
   Metadata
   ----------------------------------------------------------------------------*/
@@ -1931,6 +5863,9 @@ typedef struct _MetadataArgs
 	/** Requested metadata keys */
 	guint64 mdata_keys;
 
+	/** UPnP ID of the object */
+	gchar* itemid;
+
 	/** Metadata browse result as a DIDL-Lite-form XML string */
 	gchar* didl;
 
@@ -1971,10 +5906,13 @@ static void mafw_upnp_source_metadata_result(GUPnPDIDLLiteParser* parser,
 		GHashTable* metadata;
 		gchar* objectid;
 
+		mafw_upnp_source_track_container(args->source, didlobject);
 		objectid = util_create_objectid(args->source, didlobject);
 		metadata = mafw_upnp_source_compile_metadata(args->mdata_keys,
 							      didlobject,
-							      args->didl);
+							      args->didl,
+							      priv->pool,
+							      NULL);
 
 		args->callback(MAFW_SOURCE(args->source), objectid, metadata,
 			       args->user_data, NULL);
@@ -2021,6 +5959,9 @@ static void mafw_upnp_source_metadata_cb(GUPnPServiceProxy* service,
 			    MAFW_SOURCE_ERROR,
 			    MAFW_SOURCE_ERROR_GET_METADATA_RESULT_FAILED,
 			    "Metadata result error: %s", gupnp_error->message);
+		if (mafw_upnp_source_error_is_permanent(gupnp_error))
+			neg_cache_add(args->source->priv->negative,
+				      "BrowseMetadata", args->itemid, error);
 
 		/* Call the callback with invalid values and an error */
 		args->callback(MAFW_SOURCE(args->source),
@@ -2068,7 +6009,8 @@ static void mafw_upnp_source_metadata_cb(GUPnPServiceProxy* service,
 		}
 	}
 
-        g_free(args->didl);
+	g_free(args->didl);
+	g_free(args->itemid);
 	g_free(args);
 }
 
@@ -2087,6 +6029,8 @@ static void mafw_upnp_source_get_metadata(MafwSource *source,
 	MetadataArgs* args = NULL;
 	gchar* mdkeys_csv;
 	GError *error = NULL;
+	TextIndexGrouping grouping;
+	const gchar *label;
 
 	g_assert(self != NULL);
 	g_assert(priv != NULL);
@@ -2114,6 +6058,38 @@ static void mafw_upnp_source_get_metadata(MafwSource *source,
 		return;
 	}
 
+	if (mafw_upnp_source_parse_view(itemid, &grouping, &label))
+	{
+		mafw_upnp_source_view_metadata(self, object_id, itemid,
+					       metadata_keys, metadata_cb,
+					       user_data);
+		g_free(itemid);
+		return;
+	}
+
+	if (priv->offline)
+	{
+		g_set_error(&error,
+			    MAFW_SOURCE_ERROR,
+			    MAFW_SOURCE_ERROR_PEER,
+			    "Server is offline");
+		metadata_cb(source, object_id, NULL, user_data, error);
+		g_error_free(error);
+		g_free(itemid);
+		return;
+	}
+
+	/* Dead objects fail fast, without a round trip to the server */
+	if (neg_cache_lookup(priv->negative, "BrowseMetadata", itemid, &error))
+	{
+		g_debug("Metadata of %s failed recently: %s", object_id,
+			error->message);
+		metadata_cb(source, object_id, NULL, user_data, error);
+		g_error_free(error);
+		g_free(itemid);
+		return;
+	}
+
 	/* Some parameters we need to pass to the browse metadata return
 	 * callback */
 	args = g_new0(MetadataArgs, 1);
@@ -2121,6 +6097,7 @@ static void mafw_upnp_source_get_metadata(MafwSource *source,
 	args->callback = metadata_cb;
 	args->user_data = user_data;
 	args->mdata_keys = util_compile_mdata_keys(metadata_keys);
+	args->itemid = itemid;
 
 	/* Convert the given metadata key array into a UPnP browse filter */
 	mdkeys_csv = util_mafwkey_array_to_upnp_filter(args->mdata_keys);
@@ -2139,7 +6116,6 @@ static void mafw_upnp_source_get_metadata(MafwSource *source,
 		NULL);
 
 	g_free(mdkeys_csv);
-	g_free(itemid);
 
 	return;
 }
@@ -27,6 +27,15 @@
 #ifndef MAFW_UPNP_SOURCE_H
 #define MAFW_UPNP_SOURCE_H
 
+/* MUPnPSrc_MKey_* bits, generated from mafw-upnp-source-keys.list */
+#include "mafw-upnp-source-keys.h"
+#include "mafw-upnp-source-intern.h"
+#include "mafw-upnp-source-page.h"
+#include "mafw-upnp-source-updates.h"
+#include "mafw-upnp-source-diff.h"
+#include "mafw-upnp-source-dedup.h"
+#include "mafw-upnp-source-typeahead.h"
+
 G_BEGIN_DECLS
 
 /* Control source */
@@ -49,6 +58,28 @@ typedef struct {
 GType mafw_upnp_control_source_get_type(void);
 GObject* mafw_upnp_control_source_new(void);
 
+/* Aggregate source: the library of every server, without duplicates */
+#define MAFW_UPNP_AGGREGATE_SOURCE_UUID "upnpaggregatesource"
+
+#define MAFW_UPNP_AGGREGATE_SOURCE(o)					\
+	(G_TYPE_CHECK_INSTANCE_CAST((o),				\
+				    mafw_upnp_aggregate_source_get_type(), \
+				    MafwUpnpAggregateSource))
+
+typedef struct {
+	MafwSourceClass parent;
+} MafwUpnpAggregateSourceClass;
+
+typedef struct {
+	MafwSource parent;
+
+	/* Copies of the tracks given out, on the servers they are on */
+	DedupIndex *duplicates;
+} MafwUpnpAggregateSource;
+
+GType mafw_upnp_aggregate_source_get_type(void);
+GObject* mafw_upnp_aggregate_source_new(void);
+
 #define MAFW_UPNP_SOURCE_NAME "upnp_source_name"
 #define MAFW_UPNP_SOURCE_UUID "upnp_source_uuid"
 
@@ -99,56 +130,6 @@ struct _MafwUPnPSourceClass {
 };
 
 
-#define MUPnPSrc_MKey_URI			G_GUINT64_CONSTANT(0x1)
-#define MUPnPSrc_MKey_Childcount		G_GUINT64_CONSTANT(0x2)
-#define MUPnPSrc_MKey_MimeType			G_GUINT64_CONSTANT(0x4)
-#define MUPnPSrc_MKey_Duration			G_GUINT64_CONSTANT(0x8)
-#define MUPnPSrc_MKey_Thumbnail_URI		G_GUINT64_CONSTANT(0x10)
-#define MUPnPSrc_MKey_DIDL			G_GUINT64_CONSTANT(0x20)
-#define MUPnPSrc_MKey_Is_Seekable		G_GUINT64_CONSTANT(0x40)
-#define MUPnPSrc_MKey_Lyrics_URI		G_GUINT64_CONSTANT(0x80)
-#define MUPnPSrc_MKey_Protocol_Info		G_GUINT64_CONSTANT(0x100)
-#define MUPnPSrc_MKey_AlbumArt_Small_Uri	G_GUINT64_CONSTANT(0x200)
-#define MUPnPSrc_MKey_AlbumArt_Medium_Uri	G_GUINT64_CONSTANT(0x400)
-#define MUPnPSrc_MKey_AlbumArt_Large_Uri	G_GUINT64_CONSTANT(0x800)
-#define MUPnPSrc_MKey_Artist_Info_URI		G_GUINT64_CONSTANT(0x1000)
-#define MUPnPSrc_MKey_Audio_Bitrate		G_GUINT64_CONSTANT(0x2000)
-#define MUPnPSrc_MKey_Video_Bitrate		G_GUINT64_CONSTANT(0x4000)
-#define MUPnPSrc_MKey_Bitrate			G_GUINT64_CONSTANT(0x8000)
-#define MUPnPSrc_MKey_FileSize			G_GUINT64_CONSTANT(0x10000)
-#define MUPnPSrc_MKey_Bpp			G_GUINT64_CONSTANT(0x20000)
-#define MUPnPSrc_MKey_Title			G_GUINT64_CONSTANT(0x40000)
-#define MUPnPSrc_MKey_Artist			G_GUINT64_CONSTANT(0x80000)
-#define MUPnPSrc_MKey_Album			G_GUINT64_CONSTANT(0x100000)
-#define MUPnPSrc_MKey_Genre			G_GUINT64_CONSTANT(0x200000)
-#define MUPnPSrc_MKey_Track			G_GUINT64_CONSTANT(0x400000)
-#define MUPnPSrc_MKey_Year			G_GUINT64_CONSTANT(0x800000)
-#define MUPnPSrc_MKey_Count			G_GUINT64_CONSTANT(0x1000000)
-#define MUPnPSrc_MKey_Playcount			G_GUINT64_CONSTANT(0x2000000)
-#define MUPnPSrc_MKey_Description		G_GUINT64_CONSTANT(0x4000000)
-#define MUPnPSrc_MKey_Encoding			G_GUINT64_CONSTANT(0x8000000)
-#define MUPnPSrc_MKey_Added			G_GUINT64_CONSTANT(0x10000000)
-#define MUPnPSrc_MKey_Modified			G_GUINT64_CONSTANT(0x20000000)
-#define MUPnPSrc_MKey_Thumbnail			G_GUINT64_CONSTANT(0x40000000)
-#define MUPnPSrc_MKey_Res_X			G_GUINT64_CONSTANT(0x80000000)
-#define MUPnPSrc_MKey_Res_Y			G_GUINT64_CONSTANT(0x100000000)
-#define MUPnPSrc_MKey_Comment			G_GUINT64_CONSTANT(0x200000000)
-#define MUPnPSrc_MKey_Tags			G_GUINT64_CONSTANT(0x400000000)
-#define MUPnPSrc_MKey_Album_Info_URI		G_GUINT64_CONSTANT(0x800000000)
-#define MUPnPSrc_MKey_Lyrics			G_GUINT64_CONSTANT(0x1000000000)
-#define MUPnPSrc_MKey_Rating			G_GUINT64_CONSTANT(0x2000000000)
-#define MUPnPSrc_MKey_Composer			G_GUINT64_CONSTANT(0x4000000000)
-#define MUPnPSrc_MKey_FileName			G_GUINT64_CONSTANT(0x8000000000)
-#define MUPnPSrc_MKey_CopyRight			G_GUINT64_CONSTANT(0x10000000000)
-#define MUPnPSrc_MKey_Audio_Codec		G_GUINT64_CONSTANT(0x20000000000)
-#define MUPnPSrc_MKey_AlbumArt_Uri		G_GUINT64_CONSTANT(0x40000000000)
-#define MUPnPSrc_MKey_AlbumArt			G_GUINT64_CONSTANT(0x80000000000)
-#define MUPnPSrc_MKey_Video_Codec		G_GUINT64_CONSTANT(0x100000000000)
-#define MUPnPSrc_MKey_Video_FrameRate		G_GUINT64_CONSTANT(0x200000000000)
-#define MUPnPSrc_MKey_ExifXML			G_GUINT64_CONSTANT(0x400000000000)
-#define MUPnPSrc_MKey_Icon_URI			G_GUINT64_CONSTANT(0x800000000000)
-#define MUPnPSrc_MKey_Icon			G_GUINT64_CONSTANT(0x1000000000000)
-
 /*----------------------------------------------------------------------------
   Public API
   ----------------------------------------------------------------------------*/
@@ -158,6 +139,90 @@ void mafw_upnp_source_plugin_initialize(MafwRegistry *registry);
 void mafw_upnp_source_plugin_deinitialize(void);
 
 GObject *mafw_upnp_source_new(const gchar *name, const gchar *uuid);
+GObject *mafw_upnp_source_new_offline(const gchar *name, const gchar *uuid);
+
+void mafw_upnp_source_get_intern_stats(MafwUPnPSource *self,
+				       InternPoolStats *stats);
+
+/* Item level change feed */
+typedef void (*MafwUPnPSourceChangeCb)(MafwUPnPSource *source,
+				       const gchar *object_id,
+				       const ContainerDiff *diff,
+				       gpointer user_data);
+
+guint mafw_upnp_source_watch_container(MafwUPnPSource *self,
+				       const gchar *object_id,
+				       MafwUPnPSourceChangeCb callback,
+				       gpointer user_data);
+void mafw_upnp_source_unwatch_container(MafwUPnPSource *self,
+					guint watch_id);
+
+/* Parent chain resolution */
+typedef void (*MafwUPnPSourceAncestorsCb)(MafwUPnPSource *source,
+					  const gchar *object_id,
+					  const gchar *const *ancestor_ids,
+					  const gchar *const *titles,
+					  gpointer user_data,
+					  const GError *error);
+
+void mafw_upnp_source_get_ancestors(MafwUPnPSource *self,
+				    const gchar *object_id,
+				    MafwUPnPSourceAncestorsCb callback,
+				    gpointer user_data);
+
+/* Background crawling into the catalog cache */
+void mafw_upnp_source_set_crawling(MafwUPnPSource *self, gboolean crawl);
+
+/* Artist, album, genre and year views of the items crawled, browsable
+   as <uuid>::mafw-views, <uuid>::mafw-views/artist and
+   <uuid>::mafw-views/artist/<artist> */
+#define MAFW_UPNP_SOURCE_VIEWS "mafw-views"
+
+/* Jump to letter */
+typedef void (*MafwUPnPSourceOffsetCb)(MafwUPnPSource *source,
+				       const gchar *object_id,
+				       const gchar *letter,
+				       guint offset,
+				       gpointer user_data,
+				       const GError *error);
+
+guint mafw_upnp_source_find_letter(MafwUPnPSource *self,
+				   const gchar *object_id,
+				   const gchar *letter,
+				   MafwUPnPSourceOffsetCb callback,
+				   gpointer user_data);
+
+/* Type-ahead search, see type_ahead_set_text() */
+TypeAhead *mafw_upnp_source_type_ahead(MafwUPnPSource *self,
+				       const gchar *object_id,
+				       const gchar *const *metadata_keys,
+				       TypeAheadResultCb callback,
+				       gpointer user_data);
+
+/* Change tracking */
+void mafw_upnp_source_get_update_stamp(MafwUPnPSource *self,
+				       const gchar *object_id,
+				       UpdateStamp *stamp);
+UpdateChange mafw_upnp_source_changed_since(MafwUPnPSource *self,
+					    const gchar *object_id,
+					    const UpdateStamp *stamp);
+
+/* Columnar browse */
+typedef void (*MafwUPnPSourcePageCb)(MafwUPnPSource *source,
+				     guint browse_id,
+				     ColumnPage *page,
+				     guint remaining_count,
+				     gpointer user_data,
+				     const GError *error);
+
+guint mafw_upnp_source_browse_pages(MafwUPnPSource *self,
+				    const gchar *object_id,
+				    const MafwFilter *filter,
+				    const gchar *sort_criteria,
+				    guint skip_count,
+				    guint item_count,
+				    MafwUPnPSourcePageCb page_cb,
+				    gpointer user_data);
 GType mafw_upnp_source_get_type(void);
 
 G_END_DECLS